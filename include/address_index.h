@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+#include "definition.h"
+
+// Maps ROM addresses back to the table (or axis) that owns them.
+// Built once when a definition is loaded from every table's and axis's
+// byte span: elements * storage size starting at its address.
+//
+// Spans are sorted by start address with a running maximum of their end
+// so a lookup is a binary search plus a short walk back over overlaps.
+// When spans overlap the one starting last wins.
+//
+// The index is read-only once built, so any number of threads can look
+// things up in it; what a lookup caches lives in the caller's cursor.
+
+struct AddressSpan {
+  unsigned long start;
+  unsigned long end;           // exclusive
+  int           table;         // index into definition.tables
+  int           axis;          // -1 for the table's data, otherwise index into its tables
+  int           cellSize;      // bytes per element
+};
+
+struct AddressIndex {
+  int                 numSpans;
+  struct AddressSpan* spans;   // sorted by start
+  unsigned long*      maxEnd;  // largest end of spans[0..i]
+};
+
+// last answer and the address range it holds for, the memory editor asks
+// byte by byte so most lookups never reach the binary search. Zeroed it
+// holds nothing, and it has to be zeroed again when its index is rebuilt.
+struct AddressCursor {
+  unsigned long start;
+  unsigned long end;
+  int           span;
+};
+
+void address_index_build(struct AddressIndex* index, struct Definition* definition);
+void address_index_free(struct AddressIndex* index);
+
+// span owning [address], or NULL if no table covers it. [cursor] may be NULL.
+const struct AddressSpan* address_index_find(const struct AddressIndex* index, struct AddressCursor* cursor,
+                                             unsigned long address);
+
+// where the run of bytes without a table that [address] starts ends, at
+// most [limit], after address_index_find() returned NULL for it
+unsigned long address_index_gap_end(const struct AddressIndex* index, const struct AddressCursor* cursor,
+                                    unsigned long address, unsigned long limit);
+
+// the table (or axis) a span describes
+struct Table* address_span_table(struct Definition* definition, const struct AddressSpan* span);
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit in [bits], which must not be 0
+static inline int bit_scan_lowest(uint64_t bits)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return (int)index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if(_BitScanForward(&index, (unsigned long)bits)) return (int)index;
+  _BitScanForward(&index, (unsigned long)(bits >> 32));
+  return (int)index + 32;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
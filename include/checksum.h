@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "rom_file.h"
+
+// ROM checksums, picked by the definition's checksummodule.
+//
+// Every module we know of keeps a table of big endian {start, end, value}
+// records in the ROM. The 32 bit big endian word sum of [start, end] plus
+// value must equal the module's target. Word sums are linear, so an edit
+// moves a sum by (new - old) of the bytes it changed and a range never
+// has to be summed again after the initial pass. That pass runs on a
+// background thread when the ROM is opened.
+
+#define CHECKSUM_MAX_RANGES 64
+
+struct ChecksumModule {
+  const char*   name;          // checksummodule in the definition
+  unsigned long table;         // address of the first record
+  int           maxRanges;     // records before the table ends
+  uint32_t      target;        // sum + value of every range
+};
+
+struct ChecksumRange {
+  unsigned long start;
+  unsigned long end;           // inclusive, as stored in the table
+  unsigned long valueAddress;  // where the stored value lives
+  uint32_t      sum;           // word sum of [start, end]
+};
+
+enum ChecksumState {
+  CHECKSUM_NONE,               // no ROM, or the module isn't supported
+  CHECKSUM_PENDING,            // initial sum still running
+  CHECKSUM_READY,
+};
+
+struct Checksum {
+  const struct ChecksumModule* module;
+  struct ChecksumRange         ranges[CHECKSUM_MAX_RANGES];
+  int                          numRanges;
+  std::atomic<int>             state;
+  std::thread                  worker;
+  double                       microseconds;  // time the initial sum took
+};
+
+// NULL if [name] isn't a module we implement
+const struct ChecksumModule* checksum_module_find(const char* name);
+
+// reads the range table for [module] out of [rom] and starts summing it in the background
+// false if the module is unknown or its table doesn't make sense for this ROM
+bool checksum_open(struct Checksum* checksum, const char* module, const struct RomFile* rom);
+
+// waits for the initial sum and forgets the ROM
+void checksum_close(struct Checksum* checksum);
+
+// blocks until the initial sum is done
+void checksum_wait(struct Checksum* checksum);
+
+bool checksum_ready(const struct Checksum* checksum);
+
+// call with the old contents of [offset, offset + length) before writing [after] there
+void checksum_update(struct Checksum* checksum, unsigned long offset,
+                     const unsigned char* before, const unsigned char* after, size_t length);
+
+// number of ranges whose stored value doesn't match, -1 while pending
+int checksum_invalid(const struct Checksum* checksum, const struct RomFile* rom);
+
+bool checksum_range_valid(const struct Checksum* checksum, const struct RomFile* rom, int range);
+
+// the big endian stored value that makes [range] valid
+void checksum_range_value(const struct Checksum* checksum, int range, unsigned char bytes[4]);
+
+// rewrites every wrong stored value, returns how many were fixed
+// the writes go straight to [rom], an editor with views of it should
+// write checksum_range_value() through its own edit path instead
+int checksum_fix(struct Checksum* checksum, struct RomFile* rom);
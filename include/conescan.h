@@ -4,4 +4,6 @@ namespace ConeScan {
   void Init();
   void RenderUI(bool* exit_requested);
   void Cleanup();
+  // true while background work needs the UI to keep refreshing
+  bool IsBusy();
 }
@@ -1,6 +1,10 @@
 #pragma once
 #include "sqlite3.h"
 
+// how long a write waits for another connection's transaction, the tune
+// history commits through a connection of its own on a worker thread
+#define CONESCAN_DB_BUSY_MS 5000
+
 struct ConeScanDB {
   sqlite3* db;
 };
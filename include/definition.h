@@ -67,6 +67,17 @@ void definition_new_tables(struct Table** tables, int count);
 
 void definition_deinit(struct Definition* definition);
 
-//bool loadScalingValue(struct Scaling* scaling, char* rom, scaled_value_t* value);
+// bytes per cell for [scaling]'s storagetype, floats are assumed when unknown
+int definition_scaling_size(struct Scaling* scaling);
+
+// raw cell value at [address] honouring storagetype and endian
+double definition_read_raw(struct Scaling* scaling, const unsigned char* data, unsigned long address);
+
+// evaluates a scaling expression such as "100/(100+x)" for [x]
+// supports + - * / ^, parentheses and numeric literals
+bool definition_eval_expr(const char* expr, double x, double* out);
+
+// raw cell value at [address] run through the scaling's toexpr
+bool definition_read_scaled(struct Scaling* scaling, const unsigned char* data, unsigned long address, double* out);
 
 unsigned long definition_count_cells(struct Definition* definition);
\ No newline at end of file
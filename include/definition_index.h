@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+
+#include "definition.h"
+
+// Category grouping and search over a definition's tables.
+// Built once when a definition is loaded. Searching uses a trigram
+// index over "category name" so each keystroke only verifies the
+// tables sharing the rarest trigram of the query.
+//
+// The result is a flat list of rows ready for ImGuiListClipper:
+// a category header is stored as -(category + 1), a table as its index.
+
+#define DEFINITION_INDEX_QUERY_MAX 128
+
+struct DefinitionIndex {
+  int    numTables;
+
+  // categories sorted by name, tables inside sorted by name
+  int    numCategories;
+  const char** categories;     // not owned, points into the definition
+  int*   categoryStart;        // numCategories + 1 offsets into categoryTables
+  int*   categoryTables;
+  int*   categoryMatches;      // tables matching the current query per category
+  bool*  categoryOpen;
+
+  // lowercase "category name" per table
+  char** searchText;
+
+  // trigram -> tables posting lists
+  int       numTrigrams;
+  uint32_t* trigramKeys;       // sorted
+  int*      trigramStart;      // numTrigrams + 1 offsets into trigramTables
+  int*      trigramTables;
+
+  // current query and its results
+  char   query[DEFINITION_INDEX_QUERY_MAX];
+  bool*  match;                // one per table
+  int    numMatches;
+
+  // rows to display
+  int*   rows;
+  int    numRows;
+};
+
+void definition_index_build(struct DefinitionIndex* index, struct Definition* definition);
+void definition_index_free(struct DefinitionIndex* index);
+
+// filter tables by [query], whitespace separated terms must all match
+// returns the number of matching tables
+int definition_index_search(struct DefinitionIndex* index, const char* query);
+
+// expand or collapse a category and rebuild the rows
+void definition_index_set_open(struct DefinitionIndex* index, int category, bool open);
@@ -6,8 +6,6 @@
 #include "definition_parse.h"
 #include "definition.h"
 
-#include "console.h"
-
 struct DefinitionParse {
 	// handle to the XML documetn
 	tinyxml2::XMLDocument* metadataFile = NULL;
@@ -15,9 +13,10 @@ struct DefinitionParse {
 	// file path string
 	char* metadataFilePath = NULL;
 	
-	// console for reporting error messages
-	// wish this was elsewhhere but oh well
-	ConeScan::Console* console;
+	// receives progress and error messages, they go to stderr when NULL
+	// the UI forwards them to its console, the CLI leaves it unset
+	void (*log)(void* context, const char* message);
+	void* logContext;
 };
 
 // load the definition file and populate definition
@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "conescan_db.h"
+
+// Partial ECU downloads kept in conescan.db so a failed transfer resumes.
+//
+// A download is keyed by VIN, calibration ID and the address range read.
+// Its data is split into fixed blocks, each stored as its own row once
+// every byte of it has been received, with a bitmap of the stored blocks
+// on the download row. Restarting the same download loads the stored
+// blocks and only the missing ones are read from the ECU again.
+//
+// Each block row carries rom_file_hash_bytes() of its data; a block whose
+// hash doesn't match on load is treated as missing. That only catches a
+// damaged database, the downloader also reads a stored block back from the
+// ECU before trusting any of them.
+
+#define DOWNLOAD_CACHE_BLOCK_SIZE 0x1000
+
+// finds or creates the download, fills [bitmap] (one bit per block) and
+// [data] (transferSize bytes) from what was stored, returns its id
+int64_t conescan_db_open_download(struct ConeScanDB* db, const char* vin, const char* calID,
+                                  unsigned long startAddress, unsigned long transferSize,
+                                  uint8_t* bitmap, unsigned char* data);
+
+// stores the [count] blocks listed in [blocks] out of [data], and the updated [bitmap], in one transaction
+void conescan_db_save_download_blocks(struct ConeScanDB* db, int64_t id, unsigned long transferSize,
+                                      const uint32_t* blocks, int count, const unsigned char* data,
+                                      const uint8_t* bitmap);
+
+// forgets every stored block of the download, it starts over from nothing
+void conescan_db_clear_download(struct ConeScanDB* db, int64_t id, unsigned long transferSize);
+
+// drops a download once it completed
+void conescan_db_delete_download(struct ConeScanDB* db, int64_t id);
+
+// blocks needed for [transferSize] bytes
+uint32_t download_cache_blocks(unsigned long transferSize);
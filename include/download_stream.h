@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Consumes a download while it runs: every chunk the worker finishes is
+// announced through a single producer, single consumer ring, and a
+// consumer thread writes it to a spool file at its offset and hashes each
+// page as soon as all of its bytes are in. When the last chunk lands the
+// image is already on disk and its hash (the same rom_file_hash_buffer()
+// gives) only needs the per page hashes combined.
+//
+// The ring only carries offsets, the bytes are read from the payload the
+// worker filled; a chunk is never rewritten once it is announced.
+
+#define DOWNLOAD_STREAM_SLOTS 64
+
+struct DownloadChunk {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct DownloadStream {
+  const unsigned char*  data;
+  unsigned long         length;
+
+  struct DownloadChunk  chunks[DOWNLOAD_STREAM_SLOTS];
+  std::atomic<uint32_t> head;          // next slot the producer writes
+  std::atomic<uint32_t> tail;          // next slot the consumer reads
+  std::atomic<bool>     closing;
+  std::mutex            lock;          // only for sleeping, the ring itself is lock free
+  std::condition_variable wake;
+  std::thread           consumer;
+
+  // consumer owned
+  FILE*                 spool;         // NULL when nothing is written to disk
+  char*                 spoolPath;     // "<path>.part" until the image is complete
+  char*                 path;
+  uint32_t*             pageFilled;    // bytes received per page
+  uint64_t*             pageHash;
+  long                  numPages;
+  std::atomic<long>     pagesHashed;
+  bool                  spoolFailed;
+};
+
+// starts the consumer for [length] bytes at [data], spooling to [path] unless it is NULL
+void download_stream_open(struct DownloadStream* stream, const unsigned char* data, unsigned long length, const char* path);
+
+// announces [offset, offset + length) of data as final, waits only while the ring is full
+void download_stream_push(struct DownloadStream* stream, unsigned long offset, unsigned long length);
+
+// drains the ring and stops the consumer. Returns true with the image's
+// hash in [hash] when [complete] and every page arrived. The spool file is
+// renamed to its path in that case and [spooled] set, otherwise it is deleted.
+bool download_stream_close(struct DownloadStream* stream, bool complete, uint64_t* hash, bool* spooled);
+
+bool download_stream_active(const struct DownloadStream* stream);
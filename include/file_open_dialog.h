@@ -3,3 +3,8 @@
 // Returns a string containing the path selected
 // in a dialog menu
 char* getFileOpenPath(char* defaultPath, bool save);
+
+
+// Returns a file path picked in a save dialog,
+// NULL if cancelled
+char* getFileSavePath(char* defaultPath);
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+#include "checksum.h"
+#include "memmodel.h"
+#include "rom_file.h"
+#include "uds_ecu.h"
+
+// Writes an edited ROM back to the ECU one erase block at a time.
+//
+// The pages written since the image was last flashed pick the erase
+// blocks worth looking at (every block for an image this process hasn't
+// flashed yet, e.g. a ROM opened from a file that was edited elsewhere).
+// Saving doesn't reset them, a successful flash does. Each of those is read from the ECU first and
+// only a block that differs is erased, programmed and read back, so a map
+// change costs a couple of small blocks instead of the whole flash. The
+// read back must match the image before the next block starts.
+//
+// A failure leaves the block it stopped in erased or half written; the
+// ECU still boots from the small boot blocks and a second run picks up
+// whatever differs. That only holds while the boot blocks are intact, so
+// an image that differs from the ECU below the model's bootEnd is refused
+// unless the caller explicitly allows rewriting them.
+
+#define FLASH_WRITE_CHUNK   0x400   // bytes per read and write request
+#define FLASH_WRITE_RETRIES 3       // attempts per request before giving up
+
+struct FlashWriteResult {
+  int           sectorsChecked;     // compared against the ECU
+  int           sectorsWritten;     // erased and programmed
+  unsigned long bytesRead;          // comparing and verifying
+  unsigned long bytesWritten;
+  int           retries;
+  double        seconds;
+  char          error[128];         // why it stopped, empty on success
+};
+
+// programs [image] into [ecu], which must implement eraseBlock and
+// writeMem. The image must be [model]'s size. With [checksum] (for this
+// image) an image whose checksums don't hold is refused before anything
+// is erased, and so is one that changes the boot blocks unless [allowBoot].
+bool flash_write(struct UDSEcu* ecu, struct RomFile* image, const struct MemModel* model,
+                 struct Checksum* checksum, bool allowBoot, struct FlashWriteResult* result);
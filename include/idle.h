@@ -0,0 +1,36 @@
+#pragma once
+
+// Frame pacing for the main loop.
+// When idle mode is enabled the main loop blocks waiting for input
+// instead of rendering every vsync. Background work (downloads,
+// log lines, live data) calls idle_post_event() which is safe to
+// call from any thread, wakes the loop if it is blocked and gets
+// picked up at [backgroundRate].
+
+struct IdleConfig {
+  // wait for input instead of rendering every vsync
+  bool  enabled;
+  // max frames per second while background work is posting events
+  int   backgroundRate;
+  // max seconds the loop blocks before checking for background work again
+  float idleTimeout;
+  // frames to keep rendering after input so ImGui can settle hover/animations
+  int   settleFrames;
+};
+
+extern struct IdleConfig idle_config;
+
+// mark the UI dirty, any thread
+void idle_post_event(void);
+
+// [wake] unblocks the main loop's wait for events, glfwPostEmptyEvent in
+// the GLFW build. Set before any background work starts, the CLI and
+// bench link this without a window and leave it unset.
+void idle_set_wake(void (*wake)(void));
+
+// how long the main loop may block waiting for events, 0 to poll
+double idle_wait_timeout(double now, bool busy);
+
+// call once per loop after events were processed
+// returns true if a frame should be rendered
+bool idle_frame_begin(double now, bool had_input, bool busy);
@@ -91,6 +91,8 @@ struct MemoryEditor
     ImU8            (*ReadFn)(const ImU8* data, size_t off);    // = 0      // optional handler to read bytes.
     void            (*WriteFn)(ImU8* data, size_t off, ImU8 d); // = 0      // optional handler to write bytes.
     bool            (*HighlightFn)(const ImU8* data, size_t off);//= 0      // optional handler to return Highlight property (to support non-contiguous highlighting).
+    ImU32           (*BgColorFn)(const ImU8* data, size_t off);  // = 0      // optional handler to return a background color for a byte, 0 for none.
+    void            (*HoverFn)(const ImU8* data, size_t off);    // = 0      // optional handler called while a byte is hovered (tooltips, click actions).
 
     // [Internal State]
     bool            ContentsWidthChanged;
@@ -123,6 +125,8 @@ struct MemoryEditor
         ReadFn = NULL;
         WriteFn = NULL;
         HighlightFn = NULL;
+        BgColorFn = NULL;
+        HoverFn = NULL;
 
         // State/Internals
         ContentsWidthChanged = false;
@@ -282,6 +286,20 @@ struct MemoryEditor
                         byte_pos_x += (float)(n / OptMidColsCount) * s.SpacingBetweenMidCols;
                     ImGui::SameLine(byte_pos_x);
 
+                    // Draw user background
+                    if (BgColorFn)
+                    {
+                        ImU32 bg_color = BgColorFn(mem_data, addr);
+                        if (bg_color != 0)
+                        {
+                            ImVec2 pos = ImGui::GetCursorScreenPos();
+                            float bg_width = s.HexCellWidth;
+                            if (OptMidColsCount > 0 && n > 0 && (n + 1) < Cols && ((n + 1) % OptMidColsCount) == 0)
+                                bg_width += s.SpacingBetweenMidCols;
+                            draw_list->AddRectFilled(pos, ImVec2(pos.x + bg_width, pos.y + s.LineHeight), bg_color);
+                        }
+                    }
+
                     // Draw highlight
                     bool is_highlight_from_user_range = (addr >= HighlightMin && addr < HighlightMax);
                     bool is_highlight_from_user_func = (HighlightFn && HighlightFn(mem_data, addr));
@@ -386,6 +404,8 @@ struct MemoryEditor
                             else
                                 ImGui::Text(format_byte_space, b);
                         }
+                        if (HoverFn && ImGui::IsItemHovered())
+                            HoverFn(mem_data, addr);
                         if (!ReadOnly && ImGui::IsItemHovered() && ImGui::IsMouseClicked(0))
                         {
                             DataEditingTakeFocus = true;
@@ -0,0 +1,18 @@
+#pragma once
+#include <stddef.h>
+
+// What a definition's <memmodel> says about the ECU's flash.
+
+struct MemModel {
+  const char*          name;
+  unsigned long        romSize;      // bytes of on-chip flash, mapped from 0
+  int                  numSectors;
+  const unsigned long* sectors;      // erase block starts, numSectors + 1 entries ending at romSize
+  unsigned long        bootEnd;      // the erase blocks below this hold the boot code
+};
+
+// erase block [address] falls in, -1 past the flash
+int memmodel_sector(const struct MemModel* model, unsigned long address);
+
+// the model named [name] (case-insensitive), NULL when unknown or [name] is NULL
+const struct MemModel* memmodel_find(const char* name);
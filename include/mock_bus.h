@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "mock_ecu.h"
+#include "uds_channel.h"
+
+// Several mock ECUs on one simulated CAN channel, for exercising
+// UDSSessionManager without an adapter.
+//
+// Each module answers requests to its CAN ID on ID + 8 after the latency
+// and bus time its MockEcuConfig gives. Modules work independently of
+// each other but one request at a time each, so requests to different
+// modules overlap while a second request to a busy module queues behind
+// the first. Nobody answers an ID without a module, the request just
+// times out as it would on a car without that module. Like an adapter
+// it takes and hands out several messages per call, and announces a
+// multi-frame response with a first frame indication once its frames
+// start.
+
+#define MOCK_BUS_MAX_MODULES 8
+#define MOCK_BUS_QUEUE       32   // responses in flight before send refuses
+
+struct MockBusModule {
+  struct MockEcu*                       ecu;
+  uint32_t                              requestId;
+  std::chrono::steady_clock::time_point busyUntil;
+};
+
+struct MockBusResponse {
+  std::chrono::steady_clock::time_point due;
+  struct UDSMessage                     message;
+};
+
+struct MockBus {
+  struct MockBusModule    modules[MOCK_BUS_MAX_MODULES];
+  int                     numModules;
+  struct MockBusResponse  queue[MOCK_BUS_QUEUE];
+  int                     queued;
+  std::mutex              lock;
+  std::condition_variable arrived;
+};
+
+void mock_bus_init(struct MockBus* bus);
+
+// [ecu] answers requests to [requestId], it must outlive the bus
+bool mock_bus_add(struct MockBus* bus, struct MockEcu* ecu, uint32_t requestId);
+
+// points [channel] at [bus], which must outlive it
+void mock_bus_bind(struct MockBus* bus, struct UDSChannel* channel);
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+
+#include "rom_file.h"
+#include "uds_channel.h"
+#include "uds_ecu.h"
+
+// A simulated ECU answering the UDS services from a ROM image, for
+// benchmarking and testing the download path without a car.
+//
+// It keeps the rules a real ECU enforces: memory reads need session 0x85
+// and a key matching the last seed, and reads past the image or bigger
+// than [maxRead] are refused. Every request waits out a fixed latency,
+// optional jitter and the time its ISO-TP frames take on the bus, and
+// reads fail at [errorRate] as they would on a flaky cable.
+//
+// Programming works on the mock's private copy of the image, the file is
+// never written: erases are refused unless they cover whole
+// ROM_FILE_PAGE_SIZE pages, and a write may only clear bits, so writing
+// over data that wasn't erased first is refused like on real flash.
+//
+// mock_ecu_respond() answers raw UDS requests the same way for MockBus,
+// adding ReadDataByIdentifier (VIN, calibration ID) and ReadDTCInformation
+// for the DTCs added with mock_ecu_add_dtc().
+
+#define MOCK_ECU_DEFAULT_VIN "JM1MOCKECU0000000"
+#define MOCK_ECU_MAX_DTCS    16
+
+struct MockEcuConfig {
+  double       latency;        // seconds per request before the response starts
+  double       jitter;         // up to this many seconds more, uniformly
+  double       bandwidth;      // CAN data bytes per second, 0 for an instant bus
+  double       errorRate;      // chance in [0, 1] that a readMem fails
+  uint16_t     maxRead;        // largest read answered, 0 for 0xFFE
+  double       eraseTime;      // seconds per KiB erased
+  unsigned int seed;           // drives errors and jitter, runs repeat for the same seed
+};
+
+struct MockEcu {
+  struct RomFile        rom;
+  struct MockEcuConfig  config;
+  char                  vin[18];
+  char                  calID[33];
+
+  uint8_t               session;
+  bool                  unlocked;
+  uint8_t               seed[3];
+  uint32_t              random;
+
+  uint32_t              dtcs[MOCK_ECU_MAX_DTCS];
+  uint8_t               dtcStatus[MOCK_ECU_MAX_DTCS];
+  int                   numDtcs;
+
+  std::atomic<uint32_t> requests;
+  std::atomic<uint32_t> refused;   // negative responses, injected errors included
+  std::atomic<uint32_t> erased;    // bytes erased
+  std::atomic<uint32_t> written;   // bytes programmed
+};
+
+// [config] may be NULL for an instant, error free ECU. The VIN and
+// calibration ID come from the file name when it looks like a saved
+// download (VIN-CALID.bin) or a definition ROM (SW-CALID.BIN). Without a
+// [romPath] the module has no memory to read, like a body or ABS module.
+bool mock_ecu_open(struct MockEcu* mock, const char* romPath, const struct MockEcuConfig* config);
+void mock_ecu_close(struct MockEcu* mock);
+
+// points [ecu] at [mock], which must outlive it
+void mock_ecu_bind(struct MockEcu* mock, struct UDSEcu* ecu);
+
+// reported by ReadDTCInformation, [dtc] is the 3 byte code
+void mock_ecu_add_dtc(struct MockEcu* mock, uint32_t dtc, uint8_t status);
+
+// answers [request] into [response] (UDS_MAX_MESSAGE bytes) without
+// waiting, returns the response length and sets [seconds] to how long
+// the ECU and bus would take over it
+uint32_t mock_ecu_respond(struct MockEcu* mock, const uint8_t* request, uint32_t length,
+                          uint8_t* response, double* seconds);
@@ -0,0 +1,49 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rom_file.h"
+
+// Content addressed, reference counted store of ROM_FILE_PAGE_SIZE pages.
+//
+// Interning a page returns the id of an existing page with the same bytes
+// when there is one, so images that share most of their content (tunes of
+// the same calibration) only pay for the pages where they differ.
+
+#define PAGE_POOL_NONE 0xFFFFFFFFu
+
+struct PoolPage {
+  unsigned char* data;         // NULL while the slot is free
+  uint64_t       hash;
+  uint32_t       length;       // the last page of an image can be short
+  uint32_t       refs;
+};
+
+struct PagePool {
+  struct PoolPage* pages;
+  uint32_t         numPages;   // slots in use or free
+  uint32_t         capacity;
+  uint32_t*        freeSlots;
+  uint32_t         numFree;
+
+  // open addressing from hash to page id
+  uint32_t*        buckets;
+  uint32_t         numBuckets; // power of two
+  uint32_t         numLive;
+  uint32_t         numTombstones;
+};
+
+void page_pool_init(struct PagePool* pool);
+void page_pool_free(struct PagePool* pool);
+
+// id of a page holding [length] bytes of [data], shared if one already exists
+uint32_t page_pool_intern(struct PagePool* pool, const unsigned char* data, uint32_t length);
+
+// drops a reference, the page is freed with its last one
+void page_pool_release(struct PagePool* pool, uint32_t id);
+
+const unsigned char* page_pool_data(const struct PagePool* pool, uint32_t id);
+uint32_t page_pool_length(const struct PagePool* pool, uint32_t id);
+
+// bytes held by live pages
+size_t page_pool_bytes(const struct PagePool* pool);
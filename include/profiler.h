@@ -0,0 +1,67 @@
+#pragma once
+
+// Lightweight hierarchical frame profiler.
+// Build with -DCONESCAN_PROFILER to enable it, otherwise every
+// PROFILE_* macro compiles to nothing.
+//
+//   PROFILE_SCOPE("RenderTables");
+//
+// times the enclosing block. Scopes nest per thread, so scopes opened
+// inside another become its children in the overlay. A call site
+// remembers the parent it was first seen under.
+
+#ifdef CONESCAN_PROFILER
+
+#include <stdint.h>
+#include <atomic>
+
+#define PROFILER_MAX_SCOPES 64
+#define PROFILER_HISTORY    300
+
+struct ProfilerScope {
+  const char*           name;
+  int                   parent;       // -1 for a root scope
+  int                   depth;
+  std::atomic<uint64_t> accumNs;      // time spent this frame, any thread
+  std::atomic<uint32_t> calls;        // calls this frame
+  float                 history[PROFILER_HISTORY]; // ms per frame
+  uint32_t              callHistory[PROFILER_HISTORY];
+};
+
+struct ProfilerTimer {
+  int      id;
+  uint64_t start;
+  ProfilerTimer(const char* name, std::atomic<int>* site);
+  ~ProfilerTimer();
+};
+
+void profiler_frame_begin(void);
+void profiler_frame_end(void);
+
+// route ImGui allocations through the profiler's counters,
+// must be called before ImGui::CreateContext()
+void profiler_install_allocator(void);
+
+// overlay window with per scope averages, maxima and the frame time graph
+void profiler_draw(const char* title, bool* p_open);
+
+// write the last [frames] frames to [path] as CSV, returns frames written or -1
+int profiler_dump_csv(const char* path, int frames);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) \
+  static std::atomic<int> PROFILE_CONCAT(_profile_site_, __LINE__)(-1); \
+  ProfilerTimer PROFILE_CONCAT(_profile_timer_, __LINE__)(name, &PROFILE_CONCAT(_profile_site_, __LINE__))
+#define PROFILE_FRAME_BEGIN()        profiler_frame_begin()
+#define PROFILE_FRAME_END()          profiler_frame_end()
+#define PROFILE_INSTALL_ALLOCATOR()  profiler_install_allocator()
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME_BEGIN()
+#define PROFILE_FRAME_END()
+#define PROFILE_INSTALL_ALLOCATOR()
+
+#endif
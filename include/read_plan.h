@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+#include "definition.h"
+
+// The parts of a ROM a definition actually uses, as few address ranges as
+// possible, so an ECU read can skip everything else.
+//
+// Every table and axis span plus the internal ID string is clipped to the
+// memory model's flash size and merged with its neighbours whenever the
+// gap between them is below READ_PLAN_MERGE_GAP: reading a few unused
+// bytes is cheaper than another request round trip.
+
+#define READ_PLAN_MERGE_GAP 0x100
+
+struct ReadRange {
+  unsigned long start;
+  unsigned long end;           // exclusive
+};
+
+struct ReadPlan {
+  int               numRanges;
+  struct ReadRange* ranges;    // sorted, disjoint
+  unsigned long     romSize;   // flash size from the memmodel, or past the last span when unknown
+  unsigned long     bytes;     // total bytes in [ranges]
+  int               clipped;   // spans that fell outside the flash
+};
+
+void read_plan_build(struct ReadPlan* plan, struct Definition* definition);
+void read_plan_free(struct ReadPlan* plan);
@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "definition.h"
+#include "address_index.h"
+
+// Differences between two ROM images, as byte ranges and as table cells.
+//
+// The images are compared 64 bytes at a time with SSE2 (a word at a time
+// otherwise) and runs of differing bytes become ranges. Ranges are then
+// resolved through the address index into the cells they touch, with the
+// scaled value on both sides, and the cells grouped per table.
+
+struct RomDiffRange {
+  unsigned long start;
+  unsigned long end;           // exclusive
+};
+
+struct RomDiffCell {
+  int           table;         // index into definition.tables
+  int           axis;          // -1 for the table's data, otherwise index into its tables
+  unsigned long element;       // cell index inside the table or axis
+  unsigned long address;
+  int           size;          // bytes per cell
+  double        before;
+  double        after;
+  bool          scaled;        // false when toexpr couldn't be evaluated, values are raw
+};
+
+struct RomDiffTable {
+  int           table;
+  long          firstCell;     // into RomDiff.cells
+  long          numCells;
+};
+
+struct RomDiff {
+  struct RomDiffRange* ranges;
+  long                 numRanges;
+  unsigned long        bytes;          // total differing bytes
+
+  struct RomDiffCell*  cells;          // grouped by table, then axis, then element
+  long                 numCells;
+  struct RomDiffTable* tables;         // in definition order
+  int                  numTables;
+  unsigned long        unmappedBytes;  // differing bytes no table covers
+
+  double               microseconds;
+};
+
+// runs of differing bytes between [before] and [after], a length mismatch is one more range
+// returns the number of ranges, [ranges] is grown with realloc
+long rom_diff_ranges(const unsigned char* before, long beforeLength,
+                     const unsigned char* after, long afterLength,
+                     struct RomDiffRange** ranges, long* capacity);
+
+// compares two images, [definition] and [index] may be NULL to only get ranges
+void rom_diff(struct RomDiff* diff, const unsigned char* before, long beforeLength,
+              const unsigned char* after, long afterLength,
+              struct Definition* definition, const struct AddressIndex* index);
+
+void rom_diff_free(struct RomDiff* diff);
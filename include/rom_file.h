@@ -0,0 +1,90 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <Windows.h>
+#endif
+
+// A ROM image opened as a private (copy-on-write) memory mapping.
+// Opening costs nothing up front, untouched pages stay shared with the
+// page cache and any other mapping of the same file, and the first
+// write to a page gives this process its own copy.
+//
+// Every edit must go through rom_file_write() so the dirty page bitmap
+// stays accurate; save, diff and checksum code use it to skip pages
+// that were never touched. Emscripten has no file mappings so the image
+// is read into the heap instead, the bitmap works the same.
+
+#define ROM_FILE_PAGE_SHIFT 12
+#define ROM_FILE_PAGE_SIZE  (1ul << ROM_FILE_PAGE_SHIFT)
+
+enum RomFileBacking {
+  ROM_FILE_CLOSED,
+  ROM_FILE_MAPPED,
+  ROM_FILE_HEAP,
+};
+
+struct RomFile {
+  unsigned char*      data;
+  long                length;
+  enum RomFileBacking backing;
+
+  // one bit per ROM_FILE_PAGE_SIZE page
+  uint8_t*            dirty;
+  long                numPages;
+  long                numDirty;
+
+  // pages written since the image was last flashed to an ECU, all of
+  // them until it has been. Saving doesn't clear these
+  uint8_t*            unflashed;
+  long                numUnflashed;
+
+  // per page content hashes, a set bit in [hashStale] means recompute
+  uint64_t*           pageHash;
+  uint8_t*            hashStale;
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  HANDLE              file;
+  HANDLE              mapping;
+#endif
+};
+
+// maps [path], returns false with errno set on failure
+bool rom_file_open(struct RomFile* rom, const char* path);
+
+// a heap image of [length] zero bytes to fill through rom->data, nothing is dirty
+bool rom_file_alloc(struct RomFile* rom, long length);
+
+// unmaps the image, unsaved edits are discarded
+void rom_file_close(struct RomFile* rom);
+
+// copies [length] bytes into the image at [offset] and marks their pages dirty
+void rom_file_write(struct RomFile* rom, unsigned long offset, const void* data, size_t length);
+
+// marks [offset, offset + length) dirty after writing to rom->data directly
+void rom_file_mark_dirty(struct RomFile* rom, unsigned long offset, size_t length);
+
+bool rom_file_page_dirty(const struct RomFile* rom, long page);
+
+// forget every edit was made, called once the image has been saved
+void rom_file_clear_dirty(struct RomFile* rom);
+
+// 64 bit hash of the whole image, only pages written since the last call are rehashed
+uint64_t rom_file_hash(struct RomFile* rom);
+
+// the same hash for a plain buffer
+uint64_t rom_file_hash_buffer(const unsigned char* data, long length);
+
+// hash of [length] bytes, what the per page hashes are built from
+uint64_t rom_file_hash_bytes(const unsigned char* data, size_t length, uint64_t seed);
+
+// finds the next run of dirty pages at or after [offset]
+// [start, end) is clamped to the image, returns false when there are no more
+bool rom_file_next_dirty(const struct RomFile* rom, unsigned long offset, unsigned long* start, unsigned long* end);
+
+// forget which pages changed since the last flash, called once the image has been flashed
+void rom_file_clear_unflashed(struct RomFile* rom);
+
+// rom_file_next_dirty() over the pages written since the last flash
+bool rom_file_next_unflashed(const struct RomFile* rom, unsigned long offset, unsigned long* start, unsigned long* end);
@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+#include "conescan_db.h"
+
+// last known content hash of a ROM file, written after every save
+bool conescan_db_load_rom_hash(struct ConeScanDB* db, const char* path, uint64_t* hash, long* length);
+void conescan_db_save_rom_hash(struct ConeScanDB* db, const char* path, uint64_t hash, long length);
@@ -0,0 +1,58 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "definition.h"
+#include "address_index.h"
+
+// Three way merge of two tunes that started from the same base image.
+//
+// Every byte only one side changed is taken from that side, which the
+// SSE2 blend does for the whole image in one pass. The changes of both
+// sides are then resolved through the address index into cells; a cell
+// both sides changed to different values is a conflict and the whole
+// cell comes from one side, never a mix of bytes from each. Bytes no
+// table covers conflict as runs.
+
+enum RomMergeChoice {
+  ROM_MERGE_OURS,
+  ROM_MERGE_THEIRS,
+  ROM_MERGE_BASE,
+};
+
+struct RomMergeConflict {
+  int                 table;     // index into definition.tables, -1 outside any table
+  int                 axis;      // -1 for the table's data, otherwise index into its tables
+  unsigned long       element;
+  unsigned long       address;
+  int                 size;      // bytes in the cell or run
+  double              base;      // scaled values, 0 outside tables
+  double              ours;
+  double              theirs;
+  enum RomMergeChoice choice;
+};
+
+struct RomMerge {
+  unsigned char*           result;
+  long                     length;
+
+  long                     oursCells;        // cells only ours changed
+  long                     theirsCells;      // cells only theirs changed
+  long                     sameCells;        // both changed to the same value
+  struct RomMergeConflict* conflicts;
+  long                     numConflicts;
+
+  double                   microseconds;
+};
+
+// merges [ours] and [theirs] against [base], all three [length] bytes
+// conflicts start out as ROM_MERGE_OURS
+void rom_merge(struct RomMerge* merge, const unsigned char* base, const unsigned char* ours,
+               const unsigned char* theirs, long length,
+               struct Definition* definition, const struct AddressIndex* index);
+
+// picks a side for one conflict and copies it into merge->result
+void rom_merge_resolve(struct RomMerge* merge, long conflict, enum RomMergeChoice choice,
+                       const unsigned char* base, const unsigned char* ours, const unsigned char* theirs);
+
+void rom_merge_free(struct RomMerge* merge);
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+
+#include "rom_file.h"
+
+// Saving edited ROM images without ever leaving a half written file.
+//
+// An in place save only writes the bytes that differ from the file on
+// disk inside dirty pages. Those ranges go to "<path>.journal" first,
+// then into the file; if the process dies part way the journal is
+// replayed the next time the ROM is opened (or dropped if it was never
+// completed, in which case the file was never touched).
+//
+// Save as (and anything written from scratch) goes to "<path>.tmp" and is
+// renamed over [path] once it is on disk.
+
+struct RomSaveResult {
+  uint64_t hash;         // rom_file_hash() of what is now on disk
+  long     ranges;       // ranges written
+  long     bytes;        // bytes written into the ROM file
+};
+
+// writes the changed bytes of [rom] into [path], which must be the same size
+bool rom_save(struct RomFile* rom, const char* path, struct RomSaveResult* result);
+
+// writes all of [rom] to [path] through a temporary file
+bool rom_save_as(struct RomFile* rom, const char* path, struct RomSaveResult* result);
+
+// writes [length] bytes of [data] to [path] through a temporary file
+bool rom_save_buffer(const char* path, const unsigned char* data, long length);
+
+// renames the fully written file [from] over [to]
+bool rom_save_replace(const char* from, const char* to);
+
+// rolls an interrupted in place save forward, true if the file is consistent
+bool rom_save_recover(const char* path);
@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "definition.h"
+
+// Checks a definition against the ROM it was paired with.
+//
+// Every table and axis span must lie inside the image and agree with the
+// table's shape before it is drawn; the renderers index the ROM directly
+// and trust both once a table is marked renderable. Axes that don't rise
+// or fall steadily and tables whose data shares bytes with another table
+// are reported but still drawn. The pass runs on a background thread
+// when a ROM and definition are paired, like the checksum's first sum.
+
+#define TABLE_CHECK_IN_BOUNDS   0x01   // data and every axis fit inside the ROM
+#define TABLE_CHECK_SHAPE       0x02   // axis lengths agree with the element count
+#define TABLE_CHECK_MONOTONIC   0x04   // every axis only rises or only falls
+#define TABLE_CHECK_NO_OVERLAP  0x08   // no bytes shared with another table
+#define TABLE_CHECK_RENDERABLE  (TABLE_CHECK_IN_BOUNDS | TABLE_CHECK_SHAPE)
+
+enum TableCheckState {
+  TABLE_CHECK_NONE,
+  TABLE_CHECK_PENDING,
+  TABLE_CHECK_READY,
+};
+
+struct TableCheck {
+  int               numTables;
+  uint8_t*          flags;          // TABLE_CHECK_* per table, set when the check passed
+  int*              overlapWith;    // first table sharing bytes, -1 for none
+
+  int               outOfBounds;
+  int               badShape;
+  int               notMonotonic;
+  int               overlapping;
+
+  std::atomic<int>  state;
+  std::thread       worker;
+  double            microseconds;
+};
+
+// starts checking [definition] against [data], which must stay put until table_check_close()
+void table_check_open(struct TableCheck* check, struct Definition* definition, const unsigned char* data, long length);
+void table_check_close(struct TableCheck* check);
+void table_check_wait(struct TableCheck* check);
+bool table_check_ready(const struct TableCheck* check);
+
+// true once the pass is done and [table] can be read without bounds checks
+bool table_check_renderable(const struct TableCheck* check, int table);
+
+// "out of bounds, axis not monotonic" style summary of what failed for [table]
+void table_check_describe(const struct TableCheck* check, struct Definition* definition, int table,
+                          char* buf, size_t size);
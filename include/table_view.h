@@ -0,0 +1,65 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "definition.h"
+
+// Decoded cell values of one table, the model the table editor draws from.
+//
+// A view holds the scaled value of every data cell in the working ROM
+// and, when a reference ROM is open, the same cells decoded from it once
+// plus the difference between the two. Edits only mark the cells they
+// touch; table_view_refresh() decodes those again and nothing else, so a
+// frame where nothing changed costs nothing per open table. The first two
+// axes are kept decoded the same way, an edit to either decodes both again.
+
+enum TableOverlay {
+  TABLE_OVERLAY_NONE,
+  TABLE_OVERLAY_DELTA,         // working - reference
+  TABLE_OVERLAY_PERCENT,       // (working - reference) / |reference| * 100
+};
+
+struct TableView {
+  struct Table*     table;
+  long              numCells;
+  int               cellSize;
+  enum TableOverlay overlay;
+
+  double*           values;      // working ROM, scaled
+  double*           reference;   // reference ROM, NULL without one
+  double*           delta;       // in the overlay's unit
+  double            maxDelta;    // largest |delta|, scales the heatmap
+
+  uint8_t*          stale;       // one bit per cell
+  long              numStale;
+
+  double*           axes[2];     // tables[0] and tables[1] scaled, NULL when the table has no such axis
+  long              axisCells[2];
+  bool              axesStale;
+};
+
+// decodes every cell of [table] from [rom], and from [reference] if it isn't NULL
+void table_view_open(struct TableView* view, struct Table* table,
+                     const unsigned char* rom, long romLength,
+                     const unsigned char* reference, long referenceLength);
+
+void table_view_close(struct TableView* view);
+
+bool table_view_is_open(const struct TableView* view);
+
+// swaps the reference ROM (NULL to drop it), every cell's reference is decoded again
+void table_view_set_reference(struct TableView* view, const unsigned char* reference, long referenceLength);
+
+void table_view_set_overlay(struct TableView* view, enum TableOverlay overlay);
+
+// marks cell [element] for decoding on the next refresh
+void table_view_mark(struct TableView* view, unsigned long element);
+
+// marks the axes for decoding on the next refresh
+void table_view_mark_axes(struct TableView* view);
+
+// decodes the marked cells, returns how many there were
+long table_view_refresh(struct TableView* view, const unsigned char* rom, long romLength);
+
+// delta of [element] scaled into [-1, 1] for colouring
+float table_view_heat(const struct TableView* view, unsigned long element);
@@ -0,0 +1,82 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "conescan_db.h"
+
+// Every saved version of a ROM, kept in the rom_version table.
+//
+// A version is stored as a delta against its parent: the changed byte
+// ranges, each as a varint gap, a varint length and the new bytes. Every
+// TUNE_HISTORY_SNAPSHOT_EVERY versions along a chain a snapshot is taken
+// instead, encoded as a delta against the stock image when one of the
+// same length is loaded, so only the tune itself is stored. The stock
+// image is kept once in rom_version_base for every snapshot made from it.
+// Without one the snapshot is a delta against an erased (all 0xFF) image
+// so unused flash costs nothing. A checkout applies at most that many
+// deltas on top of the nearest snapshot.
+//
+// Opening and saving a ROM hand the commit to a TuneCommit, which copies
+// the images and encodes and inserts on a background thread, through a
+// connection of its own.
+
+#define TUNE_HISTORY_SNAPSHOT_EVERY 16
+#define TUNE_HISTORY_MESSAGE_MAX 128
+
+struct TuneVersion {
+  int64_t  id;
+  int64_t  parent;             // 0 for the first version of a path
+  uint64_t hash;               // rom_file_hash_buffer() of the image
+  long     length;
+  int      depth;              // deltas since the last snapshot
+  bool     snapshot;
+  long     size;               // bytes stored for this version
+  char     message[TUNE_HISTORY_MESSAGE_MAX];
+  char     insertedAt[32];
+};
+
+// encodes the changes from [before] to [after], returns the size written to *[out] (malloc'd)
+long tune_delta_encode(const unsigned char* before, const unsigned char* after, long length, unsigned char** out);
+
+// applies a delta to [image] in place, false if it is corrupt or runs past [length]
+bool tune_delta_apply(unsigned char* image, long length, const unsigned char* delta, long size);
+
+// records [data] as a new version of [path] on top of its latest one, a
+// snapshot is encoded against [base] when it is [length] bytes too (it may be NULL)
+// returns the new id, or the latest id when nothing changed since it
+int64_t conescan_db_commit_version(struct ConeScanDB* db, const char* path, const unsigned char* data, long length,
+                                   const unsigned char* base, long baseLength, const char* message);
+
+// newest first, returns the number written to [versions]
+int conescan_db_log_versions(struct ConeScanDB* db, const char* path, struct TuneVersion* versions, int max);
+
+// latest version of [path], 0 if there is none
+int64_t conescan_db_head_version(struct ConeScanDB* db, const char* path);
+
+// rebuilds version [id] into *[data] (malloc'd)
+bool conescan_db_checkout_version(struct ConeScanDB* db, int64_t id, unsigned char** data, long* length);
+
+struct TuneCommit {
+  char*              dbPath;        // opened again by the worker, see commitVersion()
+  char*              path;
+  unsigned char*     data;          // copies, owned until the commit is done
+  long               length;
+  unsigned char*     base;
+  long               baseLength;
+  char               message[TUNE_HISTORY_MESSAGE_MAX];
+
+  std::atomic<bool>  busy;
+  std::thread        worker;
+  int64_t            id;            // what the last commit returned
+};
+
+// commits [data] in the background, after the previous commit finished
+// so a path's versions still chain in order. [base] may be NULL.
+void tune_commit_start(struct TuneCommit* commit, struct ConeScanDB* db, const char* path,
+                       const unsigned char* data, long length, const unsigned char* base, long baseLength,
+                       const char* message);
+void tune_commit_wait(struct TuneCommit* commit);
+bool tune_commit_busy(const struct TuneCommit* commit);
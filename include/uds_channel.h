@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+
+// Whole UDS messages on a CAN channel, addressed by CAN ID.
+//
+// Below the UDSEcu services and the RX8 library: the adapter does the
+// ISO-TP segmentation and flow control (one flow control filter per
+// module, set up in j2534Initialize()), so a message here is one complete
+// request or response of up to UDS_MAX_MESSAGE bytes. Several modules
+// answer on the same channel and their responses arrive interleaved;
+// UDSSessionManager sorts them out by CAN ID.
+//
+// Every call into a J2534 DLL costs far more than the message it carries,
+// so messages move in batches: send hands the adapter everything queued
+// in one PassThruWriteMsgs, receive drains whatever has arrived with one
+// PassThruReadMsgs (two more when it had to wait for the first). The
+// PASSTHRU_MSG pools they use, one for each direction since a send can
+// run while another thread reads, are allocated once when the channel is
+// set up, nothing is allocated per message.
+//
+// A message with length 0 is a first frame indication: a multi-frame
+// response from [canId] has started to arrive, the whole of it follows
+// as its own message.
+
+#define UDS_MAX_MESSAGE   4095   // largest ISO-TP payload
+#define UDS_CHANNEL_BATCH 16     // messages per adapter call either way
+
+enum UDSChannelStatus {
+  UDS_CHANNEL_OK,
+  UDS_CHANNEL_TIMEOUT,         // nothing arrived in time, try again
+  UDS_CHANNEL_ERROR,           // the adapter failed, the channel is unusable
+};
+
+struct UDSMessage {
+  uint32_t canId;
+  uint32_t length;
+  uint8_t  data[UDS_MAX_MESSAGE];
+};
+
+struct UDSChannel {
+  void* context;
+  // hands [count] messages (up to UDS_CHANNEL_BATCH) to the adapter, [sent] of them were taken
+  enum UDSChannelStatus (*send)(void* context, const struct UDSMessage* messages, int count, int* sent);
+  // waits up to [timeoutMs] for a message from any module, then returns
+  // every one already waiting, up to [capacity]
+  enum UDSChannelStatus (*receive)(void* context, struct UDSMessage* messages, int capacity, int* count,
+                                   unsigned long timeoutMs);
+};
+
+class J2534;
+
+struct UDSJ2534 {
+  J2534*        j2534;
+  unsigned long channel;       // a connected ISO15765 channel with its filters set
+  void*         txPool;        // UDS_CHANNEL_BATCH PASSTHRU_MSGs each, owned by the channel
+  void*         rxPool;
+};
+
+// [channel] sends and receives through [j2534], which must outlive it
+void uds_channel_j2534(struct UDSChannel* channel, struct UDSJ2534* j2534);
+void uds_channel_j2534_close(struct UDSJ2534* j2534);
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+// The UDS services ConeScan uses, as a table of functions so the same
+// download code runs against a car (through RX8 and a J2534 adapter) or
+// against the mock ECU. Return values follow RX8: the bool calls return
+// true on success, the int calls return 0 on success. Buffers returned
+// through a pointer are malloc'd and freed by the caller.
+//
+// eraseBlock and writeMem are NULL for an ECU that can't be programmed
+// through this interface. Flash only goes from 1 to 0 bits: a block has
+// to be erased (to 0xFF) before anything is written to it.
+
+struct UDSEcu {
+  void* context;
+  bool (*initDiagSession)(void* context, uint8_t session);
+  int  (*getSeed)(void* context, uint8_t** seed);
+  int  (*calculateKey)(void* context, uint8_t* seed, uint8_t** key);
+  bool (*unlock)(void* context, uint8_t* key);
+  int  (*readMem)(void* context, unsigned long address, uint16_t size, char* out);
+  int  (*getVIN)(void* context, char** vin);
+  int  (*getCalibrationID)(void* context, char** calID);
+  int  (*eraseBlock)(void* context, unsigned long address, unsigned long size);
+  int  (*writeMem)(void* context, unsigned long address, uint16_t size, const char* data);
+};
+
+class RX8;
+
+// [ecu] forwards to [rx8], which must outlive it
+void uds_ecu_rx8(struct UDSEcu* ecu, RX8* rx8);
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+#include "uds_ecu.h"
+#include "uds_session.h"
+
+// One module's UDS services as a UDSEcu, sent through a UDSSessionManager
+// instead of a library that owns the adapter.
+//
+// The download and identify code runs unchanged on top, but its requests
+// queue with the manager's other sessions and go to the adapter in the
+// same batched calls. The seed to key algorithm is the ECU maker's and
+// comes from [keys], the RX8 library on a car. Memory is read with
+// ReadMemoryByAddress (0x23) using a four byte address and a two byte
+// size, seeds and keys are UDS_ECU_SESSION_KEY bytes as with RX8.
+// Nothing here programs flash, eraseBlock and writeMem are NULL.
+
+#define UDS_ECU_SESSION_KEY 3
+
+struct UDSSessionEcu {
+  struct UDSSessionManager* manager;
+  struct UDSSession*        session;
+  struct UDSEcu*            keys;
+};
+
+// [ecu] talks to [module]'s session, [module] must outlive it
+void uds_ecu_session(struct UDSEcu* ecu, struct UDSSessionEcu* module);
@@ -2,35 +2,134 @@
 
 #include <stdint.h>
 
-#include "librx8.h"
+#include <atomic>
+#include <thread>
+
+#include "uds_ecu.h"
+#include "uds_stats.h"
 #include "console.h"
+#include "conescan_db.h"
+#include "read_plan.h"
+#include "download_stream.h"
+
+// Reads ECU memory over UDS on a worker thread.
+//
+// The worker owns everything it touches while it runs. The UI only sees
+// [transferBytes], [state] and the log ring, all of which the worker
+// publishes through atomics, and the bytes of [payload] below
+// [transferBytes]. uds_request_poll() moves queued log lines to the
+// console from the UI thread, the worker never blocks on the UI.
+//
+// With a database the download is resumable: the worker marks each
+// DOWNLOAD_CACHE_BLOCK_SIZE block of [payload] in [blockDone] once it is
+// complete, uds_request_poll() stores newly finished blocks, and a later
+// download of the same VIN, calibration and range only reads the blocks
+// that are still missing. The worker reads the first and last stored
+// block back from the ECU before trusting them; if they differ it starts
+// from nothing and sets [cacheStale], and the stored copy is dropped.
+//
+// A full download also feeds a DownloadStream: each finished chunk is
+// hashed page by page and written to [spoolPath] as it arrives, so the
+// ROM is hashed and on disk by the time the last chunk lands.
+
+#define UDS_REQUEST_LOG_SLOTS 32
+#define UDS_REQUEST_LOG_SIZE  192
+
+// Chunk sizing: the worker starts at transferChunkSize and doubles it
+// against the start address until the ECU refuses, which becomes the
+// ceiling. A failed chunk is retried at half the size, a chunk slower
+// than the latency budget halves the size for the next one, and a run
+// of fast chunks doubles it again up to the ceiling.
+#define UDS_REQUEST_MIN_CHUNK      0x10
+#define UDS_REQUEST_MAX_CHUNK      0xFFE    // ISO-TP frame limit less the response SID
+#define UDS_REQUEST_LATENCY_BUDGET 0.25     // seconds, well inside the ECU's P2* timeout
+#define UDS_REQUEST_GROW_AFTER     16       // fast chunks in a row before trying a bigger size
+#define UDS_REQUEST_MAX_RETRIES    3        // failures at the minimum size before giving up
+
+enum UDSRequestState {
+	UDS_REQUEST_IDLE,
+	UDS_REQUEST_RUNNING,
+	UDS_REQUEST_DONE,
+	UDS_REQUEST_FAILED,
+	UDS_REQUEST_CANCELLED,
+};
 
-#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-#include <Windows.h>
-#else
-#include <pthread.h>
-#endif
+// single producer (worker) single consumer (UI) ring, full means the line is dropped
+struct UDSRequestLog {
+	char                  lines[UDS_REQUEST_LOG_SLOTS][UDS_REQUEST_LOG_SIZE];
+	std::atomic<uint32_t> head;      // next slot the worker writes
+	std::atomic<uint32_t> tail;      // next slot the UI reads
+	std::atomic<uint32_t> dropped;
+};
 
 struct UDSRequestDownload {
-	unsigned long address;
+	// set by the caller before uds_request_start_download()
 	unsigned long startAddress;
-	unsigned long endAddress;
 	unsigned long transferSize;
 	uint16_t      transferChunkSize;
+	struct UDSStats* stats;          // optional, retried chunks are counted there too
+	const char*   spoolPath;         // optional, a full download is written here as it arrives
 
-	float         transferProgress;
-	uint32_t      transferBytes;
-	char*         payload;
-	bool          downloadinProgress;
+	// a sparse read only covers these, set by uds_request_start_sparse_download()
+	struct ReadRange* ranges;
+	int           numRanges;
+	unsigned long plannedBytes;      // bytes the download will read, resumed ones included
 
-#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-	DWORD         threadID;
-	HANDLE        threadHandle;
-#else
+	// worker owned while it runs
+	struct UDSEcu* ecu;
+	unsigned long address;
+	unsigned long endAddress;
+	char*         payload;           // transferSize bytes, allocated when the download starts
+
+	std::atomic<uint8_t>*  blockDone;     // per block, set once its bytes are in [payload]
+
+	// UI owned, the stored download the blocks are saved to
+	struct ConeScanDB* db;
+	int64_t       downloadId;
+	uint32_t      numBlocks;
+	uint8_t*      blockSaved;        // one bit per block, as stored in the database
+	uint32_t      resumedBlocks;     // loaded from the database when the download started
+	std::atomic<bool> cacheStale;    // set by the worker, the stored blocks don't match the ECU
+	bool          reported;          // uds_request_poll() has seen the worker finish
 
-#endif
+	// a full download is hashed and spooled while it arrives
+	struct DownloadStream stream;
+	uint64_t      hash;              // rom_file_hash_buffer() of the payload once [hashed]
+	bool          hashed;
+	bool          spooled;           // the payload is at [spoolPath]
 
+	std::atomic<uint32_t> transferBytes;  // bytes of [payload] that are complete, resumed ones included
+	std::atomic<uint32_t> chunkSize;      // bytes per read right now
+	std::atomic<uint32_t> bytesPerSecond; // read from the ECU since the transfer started
+	std::atomic<uint32_t> retries;        // chunks read again at a smaller size
+	std::atomic<int>      state;          // UDSRequestState
+	std::atomic<bool>     cancel;
+	std::thread           worker;
+	struct UDSRequestLog  log;
 };
 
-void uds_request_start_download(RX8* ecu, struct UDSRequestDownload* request, ConeScan::Console* console);
+// [db] may be NULL, the download then starts from scratch every time and isn't kept
+void uds_request_start_download(struct UDSEcu* ecu, struct UDSRequestDownload* request, ConeScan::Console* console,
+                                struct ConeScanDB* db, const char* vin, const char* calID);
+
+// reads only [plan]'s ranges into a payload the size of its ROM, unread
+// bytes are 0xFF. Sparse reads aren't stored for resuming.
+void uds_request_start_sparse_download(struct UDSEcu* ecu, struct UDSRequestDownload* request, ConeScan::Console* console,
+                                       const struct ReadPlan* plan);
+
+// asks the worker to stop after its current chunk
+void uds_request_cancel(struct UDSRequestDownload* request);
+
+// cancels, joins the worker and frees the payload
 void uds_request_complete(struct UDSRequestDownload* request);
+
+// copies queued worker messages to [console] and stores finished blocks, call once per frame.
+// Returns true on the call that sees the download finish, whatever its state.
+bool uds_request_poll(struct UDSRequestDownload* request, ConeScan::Console* console);
+
+bool  uds_request_busy(const struct UDSRequestDownload* request);
+enum UDSRequestState uds_request_state(const struct UDSRequestDownload* request);
+float uds_request_progress(const struct UDSRequestDownload* request);
+
+// bytes from the start of [payload] with no missing block in between
+uint32_t uds_request_contiguous_bytes(const struct UDSRequestDownload* request);
@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "uds_channel.h"
+
+// Concurrent UDS sessions with every module on one channel.
+//
+// Each module is a UDSSession with its own request CAN ID, answering on
+// that ID + UDS_SESSION_RESPONSE_OFFSET. UDS allows one outstanding
+// request per module, but nothing stops requests to different modules
+// being on the bus at once: uds_session_send() queues a request and
+// returns, uds_session_wait() collects its response. There is no receive
+// thread, whichever caller is waiting reads the channel and files each
+// message under the session its CAN ID belongs to, waking that session's
+// waiter, so one thread can drive all modules or each module can have
+// its own.
+//
+// Requests queue in [outbox] and go to the adapter together on the next
+// uds_session_flush() or wait, and every read takes all the responses
+// already waiting into [incoming]. Both are part of the manager, a
+// response is copied straight into its session, nothing is allocated per
+// message.
+//
+// A module that answers "response pending" (0x7F, service, 0x78) gets
+// UDS_SESSION_PENDING_MS more from then on, as P2* allows. One whose
+// multi-frame response has started (a first frame indication) gets
+// UDS_SESSION_MESSAGE_MS for the rest of it, a 4095 byte response alone
+// is about 150 ms of frames at 500 kbit/s.
+//
+// A response is only taken once its request has gone to the adapter, an
+// answer to an earlier request that timed out can't be mistaken for the
+// answer to its retry while the retry is still queued.
+
+#define UDS_SESSION_MAX_MODULES     8
+#define UDS_SESSION_FIRST_ID        0x7E0   // the flow control filters j2534Initialize() sets
+#define UDS_SESSION_MODULES         7       // 0x7E0 to 0x7E6
+#define UDS_SESSION_RESPONSE_OFFSET 8
+#define UDS_SESSION_TIMEOUT_MS      150     // P2: the module has to start answering by then
+#define UDS_SESSION_PENDING_MS      5000    // P2*
+#define UDS_SESSION_MESSAGE_MS      1000    // to finish a response once its first frame is in
+#define UDS_SESSION_POLL_MS         10      // longest a reader holds the channel before checking its deadline
+
+enum UDSSessionResult {
+  UDS_SESSION_POSITIVE,
+  UDS_SESSION_NEGATIVE,        // the response is 0x7F, service, code
+  UDS_SESSION_TIMEOUT,
+  UDS_SESSION_BUSY,            // the module still has a request outstanding
+  UDS_SESSION_ERROR,           // the channel failed
+};
+
+struct UDSSession {
+  uint32_t          requestId;
+  uint32_t          responseId;
+
+  // guarded by the manager's lock
+  bool              outstanding;
+  bool              sent;          // the request has gone to the adapter
+  bool              answered;
+  uint8_t           service;
+  std::chrono::steady_clock::time_point deadline;
+  struct UDSMessage response;
+
+  uint32_t          requests;
+  uint32_t          negative;
+  uint32_t          timeouts;
+};
+
+struct UDSSessionManager {
+  struct UDSChannel*      channel;
+  struct UDSSession       sessions[UDS_SESSION_MAX_MODULES];
+  int                     numSessions;
+
+  std::mutex              lock;
+  std::condition_variable arrived;
+  bool                    reading;      // a waiter is reading the channel into [incoming]
+  bool                    failed;
+  uint32_t                unexpected;   // responses no session was waiting for
+  uint32_t                receiveCalls;
+  uint32_t                received;
+  struct UDSMessage       incoming[UDS_CHANNEL_BATCH];
+
+  std::mutex              sendLock;     // guards everything below
+  struct UDSMessage       outbox[UDS_CHANNEL_BATCH];
+  int                     queued;
+  uint32_t                sendCalls;
+  uint32_t                sent;
+};
+
+// sessions for [count] modules from [firstId] up, [channel] must outlive the manager
+void uds_session_open(struct UDSSessionManager* manager, struct UDSChannel* channel, uint32_t firstId, int count);
+
+// NULL when [requestId] isn't one of the manager's modules
+struct UDSSession* uds_session_find(struct UDSSessionManager* manager, uint32_t requestId);
+
+// queues [request] for [session] without waiting for the response,
+// UDS_SESSION_POSITIVE once it's queued
+enum UDSSessionResult uds_session_send(struct UDSSessionManager* manager, struct UDSSession* session,
+                                       const uint8_t* request, uint32_t length);
+
+// hands every queued request to the adapter, false once the channel failed
+bool uds_session_flush(struct UDSSessionManager* manager);
+
+// waits for [session]'s response, which stays in session->response until its next send
+enum UDSSessionResult uds_session_wait(struct UDSSessionManager* manager, struct UDSSession* session);
+
+// uds_session_send() then uds_session_wait()
+enum UDSSessionResult uds_session_request(struct UDSSessionManager* manager, struct UDSSession* session,
+                                          const uint8_t* request, uint32_t length);
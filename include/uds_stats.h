@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+
+#include "uds_ecu.h"
+
+// Latency histograms and transport counters for every UDS request.
+//
+// uds_stats_wrap() puts a timing layer in front of a UDSEcu: each call is
+// timed with the monotonic clock and lands in its service's histogram.
+// Everything is an atomic updated with relaxed ordering, so the worker
+// never waits on the UI reading the numbers; a read taken mid-request may
+// be off by that one request.
+//
+// Histogram buckets are log-linear over microseconds: each power of two
+// is split in UDS_STATS_SUB_BUCKETS and a percentile is reported as the
+// middle of its bucket, within about 12% of the real value. The wrapped
+// calls only report success, so a failure is counted as a timeout when it
+// took longer than UDS_STATS_TIMEOUT_MS (the tester gave up waiting) and
+// as a negative response otherwise.
+
+#define UDS_STATS_SUB_BITS    2
+#define UDS_STATS_SUB_BUCKETS (1 << UDS_STATS_SUB_BITS)
+#define UDS_STATS_OCTAVES     28   // past 2^28 us (4.5 minutes) lands in the last bucket
+#define UDS_STATS_BUCKETS     (UDS_STATS_OCTAVES * UDS_STATS_SUB_BUCKETS)
+#define UDS_STATS_TIMEOUT_MS  1000
+
+enum UDSService {
+  UDS_SERVICE_DIAG_SESSION,
+  UDS_SERVICE_SEED,
+  UDS_SERVICE_KEY,
+  UDS_SERVICE_READ_MEM,
+  UDS_SERVICE_VIN,
+  UDS_SERVICE_CAL_ID,
+  UDS_SERVICE_ERASE,
+  UDS_SERVICE_WRITE_MEM,
+  UDS_SERVICE_COUNT,
+};
+
+struct UDSHistogram {
+  std::atomic<uint32_t> buckets[UDS_STATS_BUCKETS];
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> maxMicros;
+  std::atomic<uint64_t> totalMicros;
+};
+
+struct UDSStats {
+  struct UDSHistogram   services[UDS_SERVICE_COUNT];
+  std::atomic<uint32_t> requests;
+  std::atomic<uint32_t> negative;      // refused quickly, a negative response code
+  std::atomic<uint32_t> timeouts;      // failed after UDS_STATS_TIMEOUT_MS
+  std::atomic<uint32_t> retries;       // reported by the caller, see uds_stats_retry()
+  std::atomic<uint64_t> bytesSent;
+  std::atomic<uint64_t> bytesReceived;
+  std::atomic<uint64_t> frames;        // CAN frames both ways, estimated from ISO-TP
+};
+
+// in front of [inner], which must outlive it
+struct UDSStatsEcu {
+  struct UDSEcu    ecu;                // hand this to the download code
+  struct UDSEcu*   inner;
+  struct UDSStats* stats;
+};
+
+void uds_stats_wrap(struct UDSStatsEcu* wrapper, struct UDSEcu* inner, struct UDSStats* stats);
+void uds_stats_reset(struct UDSStats* stats);
+
+void uds_stats_record(struct UDSStats* stats, enum UDSService service, uint64_t micros);
+void uds_stats_retry(struct UDSStats* stats);
+
+// latency in microseconds below which [fraction] of the requests finished, 0 when there are none
+uint32_t uds_stats_percentile(const struct UDSHistogram* histogram, double fraction);
+
+const char* uds_stats_service_name(enum UDSService service);
+
+// CAN frames an ISO-TP message of [bytes] takes, flow control not included
+uint32_t uds_isotp_frames(unsigned long bytes);
+
+// one row per service plus the counters, returns -1 when [path] can't be written
+int uds_stats_dump_csv(const struct UDSStats* stats, const char* path);
@@ -0,0 +1,60 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "uds_session.h"
+
+// Asks every module on the channel for its VIN, calibration ID and stored
+// DTCs at once.
+//
+// Each step goes out to all modules that are still answering before any
+// response is collected, so a full scan costs about three round trips of
+// the slowest module instead of three per module, and the modules that
+// aren't fitted time out together. A module that times out on the VIN
+// request is taken as absent and skipped after that; a negative response
+// means it is there but doesn't support the request. The scan runs on a
+// background thread like the table check.
+
+#define VEHICLE_SCAN_MAX_DTCS 32
+#define VEHICLE_SCAN_DTC_MASK 0x0D   // test failed, pending or confirmed
+
+enum VehicleScanState {
+  VEHICLE_SCAN_NONE,
+  VEHICLE_SCAN_RUNNING,
+  VEHICLE_SCAN_READY,
+};
+
+struct ModuleScan {
+  uint32_t requestId;
+  bool     present;
+  char     vin[18];                  // empty when the module doesn't report one
+  char     calID[33];
+  bool     dtcsRead;
+  int      numDtcs;                  // every DTC reported, more than fit in [dtcs] when it's over the max
+  uint32_t dtcs[VEHICLE_SCAN_MAX_DTCS];
+  uint8_t  dtcStatus[VEHICLE_SCAN_MAX_DTCS];
+};
+
+struct VehicleScan {
+  struct UDSSessionManager manager;
+  struct ModuleScan        modules[UDS_SESSION_MAX_MODULES];
+  int                      numModules;
+  double                   seconds;
+  std::atomic<int>         state;
+  std::thread              worker;
+};
+
+// starts scanning [count] modules from [firstId] up over [channel], which
+// nothing else may read until the scan is ready
+void vehicle_scan_start(struct VehicleScan* scan, struct UDSChannel* channel, uint32_t firstId, int count);
+void vehicle_scan_wait(struct VehicleScan* scan);
+void vehicle_scan_close(struct VehicleScan* scan);
+bool vehicle_scan_busy(const struct VehicleScan* scan);
+bool vehicle_scan_ready(const struct VehicleScan* scan);
+int  vehicle_scan_present(const struct VehicleScan* scan);
+
+// "P0301-00" style name for a 3 byte UDS DTC
+void vehicle_scan_dtc_name(uint32_t dtc, char* buf, size_t size);
@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "page_pool.h"
+
+// ROM images kept open side by side against the one loaded definition.
+//
+// Each image is a list of page ids into a shared PagePool, so variants of
+// the same calibration only store the pages that differ between them.
+// Images are read only here; the working ROM that gets edited and saved
+// is still the one in [rom].
+
+struct WorkspaceRom {
+  char*     path;
+  long      length;
+  uint32_t  numPages;
+  uint32_t* pages;             // page ids into Workspace.pool
+  uint64_t  hash;              // rom_file_hash_buffer() of the image
+};
+
+struct Workspace {
+  struct PagePool      pool;
+  struct WorkspaceRom* roms;
+  int                  numRoms;
+};
+
+void workspace_init(struct Workspace* workspace);
+void workspace_free(struct Workspace* workspace);
+
+// adds a copy of [data], returns its index
+int workspace_add(struct Workspace* workspace, const char* path, const unsigned char* data, long length);
+
+// maps [path] and adds it, -1 with errno set on failure
+int workspace_add_file(struct Workspace* workspace, const char* path);
+
+void workspace_remove(struct Workspace* workspace, int index);
+
+// copies [length] bytes at [offset] of image [index] into [out], false past its end
+bool workspace_read(const struct Workspace* workspace, int index, unsigned long offset, void* out, size_t length);
+
+// bytes the images would take as separate copies
+size_t workspace_logical_bytes(const struct Workspace* workspace);
+
+// bytes the pool actually holds
+size_t workspace_stored_bytes(const struct Workspace* workspace);
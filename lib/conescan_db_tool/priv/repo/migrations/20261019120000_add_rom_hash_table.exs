@@ -0,0 +1,12 @@
+defmodule ConescanDbTool.Repo.Migrations.AddRomHashTable do
+  use Ecto.Migration
+
+  def change do
+    create table(:rom_hash) do
+      add :path, :string, null: false
+      add :hash, :string, null: false
+      add :length, :integer, null: false
+    end
+    create unique_index(:rom_hash, [:path])
+  end
+end
@@ -0,0 +1,18 @@
+defmodule ConescanDbTool.Repo.Migrations.AddRomVersionTable do
+  use Ecto.Migration
+
+  def change do
+    create table(:rom_version) do
+      add :path, :string, null: false
+      add :parent, :integer
+      add :hash, :string, null: false
+      add :length, :integer, null: false
+      add :depth, :integer, null: false
+      add :snapshot, :boolean, null: false
+      add :data, :binary, null: false
+      add :message, :string
+      timestamps()
+    end
+    create index(:rom_version, [:path])
+  end
+end
@@ -0,0 +1,23 @@
+defmodule ConescanDbTool.Repo.Migrations.AddRomDownloadTables do
+  use Ecto.Migration
+
+  def change do
+    create table(:rom_download) do
+      add :vin, :string, null: false
+      add :cal_id, :string, null: false
+      add :start_address, :integer, null: false
+      add :transfer_size, :integer, null: false
+      add :block_size, :integer, null: false
+      add :bitmap, :binary, null: false
+      timestamps()
+    end
+    create unique_index(:rom_download, [:vin, :cal_id, :start_address, :transfer_size])
+
+    create table(:rom_download_block) do
+      add :download_id, references(:rom_download, on_delete: :delete_all), null: false
+      add :block, :integer, null: false
+      add :data, :binary, null: false
+    end
+    create unique_index(:rom_download_block, [:download_id, :block])
+  end
+end
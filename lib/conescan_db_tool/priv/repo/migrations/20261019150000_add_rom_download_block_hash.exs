@@ -0,0 +1,9 @@
+defmodule ConescanDbTool.Repo.Migrations.AddRomDownloadBlockHash do
+  use Ecto.Migration
+
+  def change do
+    alter table(:rom_download_block) do
+      add :hash, :integer
+    end
+  end
+end
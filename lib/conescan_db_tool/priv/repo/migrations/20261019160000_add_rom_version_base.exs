@@ -0,0 +1,17 @@
+defmodule ConescanDbTool.Repo.Migrations.AddRomVersionBase do
+  use Ecto.Migration
+
+  def change do
+    create table(:rom_version_base) do
+      add :hash, :string, null: false
+      add :length, :integer, null: false
+      add :data, :binary, null: false
+      timestamps()
+    end
+    create unique_index(:rom_version_base, [:hash, :length])
+
+    alter table(:rom_version) do
+      add :base, references(:rom_version_base)
+    end
+  end
+end
@@ -0,0 +1,115 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "definition.h"
+#include "address_index.h"
+
+static int compareSpans(const void* a, const void* b)
+{
+  const struct AddressSpan* sa = (const struct AddressSpan*)a;
+  const struct AddressSpan* sb = (const struct AddressSpan*)b;
+  if(sa->start != sb->start) return sa->start < sb->start ? -1 : 1;
+  if(sa->end != sb->end) return sa->end < sb->end ? -1 : 1;
+  return sa->table - sb->table;
+}
+
+static void addSpan(struct AddressIndex* index, struct Table* table, int t, int axis)
+{
+  if(table->elements <= 0) return;
+  struct AddressSpan* span = &index->spans[index->numSpans++];
+  span->cellSize = definition_scaling_size(table->Scaling);
+  span->start = table->address;
+  span->end = table->address + (unsigned long)table->elements * span->cellSize;
+  span->table = t;
+  span->axis = axis;
+}
+
+void address_index_build(struct AddressIndex* index, struct Definition* definition)
+{
+  address_index_free(index);
+
+  int count = 0;
+  for(int i = 0; i < definition->numTables; i++)
+    count += 1 + definition->tables[i].numTables;
+  if(count == 0) return;
+
+  index->spans = (struct AddressSpan*)malloc(sizeof(struct AddressSpan) * count);
+  assert(index->spans);
+  for(int i = 0; i < definition->numTables; i++) {
+    struct Table* table = &definition->tables[i];
+    addSpan(index, table, i, -1);
+    for(int j = 0; j < table->numTables && table->tables; j++)
+      addSpan(index, &table->tables[j], i, j);
+  }
+  qsort(index->spans, index->numSpans, sizeof(struct AddressSpan), compareSpans);
+
+  index->maxEnd = (unsigned long*)malloc(sizeof(unsigned long) * (index->numSpans ? index->numSpans : 1));
+  assert(index->maxEnd);
+  unsigned long maxEnd = 0;
+  for(int i = 0; i < index->numSpans; i++) {
+    if(index->spans[i].end > maxEnd) maxEnd = index->spans[i].end;
+    index->maxEnd[i] = maxEnd;
+  }
+}
+
+void address_index_free(struct AddressIndex* index)
+{
+  if(index->spans) free(index->spans);
+  if(index->maxEnd) free(index->maxEnd);
+  memset(index, 0, sizeof(struct AddressIndex));
+}
+
+const struct AddressSpan* address_index_find(const struct AddressIndex* index, struct AddressCursor* cursor,
+                                             unsigned long address)
+{
+  if(index->numSpans == 0) return NULL;
+  if(cursor && address >= cursor->start && address < cursor->end)
+    return cursor->span < 0 ? NULL : &index->spans[cursor->span];
+
+  // first span starting after [address]
+  int lo = 0, hi = index->numSpans;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(index->spans[mid].start <= address) lo = mid + 1;
+    else hi = mid;
+  }
+  unsigned long next = lo < index->numSpans ? index->spans[lo].start : ULONG_MAX;
+
+  // walk back while an earlier span could still reach [address]
+  int found = -1;
+  for(int i = lo - 1; i >= 0 && index->maxEnd[i] > address; i--) {
+    if(index->spans[i].end > address) {
+      found = i;
+      break;
+    }
+  }
+
+  if(cursor) {
+    cursor->start = address;
+    cursor->end = found < 0 ? next : (index->spans[found].end < next ? index->spans[found].end : next);
+    cursor->span = found;
+  }
+  return found < 0 ? NULL : &index->spans[found];
+}
+
+unsigned long address_index_gap_end(const struct AddressIndex* index, const struct AddressCursor* cursor,
+                                    unsigned long address, unsigned long limit)
+{
+  if(index->numSpans == 0) return limit;
+  struct AddressCursor gap;
+  if(!cursor || address < cursor->start || address >= cursor->end) {
+    if(address_index_find(index, &gap, address)) return address;
+    cursor = &gap;
+  }
+  if(cursor->span >= 0) return address;
+  return cursor->end < limit ? cursor->end : limit;
+}
+
+struct Table* address_span_table(struct Definition* definition, const struct AddressSpan* span)
+{
+  struct Table* table = &definition->tables[span->table];
+  return span->axis < 0 ? table : &table->tables[span->axis];
+}
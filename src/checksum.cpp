@@ -0,0 +1,189 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "checksum.h"
+#include "idle.h"
+#include "rom_file.h"
+
+#define CHECKSUM_RECORD_SIZE 12
+
+static const struct ChecksumModule modules[] = {
+  // LFG2EE (NC MX-5), the table fills the block below 0xFF800
+  { "21053000",  0xFF650, 36, 0x5AA5A55A },
+  // N3K1 and N3ZB (RX-8)
+  { "subarudbw", 0x7FB80, 17, 0x5AA5A55A },
+};
+
+const struct ChecksumModule* checksum_module_find(const char* name)
+{
+  if(!name) return NULL;
+  for(size_t i = 0; i < sizeof(modules) / sizeof(modules[0]); i++) {
+    if(strcmp(modules[i].name, name) == 0) return &modules[i];
+  }
+  return NULL;
+}
+
+static uint32_t read32(const unsigned char* data)
+{
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static uint32_t sumWords(const unsigned char* data, unsigned long start, unsigned long end)
+{
+  uint32_t sum = 0;
+  for(unsigned long address = start; address + 3 <= end; address += 4)
+    sum += read32(data + address);
+  return sum;
+}
+
+static void sumRanges(struct Checksum* checksum, const unsigned char* data)
+{
+  auto begin = std::chrono::steady_clock::now();
+  for(int i = 0; i < checksum->numRanges; i++) {
+    struct ChecksumRange* range = &checksum->ranges[i];
+    range->sum = sumWords(data, range->start, range->end);
+  }
+  checksum->microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+  checksum->state.store(CHECKSUM_READY, std::memory_order_release);
+  idle_post_event();
+}
+
+// records end at an erased (all ones) or empty entry, anything else
+// that isn't a word aligned range inside the ROM means the module is wrong
+static int readTable(struct Checksum* checksum, const struct RomFile* rom)
+{
+  const struct ChecksumModule* module = checksum->module;
+  unsigned long tableEnd = module->table + (unsigned long)module->maxRanges * CHECKSUM_RECORD_SIZE;
+  if(tableEnd > (unsigned long)rom->length) return -1;
+
+  int count = 0;
+  for(int i = 0; i < module->maxRanges && i < CHECKSUM_MAX_RANGES; i++) {
+    unsigned long record = module->table + (unsigned long)i * CHECKSUM_RECORD_SIZE;
+    unsigned long start = read32(rom->data + record);
+    unsigned long end = read32(rom->data + record + 4);
+    if(start == 0xFFFFFFFF || (start == 0 && end == 0)) break;
+    if(start > end || end >= (unsigned long)rom->length || (start & 3) || ((end + 1) & 3)) return -1;
+
+    struct ChecksumRange* range = &checksum->ranges[count++];
+    range->start = start;
+    range->end = end;
+    range->valueAddress = record + 8;
+    range->sum = 0;
+  }
+  return count;
+}
+
+bool checksum_open(struct Checksum* checksum, const char* module, const struct RomFile* rom)
+{
+  checksum_close(checksum);
+  checksum->module = checksum_module_find(module);
+  if(!checksum->module || rom->backing == ROM_FILE_CLOSED) return false;
+
+  int count = readTable(checksum, rom);
+  if(count <= 0) {
+    checksum->module = NULL;
+    return false;
+  }
+  checksum->numRanges = count;
+  checksum->state.store(CHECKSUM_PENDING, std::memory_order_release);
+
+  // the image can't move while the checksum is open, checksum_close() joins first
+#ifdef __EMSCRIPTEN__
+  sumRanges(checksum, rom->data);
+#else
+  checksum->worker = std::thread(sumRanges, checksum, (const unsigned char*)rom->data);
+#endif
+  return true;
+}
+
+void checksum_wait(struct Checksum* checksum)
+{
+  if(checksum->worker.joinable()) checksum->worker.join();
+}
+
+void checksum_close(struct Checksum* checksum)
+{
+  checksum_wait(checksum);
+  checksum->module = NULL;
+  checksum->numRanges = 0;
+  checksum->microseconds = 0.0;
+  checksum->state.store(CHECKSUM_NONE, std::memory_order_release);
+}
+
+bool checksum_ready(const struct Checksum* checksum)
+{
+  return checksum->state.load(std::memory_order_acquire) == CHECKSUM_READY;
+}
+
+void checksum_update(struct Checksum* checksum, unsigned long offset,
+                     const unsigned char* before, const unsigned char* after, size_t length)
+{
+  if(!checksum->module || length == 0) return;
+  // an edit racing the initial sum could be counted twice
+  checksum_wait(checksum);
+
+  unsigned long last = offset + length - 1;
+  for(int i = 0; i < checksum->numRanges; i++) {
+    struct ChecksumRange* range = &checksum->ranges[i];
+    if(last < range->start || offset > range->end) continue;
+    unsigned long from = offset > range->start ? offset : range->start;
+    unsigned long to = last < range->end ? last : range->end;
+
+    // each byte carries weight 256^(3 - position in its word)
+    uint32_t delta = 0;
+    for(unsigned long address = from; address <= to; address++) {
+      uint32_t change = (uint32_t)after[address - offset] - (uint32_t)before[address - offset];
+      delta += change << (8 * (3 - (address & 3)));
+    }
+    range->sum += delta;
+  }
+}
+
+bool checksum_range_valid(const struct Checksum* checksum, const struct RomFile* rom, int range)
+{
+  assert(range >= 0 && range < checksum->numRanges);
+  const struct ChecksumRange* r = &checksum->ranges[range];
+  return (uint32_t)(r->sum + read32(rom->data + r->valueAddress)) == checksum->module->target;
+}
+
+int checksum_invalid(const struct Checksum* checksum, const struct RomFile* rom)
+{
+  if(!checksum->module || !checksum_ready(checksum)) return -1;
+  int invalid = 0;
+  for(int i = 0; i < checksum->numRanges; i++) {
+    if(!checksum_range_valid(checksum, rom, i)) invalid++;
+  }
+  return invalid;
+}
+
+void checksum_range_value(const struct Checksum* checksum, int range, unsigned char bytes[4])
+{
+  uint32_t value = checksum->module->target - checksum->ranges[range].sum;
+  bytes[0] = (unsigned char)(value >> 24);
+  bytes[1] = (unsigned char)(value >> 16);
+  bytes[2] = (unsigned char)(value >> 8);
+  bytes[3] = (unsigned char)value;
+}
+
+int checksum_fix(struct Checksum* checksum, struct RomFile* rom)
+{
+  if(!checksum->module) return 0;
+  checksum_wait(checksum);
+
+  int fixed = 0;
+  for(int i = 0; i < checksum->numRanges; i++) {
+    if(checksum_range_valid(checksum, rom, i)) continue;
+    unsigned long address = checksum->ranges[i].valueAddress;
+    unsigned char bytes[4];
+    checksum_range_value(checksum, i, bytes);
+    // the value could sit inside another range
+    checksum_update(checksum, address, rom->data + address, bytes, 4);
+    rom_file_write(rom, address, bytes, 4);
+    fixed++;
+  }
+  return fixed;
+}
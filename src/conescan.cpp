@@ -18,6 +18,7 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 
 #ifdef __EMSCRIPTEN__
 #include "emscripten.h"
@@ -28,16 +29,38 @@
 #include "history.h"
 #include "definition.h"
 #include "definition_parse.h"
+#include "definition_index.h"
+#include "address_index.h"
+#include "rom_search.h"
+#include "rom_file.h"
+#include "rom_save.h"
+#include "rom_hash.h"
+#include "checksum.h"
+#include "table_check.h"
+#include "rom_diff.h"
+#include "table_view.h"
+#include "rom_merge.h"
+#include "workspace.h"
+#include "tune_history.h"
+#include "memmodel.h"
+#include "read_plan.h"
 #include "console.h"
 #include "layout.h"
 #include "file_open_dialog.h"
+#include "idle.h"
+#include "profiler.h"
 
 //#define OP20PT32_USE_LIB
 #include "J2534.h"
 #include "librx8.h"
 #include "util.h"
 
+#include "uds_ecu.h"
+#include "uds_ecu_session.h"
+#include "uds_stats.h"
 #include "uds_request_download.h"
+#include "uds_channel.h"
+#include "vehicle_scan.h"
 
 #ifdef __EMSCRIPTEN__
 const char* db_path = "/conescan.db";
@@ -59,6 +82,11 @@ bool show_console_window = true;
 // demo window is for the IMGui window
 bool show_demo_window = false;
 
+#ifdef CONESCAN_PROFILER
+// frame profiler overlay
+bool show_profiler_window = false;
+#endif
+
 // sqlite database handle
 struct ConeScanDB db;
 
@@ -80,23 +108,110 @@ char firmwareVersion[255] = { 0 };
 
 // J2534 -> UDS interface
 RX8* ecu;
+struct UDSEcu udsEcu;  // [ecu] as UDS services, only its seed to key algorithm is used
+struct UDSSessionManager udsSessions;  // the PCM's session on [udsChannel]
+struct UDSSessionEcu udsModule;
+struct UDSEcu udsSessionEcu;  // [udsModule] as the UDS services the download code calls
+struct UDSStats udsStats;
+struct UDSStatsEcu udsTimed;  // [udsSessionEcu] with every request timed into [udsStats]
 char* vin;
 char* calID;
 struct UDSRequestDownload uds_transfer;
+char downloadPath[PATH_MAX];  // where a full download is spooled, in the working directory like conescan.db
+
+// J2534 -> every module at once, the scan has sessions of its own and
+// only runs while no download or identify is using [udsSessions]
+struct UDSJ2534 udsLink;
+struct UDSChannel udsChannel;
+struct VehicleScan vehicleScan;
+bool vehicleScanReported = false;
 
 // binary file for holding the ROM
 // this buffer can be modified with the
-// [rom_edit] editor
+// [rom_edit] editor, every write must go
+// through [rom] so dirty pages are tracked
 char* romFilePath = NULL;
+struct RomFile rom;
 unsigned char* romFile = NULL;
 long romFileLength = 0;
 
+// checksums of [rom] for definition.checksummodule, kept current on every write
+struct Checksum checksum;
+bool checksumReported = false;
+
+// definition checked against [rom], tables are only drawn once they pass
+struct TableCheck tableCheck;
+bool tableCheckReported = false;
+
+// reference image (stock or last flashed) the working ROM is compared against
+char* referenceRomPath = NULL;
+struct RomFile referenceRom;
+bool show_rom_diff_window = false;
+struct RomDiff romDiff;
+bool romDiffStale = true;
+int romDiffSelected = -1;
+
+// three way merge of [theirsRom] into the working ROM, the reference ROM is the base
+bool show_rom_merge_window = false;
+char* theirsRomPath = NULL;
+struct RomFile theirsRom;
+struct RomMerge romMerge;
+uint64_t romMergeOursHash;    // rom_file_hash() of the working ROM romMerge was computed from
+
+// other ROMs open read only against [definition], pages shared between them
+bool show_workspace_window = false;
+struct Workspace workspace;
+int pendingWorkingRom = -1;   // waiting on a save or discard of the working ROM
+
+// saved versions of the working ROM, reloaded from the db when stale
+bool show_tune_history_window = false;
+struct TuneVersion tuneHistory[64];
+int numTuneHistory = 0;
+bool tuneHistoryStale = true;
+char tuneMessage[TUNE_HISTORY_MESSAGE_MAX] = "";
+int tuneHistorySelected = -1;
+struct RomDiff tuneHistoryDiff;
+struct TuneCommit tuneCommit;  // the version being recorded, the list reloads once it's in
+
+// table windows showing a workspace ROM rather than the working one
+struct WorkspaceTable {
+  int rom;                     // index into workspace.roms
+  int table;                   // index into definition.tables
+};
+struct WorkspaceTable* workspaceTables = NULL;
+int numWorkspaceTables = 0;
+
 // ROM layout
 struct Definition definition;
 
 // Handles Parsing definitions
 struct DefinitionParse definition_parse;
 
+// category tree and search over definition.tables
+struct DefinitionIndex definitionIndex;
+char tableSearch[DEFINITION_INDEX_QUERY_MAX] = { 0 };
+
+// which table owns a ROM address, drives the [rom_edit] annotations
+struct AddressIndex addressIndex;
+// the memory editor's lookups, it colours and hovers byte by byte
+struct AddressCursor romEditCursor;
+
+// table editor window to bring to the front next frame, -1 for none
+int focusTable = -1;
+
+// decoded cells (and reference overlay) per table, opened with its editor window
+struct TableView* tableViews = NULL;
+
+// ROM search window state, results are highlighted in [rom_edit]
+bool show_rom_search_window = false;
+struct RomSearchResults romSearchResults;
+int romSearchType = ROM_SEARCH_BYTES;
+char romSearchText[128] = { 0 };
+double romSearchTolerance = 0.0;
+bool romSearchBigEndian = true;
+bool romSearchAligned = true;
+const char* romSearchError = NULL;   // why the last search didn't run
+
 /* Holds bools for each table */
 bool* tableSelect = NULL;
 
@@ -211,12 +326,336 @@ void deinitSelects()
     }
 }
 
-void closeRomFile()
+// checksums need both the ROM and the definition naming the module
+void startChecksum()
+{
+    checksum_close(&checksum);
+    checksumReported = false;
+    if(!romFile || !definition.checksummodule) return;
+    if(!checksum_open(&checksum, definition.checksummodule, &rom))
+        console.AddLog("Checksum module %s is not supported for this ROM", definition.checksummodule);
+}
+
+// table bounds and shapes need both the ROM and the definition too
+void startTableCheck()
+{
+    table_check_close(&tableCheck);
+    tableCheckReported = false;
+    if(!romFile || !definition.tables) return;
+    table_check_open(&tableCheck, &definition, romFile, romFileLength);
+}
+
+// builds everything derived from a freshly parsed definition
+void initDefinition()
+{
+    initSelects();
+    definition_index_build(&definitionIndex, &definition);
+    definition_index_search(&definitionIndex, tableSearch);
+    address_index_build(&addressIndex, &definition);
+    memset(&romEditCursor, 0, sizeof(romEditCursor));
+    tableViews = (struct TableView*)calloc(definition.numTables, sizeof(struct TableView));
+    assert(tableViews);
+    startChecksum();
+    startTableCheck();
+    romDiffStale = true;
+}
+
+// views hold decoded ROM values, they are rebuilt when their window is drawn
+void closeTableViews()
+{
+    if (!tableViews) return;
+    for (int i = 0; i < definition.numTables; i++)
+        table_view_close(&tableViews[i]);
+}
+
+void deinitDefinition()
+{
+    deinitSelects();
+    closeTableViews();
+    free(tableViews);
+    tableViews = NULL;
+    definition_index_free(&definitionIndex);
+    address_index_free(&addressIndex);
+    checksum_close(&checksum);
+    table_check_close(&tableCheck);
+    rom_merge_free(&romMerge);
+    numWorkspaceTables = 0;
+    rom_diff_free(&romDiff);
+    romDiffSelected = -1;
+    romDiffStale = true;
+}
+
+// opens a table editor window and focuses it
+void openTable(int table)
+{
+    if (!tableSelect || table < 0 || table >= definition.numTables) return;
+    tableSelect[table] = true;
+    focusTable = table;
+}
+
+// [rom_edit] tints every byte with the colour of the table that owns it
+static ImU32 romEditBgColor(const ImU8* data, size_t off)
+{
+    const struct AddressSpan* span = address_index_find(&addressIndex, &romEditCursor, off);
+    if (!span) return 0;
+    // golden ratio steps keep neighbouring tables apart in hue
+    float hue = span->table * 0.618034f;
+    hue -= (int)hue;
+    return ImColor::HSV(hue, 0.6f, 0.6f, span->axis < 0 ? 0.35f : 0.2f);
+}
+
+// "x 3, y 5" for 3D table data, the plain element index otherwise
+static void formatCell(char* buf, size_t size, struct Table* owner, int axis, unsigned long element)
+{
+    if (axis < 0 && owner->type && strcmp(owner->type, "3D") == 0 && owner->numTables == 2) {
+        // data is stored with the y axis varying fastest, see Render3DTable
+        struct Table* y = owner->swapxy ? &owner->tables[0] : &owner->tables[1];
+        int rows = y->elements > 0 ? y->elements : 1;
+        snprintf(buf, size, "x %lu, y %lu", element / rows, element % rows);
+    } else {
+        snprintf(buf, size, "%lu", element);
+    }
+}
+
+// [rom_edit] tooltip with the owning table, cell and scaled value
+static void romEditHover(const ImU8* data, size_t off)
+{
+    const struct AddressSpan* span = address_index_find(&addressIndex, &romEditCursor, off);
+    if (!span) return;
+    struct Table* owner = &definition.tables[span->table];
+    struct Table* table = address_span_table(&definition, span);
+    unsigned long element = (off - span->start) / span->cellSize;
+    unsigned long cell = span->start + element * span->cellSize;
+
+    ImGui::BeginTooltip();
+    ImGui::Text("%s", owner->name);
+    if (span->axis >= 0)
+        ImGui::TextDisabled("%s: %s", table->type ? table->type : "Axis", table->name);
+    char label[64];
+    formatCell(label, sizeof(label), owner, span->axis, element);
+    ImGui::Text("Cell: %s", label);
+    ImGui::Text("Address: 0x%06lX", cell);
+    double value;
+    if (cell + span->cellSize > (unsigned long)romFileLength) {
+        ImGui::TextDisabled("Value: past the end of the ROM");
+    } else if (definition_read_scaled(table->Scaling, data, cell, &value)) {
+        ImGui::Text("Value: %g %s", value, (table->Scaling && table->Scaling->units) ? table->Scaling->units : "");
+    } else {
+        ImGui::TextDisabled("Value: %g (raw, bad toexpr)", definition_read_raw(table->Scaling, data, cell));
+    }
+    ImGui::TextDisabled("Double-click to open the table");
+    ImGui::EndTooltip();
+
+    if (ImGui::IsMouseDoubleClicked(0))
+        openTable(span->table);
+}
+
+// every edit to the ROM goes through here so checksums and dirty pages follow it
+void romWrite(unsigned long offset, const void* data, size_t length)
+{
+    // the table check reads axis values from the image
+    table_check_wait(&tableCheck);
+    checksum_update(&checksum, offset, romFile + offset, (const unsigned char*)data, length);
+    rom_file_write(&rom, offset, data, length);
+    romDiffStale = true;
+
+    // only the cells written are decoded again by their table views
+    if (!tableViews) return;
+    struct AddressCursor cursor;
+    memset(&cursor, 0, sizeof(cursor));
+    unsigned long end = offset + length;
+    for (unsigned long address = offset; address < end;) {
+        const struct AddressSpan* span = address_index_find(&addressIndex, &cursor, address);
+        if (!span) {
+            address = address_index_gap_end(&addressIndex, &cursor, address, end);
+            continue;
+        }
+        unsigned long element = (address - span->start) / span->cellSize;
+        if (span->axis < 0) table_view_mark(&tableViews[span->table], element);
+        else if (span->axis < 2) table_view_mark_axes(&tableViews[span->table]);
+        address = span->start + (element + 1) * span->cellSize;
+    }
+}
+
+// rewrites every wrong stored checksum through romWrite so views and the diff see it
+int fixChecksums()
+{
+    if (!checksum.module) return 0;
+    checksum_wait(&checksum);
+    int fixed = 0;
+    for (int i = 0; i < checksum.numRanges; i++) {
+        if (checksum_range_valid(&checksum, &rom, i)) continue;
+        unsigned char bytes[4];
+        checksum_range_value(&checksum, i, bytes);
+        romWrite(checksum.ranges[i].valueAddress, bytes, 4);
+        fixed++;
+    }
+    return fixed;
+}
+
+// [rom_edit] edits land in copy-on-write pages and mark them dirty
+static void romEditWrite(ImU8* data, size_t off, ImU8 d)
+{
+    romWrite(off, &d, 1);
+}
+
+// [rom_edit] highlights every search match
+static bool romEditSearchHighlight(const ImU8* data, size_t off)
+{
+    return rom_search_results_contains(&romSearchResults, off);
+}
+
+void closeReferenceRom()
 {
-  if(romFile) {
-    free(romFile);
-    romFile = NULL;
+  // the reference is the merge base
+  rom_merge_free(&romMerge);
+  rom_file_close(&theirsRom);
+  if(tableViews) {
+    for(int i = 0; i < definition.numTables; i++) {
+      if(table_view_is_open(&tableViews[i])) table_view_set_reference(&tableViews[i], NULL, 0);
+    }
+  }
+  rom_file_close(&referenceRom);
+  rom_diff_free(&romDiff);
+  romDiffSelected = -1;
+  if(referenceRomPath) {
+    free(referenceRomPath);
+    referenceRomPath = NULL;
+  }
+}
+
+// the image now in [referenceRom] came from [path]
+static void referenceRomLoaded(const char* path)
+{
+  size_t len = strlen(path);
+  referenceRomPath = (char*)malloc(len + 1);
+  assert(referenceRomPath);
+  memcpy(referenceRomPath, path, len + 1);
+  romDiffStale = true;
+  if(tableViews) {
+    for(int i = 0; i < definition.numTables; i++) {
+      if(table_view_is_open(&tableViews[i]))
+        table_view_set_reference(&tableViews[i], referenceRom.data, referenceRom.length);
+    }
+  }
+  console.AddLog("Comparing against reference rom %s", path);
+}
+
+void loadReferenceRom(const char* path)
+{
+  closeReferenceRom();
+  if(!rom_file_open(&referenceRom, path)) {
+    console.AddLog("IO error opening reference rom %s %s", path, strerror(errno));
+    return;
+  }
+  referenceRomLoaded(path);
+}
+
+void closeMerge()
+{
+  rom_merge_free(&romMerge);
+  rom_file_close(&theirsRom);
+  if(theirsRomPath) {
+    free(theirsRomPath);
+    theirsRomPath = NULL;
+  }
+}
+
+// merges [path] into the working ROM against the reference ROM
+void startMerge(const char* path)
+{
+  closeMerge();
+  if(!rom_file_open(&theirsRom, path)) {
+    console.AddLog("IO error opening rom %s %s", path, strerror(errno));
+    return;
+  }
+  if(theirsRom.length != romFileLength || referenceRom.length != romFileLength) {
+    console.AddLog("[Merge] %s is %ld bytes, the working and reference ROMs are %ld and %ld",
+                   path, theirsRom.length, romFileLength, referenceRom.length);
+    rom_file_close(&theirsRom);
+    return;
+  }
+  size_t len = strlen(path);
+  theirsRomPath = (char*)malloc(len + 1);
+  assert(theirsRomPath);
+  memcpy(theirsRomPath, path, len + 1);
+
+  rom_merge(&romMerge, referenceRom.data, romFile, theirsRom.data, romFileLength,
+            definition.tables ? &definition : NULL, &addressIndex);
+  romMergeOursHash = rom_file_hash(&rom);
+  console.AddLog("[Merge] %ld cells from ours, %ld from theirs, %ld conflicts (%0.1f us)",
+                 romMerge.oursCells, romMerge.theirsCells, romMerge.numConflicts, romMerge.microseconds);
+}
+
+// merges again against the working ROM as it is now, edits made while the
+// merge window was open are ours too; conflicts at the same address keep
+// the side picked for them, returns the number that are new
+static long remergeEdited()
+{
+  struct RomMerge previous = romMerge;
+  memset(&romMerge, 0, sizeof(romMerge));
+  rom_merge(&romMerge, referenceRom.data, romFile, theirsRom.data, romFileLength,
+            definition.tables ? &definition : NULL, &addressIndex);
+  romMergeOursHash = rom_file_hash(&rom);
+
+  // both lists are in address order
+  long added = 0;
+  long p = 0;
+  for(long i = 0; i < romMerge.numConflicts; i++) {
+    struct RomMergeConflict* conflict = &romMerge.conflicts[i];
+    while(p < previous.numConflicts && previous.conflicts[p].address < conflict->address) p++;
+    if(p < previous.numConflicts && previous.conflicts[p].address == conflict->address &&
+       previous.conflicts[p].size == conflict->size)
+      rom_merge_resolve(&romMerge, i, previous.conflicts[p].choice, referenceRom.data, romFile, theirsRom.data);
+    else
+      added++;
+  }
+  rom_merge_free(&previous);
+  return added;
+}
+
+// writes the merge result over the working ROM, only the bytes that change
+void applyMerge()
+{
+  if(rom_file_hash(&rom) != romMergeOursHash) {
+    long added = remergeEdited();
+    if(added > 0) {
+      console.AddLog("[Merge] the working ROM changed since the merge started, %ld new conflict%s to review",
+                     added, added == 1 ? "" : "s");
+      return;
+    }
   }
+
+  struct RomDiffRange* ranges = NULL;
+  long capacity = 0;
+  long count = rom_diff_ranges(romFile, romFileLength, romMerge.result, romMerge.length, &ranges, &capacity);
+  unsigned long bytes = 0;
+  for(long i = 0; i < count; i++) {
+    romWrite(ranges[i].start, romMerge.result + ranges[i].start, ranges[i].end - ranges[i].start);
+    bytes += ranges[i].end - ranges[i].start;
+  }
+  free(ranges);
+  console.AddLog("[Merge] applied %s, %lu bytes in %ld ranges changed", theirsRomPath, bytes, count);
+  closeMerge();
+}
+
+void closeRomFile()
+{
+  romSearchResults.count = 0;
+  checksum_close(&checksum);
+  table_check_close(&tableCheck);
+  rom_diff_free(&romDiff);
+  romDiffSelected = -1;
+  romDiffStale = true;
+  rom_diff_free(&tuneHistoryDiff);
+  tuneHistorySelected = -1;
+  numTuneHistory = 0;
+  tuneHistoryStale = true;
+  closeTableViews();
+  closeMerge();
+  rom_file_close(&rom);
+  romFile = NULL;
+  romFileLength = 0;
   if(romFilePath) {
     free(romFilePath);
     romFilePath = NULL;
@@ -238,53 +677,93 @@ bool setRomFilePath(char* path)
     return false;
 }
 
+static void romFileLoaded(void);
+
 void loadRomFile(void)
 {
   if(!romFilePath) return;
-  if(romFile) {
-    free(romFile);
-    romFile = NULL;
-  }
+  rom_file_close(&rom);
+  romFile = NULL;
+  romFileLength = 0;
+
+  // finish a save that was interrupted last time
+  if(!rom_save_recover(romFilePath))
+    console.AddLog("IO error recovering unfinished save of %s %s", romFilePath, strerror(errno));
 
-  FILE* fp = fopen(romFilePath, "rb");
-  int length = 0;
-  if(!fp) {
-    console.AddLog("Failed to open %s for reading", romFilePath);
+  if(!rom_file_open(&rom, romFilePath)) {
+    console.AddLog("IO error opening rom %s %s", romFilePath, strerror(errno));
     free(romFilePath);
     romFilePath = NULL;
     return;
   }
+  console.AddLog("%s %ld bytes from %s", rom.backing == ROM_FILE_MAPPED ? "Mapped" : "Read",
+                 rom.length, romFilePath);
+  romFileLoaded();
+}
 
-  if (fseek(fp, 0, SEEK_END)) goto io_error;
-  length = ftell(fp);
-  if(!(length > 0)) goto io_error;
-  rewind(fp);
-
-  romFile = (unsigned char*)malloc(length);
-  assert(romFile);
-  romFileLength = length;
-  if(!romFile) goto io_error;
-  fread(romFile, 1, length, fp);
-  console.AddLog("Read %d bytes from %s", length, romFilePath);
+// the image now in [rom] is the working ROM at [romFilePath]
+static void romFileLoaded(void)
+{
+  romFile = rom.data;
+  romFileLength = rom.length;
+
+  uint64_t savedHash;
+  long savedLength;
+  if(conescan_db_load_rom_hash(&db, romFilePath, &savedHash, &savedLength) &&
+     (savedLength != rom.length || savedHash != rom_file_hash(&rom)))
+    console.AddLog("%s was modified outside of ConeScan since it was last saved", romFilePath);
   addRomFileToHistory(romFilePath);
-  return;
+  startChecksum();
+  startTableCheck();
 
-io_error:
-  console.AddLog("IO error opening rom %s %s", romFilePath, strerror(errno));
-  free(romFilePath);
-  romFilePath = NULL;
-  return;
+  // the image as opened is where its history starts, a no-op when it matches the last version
+  tune_commit_start(&tuneCommit, &db, romFilePath, rom.data, rom.length, referenceRom.data, referenceRom.length, NULL);
+  tuneHistoryStale = true;
+}
+
+// saves the open ROM to [path], in place if it's the file that was opened
+bool saveRomFile(char* path)
+{
+  struct RomSaveResult result;
+  bool inPlace = strcmp(path, romFilePath) == 0;
+  int fixed = fixChecksums();
+  if(fixed) console.AddLog("Corrected %d checksum%s before saving", fixed, fixed == 1 ? "" : "s");
+  bool ok = inPlace ? rom_save(&rom, path, &result) : rom_save_as(&rom, path, &result);
+  if(!ok) {
+    console.AddLog("IO error saving rom %s %s", path, strerror(errno));
+    return false;
+  }
+  conescan_db_save_rom_hash(&db, path, result.hash, rom.length);
+  tune_commit_start(&tuneCommit, &db, path, rom.data, rom.length, referenceRom.data, referenceRom.length, tuneMessage);
+  tuneMessage[0] = 0;
+  tuneHistoryStale = true;
+  console.AddLog("Saved %ld bytes in %ld ranges to %s (hash %016llx)", result.bytes, result.ranges,
+                 path, (unsigned long long)result.hash);
+
+  if(!inPlace) {
+    free(romFilePath);
+    romFilePath = NULL;
+    setRomFilePath(path);
+    addRomFileToHistory(romFilePath);
+  }
+  return true;
+}
+
+static void definitionLog(void* context, const char* message)
+{
+  ((ConeScan::Console*)context)->AddLog("%s", message);
 }
 
 void ConeScan::Init(void)
 {
   memset(&definition, 0, sizeof(struct Definition));
   memset((void*)&definition_parse, 0, sizeof(struct DefinitionParse));
-  definition_parse.console = &console;
+  definition_parse.log = definitionLog;
+  definition_parse.logContext = &console;
   definition_parse.metadataFile = NULL;
   definition_parse.metadataFilePath = NULL;
 
-  memset(&uds_transfer, 0, sizeof(struct UDSRequestDownload));
+  workspace_init(&workspace);
   memset(&db, 0, sizeof(struct ConeScanDB));
   conescan_db_open(&db, db_path);
 
@@ -331,6 +810,17 @@ void ConeScan::Init(void)
   else {
       j2534InitOK = true;
       ecu = new RX8(&j2534, devID, chanID);
+      uds_ecu_rx8(&udsEcu, ecu);
+      udsLink.j2534 = &j2534;
+      udsLink.channel = chanID;
+      uds_channel_j2534(&udsChannel, &udsLink);
+      // downloads and identify go through the channel's batching like the scan
+      uds_session_open(&udsSessions, &udsChannel, UDS_SESSION_FIRST_ID, 1);
+      udsModule.manager = &udsSessions;
+      udsModule.session = &udsSessions.sessions[0];
+      udsModule.keys = &udsEcu;
+      uds_ecu_session(&udsSessionEcu, &udsModule);
+      uds_stats_wrap(&udsTimed, &udsSessionEcu, &udsStats);
   }
 
   rom_edit.Open = false;
@@ -338,6 +828,11 @@ void ConeScan::Init(void)
   rom_edit.OptShowDataPreview = true;
   rom_edit.PreviewDataType = ImGuiDataType_Float;
   rom_edit.PreviewEndianess = 1;
+  rom_edit.BgColorFn = romEditBgColor;
+  rom_edit.HoverFn = romEditHover;
+  rom_edit.HighlightFn = romEditSearchHighlight;
+  rom_edit.WriteFn = romEditWrite;
+  rom_search_results_init(&romSearchResults);
 }
 
 void RenderDefinitionInfo()
@@ -376,9 +871,36 @@ void RenderDefinitionInfo()
     }
 
     ImGui::Text("Checksum Module: ");
-    if(definition.memmodel) {
+    if(definition.checksummodule) {
       ImGui::SameLine(); 
       ImGui::TextColored(valueColor, definition.checksummodule);
+      if(checksum.module) {
+        int invalid = checksum_invalid(&checksum, &rom);
+        ImGui::SameLine();
+        if(invalid < 0)
+          ImGui::TextColored(valueColor, "(verifying)");
+        else if(invalid == 0)
+          ImGui::TextColored(ImVec4(0.4f, 0.9f, 0.4f, 1.0f), "(%d ranges ok)", checksum.numRanges);
+        else
+          ImGui::TextColored(ImVec4(0.9f, 0.4f, 0.4f, 1.0f), "(%d of %d ranges wrong)", invalid, checksum.numRanges);
+      }
+    }
+
+    ImGui::Text("Tables: ");
+    if(tableCheck.numTables) {
+      ImGui::SameLine();
+      if(!table_check_ready(&tableCheck))
+        ImGui::TextColored(valueColor, "(checking against the ROM)");
+      else if(tableCheck.outOfBounds + tableCheck.badShape == 0)
+        ImGui::TextColored(ImVec4(0.4f, 0.9f, 0.4f, 1.0f), "(%d fit the ROM)", tableCheck.numTables);
+      else
+        ImGui::TextColored(ImVec4(0.9f, 0.4f, 0.4f, 1.0f), "(%d out of bounds, %d bad shape)",
+                           tableCheck.outOfBounds, tableCheck.badShape);
+      if(table_check_ready(&tableCheck) && tableCheck.notMonotonic + tableCheck.overlapping) {
+        ImGui::SameLine();
+        ImGui::TextColored(valueColor, "%d axes not monotonic, %d overlapping",
+                           tableCheck.notMonotonic, tableCheck.overlapping);
+      }
     }
 
     ImGui::Text("Year: ");
@@ -423,12 +945,14 @@ void RenderDefinitionInfo()
 
 void RenderScalings()
 {
-  char buffer[64] = {0};
   ImVec4 valueColor(0.5f, 0.5f, 0.5f, 1.0f);
   if (ImGui::TreeNode("Scalings")) {
-    for(int i = 0; i < definition.numScalings; i++) {
-      sprintf(buffer, "%s##%d", definition.scalings[i].name, i);
-      ImGui::TextColored(valueColor, buffer);
+    ImGuiListClipper clipper;
+    clipper.Begin(definition.numScalings);
+    while (clipper.Step()) {
+      for(int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+        ImGui::TextColored(valueColor, "%s", definition.scalings[i].name ? definition.scalings[i].name : "");
+      }
     }
     ImGui::TreePop();
   }
@@ -469,28 +993,35 @@ void Render2DTable(struct Table* table)
   }
 }
 
-void tableCopyF32(float* value, unsigned char* data, unsigned long address)
+// cell background for the reference overlay, red above the reference and blue below
+static ImU32 overlayColor(float heat)
 {
-    assert(value); assert(data);
-    *((unsigned char*)(value) + 3) = data[address];
-    *((unsigned char*)(value) + 2) = data[address + 1];
-    *((unsigned char*)(value) + 1) = data[address + 2];
-    *((unsigned char*)(value) + 0) = data[address + 3];
+  if (heat >= 0.0f)
+    return ImGui::GetColorU32(ImVec4(0.25f + 0.6f * heat, 0.25f, 0.25f, 0.65f));
+  return ImGui::GetColorU32(ImVec4(0.25f, 0.25f, 0.25f - 0.6f * heat, 0.65f));
 }
 
-void Render3DTable(struct Table* table, struct cellState* cellIndex) 
+// cell values come from [view], decoded when the table was opened or its bytes were written
+void Render3DTable(struct Table* table, struct cellState* cellIndex, struct TableView* view) 
 {
   assert(romFile);
   assert(table);
+  assert(view);
   assert(table->numTables == 2);
   struct Table* x;
   struct Table* y;
+  const double* xValues;
+  const double* yValues;
   if(table->swapxy) {
     x = &table->tables[1];
     y = &table->tables[0];
+    xValues = view->axes[1];
+    yValues = view->axes[0];
   } else {
     x = &table->tables[0];
     y = &table->tables[1];
+    xValues = view->axes[0];
+    yValues = view->axes[1];
   }
   assert(x->elements == 10);
   assert(y->elements == 18);
@@ -517,12 +1048,11 @@ void Render3DTable(struct Table* table, struct cellState* cellIndex)
     cellIndex += sizeof(struct cellState);
 
     // 0,1 - 0,xelements
-    for(int xi = 1; xi < x->elements+1; xi++,x_axis_address+=4) {
-      tableCopyF32(&cellIndex->value.f32, romFile, x_axis_address);
+    for(int xi = 1; xi < x->elements+1; xi++) {
       assert(x->Scaling);
 
       // 0,xi
-      sprintf(buffer, "%0.2F##3d-x-%d", cellIndex->value.f32, xi);
+      sprintf(buffer, "%0.2F##3d-x-%d", xValues[xi - 1], xi);
       ImGui::TableSetupColumn(buffer, ImGuiTableColumnFlags_WidthFixed, TEXT_BASE_WIDTH);
       cellIndex += sizeof(struct cellState);
     }
@@ -537,8 +1067,7 @@ void Render3DTable(struct Table* table, struct cellState* cellIndex)
       ImGui::TableSetColumnIndex(0);
       ImU32 row_bg_color = ImGui::GetColorU32(ImVec4(0.2f, 0.2f, 0.2f, 0.65f));
       ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, row_bg_color);
-      tableCopyF32(&cellIndex->value.f32, romFile, y_axis_address);
-      sprintf(buffer, "%0.2F##3d-y-%d", cellIndex->value.f32, yi);
+      sprintf(buffer, "%0.2F##3d-y-%d", yValues[yo], yi);
       ImGui::Selectable(buffer, &cellIndex->selected, 0, ImVec2(0.0, 0.0));
       if (cellIndex->selected) {
           rom_edit.GotoAddrAndHighlight(y_axis_address, y_axis_address+ 4);
@@ -556,12 +1085,21 @@ void Render3DTable(struct Table* table, struct cellState* cellIndex)
               xi++)
       {
         ImGui::TableSetColumnIndex(xi);
-        tableCopyF32(&cellIndex->value.f32, romFile, base);
-        sprintf(buffer, "%0.2F##3d-xy-%d%d", cellIndex->value.f32, xi, yi);
+        // data is stored with the y axis varying fastest
+        unsigned long element = (unsigned long)(xi - 1) * y->elements + yo;
+        double value = view->values[element];
+        sprintf(buffer, "%0.2F##3d-xy-%d%d", value, xi, yi);
         ImU32 cell_bg_color;
-        if(cellIndex->value.f32 < 33.33) {
+        if(view->reference && view->overlay != TABLE_OVERLAY_NONE) {
+          double delta = view->delta[element];
+          if(view->overlay == TABLE_OVERLAY_PERCENT)
+            sprintf(buffer, "%+0.1F%%##3d-xy-%d%d", delta, xi, yi);
+          else
+            sprintf(buffer, "%+0.2F##3d-xy-%d%d", delta, xi, yi);
+          cell_bg_color = overlayColor(table_view_heat(view, element));
+        } else if(value < 33.33) {
          cell_bg_color = ImGui::GetColorU32(ImVec4(0.0f, 0.8f, 0.0f, 0.65f));
-        } else if(cellIndex->value.f32 < 66.66) {
+        } else if(value < 66.66) {
          cell_bg_color = ImGui::GetColorU32(ImVec4(0.0f, 0.0f, 0.8f, 0.65f));
         } else {
          cell_bg_color = ImGui::GetColorU32(ImVec4(0.8f, 0.0f, 0.0f, 0.65f));
@@ -587,28 +1125,88 @@ void RenderTables()
 {
   char buffer[120] = {0};
   if (ImGui::TreeNode("Tables")) {
-    for(int i = 0; i < definition.numTables; i++) {
-      sprintf(buffer, "%s##%d", definition.tables[i].name, i);
-      if(romFile) {
-        ImGui::Selectable(buffer, &tableSelect[i]);
-      } else {
-        ImGui::TextDisabled(buffer);
+    ImGui::SetNextItemWidth(-FLT_MIN);
+    if (ImGui::InputTextWithHint("##tablesearch", "Search tables and categories", tableSearch, IM_ARRAYSIZE(tableSearch)))
+      definition_index_search(&definitionIndex, tableSearch);
+
+    // only the visible rows of the category tree are emitted
+    int toggled = -1;
+    ImGuiListClipper clipper;
+    clipper.Begin(definitionIndex.numRows);
+    while (clipper.Step()) {
+      for(int r = clipper.DisplayStart; r < clipper.DisplayEnd; r++) {
+        int row = definitionIndex.rows[r];
+        ImGui::PushID(row);
+        if(row < 0) {
+          int c = -row - 1;
+          ImGui::SetNextItemOpen(definitionIndex.categoryOpen[c], ImGuiCond_Always);
+          bool open = ImGui::TreeNodeEx("##category", ImGuiTreeNodeFlags_NoTreePushOnOpen, "%s (%d)",
+                                        definitionIndex.categories[c], definitionIndex.categoryMatches[c]);
+          if(open != definitionIndex.categoryOpen[c]) toggled = c;
+        } else {
+          ImGui::Indent();
+          if(romFile && table_check_ready(&tableCheck) && !table_check_renderable(&tableCheck, row)) {
+            ImGui::TextDisabled("%s", definition.tables[row].name);
+            if(ImGui::IsItemHovered()) {
+              char reason[256];
+              table_check_describe(&tableCheck, &definition, row, reason, sizeof(reason));
+              ImGui::SetTooltip("%s", reason);
+            }
+          } else if(romFile) {
+            ImGui::Selectable(definition.tables[row].name, &tableSelect[row]);
+          } else {
+            ImGui::TextDisabled("%s", definition.tables[row].name);
+          }
+          ImGui::Unindent();
+        }
+        ImGui::PopID();
       }
     }
+    // rows change when a category opens, so apply it after the clipper is done
+    if(toggled >= 0)
+      definition_index_set_open(&definitionIndex, toggled, !definitionIndex.categoryOpen[toggled]);
     ImGui::TreePop();
   }
 
-  // TODO: load into categories
   long j = 0;
   for(int i = 0; i < definition.numTables; i++) {
     if(tableSelect[i]) {
       ImGui::SetNextWindowSize(ImVec2(655, 420), ImGuiCond_FirstUseEver);
+      if(focusTable == i) {
+        ImGui::SetNextWindowFocus();
+        focusTable = -1;
+      }
       sprintf(buffer, "Table Editor %s##%d", definition.tables[i].name, i);
       ImGui::Begin(buffer, &tableSelect[i], ImGuiWindowFlags_MenuBar);
 
+      // the renderers index the ROM directly, only tables that passed the check are drawn
+      if(!table_check_renderable(&tableCheck, i)) {
+        char reason[256];
+        table_check_describe(&tableCheck, &definition, i, reason, sizeof(reason));
+        if(table_check_ready(&tableCheck))
+          ImGui::TextColored(ImVec4(0.9f, 0.4f, 0.4f, 1.0f), "%s does not fit this ROM: %s", definition.tables[i].name, reason);
+        else
+          ImGui::TextDisabled("Checking %s against the ROM", definition.tables[i].name);
+        ImGui::End();
+        continue;
+      }
+
+      struct TableView* view = &tableViews[i];
+      if(!table_view_is_open(view))
+        table_view_open(view, &definition.tables[i], romFile, romFileLength, referenceRom.data, referenceRom.length);
+      table_view_refresh(view, romFile, romFileLength);
+
       if(ImGui::BeginMenuBar()) {
         if (ImGui::BeginMenu("Options")) {
           if(ImGui::MenuItem("Enable Memory Editor", NULL, &rom_edit.Open, true));
+          ImGui::Separator();
+          bool hasReference = view->reference != NULL;
+          if(ImGui::MenuItem("Values", NULL, view->overlay == TABLE_OVERLAY_NONE))
+            table_view_set_overlay(view, TABLE_OVERLAY_NONE);
+          if(ImGui::MenuItem("Delta from Reference", NULL, view->overlay == TABLE_OVERLAY_DELTA, hasReference))
+            table_view_set_overlay(view, TABLE_OVERLAY_DELTA);
+          if(ImGui::MenuItem("Percent from Reference", NULL, view->overlay == TABLE_OVERLAY_PERCENT, hasReference))
+            table_view_set_overlay(view, TABLE_OVERLAY_PERCENT);
           ImGui::EndMenu();
         }
         ImGui::EndMenuBar();
@@ -624,7 +1222,7 @@ void RenderTables()
       ImGui::Text(buffer);
       assert(definition.tables[i].type);
       if(strcmp(definition.tables[i].type, "3D") == 0) {
-        Render3DTable(&definition.tables[i], &cellValues[j]);
+        Render3DTable(&definition.tables[i], &cellValues[j], view);
         j += definition.tables[i].elements;
         j += definition.tables[i].tables[0].elements;
         j += definition.tables[i].tables[1].elements;
@@ -658,14 +1256,14 @@ void RenderMenu(bool* exit_requested)
             free(tmp);
             if (loadMetadataFile(&definition_parse, &definition)) {
                 addMetadataFileToHistory(definition_parse.metadataFilePath);
-                initSelects();
+                initDefinition();
             }
           } 
         }
       } else {
         if (ImGui::MenuItem("close metadata file", NULL)) {
           closeMetadataFile(&definition_parse, &definition);
-          deinitSelects();
+          deinitDefinition();
         }
       }
       ImGui::Separator();
@@ -677,10 +1275,10 @@ void RenderMenu(bool* exit_requested)
         if(ImGui::MenuItem(metadataFilePathHistory[i], NULL)) {
           // close the file if it was open
           closeMetadataFile(&definition_parse, &definition);
-          deinitSelects();
+          deinitDefinition();
           setMetadataFilePath(&definition_parse, metadataFilePathHistory[i]);
           if (loadMetadataFile(&definition_parse, &definition)) {
-              initSelects();
+              initDefinition();
           }
         }
       }
@@ -693,15 +1291,26 @@ void RenderMenu(bool* exit_requested)
             closeRomFile();
             char* tmp = getFileOpenPath(NULL , false);
             if (tmp) {
-                if (setRomFilePath(tmp)) {
+                if (setRomFilePath(tmp))
                     loadRomFile();
-                    addRomFileToHistory(romFilePath);
-                    loadRomFile();
-                }
                 free(tmp);
             }
           } 
       } else {
+        if (ImGui::MenuItem("Save ROM", NULL, false, rom.numDirty > 0)) {
+            saveRomFile(romFilePath);
+        }
+        if (ImGui::MenuItem("Fix Checksums", NULL, false, checksum_invalid(&checksum, &rom) > 0)) {
+            int fixed = fixChecksums();
+            console.AddLog("Corrected %d checksum%s", fixed, fixed == 1 ? "" : "s");
+        }
+        if (ImGui::MenuItem("Save ROM As...", NULL)) {
+            char* tmp = getFileSavePath(NULL);
+            if (tmp) {
+                saveRomFile(tmp);
+                free(tmp);
+            }
+        }
         if (ImGui::MenuItem("Close ROM file", NULL)) {
             closeRomFile();
         }
@@ -723,6 +1332,31 @@ void RenderMenu(bool* exit_requested)
 
       if(ImGui::MenuItem("Show ImGui Demo", NULL, &show_demo_window));
       if(ImGui::MenuItem("Show Console", NULL, &show_console_window));
+      if(ImGui::MenuItem("Search ROM", NULL, &show_rom_search_window, romFile != NULL));
+
+      ImGui::Separator();
+      if(ImGui::MenuItem("Open Reference ROM...", NULL)) {
+        char* tmp = getFileOpenPath(NULL, false);
+        if(tmp) {
+          loadReferenceRom(tmp);
+          free(tmp);
+          show_rom_diff_window = referenceRom.data != NULL;
+        }
+      }
+      if(ImGui::MenuItem("Close Reference ROM", NULL, false, referenceRom.data != NULL)) closeReferenceRom();
+      if(ImGui::MenuItem("Compare with Reference", NULL, &show_rom_diff_window, romFile && referenceRom.data));
+      if(ImGui::MenuItem("Merge into ROM...", NULL, &show_rom_merge_window, romFile && referenceRom.data));
+      if(ImGui::MenuItem("Workspace", NULL, &show_workspace_window));
+      if(ImGui::MenuItem("Tune History", NULL, &show_tune_history_window, romFile != NULL));
+#ifdef CONESCAN_PROFILER
+      if(ImGui::MenuItem("Show Profiler", NULL, &show_profiler_window));
+#endif
+
+      if (ImGui::BeginMenu("Power Saving")) {
+        ImGui::MenuItem("Idle when inactive", NULL, &idle_config.enabled);
+        ImGui::SliderInt("Background refresh", &idle_config.backgroundRate, 1, 60, "%d Hz");
+        ImGui::EndMenu();
+      }
 
       ImGui::Separator();
       if (ImGui::MenuItem("Delete History", NULL)) {
@@ -744,7 +1378,8 @@ void RenderMenu(bool* exit_requested)
 
     if (ImGui::BeginMenu("ECU")) {
         bool allowSaveRom = false;
-        if (uds_transfer.payload && (uds_transfer.downloadinProgress == false)) allowSaveRom = true;
+        // a sparse read isn't a whole ROM
+        if (uds_transfer.payload && !uds_transfer.numRanges && uds_request_state(&uds_transfer) == UDS_REQUEST_DONE) allowSaveRom = true;
 
         if (ImGui::MenuItem("Save Rom", NULL, false, allowSaveRom)) {
             //uds_transfer.payload
@@ -756,7 +1391,6 @@ void RenderMenu(bool* exit_requested)
             char* defaultFileName = (char*)malloc(strnlen(vin, 18) + strnlen(calID, 20) + 7);
             assert(defaultFileName);
             char  fullPath[PATH_MAX] = { 0 };
-            FILE* outFile = NULL;
 
             assert(defaultFileName);
             memset(defaultFileName, 0, strnlen(vin, PATH_MAX) + strnlen(calID, 20) + 7);
@@ -777,18 +1411,17 @@ void RenderMenu(bool* exit_requested)
 #endif
             strncpy(fullPath + strlen(path) + 1, defaultFileName, strlen(defaultFileName));
 
-            int rc;
             console.AddLog("[UDS] Saving transfer to %s (default='%s')", path, defaultFileName);
-            outFile = fopen(fullPath, "wb");
-            if (!outFile) goto cleanup;
             assert(uds_transfer.payload);
-            rc = fwrite(uds_transfer.payload, 1, uds_transfer.transferBytes, outFile);
-            if (rc != 1) goto cleanup;
-            
-            fflush(outFile);
-            console.AddLog("[UDS] Transfer saved to %s", path);
+            if (!rom_save_buffer(fullPath, (const unsigned char*)uds_transfer.payload, uds_transfer.transferBytes.load())) {
+                console.AddLog("[UDS] IO error saving transfer to %s %s", fullPath, strerror(errno));
+                goto cleanup;
+            }
+            conescan_db_save_rom_hash(&db, fullPath,
+                                      rom_file_hash_buffer((const unsigned char*)uds_transfer.payload, uds_transfer.transferBytes.load()),
+                                      uds_transfer.transferBytes.load());
+            console.AddLog("[UDS] Transfer saved to %s", fullPath);
         cleanup:
-            if (outFile) fclose(outFile);
             if (path) free(path);
             if (defaultFileName) free(defaultFileName);
         }
@@ -798,6 +1431,134 @@ void RenderMenu(bool* exit_requested)
   }
 }
 
+// the ECU image was streamed to disk and hashed while it downloaded,
+// all that is left is recording it and checking it against the definition
+static void downloadFinished()
+{
+    if (uds_request_state(&uds_transfer) != UDS_REQUEST_DONE || !uds_transfer.hashed) return;
+    console.AddLog("[UDS] ROM hash %016" PRIx64, uds_transfer.hash);
+    if (uds_transfer.spooled)
+        conescan_db_save_rom_hash(&db, uds_transfer.spoolPath, uds_transfer.hash, (long)uds_transfer.transferSize);
+    if (definition.internalidstring) {
+        size_t length = strlen(definition.internalidstring);
+        bool matches = definition.internalidaddress + length <= uds_transfer.transferSize &&
+                       memcmp(uds_transfer.payload + definition.internalidaddress, definition.internalidstring, length) == 0;
+        console.AddLog("[UDS] ROM %s the open definition %s", matches ? "matches" : "does not match",
+                       definition.xmlid ? definition.xmlid : definition.internalidstring);
+    }
+}
+
+// where the time of each UDS service goes, to tell a slow adapter from a slow ECU
+static void RenderTransportStats()
+{
+    if (!ImGui::CollapsingHeader("Transport"))
+        return;
+    if (ImGui::BeginTable("uds_stats", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        const char* columns[] = { "Service", "Count", "Mean ms", "p50 ms", "p90 ms", "p99 ms", "Max ms" };
+        for (int i = 0; i < IM_ARRAYSIZE(columns); i++)
+            ImGui::TableSetupColumn(columns[i]);
+        ImGui::TableHeadersRow();
+        for (int s = 0; s < UDS_SERVICE_COUNT; s++) {
+            const struct UDSHistogram* histogram = &udsStats.services[s];
+            uint32_t count = histogram->count.load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            double mean = histogram->totalMicros.load(std::memory_order_relaxed) / (double)count;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(uds_stats_service_name((enum UDSService)s));
+            ImGui::TableNextColumn(); ImGui::Text("%u", count);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", mean / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", uds_stats_percentile(histogram, 0.50) / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", uds_stats_percentile(histogram, 0.90) / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", uds_stats_percentile(histogram, 0.99) / 1000.0);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", histogram->maxMicros.load(std::memory_order_relaxed) / 1000.0);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text("%u requests, %u negative responses, %u timeouts, %u retries",
+                udsStats.requests.load(), udsStats.negative.load(), udsStats.timeouts.load(), udsStats.retries.load());
+    ImGui::Text("%llu bytes sent, %llu received, %llu frames",
+                (unsigned long long)udsStats.bytesSent.load(), (unsigned long long)udsStats.bytesReceived.load(),
+                (unsigned long long)udsStats.frames.load());
+    if (ImGui::Button("Reset"))
+        uds_stats_reset(&udsStats);
+    ImGui::SameLine();
+    if (ImGui::Button("Export CSV")) {
+        char defaultName[] = "uds_stats.csv";
+        char* path = getFileSavePath(defaultName);
+        if (path) {
+            if (uds_stats_dump_csv(&udsStats, path) == 0) console.AddLog("[UDS] Transport stats written to %s", path);
+            else console.AddLog("[UDS] IO error writing %s %s", path, strerror(errno));
+            free(path);
+        }
+    }
+}
+
+static void vehicleScanFinished()
+{
+    console.AddLog("[UDS] Scanned %d modules in %.2fs, %d answered", vehicleScan.numModules, vehicleScan.seconds,
+                   vehicle_scan_present(&vehicleScan));
+    for (int i = 0; i < vehicleScan.numModules; i++) {
+        const struct ModuleScan* module = &vehicleScan.modules[i];
+        if (module->present)
+            console.AddLog("[UDS] 0x%03X VIN %s calibration %s, %d DTCs", module->requestId, module->vin, module->calID, module->numDtcs);
+    }
+}
+
+// what every module on the bus reported in the last scan
+static void RenderModules()
+{
+    if (!vehicle_scan_ready(&vehicleScan) || !ImGui::CollapsingHeader("Modules"))
+        return;
+    if (ImGui::BeginTable("modules", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        const char* columns[] = { "Module", "VIN", "Calibration", "DTCs" };
+        for (int i = 0; i < IM_ARRAYSIZE(columns); i++)
+            ImGui::TableSetupColumn(columns[i]);
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < vehicleScan.numModules; i++) {
+            const struct ModuleScan* module = &vehicleScan.modules[i];
+            if (!module->present) continue;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::Text("0x%03X", module->requestId);
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(module->vin);
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(module->calID);
+            ImGui::TableNextColumn();
+            if (!module->dtcsRead) {
+                ImGui::TextDisabled("not supported");
+                continue;
+            }
+            if (module->numDtcs == 0) ImGui::TextUnformatted("none");
+            for (int d = 0; d < module->numDtcs && d < VEHICLE_SCAN_MAX_DTCS; d++) {
+                char name[16];
+                vehicle_scan_dtc_name(module->dtcs[d], name, sizeof(name));
+                if (d) ImGui::SameLine();
+                ImGui::TextUnformatted(name);
+            }
+            if (module->numDtcs > VEHICLE_SCAN_MAX_DTCS) {
+                ImGui::SameLine();
+                ImGui::Text("+%d more", module->numDtcs - VEHICLE_SCAN_MAX_DTCS);
+            }
+        }
+        ImGui::EndTable();
+    }
+    const struct UDSSessionManager* manager = &vehicleScan.manager;
+    ImGui::Text("%.2fs, %u requests in %u writes, %u responses in %u reads, %u unexpected", vehicleScan.seconds,
+                manager->sent, manager->sendCalls, manager->received, manager->receiveCalls, manager->unexpected);
+}
+
+// "VIN-CALID.bin", or "VIN-CALID-2.bin" and up when an earlier dump
+// already has that name, a new download never replaces one
+static void chooseDownloadPath(char* path, size_t size)
+{
+    const char* cal = calID ? calID : "unknown";
+    snprintf(path, size, "%s-%s.bin", vin, cal);
+    for (int n = 2;; n++) {
+        FILE* existing = fopen(path, "rb");
+        if (!existing) return;
+        fclose(existing);
+        snprintf(path, size, "%s-%s-%d.bin", vin, cal, n);
+    }
+}
+
 void RenderConnection()
 {
     ImGui::SetNextWindowSize(ImVec2(200, 200), ImGuiCond_FirstUseEver);
@@ -805,6 +1566,12 @@ void RenderConnection()
     sprintf(buf, "J2534 Interface %s %s", dllName, dllVersion);
 
     ImGui::Begin(buf, NULL);
+    if (uds_request_poll(&uds_transfer, &console))
+        downloadFinished();
+    if (vehicle_scan_ready(&vehicleScan) && !vehicleScanReported) {
+        vehicleScanReported = true;
+        vehicleScanFinished();
+    }
 
     if (ImGui::BeginPopupContextItem())
     {
@@ -813,7 +1580,14 @@ void RenderConnection()
         }
         ImGui::EndPopup();
     }
-    if (j2534InitOK) {
+    // the worker has the ECU to itself while a download runs, the scan has the whole channel
+    bool busy = uds_request_busy(&uds_transfer);
+    if (j2534InitOK && busy) {
+      if (ImGui::Button("Cancel Download"))
+          uds_request_cancel(&uds_transfer);
+    } else if (j2534InitOK && vehicle_scan_busy(&vehicleScan)) {
+      ImGui::TextDisabled("Scanning modules...");
+    } else if (j2534InitOK) {
       if (ImGui::Button("Identify Vehicle")) {
           if (vin) {
               free(vin);
@@ -824,31 +1598,60 @@ void RenderConnection()
               calID = NULL;
           }
 
-          if (ecu->getVIN(&vin)) {
+          if (udsTimed.ecu.getVIN(udsTimed.ecu.context, &vin)) {
               console.AddLog("ERROR: Failed to get VIN");
           }
           else {
               console.AddLog("Got VIN: %s", vin);
           }
 
-          if (ecu->getCalibrationID(&calID)) {
+          if (udsTimed.ecu.getCalibrationID(udsTimed.ecu.context, &calID)) {
               console.AddLog("ERROR: failed to read calibration ID");
           }
           else {
               console.AddLog("Got CALID: %s", calID);
           }
       }
+      ImGui::SameLine();
+      if (ImGui::Button("Scan Modules")) {
+          vehicle_scan_start(&vehicleScan, &udsChannel, UDS_SESSION_FIRST_ID, UDS_SESSION_MODULES);
+          vehicleScanReported = false;
+      }
+      if (ImGui::IsItemHovered())
+          ImGui::SetTooltip("Reads VIN, calibration and DTCs from 0x%03X-0x%03X at the same time",
+                            UDS_SESSION_FIRST_ID, UDS_SESSION_FIRST_ID + UDS_SESSION_MODULES - 1);
       // don't display these unless the VIN is loaded
       // probably need a better way off handling this
       if (vin) {
         ImGui::SameLine();
         if (ImGui::Button("Download ROM")) {
+            // the open definition knows the flash size, 512K otherwise
+            const struct MemModel* model = memmodel_find(definition.memmodel);
             uds_transfer.startAddress = 0;
-            uds_transfer.transferSize = 0x80000;
+            uds_transfer.transferSize = model ? model->romSize : 0x80000;
             uds_transfer.transferChunkSize = 0x100;
-            uds_request_start_download(ecu, &uds_transfer, &console);
+            uds_transfer.stats = &udsStats;
+            chooseDownloadPath(downloadPath, sizeof(downloadPath));
+            uds_transfer.spoolPath = downloadPath;
+            uds_request_start_download(&udsTimed.ecu, &uds_transfer, &console, &db, vin, calID);
             mem_edit.Open = true;
         }
+        if (definition.numTables) {
+            ImGui::SameLine();
+            if (ImGui::Button("Read Tables")) {
+                struct ReadPlan plan;
+                memset(&plan, 0, sizeof(plan));
+                read_plan_build(&plan, &definition);
+                if (plan.clipped) console.AddLog("[UDS] %d table spans lie outside the %lu byte ROM", plan.clipped, plan.romSize);
+                uds_transfer.transferChunkSize = 0x100;
+                uds_transfer.stats = &udsStats;
+                uds_request_start_sparse_download(&udsTimed.ecu, &uds_transfer, &console, &plan);
+                read_plan_free(&plan);
+                mem_edit.Open = true;
+            }
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Reads only the bytes the definition's tables and ID string use");
+        }
       }
     }
     ImGui::Separator();
@@ -867,15 +1670,23 @@ void RenderConnection()
     }
     ImGui::Separator();
 
-    ImGui::ProgressBar(uds_transfer.transferProgress, ImVec2(0.0f, 0.0f));
+    float progress = uds_request_progress(&uds_transfer);
+    ImGui::ProgressBar(progress, ImVec2(0.0f, 0.0f));
     ImGui::SameLine(0.0f, ImGui::GetStyle().ItemInnerSpacing.x);
-    ImGui::Text("Transfer Progress %0.2F", uds_transfer.transferProgress);
+    ImGui::Text("Transfer Progress %0.2F", progress);
+    if (uds_transfer.transferBytes.load()) {
+        ImGui::Text("%0.1f KB/s, 0x%X byte reads, %u retries", uds_transfer.bytesPerSecond.load() / 1024.0,
+                    uds_transfer.chunkSize.load(), uds_transfer.retries.load());
+    }
+    RenderModules();
+    RenderTransportStats();
     if (uds_transfer.payload) {
+        // only the blocks up to the first one still missing are shown
         if(mem_edit.Open)
-            mem_edit.DrawWindow("ECU Memory Editor", uds_transfer.payload, uds_transfer.transferBytes);
+            mem_edit.DrawWindow("ECU Memory Editor", uds_transfer.payload, uds_request_contiguous_bytes(&uds_transfer));
 
-        if (mem_edit.Open == false) {
-            uds_transfer.downloadinProgress = false;
+        if (mem_edit.Open == false && busy) {
+            uds_request_cancel(&uds_transfer);
         }
     }
 
@@ -958,39 +1769,687 @@ void RenderRomEdit()
     if(!romFile) return;
     if (rom_edit.Open)
         rom_edit.DrawWindow("Rom Memory Editor", romFile, romFileLength);
+}
+
+void RenderRomSearch()
+{
+    if (!show_rom_search_window || !romFile) return;
+    ImGui::SetNextWindowSize(ImVec2(360, 420), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("ROM Search", &show_rom_search_window)) {
+        ImGui::End();
+        return;
+    }
+
+    static const char* types[] = { "Hex bytes", "float", "uint8", "uint16", "uint32" };
+    ImGui::Combo("Type", &romSearchType, types, IM_ARRAYSIZE(types));
+    bool submit = ImGui::InputTextWithHint("##romsearch",
+                                           romSearchType == ROM_SEARCH_BYTES ? "3F 80 ?? 00" : "value",
+                                           romSearchText, IM_ARRAYSIZE(romSearchText),
+                                           ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    submit |= ImGui::Button("Search");
+    if (romSearchType != ROM_SEARCH_BYTES) {
+        ImGui::InputDouble("Tolerance", &romSearchTolerance);
+        ImGui::Checkbox("Big endian", &romSearchBigEndian);
+        ImGui::SameLine();
+        ImGui::Checkbox("Aligned", &romSearchAligned);
+    }
+
+    if (submit) {
+        struct RomSearchPattern pattern;
+        memset(&pattern, 0, sizeof(pattern));
+        romSearchError = NULL;
+        if (romSearchType == ROM_SEARCH_BYTES) {
+            if (!rom_search_parse_hex(&pattern, romSearchText)) romSearchError = "Could not parse";
+        } else {
+            char* end = NULL;
+            double value = strtod(romSearchText, &end);
+            rom_search_set_value(&pattern, (enum RomSearchType)romSearchType, value,
+                                 romSearchTolerance, romSearchBigEndian, romSearchAligned);
+            if (end == romSearchText) romSearchError = "Could not parse";
+            else if (!rom_search_prepare(&pattern)) romSearchError = "Out of range for the type:";
+        }
+        romSearchResults.count = 0;
+        if (!romSearchError) {
+            rom_search(romFile, romFileLength, &pattern, &romSearchResults, 0);
+            console.AddLog("[Search] %d matches for '%s' in %0.1f us", romSearchResults.count, romSearchText, romSearchResults.microseconds);
+        }
+    }
+
+    if (romSearchError)
+        ImGui::TextColored(ImVec4(0.9f, 0.3f, 0.3f, 1.0f), "%s '%s'", romSearchError, romSearchText);
+    else
+        ImGui::Text("%d matches%s (%0.1f us)", romSearchResults.count, romSearchResults.truncated ? "+" : "", romSearchResults.microseconds);
+    ImGui::Separator();
+
+    ImGui::BeginChild("##romsearchresults");
+    ImGuiListClipper clipper;
+    clipper.Begin(romSearchResults.count);
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            unsigned long offset = romSearchResults.offsets[i];
+            const struct AddressSpan* span = address_index_find(&addressIndex, NULL, offset);
+            ImGui::PushID(i);
+            if (ImGui::Selectable("##match", false)) {
+                rom_edit.Open = true;
+                rom_edit.GotoAddrAndHighlight(offset, offset + romSearchResults.length);
+            }
+            ImGui::SameLine();
+            ImGui::Text("0x%06lX", offset);
+            if (span) {
+                ImGui::SameLine();
+                ImGui::TextDisabled("%s", definition.tables[span->table].name);
+            }
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+    ImGui::End();
+}
+
+void RenderRomDiff()
+{
+    if (!show_rom_diff_window || !romFile || !referenceRom.data) return;
+    ImGui::SetNextWindowSize(ImVec2(420, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("ROM Diff", &show_rom_diff_window)) {
+        ImGui::End();
+        return;
+    }
+
+    // edits only flag the diff, it is rebuilt the next time it is shown
+    if (romDiffStale) {
+        rom_diff(&romDiff, referenceRom.data, referenceRom.length, romFile, romFileLength,
+                 definition.tables ? &definition : NULL, definition.tables ? &addressIndex : NULL);
+        if (romDiffSelected >= romDiff.numTables) romDiffSelected = -1;
+        romDiffStale = false;
+    }
+
+    ImGui::TextDisabled("%s", referenceRomPath);
+    ImGui::Text("%lu bytes in %ld ranges (%0.1f us)", romDiff.bytes, romDiff.numRanges, romDiff.microseconds);
+    ImGui::Text("%ld cells in %d tables, %lu bytes outside any table", romDiff.numCells, romDiff.numTables, romDiff.unmappedBytes);
+    ImGui::Separator();
+
+    ImGui::BeginChild("##romdifftables", ImVec2(0, ImGui::GetContentRegionAvail().y * 0.5f), true);
+    ImGuiListClipper clipper;
+    clipper.Begin(romDiff.numTables);
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            struct RomDiffTable* changed = &romDiff.tables[i];
+            ImGui::PushID(i);
+            if (ImGui::Selectable(definition.tables[changed->table].name, romDiffSelected == i,
+                                  ImGuiSelectableFlags_AllowDoubleClick)) {
+                romDiffSelected = i;
+                if (ImGui::IsMouseDoubleClicked(0))
+                    openTable(changed->table);
+            }
+            ImGui::SameLine(ImGui::GetContentRegionAvail().x - 60);
+            ImGui::TextDisabled("%ld cells", changed->numCells);
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+
+    ImGui::BeginChild("##romdiffcells");
+    if (romDiffSelected >= 0) {
+        struct RomDiffTable* changed = &romDiff.tables[romDiffSelected];
+        struct Table* owner = &definition.tables[changed->table];
+        clipper.Begin((int)changed->numCells);
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                struct RomDiffCell* cell = &romDiff.cells[changed->firstCell + i];
+                char label[64];
+                formatCell(label, sizeof(label), owner, cell->axis, cell->element);
+                ImGui::PushID(i);
+                if (ImGui::Selectable("##cell", false)) {
+                    rom_edit.Open = true;
+                    rom_edit.GotoAddrAndHighlight(cell->address, cell->address + cell->size);
+                }
+                ImGui::SameLine();
+                if (cell->axis >= 0)
+                    ImGui::Text("%s %s", owner->tables[cell->axis].type ? owner->tables[cell->axis].type : "Axis", label);
+                else
+                    ImGui::Text("%s", label);
+                ImGui::SameLine(140);
+                ImGui::TextDisabled("0x%06lX", cell->address);
+                ImGui::SameLine(220);
+                ImGui::Text("%g -> %g%s", cell->before, cell->after, cell->scaled ? "" : " (raw)");
+                ImGui::PopID();
+            }
+        }
+    }
+    ImGui::EndChild();
+    ImGui::End();
+}
+
+void RenderRomMerge()
+{
+    if (!show_rom_merge_window || !romFile || !referenceRom.data) return;
+    ImGui::SetNextWindowSize(ImVec2(520, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("ROM Merge", &show_rom_merge_window)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::TextDisabled("Base:   %s", referenceRomPath);
+    ImGui::TextDisabled("Ours:   %s", romFilePath);
+    ImGui::TextDisabled("Theirs: %s", theirsRomPath ? theirsRomPath : "");
+    if (ImGui::Button("Open Theirs...")) {
+        char* tmp = getFileOpenPath(NULL, false);
+        if (tmp) {
+            startMerge(tmp);
+            free(tmp);
+        }
+    }
+    if (!romMerge.result) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("%ld cells from ours, %ld from theirs, %ld changed the same on both (%0.1f us)",
+                romMerge.oursCells, romMerge.theirsCells, romMerge.sameCells, romMerge.microseconds);
+    ImGui::Text("%ld conflicts", romMerge.numConflicts);
+    if (romMerge.numConflicts) {
+        ImGui::SameLine();
+        if (ImGui::SmallButton("All ours")) {
+            for (long i = 0; i < romMerge.numConflicts; i++)
+                rom_merge_resolve(&romMerge, i, ROM_MERGE_OURS, referenceRom.data, romFile, theirsRom.data);
+        }
+        ImGui::SameLine();
+        if (ImGui::SmallButton("All theirs")) {
+            for (long i = 0; i < romMerge.numConflicts; i++)
+                rom_merge_resolve(&romMerge, i, ROM_MERGE_THEIRS, referenceRom.data, romFile, theirsRom.data);
+        }
+    }
+    ImGui::Separator();
+
+    ImGui::BeginChild("##romconflicts", ImVec2(0, -ImGui::GetFrameHeightWithSpacing()));
+    ImGuiListClipper clipper;
+    clipper.Begin((int)romMerge.numConflicts);
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            struct RomMergeConflict* conflict = &romMerge.conflicts[i];
+            ImGui::PushID(i);
+            int choice = conflict->choice;
+            bool changed = ImGui::RadioButton("ours", &choice, ROM_MERGE_OURS);
+            ImGui::SameLine();
+            changed |= ImGui::RadioButton("theirs", &choice, ROM_MERGE_THEIRS);
+            ImGui::SameLine();
+            changed |= ImGui::RadioButton("base", &choice, ROM_MERGE_BASE);
+            if (changed)
+                rom_merge_resolve(&romMerge, i, (enum RomMergeChoice)choice, referenceRom.data, romFile, theirsRom.data);
+            ImGui::SameLine();
+            if (conflict->table >= 0) {
+                struct Table* owner = &definition.tables[conflict->table];
+                char label[64];
+                formatCell(label, sizeof(label), owner, conflict->axis, conflict->element);
+                if (ImGui::Selectable(owner->name, false, ImGuiSelectableFlags_AllowDoubleClick) && ImGui::IsMouseDoubleClicked(0))
+                    openTable(conflict->table);
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("%s%s %s @ 0x%06lX\nbase %g, ours %g, theirs %g",
+                                      conflict->axis >= 0 ? "axis " : "", owner->name, label, conflict->address,
+                                      conflict->base, conflict->ours, conflict->theirs);
+                ImGui::SameLine();
+                ImGui::TextDisabled("%s  %g / %g", label, conflict->ours, conflict->theirs);
+            } else {
+                ImGui::Text("0x%06lX", conflict->address);
+                ImGui::SameLine();
+                ImGui::TextDisabled("%d bytes outside any table", conflict->size);
+            }
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+
+    if (ImGui::Button("Apply Merge"))
+        applyMerge();
+    ImGui::SameLine();
+    if (ImGui::Button("Cancel"))
+        closeMerge();
+    ImGui::End();
+}
+
+static const char* pathBasename(const char* path)
+{
+    const char* name = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') name = p + 1;
+    }
+    return name;
+}
+
+void openWorkspaceTable(int rom, int table)
+{
+    for (int i = 0; i < numWorkspaceTables; i++) {
+        if (workspaceTables[i].rom == rom && workspaceTables[i].table == table) return;
+    }
+    workspaceTables = (struct WorkspaceTable*)realloc(workspaceTables, sizeof(struct WorkspaceTable) * (numWorkspaceTables + 1));
+    assert(workspaceTables);
+    workspaceTables[numWorkspaceTables].rom = rom;
+    workspaceTables[numWorkspaceTables].table = table;
+    numWorkspaceTables++;
+}
+
+static void closeWorkspaceTable(int i)
+{
+    memmove(&workspaceTables[i], &workspaceTables[i + 1], sizeof(struct WorkspaceTable) * (numWorkspaceTables - i - 1));
+    numWorkspaceTables--;
+}
+
+// copies workspace image [index] into [out], the file it came from isn't read again
+static bool workspaceImage(int index, struct RomFile* out)
+{
+    const struct WorkspaceRom* image = &workspace.roms[index];
+    if (!rom_file_alloc(out, image->length)) {
+        console.AddLog("Out of memory copying %s from the workspace", image->path);
+        return false;
+    }
+    workspace_read(&workspace, index, 0, out->data, image->length);
+    return true;
+}
+
+void referenceFromWorkspace(int index)
+{
+    closeReferenceRom();
+    if (!workspaceImage(index, &referenceRom)) return;
+    referenceRomLoaded(workspace.roms[index].path);
+}
+
+// replaces the working ROM with workspace image [index], unsaved edits are discarded
+void workingFromWorkspace(int index)
+{
+    closeRomFile();
+    if (!setRomFilePath(workspace.roms[index].path)) return;
+    if (!workspaceImage(index, &rom)) {
+        free(romFilePath);
+        romFilePath = NULL;
+        return;
+    }
+    console.AddLog("Copied %ld bytes of %s from the workspace", rom.length, romFilePath);
+    romFileLoaded();
+}
+
+// drops [rom] from the workspace along with its table windows
+void removeWorkspaceRom(int rom)
+{
+    pendingWorkingRom = -1;
+    for (int i = numWorkspaceTables - 1; i >= 0; i--) {
+        if (workspaceTables[i].rom == rom) closeWorkspaceTable(i);
+        else if (workspaceTables[i].rom > rom) workspaceTables[i].rom--;
+    }
+    workspace_remove(&workspace, rom);
+}
+
+// scaled value of cell [element] of [table] in workspace ROM [rom]
+static bool workspaceCell(int rom, struct Table* table, int element, double* value)
+{
+    unsigned char cell[4];
+    int size = definition_scaling_size(table->Scaling);
+    if (!workspace_read(&workspace, rom, table->address + (unsigned long)element * size, cell, size)) return false;
+    if (!definition_read_scaled(table->Scaling, cell, 0, value))
+        *value = definition_read_raw(table->Scaling, cell, 0);
+    return true;
+}
+
+static void workspaceCellText(int rom, struct Table* table, int element)
+{
+    double value;
+    if (workspaceCell(rom, table, element, &value))
+        ImGui::Text("%0.2f", value);
+    else
+        ImGui::TextDisabled("--");
+}
 
-    if (rom_edit.Open == false) {
-        uds_transfer.downloadinProgress = false;
+// read only table window for a workspace ROM, every read is bounds checked against the image
+void RenderWorkspaceTable(int i)
+{
+    struct WorkspaceTable* open = &workspaceTables[i];
+    struct Table* table = &definition.tables[open->table];
+    char buffer[PATH_MAX + 128];
+    snprintf(buffer, sizeof(buffer), "%s [%s]##workspace-%d-%d", table->name,
+             pathBasename(workspace.roms[open->rom].path), open->rom, open->table);
+
+    bool visible = true;
+    ImGui::SetNextWindowSize(ImVec2(655, 420), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin(buffer, &visible)) {
+        ImGui::TextDisabled("%s", workspace.roms[open->rom].path);
+        static ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY;
+        bool is3D = table->type && strcmp(table->type, "3D") == 0 && table->numTables == 2;
+        bool is2D = table->type && strcmp(table->type, "2D") == 0 && table->numTables == 1;
+        if (is3D) {
+            struct Table* x = table->swapxy ? &table->tables[1] : &table->tables[0];
+            struct Table* y = table->swapxy ? &table->tables[0] : &table->tables[1];
+            if (x->elements > 0 && y->elements > 0 && x->elements < 63 && ImGui::BeginTable("##workspace3d", x->elements + 1, flags)) {
+                ImGui::TableSetupScrollFreeze(1, 1);
+                ImGui::TableNextRow(ImGuiTableRowFlags_Headers);
+                for (int xi = 0; xi < x->elements; xi++) {
+                    ImGui::TableSetColumnIndex(xi + 1);
+                    workspaceCellText(open->rom, x, xi);
+                }
+                for (int yi = 0; yi < y->elements; yi++) {
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    workspaceCellText(open->rom, y, yi);
+                    for (int xi = 0; xi < x->elements; xi++) {
+                        ImGui::TableSetColumnIndex(xi + 1);
+                        // data is stored with the y axis varying fastest
+                        workspaceCellText(open->rom, table, xi * y->elements + yi);
+                    }
+                }
+                ImGui::EndTable();
+            }
+        } else if (is2D) {
+            struct Table* x = &table->tables[0];
+            if (ImGui::BeginTable("##workspace2d", 2, flags)) {
+                for (int xi = 0; xi < table->elements; xi++) {
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    if (xi < x->elements) workspaceCellText(open->rom, x, xi);
+                    ImGui::TableSetColumnIndex(1);
+                    workspaceCellText(open->rom, table, xi);
+                }
+                ImGui::EndTable();
+            }
+        } else {
+            for (int e = 0; e < table->elements; e++)
+                workspaceCellText(open->rom, table, e);
+        }
     }
+    ImGui::End();
+    if (!visible) closeWorkspaceTable(i);
+}
+
+void RenderWorkspace()
+{
+    // tagged table windows stay open while the workspace window is hidden
+    for (int i = numWorkspaceTables - 1; i >= 0; i--)
+        RenderWorkspaceTable(i);
+
+    if (!show_workspace_window) return;
+    ImGui::SetNextWindowSize(ImVec2(520, 320), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Workspace", &show_workspace_window)) {
+        ImGui::End();
+        return;
+    }
+
+    size_t logical = workspace_logical_bytes(&workspace);
+    size_t stored = workspace_stored_bytes(&workspace);
+    ImGui::Text("%d ROMs, %0.1f KB as files, %0.1f KB stored", workspace.numRoms, logical / 1024.0, stored / 1024.0);
+    if (ImGui::Button("Add ROM...")) {
+        char* tmp = getFileOpenPath(NULL, false);
+        if (tmp) {
+            if (workspace_add_file(&workspace, tmp) < 0)
+                console.AddLog("IO error opening rom %s %s", tmp, strerror(errno));
+            free(tmp);
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Add Working ROM") && romFile)
+        workspace_add(&workspace, romFilePath, romFile, romFileLength);
+    ImGui::Separator();
+
+    int remove = -1;
+    for (int i = 0; i < workspace.numRoms; i++) {
+        struct WorkspaceRom* image = &workspace.roms[i];
+        ImGui::PushID(i);
+        ImGui::Text("%s", pathBasename(image->path));
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("%s\n%ld bytes, hash %016llx", image->path, image->length, (unsigned long long)image->hash);
+        ImGui::SameLine(240);
+        if (ImGui::SmallButton("Open Tables") && tableSelect) {
+            // the tables open for the working ROM, shown from this one
+            for (int t = 0; t < definition.numTables; t++) {
+                if (tableSelect[t]) openWorkspaceTable(i, t);
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Reference"))
+            referenceFromWorkspace(i);
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Make Working")) {
+            if (romFile && rom.numDirty > 0) pendingWorkingRom = i;
+            else workingFromWorkspace(i);
+        }
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Remove")) remove = i;
+        ImGui::PopID();
+    }
+    if (remove >= 0) removeWorkspaceRom(remove);
+
+    // the working ROM has edits, save or drop them before it's replaced
+    if (pendingWorkingRom >= 0 && !ImGui::IsPopupOpen("Unsaved Changes")) ImGui::OpenPopup("Unsaved Changes");
+    if (ImGui::BeginPopupModal("Unsaved Changes", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+        int target = pendingWorkingRom;
+        bool close = target < 0 || !romFile;
+        if (!close) ImGui::Text("%s has unsaved changes in %ld pages.", pathBasename(romFilePath), rom.numDirty);
+        if (!close && ImGui::Button("Save")) {
+            if (saveRomFile(romFilePath)) workingFromWorkspace(target);
+            close = true;
+        }
+        ImGui::SameLine();
+        if (!close && ImGui::Button("Discard")) {
+            workingFromWorkspace(target);
+            close = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) close = true;
+        if (close) {
+            pendingWorkingRom = -1;
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+    ImGui::End();
+}
+
+// replaces the working ROM with version [id], only the bytes that differ are written
+void checkoutTuneVersion(int64_t id)
+{
+    unsigned char* image;
+    long length;
+    if (!conescan_db_checkout_version(&db, id, &image, &length)) {
+        console.AddLog("Version %lld of %s could not be rebuilt", (long long)id, romFilePath);
+        return;
+    }
+    if (length != romFileLength) {
+        console.AddLog("Version %lld is %ld bytes, the open rom is %ld", (long long)id, length, romFileLength);
+        free(image);
+        return;
+    }
+    struct RomDiffRange* ranges = NULL;
+    long capacity = 0;
+    long numRanges = rom_diff_ranges(romFile, romFileLength, image, length, &ranges, &capacity);
+    for (long i = 0; i < numRanges; i++)
+        romWrite(ranges[i].start, image + ranges[i].start, ranges[i].end - ranges[i].start);
+    console.AddLog("Checked out version %lld, %ld ranges changed", (long long)id, numRanges);
+    if (ranges) free(ranges);
+    free(image);
+}
+
+// compares version [id] against the working ROM into [tuneHistoryDiff]
+static void diffTuneVersion(int64_t id)
+{
+    unsigned char* image;
+    long length;
+    rom_diff_free(&tuneHistoryDiff);
+    if (!conescan_db_checkout_version(&db, id, &image, &length)) return;
+    rom_diff(&tuneHistoryDiff, image, length, romFile, romFileLength,
+             definition.tables ? &definition : NULL, definition.tables ? &addressIndex : NULL);
+    free(image);
+}
+
+void RenderTuneHistory()
+{
+    if (!show_tune_history_window || !romFile) return;
+    ImGui::SetNextWindowSize(ImVec2(520, 420), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Tune History", &show_tune_history_window)) {
+        ImGui::End();
+        return;
+    }
+
+    if (tuneHistoryStale && !tune_commit_busy(&tuneCommit)) {
+        numTuneHistory = conescan_db_log_versions(&db, romFilePath, tuneHistory, IM_ARRAYSIZE(tuneHistory));
+        tuneHistorySelected = -1;
+        rom_diff_free(&tuneHistoryDiff);
+        tuneHistoryStale = false;
+    }
+
+    ImGui::InputText("Note for next save", tuneMessage, sizeof(tuneMessage));
+    ImGui::Separator();
+
+    ImGui::BeginChild("##tuneversions", ImVec2(0, ImGui::GetContentRegionAvail().y * 0.6f), true);
+    ImGuiListClipper clipper;
+    clipper.Begin(numTuneHistory);
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            struct TuneVersion* version = &tuneHistory[i];
+            ImGui::PushID(i);
+            char label[64];
+            snprintf(label, sizeof(label), "#%lld  %s", (long long)version->id, version->insertedAt);
+            if (ImGui::Selectable(label, tuneHistorySelected == i, 0, ImVec2(200, 0))) {
+                tuneHistorySelected = i;
+                diffTuneVersion(version->id);
+            }
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("hash %016llx\n%ld bytes stored as %s", (unsigned long long)version->hash,
+                                  version->size, version->snapshot ? "a snapshot" : "a delta");
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s", version->message[0] ? version->message : "--");
+            ImGui::SameLine(ImGui::GetContentRegionAvail().x - 60);
+            if (ImGui::SmallButton("Checkout"))
+                checkoutTuneVersion(version->id);
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+
+    ImGui::BeginChild("##tunediff");
+    if (tuneHistorySelected >= 0) {
+        ImGui::Text("%lu bytes in %ld ranges differ from the open rom", tuneHistoryDiff.bytes, tuneHistoryDiff.numRanges);
+        for (int i = 0; i < tuneHistoryDiff.numTables; i++) {
+            struct RomDiffTable* changed = &tuneHistoryDiff.tables[i];
+            ImGui::PushID(i);
+            if (ImGui::Selectable(definition.tables[changed->table].name, false, ImGuiSelectableFlags_AllowDoubleClick) &&
+                ImGui::IsMouseDoubleClicked(0))
+                openTable(changed->table);
+            ImGui::SameLine(ImGui::GetContentRegionAvail().x - 60);
+            ImGui::TextDisabled("%ld cells", changed->numCells);
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+    ImGui::End();
 }
 
 void ConeScan::RenderUI(bool* exit_requested)
 {
-  if(show_console_window)
+  PROFILE_SCOPE("RenderUI");
+  if(show_console_window) {
+    PROFILE_SCOPE("Console::Draw");
     console.Draw("Console", &show_console_window);
+  }
 
   if(show_demo_window)
     ImGui::ShowDemoWindow(&show_demo_window);
 
+#ifdef CONESCAN_PROFILER
+  if(show_profiler_window)
+    profiler_draw("Profiler", &show_profiler_window);
+#endif
+
+  // the first verify after opening runs in the background, report it once it lands
+  if(!checksumReported && checksum_ready(&checksum)) {
+    int invalid = checksum_invalid(&checksum, &rom);
+    console.AddLog("Checksum %s: %d ranges verified in %.0f us, %d wrong", checksum.module->name,
+                   checksum.numRanges, checksum.microseconds, invalid);
+    checksumReported = true;
+  }
+  if(!tableCheckReported && table_check_ready(&tableCheck)) {
+    console.AddLog("Checked %d tables against the ROM in %.0f us: %d out of bounds, %d bad shape, "
+                   "%d axes not monotonic, %d overlapping", tableCheck.numTables, tableCheck.microseconds,
+                   tableCheck.outOfBounds, tableCheck.badShape, tableCheck.notMonotonic, tableCheck.overlapping);
+    for(int i = 0; i < tableCheck.numTables; i++) {
+      if(table_check_renderable(&tableCheck, i)) continue;
+      char reason[256];
+      table_check_describe(&tableCheck, &definition, i, reason, sizeof(reason));
+      console.AddLog("[error] %s: %s", definition.tables[i].name, reason);
+    }
+    tableCheckReported = true;
+  }
+
   // title menu bar
-  RenderMenu(exit_requested);
-  
+  {
+    PROFILE_SCOPE("RenderMenu");
+    RenderMenu(exit_requested);
+  }
+
   ImGui::Begin("Definition Info", NULL);
-  RenderDefinitionInfo();
-  RenderScalings();
-  RenderTables();
+  {
+    PROFILE_SCOPE("RenderDefinitionInfo");
+    RenderDefinitionInfo();
+  }
+  {
+    PROFILE_SCOPE("RenderScalings");
+    RenderScalings();
+  }
+  {
+    PROFILE_SCOPE("RenderTables");
+    RenderTables();
+  }
   ImGui::End();
 
-  RenderConnection();
-  RenderLiveData();
-  RenderRomEdit();
+  {
+    PROFILE_SCOPE("RenderConnection");
+    RenderConnection();
+  }
+  {
+    PROFILE_SCOPE("RenderLiveData");
+    RenderLiveData();
+  }
+  {
+    PROFILE_SCOPE("RenderRomEdit");
+    RenderRomEdit();
+  }
+  {
+    PROFILE_SCOPE("RenderRomSearch");
+    RenderRomSearch();
+  }
+  {
+    PROFILE_SCOPE("RenderRomDiff");
+    RenderRomDiff();
+  }
+  {
+    PROFILE_SCOPE("RenderRomMerge");
+    RenderRomMerge();
+  }
+  {
+    PROFILE_SCOPE("RenderWorkspace");
+    RenderWorkspace();
+  }
+  {
+    PROFILE_SCOPE("RenderTuneHistory");
+    RenderTuneHistory();
+  }
+}
+
+bool ConeScan::IsBusy()
+{
+  return uds_request_busy(&uds_transfer) || vehicle_scan_busy(&vehicleScan) || tune_commit_busy(&tuneCommit);
 }
 
 void ConeScan::Cleanup()
 {
   uds_request_complete(&uds_transfer);
+  vehicle_scan_close(&vehicleScan);
+  uds_channel_j2534_close(&udsLink);
   closeMetadataFile(&definition_parse, &definition);
-  deinitSelects();
+  deinitDefinition();
+  closeRomFile();
+  closeReferenceRom();
+  workspace_free(&workspace);
+  free(workspaceTables);
+  workspaceTables = NULL;
+  numWorkspaceTables = 0;
+  rom_search_results_free(&romSearchResults);
   int layoutID = 0;
   if(iniData) {
     // if ini data was loaded, assume we are using layout 1 for now
@@ -1000,6 +2459,7 @@ void ConeScan::Cleanup()
   iniData = ImGui::SaveIniSettingsToMemory(&iniSize);
   conescan_db_save_layout(&db, layoutID, iniData);
 
+  tune_commit_wait(&tuneCommit);
   conescan_db_close(&db);
   if (j2534InitOK) {
     j2534.PassThruClose(devID);
@@ -0,0 +1,468 @@
+// conescan-cli: the definition, checksum and diff code without a window
+//
+// Runs one command over many ROMs, a worker per core. Each file's output
+// is buffered by its worker and written to stdout in argument order as
+// soon as every file before it is done, so results stream while the rest
+// are still being processed and the output is the same for any -j.
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "definition.h"
+#include "definition_parse.h"
+#include "address_index.h"
+#include "checksum.h"
+#include "rom_diff.h"
+#include "rom_file.h"
+#include "rom_save.h"
+#include "table_check.h"
+
+enum CliCommand {
+  CLI_IDENTIFY,
+  CLI_CHECKSUM,
+  CLI_FIX_CHECKSUM,
+  CLI_EXPORT_CSV,
+  CLI_EXPORT_JSON,
+  CLI_DIFF,
+  CLI_VALIDATE,
+};
+
+static const struct {
+  const char*     name;
+  enum CliCommand command;
+  const char*     help;
+} commands[] = {
+  { "identify",     CLI_IDENTIFY,     "print the definition each ROM matches" },
+  { "checksum",     CLI_CHECKSUM,     "verify checksums, exits 1 if any are wrong" },
+  { "fix-checksum", CLI_FIX_CHECKSUM, "correct checksums and save each ROM in place" },
+  { "export-csv",   CLI_EXPORT_CSV,   "every table cell as file,table,x,y,value" },
+  { "export-json",  CLI_EXPORT_JSON,  "every table of a ROM as one JSON line" },
+  { "diff",         CLI_DIFF,         "changed tables against --stock" },
+  { "validate",     CLI_VALIDATE,     "check table bounds, shapes, axes and overlaps, exits 1 on errors" },
+};
+
+// output of one file, filled by a worker and written by the main thread
+struct CliOutput {
+  char*  data;
+  size_t length;
+  size_t capacity;
+};
+
+struct CliJob {
+  const char*      path;
+  struct CliOutput out;
+  int              status;     // 0 ok, 1 check failed, 2 error
+  bool             done;
+};
+
+static struct {
+  enum CliCommand    command;
+  struct Definition* definitions;
+  int                numDefinitions;
+  struct AddressIndex* indexes;      // one per definition for diff, shared by the workers
+  bool               force;          // use the first definition without matching its id
+  struct RomFile     stock;
+  const char*        stockPath;
+
+  struct CliJob*     jobs;
+  int                numJobs;
+  std::atomic<int>   next;
+  std::mutex         lock;
+  std::condition_variable finished;
+} cli;
+
+static void outPrintf(struct CliOutput* out, const char* fmt, ...)
+{
+  va_list args;
+  for(;;) {
+    size_t room = out->capacity - out->length;
+    va_start(args, fmt);
+    int n = vsnprintf(out->data ? out->data + out->length : NULL, room, fmt, args);
+    va_end(args);
+    assert(n >= 0);
+    if((size_t)n < room) {
+      out->length += n;
+      return;
+    }
+    out->capacity = out->capacity * 2 > out->length + n + 1 ? out->capacity * 2 : out->length + n + 1 + 4096;
+    out->data = (char*)realloc(out->data, out->capacity);
+    assert(out->data);
+  }
+}
+
+// [text] as a quoted CSV field
+static void outCsv(struct CliOutput* out, const char* text)
+{
+  outPrintf(out, "\"");
+  for(const char* c = text ? text : ""; *c; c++) outPrintf(out, *c == '"' ? "\"\"" : "%c", *c);
+  outPrintf(out, "\"");
+}
+
+static void outJsonString(struct CliOutput* out, const char* text)
+{
+  outPrintf(out, "\"");
+  for(const unsigned char* c = (const unsigned char*)(text ? text : ""); *c; c++) {
+    if(*c == '"' || *c == '\\') outPrintf(out, "\\%c", *c);
+    else if(*c < 0x20) outPrintf(out, "\\u%04x", *c);
+    else outPrintf(out, "%c", *c);
+  }
+  outPrintf(out, "\"");
+}
+
+// definition whose internal id is in [rom], NULL if none is
+static struct Definition* identify(const struct RomFile* rom)
+{
+  for(int i = 0; i < cli.numDefinitions; i++) {
+    struct Definition* definition = &cli.definitions[i];
+    if(!definition->internalidstring) continue;
+    size_t length = strlen(definition->internalidstring);
+    if(definition->internalidaddress + length > (unsigned long)rom->length) continue;
+    if(memcmp(rom->data + definition->internalidaddress, definition->internalidstring, length) == 0) return definition;
+  }
+  return cli.force && cli.numDefinitions ? &cli.definitions[0] : NULL;
+}
+
+// scaled value of cell [element], NAN past the end of the image
+static double cellValue(const struct RomFile* rom, struct Table* table, int element)
+{
+  if(!table->Scaling) return NAN;
+  int size = definition_scaling_size(table->Scaling);
+  unsigned long address = table->address + (unsigned long)element * size;
+  if(address + size > (unsigned long)rom->length) return NAN;
+  double value;
+  if(!definition_read_scaled(table->Scaling, rom->data, address, &value))
+    value = definition_read_raw(table->Scaling, rom->data, address);
+  return value;
+}
+
+static void outValue(struct CliOutput* out, double value, const char* missing)
+{
+  if(isnan(value)) outPrintf(out, "%s", missing);
+  else outPrintf(out, "%g", value);
+}
+
+// the axes of [table] in display order, NULL where it has none
+static void tableAxes(struct Table* table, struct Table** x, struct Table** y)
+{
+  *x = NULL;
+  *y = NULL;
+  if(table->type && strcmp(table->type, "3D") == 0 && table->numTables == 2) {
+    *x = table->swapxy ? &table->tables[1] : &table->tables[0];
+    *y = table->swapxy ? &table->tables[0] : &table->tables[1];
+  } else if(table->type && strcmp(table->type, "2D") == 0 && table->numTables == 1) {
+    *x = &table->tables[0];
+  }
+}
+
+static void exportCsv(struct CliJob* job, const struct RomFile* rom, struct Definition* definition)
+{
+  for(int t = 0; t < definition->numTables; t++) {
+    struct Table* table = &definition->tables[t];
+    struct Table *x, *y;
+    tableAxes(table, &x, &y);
+    for(int e = 0; e < table->elements; e++) {
+      outCsv(&job->out, job->path);
+      outPrintf(&job->out, ",");
+      outCsv(&job->out, table->name);
+      outPrintf(&job->out, ",");
+      // 3D data is stored with the y axis varying fastest
+      int xi = y && y->elements ? e / y->elements : e;
+      int yi = y && y->elements ? e % y->elements : 0;
+      if(x && xi < x->elements) outValue(&job->out, cellValue(rom, x, xi), "");
+      outPrintf(&job->out, ",");
+      if(y && yi < y->elements) outValue(&job->out, cellValue(rom, y, yi), "");
+      outPrintf(&job->out, ",");
+      outValue(&job->out, cellValue(rom, table, e), "");
+      outPrintf(&job->out, "\n");
+    }
+  }
+}
+
+static void outJsonCells(struct CliOutput* out, const struct RomFile* rom, struct Table* table, int count)
+{
+  outPrintf(out, "[");
+  for(int e = 0; e < count; e++) {
+    if(e) outPrintf(out, ",");
+    outValue(out, cellValue(rom, table, e), "null");
+  }
+  outPrintf(out, "]");
+}
+
+static void exportJson(struct CliJob* job, const struct RomFile* rom, struct Definition* definition)
+{
+  struct CliOutput* out = &job->out;
+  outPrintf(out, "{\"file\":");
+  outJsonString(out, job->path);
+  outPrintf(out, ",\"definition\":");
+  outJsonString(out, definition->xmlid);
+  outPrintf(out, ",\"tables\":[");
+  for(int t = 0; t < definition->numTables; t++) {
+    struct Table* table = &definition->tables[t];
+    struct Table *x, *y;
+    tableAxes(table, &x, &y);
+    if(t) outPrintf(out, ",");
+    outPrintf(out, "{\"name\":");
+    outJsonString(out, table->name);
+    outPrintf(out, ",\"category\":");
+    outJsonString(out, table->category);
+    outPrintf(out, ",\"units\":");
+    outJsonString(out, table->Scaling ? table->Scaling->units : NULL);
+    if(x) {
+      outPrintf(out, ",\"x\":");
+      outJsonCells(out, rom, x, x->elements);
+    }
+    if(y && y->elements) {
+      outPrintf(out, ",\"y\":");
+      outJsonCells(out, rom, y, y->elements);
+      // one row per y, data is stored with y varying fastest
+      outPrintf(out, ",\"values\":[");
+      for(int yi = 0; yi < y->elements; yi++) {
+        outPrintf(out, yi ? ",[" : "[");
+        for(int xi = 0; xi < x->elements; xi++) {
+          if(xi) outPrintf(out, ",");
+          outValue(out, cellValue(rom, table, xi * y->elements + yi), "null");
+        }
+        outPrintf(out, "]");
+      }
+      outPrintf(out, "]}");
+    } else {
+      outPrintf(out, ",\"values\":");
+      outJsonCells(out, rom, table, table->elements);
+      outPrintf(out, "}");
+    }
+  }
+  outPrintf(out, "]}\n");
+}
+
+static void diffStock(struct CliJob* job, const struct RomFile* rom, struct Definition* definition)
+{
+  struct RomDiff diff;
+  memset(&diff, 0, sizeof(diff));
+  rom_diff(&diff, cli.stock.data, cli.stock.length, rom->data, rom->length, definition,
+           &cli.indexes[definition - cli.definitions]);
+  outPrintf(&job->out, "%s\t%lu bytes in %ld ranges, %ld cells in %d tables, %lu bytes outside any table\n",
+            job->path, diff.bytes, diff.numRanges, diff.numCells, diff.numTables, diff.unmappedBytes);
+  for(int i = 0; i < diff.numTables; i++) {
+    outPrintf(&job->out, "\t%s\t%ld cells\n", definition->tables[diff.tables[i].table].name, diff.tables[i].numCells);
+  }
+  rom_diff_free(&diff);
+}
+
+static void validate(struct CliJob* job, const struct RomFile* rom, struct Definition* definition)
+{
+  struct TableCheck check;
+  check.numTables = 0;
+  check.flags = NULL;
+  check.overlapWith = NULL;
+  table_check_open(&check, definition, rom->data, rom->length);
+  table_check_wait(&check);
+  outPrintf(&job->out, "%s\t%d tables\t%d out of bounds\t%d bad shape\t%d not monotonic\t%d overlapping\n",
+            job->path, check.numTables, check.outOfBounds, check.badShape, check.notMonotonic, check.overlapping);
+  for(int t = 0; t < check.numTables; t++) {
+    if(check.flags[t] == (TABLE_CHECK_RENDERABLE | TABLE_CHECK_MONOTONIC | TABLE_CHECK_NO_OVERLAP)) continue;
+    char reason[256];
+    table_check_describe(&check, definition, t, reason, sizeof(reason));
+    outPrintf(&job->out, "\t%s\t%s\n", definition->tables[t].name, reason);
+  }
+  job->status = check.outOfBounds + check.badShape ? 1 : 0;
+  table_check_close(&check);
+}
+
+static void runJob(struct CliJob* job)
+{
+  struct RomFile rom;
+  memset(&rom, 0, sizeof(rom));
+  if(!rom_file_open(&rom, job->path)) {
+    outPrintf(&job->out, "%s\terror\t%s\n", job->path, strerror(errno));
+    job->status = 2;
+    return;
+  }
+
+  struct Definition* definition = identify(&rom);
+  if(cli.command == CLI_IDENTIFY) {
+    outPrintf(&job->out, "%s\t%s\n", job->path, definition ? definition->xmlid : "unknown");
+    job->status = definition ? 0 : 1;
+  } else if(!definition) {
+    outPrintf(&job->out, "%s\terror\tno definition matches\n", job->path);
+    job->status = 2;
+  } else if(cli.command == CLI_CHECKSUM || cli.command == CLI_FIX_CHECKSUM) {
+    struct Checksum checksum;
+    checksum.module = NULL;
+    checksum.numRanges = 0;
+    checksum.state = CHECKSUM_NONE;
+    if(!checksum_open(&checksum, definition->checksummodule, &rom)) {
+      outPrintf(&job->out, "%s\terror\tchecksum module %s not supported\n", job->path,
+                definition->checksummodule ? definition->checksummodule : "(none)");
+      job->status = 2;
+    } else {
+      checksum_wait(&checksum);
+      int invalid = checksum_invalid(&checksum, &rom);
+      if(cli.command == CLI_CHECKSUM) {
+        outPrintf(&job->out, "%s\t%s\t%d ranges\t%d wrong\n", job->path, checksum.module->name, checksum.numRanges, invalid);
+        for(int i = 0; i < checksum.numRanges; i++) {
+          if(!checksum_range_valid(&checksum, &rom, i))
+            outPrintf(&job->out, "\t0x%06lX-0x%06lX\twrong\n", checksum.ranges[i].start, checksum.ranges[i].end);
+        }
+        job->status = invalid ? 1 : 0;
+      } else {
+        int fixed = checksum_fix(&checksum, &rom);
+        struct RomSaveResult result;
+        if(fixed && !rom_save(&rom, job->path, &result)) {
+          outPrintf(&job->out, "%s\terror\tsaving %s\n", job->path, strerror(errno));
+          job->status = 2;
+        } else {
+          outPrintf(&job->out, "%s\t%s\t%d fixed\n", job->path, checksum.module->name, fixed);
+        }
+      }
+    }
+    checksum_close(&checksum);
+  } else if(cli.command == CLI_EXPORT_CSV) {
+    exportCsv(job, &rom, definition);
+  } else if(cli.command == CLI_EXPORT_JSON) {
+    exportJson(job, &rom, definition);
+  } else if(cli.command == CLI_DIFF) {
+    diffStock(job, &rom, definition);
+  } else if(cli.command == CLI_VALIDATE) {
+    validate(job, &rom, definition);
+  }
+  rom_file_close(&rom);
+}
+
+static void workerMain()
+{
+  for(int i = cli.next.fetch_add(1); i < cli.numJobs; i = cli.next.fetch_add(1)) {
+    runJob(&cli.jobs[i]);
+    std::lock_guard<std::mutex> guard(cli.lock);
+    cli.jobs[i].done = true;
+    cli.finished.notify_one();
+  }
+}
+
+static void usage(const char* program)
+{
+  fprintf(stderr, "usage: %s [options] <command> rom...\n\n", program);
+  fprintf(stderr, "commands:\n");
+  for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    fprintf(stderr, "  %-14s %s\n", commands[i].name, commands[i].help);
+  fprintf(stderr, "\noptions:\n");
+  fprintf(stderr, "  -d <definition.xml>  load a definition, repeat for several; ROMs pick theirs by internal id\n");
+  fprintf(stderr, "  -f                   use the first definition even when its id doesn't match\n");
+  fprintf(stderr, "  -j <threads>         worker threads, defaults to one per core\n");
+  fprintf(stderr, "  --stock <rom>        image the diff command compares against\n");
+  fprintf(stderr, "  -v                   print definition parser messages\n");
+}
+
+static void quietLog(void* context, const char* message)
+{
+}
+
+int main(int argc, char** argv)
+{
+  const char** definitionPaths = (const char**)calloc(argc, sizeof(const char*));
+  assert(definitionPaths);
+  int numDefinitionPaths = 0;
+  int threads = (int)std::thread::hardware_concurrency();
+  bool verbose = false;
+  bool haveCommand = false;
+  int arg = 1;
+
+  for(; arg < argc; arg++) {
+    if(strcmp(argv[arg], "-d") == 0 && arg + 1 < argc) definitionPaths[numDefinitionPaths++] = argv[++arg];
+    else if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) threads = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "--stock") == 0 && arg + 1 < argc) cli.stockPath = argv[++arg];
+    else if(strcmp(argv[arg], "-f") == 0) cli.force = true;
+    else if(strcmp(argv[arg], "-v") == 0) verbose = true;
+    else if(argv[arg][0] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else {
+      for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if(strcmp(argv[arg], commands[i].name) == 0) {
+          cli.command = commands[i].command;
+          haveCommand = true;
+        }
+      }
+      arg++;
+      break;
+    }
+  }
+  if(!haveCommand || arg >= argc || !numDefinitionPaths || (cli.command == CLI_DIFF && !cli.stockPath)) {
+    usage(argv[0]);
+    return 2;
+  }
+  if(threads < 1) threads = 1;
+
+  cli.definitions = (struct Definition*)calloc(numDefinitionPaths, sizeof(struct Definition));
+  assert(cli.definitions);
+  for(int i = 0; i < numDefinitionPaths; i++) {
+    struct DefinitionParse parse;
+    memset((void*)&parse, 0, sizeof(struct DefinitionParse));
+    parse.log = verbose ? NULL : quietLog;
+    setMetadataFilePath(&parse, (char*)definitionPaths[i]);
+    if(!loadMetadataFile(&parse, &cli.definitions[cli.numDefinitions])) {
+      fprintf(stderr, "could not load definition %s\n", definitionPaths[i]);
+      return 2;
+    }
+    free(parse.metadataFilePath);
+    cli.numDefinitions++;
+  }
+
+  if(cli.stockPath && !rom_file_open(&cli.stock, cli.stockPath)) {
+    fprintf(stderr, "could not open %s: %s\n", cli.stockPath, strerror(errno));
+    return 2;
+  }
+
+  if(cli.command == CLI_DIFF) {
+    cli.indexes = (struct AddressIndex*)calloc(cli.numDefinitions, sizeof(struct AddressIndex));
+    assert(cli.indexes);
+    for(int i = 0; i < cli.numDefinitions; i++) address_index_build(&cli.indexes[i], &cli.definitions[i]);
+  }
+
+  cli.numJobs = argc - arg;
+  cli.jobs = (struct CliJob*)calloc(cli.numJobs, sizeof(struct CliJob));
+  assert(cli.jobs);
+  for(int i = 0; i < cli.numJobs; i++) cli.jobs[i].path = argv[arg + i];
+  if(threads > cli.numJobs) threads = cli.numJobs;
+
+  if(cli.command == CLI_EXPORT_CSV) printf("file,table,x,y,value\n");
+
+  cli.next = 0;
+  std::thread* workers = new std::thread[threads];
+  for(int i = 0; i < threads; i++) workers[i] = std::thread(workerMain);
+
+  // write each file's output in order as soon as it and everything before it is done
+  int status = 0;
+  for(int i = 0; i < cli.numJobs; i++) {
+    struct CliJob* job = &cli.jobs[i];
+    {
+      std::unique_lock<std::mutex> guard(cli.lock);
+      cli.finished.wait(guard, [job] { return job->done; });
+    }
+    if(job->out.length) fwrite(job->out.data, 1, job->out.length, stdout);
+    fflush(stdout);
+    free(job->out.data);
+    if(job->status > status) status = job->status;
+  }
+
+  for(int i = 0; i < threads; i++) workers[i].join();
+  delete[] workers;
+  free(cli.jobs);
+  rom_file_close(&cli.stock);
+  for(int i = 0; i < cli.numDefinitions && cli.indexes; i++) address_index_free(&cli.indexes[i]);
+  free(cli.indexes);
+  for(int i = 0; i < cli.numDefinitions; i++) definition_deinit(&cli.definitions[i]);
+  free(cli.definitions);
+  free(definitionPaths);
+  return status;
+}
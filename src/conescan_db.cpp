@@ -8,6 +8,7 @@ void conescan_db_open(struct ConeScanDB* db, const char* path)
   assert(path);
   printf("loading db %s\n", path);
   sqlite3_open(path, &db->db);
+  sqlite3_busy_timeout(db->db, CONESCAN_DB_BUSY_MS);
 }
 
 void conescan_db_close(struct ConeScanDB* db)
@@ -5,6 +5,8 @@
 #include "imgui.h"
 
 #include "console.h"
+#include "idle.h"
+#include "profiler.h"
 
 namespace ConeScan {
     // Portable helpers
@@ -25,6 +27,7 @@ namespace ConeScan {
         Commands.push_back("HISTORY");
         Commands.push_back("CLEAR");
         Commands.push_back("CLASSIFY");
+        Commands.push_back("PROFILE");
         AutoScroll = true;
         ScrollToBottom = false;
         // AddLog("Console test");
@@ -57,6 +60,7 @@ namespace ConeScan {
         buf[IM_ARRAYSIZE(buf)-1] = 0;
         va_end(args);
         Items.push_back(Strdup(buf));
+        idle_post_event();
     }
 
     void    Console::Draw(const char* title, bool* p_open)
@@ -221,6 +225,24 @@ namespace ConeScan {
             for (int i = 0; i < Commands.Size; i++)
                 AddLog("- %s", Commands[i]);
         }
+        else if (Strnicmp(command_line, "PROFILE", 7) == 0)
+        {
+            // PROFILE [frames] [path]: dump the last frames of the profiler to CSV
+#ifdef CONESCAN_PROFILER
+            int frames = 0;
+            char path[256] = "profile.csv";
+            sscanf(command_line + 7, "%d %255s", &frames, path);
+            if (frames <= 0)
+                frames = PROFILER_HISTORY;
+            int written = profiler_dump_csv(path, frames);
+            if (written < 0)
+                AddLog("[error] could not write %s", path);
+            else
+                AddLog("wrote %d frames to %s", written, path);
+#else
+            AddLog("[error] profiler not enabled in this build, rebuild with PROFILER=1");
+#endif
+        }
         else if (Stricmp(command_line, "HISTORY") == 0)
         {
             int first = History.Size - 10;
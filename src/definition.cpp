@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -263,3 +264,137 @@ unsigned long definition_count_cells(struct Definition* definition)
     }
     return numCells;
 }
+
+int definition_scaling_size(struct Scaling* scaling)
+{
+    if (scaling == NULL || scaling->storagetype == NULL) return 4;
+    if (strcmp(scaling->storagetype, "uint8") == 0 || strcmp(scaling->storagetype, "int8") == 0) return 1;
+    if (strcmp(scaling->storagetype, "uint16") == 0 || strcmp(scaling->storagetype, "int16") == 0) return 2;
+    return 4;
+}
+
+double definition_read_raw(struct Scaling* scaling, const unsigned char* data, unsigned long address)
+{
+    int size = definition_scaling_size(scaling);
+    bool little = scaling && scaling->endian && strcmp(scaling->endian, "little") == 0;
+    uint32_t raw = 0;
+    for (int i = 0; i < size; i++) {
+        int shift = little ? i * 8 : (size - 1 - i) * 8;
+        raw |= (uint32_t)data[address + i] << shift;
+    }
+
+    const char* type = (scaling && scaling->storagetype) ? scaling->storagetype : "float";
+    if (strcmp(type, "float") == 0) {
+        float f;
+        memcpy(&f, &raw, sizeof(f));
+        return f;
+    }
+    if (strcmp(type, "int8") == 0) return (int8_t)raw;
+    if (strcmp(type, "int16") == 0) return (int16_t)raw;
+    if (strcmp(type, "int32") == 0) return (int32_t)raw;
+    return raw;
+}
+
+// recursive descent over a scaling expression, [*expr] is advanced as it's consumed
+static bool expr_sum(const char** expr, double x, double* out);
+
+static void expr_skip(const char** expr)
+{
+    while (**expr == ' ' || **expr == '\t') (*expr)++;
+}
+
+static bool expr_primary(const char** expr, double x, double* out)
+{
+    expr_skip(expr);
+    if (**expr == '(') {
+        (*expr)++;
+        if (!expr_sum(expr, x, out)) return false;
+        expr_skip(expr);
+        if (**expr != ')') return false;
+        (*expr)++;
+        return true;
+    }
+    if (**expr == 'x' || **expr == 'X') {
+        (*expr)++;
+        *out = x;
+        return true;
+    }
+    char* end = NULL;
+    *out = strtod(*expr, &end);
+    if (end == *expr) return false;
+    *expr = end;
+    return true;
+}
+
+static bool expr_unary(const char** expr, double x, double* out);
+
+static bool expr_power(const char** expr, double x, double* out)
+{
+    if (!expr_primary(expr, x, out)) return false;
+    expr_skip(expr);
+    if (**expr == '^') {
+        (*expr)++;
+        double exponent;
+        if (!expr_unary(expr, x, &exponent)) return false;
+        *out = pow(*out, exponent);
+    }
+    return true;
+}
+
+static bool expr_unary(const char** expr, double x, double* out)
+{
+    expr_skip(expr);
+    if (**expr == '-' || **expr == '+') {
+        bool negate = **expr == '-';
+        (*expr)++;
+        if (!expr_unary(expr, x, out)) return false;
+        if (negate) *out = -*out;
+        return true;
+    }
+    return expr_power(expr, x, out);
+}
+
+static bool expr_product(const char** expr, double x, double* out)
+{
+    if (!expr_unary(expr, x, out)) return false;
+    for (;;) {
+        expr_skip(expr);
+        char op = **expr;
+        if (op != '*' && op != '/') return true;
+        (*expr)++;
+        double rhs;
+        if (!expr_unary(expr, x, &rhs)) return false;
+        *out = op == '*' ? *out * rhs : *out / rhs;
+    }
+}
+
+static bool expr_sum(const char** expr, double x, double* out)
+{
+    if (!expr_product(expr, x, out)) return false;
+    for (;;) {
+        expr_skip(expr);
+        char op = **expr;
+        if (op != '+' && op != '-') return true;
+        (*expr)++;
+        double rhs;
+        if (!expr_product(expr, x, &rhs)) return false;
+        *out = op == '+' ? *out + rhs : *out - rhs;
+    }
+}
+
+bool definition_eval_expr(const char* expr, double x, double* out)
+{
+    if (expr == NULL) {
+        *out = x;
+        return true;
+    }
+    if (!expr_sum(&expr, x, out)) return false;
+    expr_skip(&expr);
+    return *expr == '\0';
+}
+
+bool definition_read_scaled(struct Scaling* scaling, const unsigned char* data, unsigned long address, double* out)
+{
+    double raw = definition_read_raw(scaling, data, address);
+    return definition_eval_expr(scaling ? scaling->toexpr : NULL, raw, out);
+}
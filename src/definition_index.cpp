@@ -0,0 +1,263 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "definition.h"
+#include "definition_index.h"
+
+static const char* uncategorized = "Uncategorized";
+
+// used by qsort to order tables by category then name
+static struct Table* sortTables = NULL;
+
+static const char* tableCategory(struct Table* table)
+{
+  return table->category ? table->category : uncategorized;
+}
+
+static int compareTables(const void* a, const void* b)
+{
+  struct Table* ta = &sortTables[*(const int*)a];
+  struct Table* tb = &sortTables[*(const int*)b];
+  int rc = strcmp(tableCategory(ta), tableCategory(tb));
+  if(rc) return rc;
+  return strcmp(ta->name ? ta->name : "", tb->name ? tb->name : "");
+}
+
+static int compareU64(const void* a, const void* b)
+{
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static uint32_t trigram(const char* s)
+{
+  return ((uint32_t)(uint8_t)s[0] << 16) | ((uint32_t)(uint8_t)s[1] << 8) | (uint32_t)(uint8_t)s[2];
+}
+
+static char* lowerConcat(const char* a, const char* b)
+{
+  size_t la = strlen(a), lb = strlen(b);
+  char* out = (char*)malloc(la + lb + 2);
+  assert(out);
+  for(size_t i = 0; i < la; i++) out[i] = (char)tolower((unsigned char)a[i]);
+  out[la] = ' ';
+  for(size_t i = 0; i < lb; i++) out[la + 1 + i] = (char)tolower((unsigned char)b[i]);
+  out[la + lb + 1] = '\0';
+  return out;
+}
+
+static void rebuildRows(struct DefinitionIndex* index)
+{
+  index->numRows = 0;
+  for(int c = 0; c < index->numCategories; c++) {
+    if(index->categoryMatches[c] == 0) continue;
+    index->rows[index->numRows++] = -(c + 1);
+    if(!index->categoryOpen[c]) continue;
+    for(int i = index->categoryStart[c]; i < index->categoryStart[c + 1]; i++) {
+      int t = index->categoryTables[i];
+      if(index->match[t]) index->rows[index->numRows++] = t;
+    }
+  }
+}
+
+void definition_index_build(struct DefinitionIndex* index, struct Definition* definition)
+{
+  definition_index_free(index);
+  int n = definition->numTables;
+  index->numTables = n;
+  if(n <= 0) return;
+
+  // group tables by category
+  index->categoryTables = (int*)malloc(sizeof(int) * n);
+  assert(index->categoryTables);
+  for(int i = 0; i < n; i++) index->categoryTables[i] = i;
+  sortTables = definition->tables;
+  qsort(index->categoryTables, n, sizeof(int), compareTables);
+  sortTables = NULL;
+
+  index->categories = (const char**)malloc(sizeof(char*) * n);
+  index->categoryStart = (int*)malloc(sizeof(int) * (n + 1));
+  assert(index->categories);
+  assert(index->categoryStart);
+  index->numCategories = 0;
+  for(int i = 0; i < n; i++) {
+    const char* category = tableCategory(&definition->tables[index->categoryTables[i]]);
+    if(index->numCategories == 0 || strcmp(index->categories[index->numCategories - 1], category) != 0) {
+      index->categories[index->numCategories] = category;
+      index->categoryStart[index->numCategories] = i;
+      index->numCategories++;
+    }
+  }
+  index->categoryStart[index->numCategories] = n;
+
+  index->categoryMatches = (int*)malloc(sizeof(int) * index->numCategories);
+  index->categoryOpen = (bool*)malloc(sizeof(bool) * index->numCategories);
+  assert(index->categoryMatches);
+  assert(index->categoryOpen);
+  memset(index->categoryOpen, 0, sizeof(bool) * index->numCategories);
+
+  // search strings and every (trigram, table) pair
+  index->searchText = (char**)malloc(sizeof(char*) * n);
+  assert(index->searchText);
+  size_t numPairs = 0, maxPairs = 0;
+  for(int i = 0; i < n; i++) {
+    struct Table* table = &definition->tables[i];
+    index->searchText[i] = lowerConcat(tableCategory(table), table->name ? table->name : "");
+    size_t len = strlen(index->searchText[i]);
+    if(len >= 3) maxPairs += len - 2;
+  }
+
+  uint64_t* pairs = (uint64_t*)malloc(sizeof(uint64_t) * (maxPairs ? maxPairs : 1));
+  assert(pairs);
+  for(int i = 0; i < n; i++) {
+    const char* text = index->searchText[i];
+    size_t len = strlen(text);
+    for(size_t j = 0; j + 3 <= len; j++)
+      pairs[numPairs++] = ((uint64_t)trigram(text + j) << 32) | (uint32_t)i;
+  }
+  qsort(pairs, numPairs, sizeof(uint64_t), compareU64);
+
+  // compress into sorted keys and posting lists, dropping duplicates
+  index->trigramKeys = (uint32_t*)malloc(sizeof(uint32_t) * (numPairs ? numPairs : 1));
+  index->trigramStart = (int*)malloc(sizeof(int) * (numPairs + 1));
+  index->trigramTables = (int*)malloc(sizeof(int) * (numPairs ? numPairs : 1));
+  assert(index->trigramKeys);
+  assert(index->trigramStart);
+  assert(index->trigramTables);
+  int postings = 0;
+  index->numTrigrams = 0;
+  for(size_t i = 0; i < numPairs; i++) {
+    if(i > 0 && pairs[i] == pairs[i - 1]) continue;
+    uint32_t key = (uint32_t)(pairs[i] >> 32);
+    if(index->numTrigrams == 0 || index->trigramKeys[index->numTrigrams - 1] != key) {
+      index->trigramKeys[index->numTrigrams] = key;
+      index->trigramStart[index->numTrigrams] = postings;
+      index->numTrigrams++;
+    }
+    index->trigramTables[postings++] = (int)(pairs[i] & 0xffffffff);
+  }
+  index->trigramStart[index->numTrigrams] = postings;
+  free(pairs);
+
+  index->match = (bool*)malloc(sizeof(bool) * n);
+  index->rows = (int*)malloc(sizeof(int) * (n + index->numCategories));
+  assert(index->match);
+  assert(index->rows);
+  definition_index_search(index, "");
+}
+
+void definition_index_free(struct DefinitionIndex* index)
+{
+  if(index->searchText) {
+    for(int i = 0; i < index->numTables; i++)
+      free(index->searchText[i]);
+    free(index->searchText);
+  }
+  if(index->categories) free(index->categories);
+  if(index->categoryStart) free(index->categoryStart);
+  if(index->categoryTables) free(index->categoryTables);
+  if(index->categoryMatches) free(index->categoryMatches);
+  if(index->categoryOpen) free(index->categoryOpen);
+  if(index->trigramKeys) free(index->trigramKeys);
+  if(index->trigramStart) free(index->trigramStart);
+  if(index->trigramTables) free(index->trigramTables);
+  if(index->match) free(index->match);
+  if(index->rows) free(index->rows);
+  memset(index, 0, sizeof(struct DefinitionIndex));
+}
+
+// posting list for a trigram, NULL if no table contains it
+static const int* postingList(struct DefinitionIndex* index, uint32_t key, int* count)
+{
+  int lo = 0, hi = index->numTrigrams;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(index->trigramKeys[mid] < key) lo = mid + 1;
+    else hi = mid;
+  }
+  if(lo == index->numTrigrams || index->trigramKeys[lo] != key) {
+    *count = 0;
+    return NULL;
+  }
+  *count = index->trigramStart[lo + 1] - index->trigramStart[lo];
+  return &index->trigramTables[index->trigramStart[lo]];
+}
+
+int definition_index_search(struct DefinitionIndex* index, const char* query)
+{
+  if(index->numTables == 0) return 0;
+
+  // lowercase copy, terms split in place on whitespace
+  char terms[DEFINITION_INDEX_QUERY_MAX];
+  snprintf(index->query, sizeof(index->query), "%s", query ? query : "");
+  int numTerms = 0;
+  const char* term[DEFINITION_INDEX_QUERY_MAX / 2];
+  size_t len = strlen(index->query);
+  for(size_t i = 0; i <= len; i++) {
+    char c = (char)tolower((unsigned char)index->query[i]);
+    terms[i] = isspace((unsigned char)c) ? '\0' : c;
+    if(terms[i] && (i == 0 || terms[i - 1] == '\0'))
+      term[numTerms++] = &terms[i];
+  }
+
+  memset(index->categoryMatches, 0, sizeof(int) * index->numCategories);
+  index->numMatches = 0;
+
+  if(numTerms == 0) {
+    memset(index->match, 1, sizeof(bool) * index->numTables);
+    index->numMatches = index->numTables;
+  } else {
+    // candidates come from the shortest posting list of any term's trigrams,
+    // short terms fall back to checking every table
+    const int* candidates = NULL;
+    int numCandidates = index->numTables;
+    bool none = false;
+    for(int t = 0; t < numTerms && !none; t++) {
+      size_t tlen = strlen(term[t]);
+      for(size_t j = 0; j + 3 <= tlen; j++) {
+        int count = 0;
+        const int* list = postingList(index, trigram(term[t] + j), &count);
+        if(!list) { none = true; break; }
+        if(count < numCandidates || candidates == NULL) {
+          candidates = list;
+          numCandidates = count;
+        }
+      }
+    }
+
+    memset(index->match, 0, sizeof(bool) * index->numTables);
+    if(!none) {
+      for(int i = 0; i < numCandidates; i++) {
+        int table = candidates ? candidates[i] : i;
+        bool ok = true;
+        for(int t = 0; t < numTerms && ok; t++)
+          ok = strstr(index->searchText[table], term[t]) != NULL;
+        if(ok) {
+          index->match[table] = true;
+          index->numMatches++;
+        }
+      }
+    }
+  }
+
+  for(int c = 0; c < index->numCategories; c++) {
+    for(int i = index->categoryStart[c]; i < index->categoryStart[c + 1]; i++)
+      if(index->match[index->categoryTables[i]]) index->categoryMatches[c]++;
+    // searching opens every category with a hit, clearing the search collapses them
+    index->categoryOpen[c] = numTerms > 0 && index->categoryMatches[c] > 0;
+  }
+  rebuildRows(index);
+  return index->numMatches;
+}
+
+void definition_index_set_open(struct DefinitionIndex* index, int category, bool open)
+{
+  assert(category >= 0 && category < index->numCategories);
+  index->categoryOpen[category] = open;
+  rebuildRows(index);
+}
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "tinyxml2.h"
@@ -8,6 +10,19 @@
 #include "definition_parse.h"
 #include "definition.h"
 
+static void parseLog(struct DefinitionParse* parse, const char* fmt, ...)
+{
+    char message[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    if (parse->log)
+        parse->log(parse->logContext, message);
+    else
+        fprintf(stderr, "%s\n", message);
+}
+
 void closeMetadataFile(struct DefinitionParse* parse,
                        struct Definition* definition)
 {
@@ -81,7 +96,7 @@ void loadScalings(struct DefinitionParse* parse,
         definition->numScalings += 1;
         scaling = scaling->NextSiblingElement("scaling");
     }
-    parse->console->AddLog("Processing %d scalings", definition->numScalings);
+    parseLog(parse, "Processing %d scalings", definition->numScalings);
     definition_new_scalings(definition);
 
     scaling = rom->FirstChildElement("scaling");
@@ -89,7 +104,7 @@ void loadScalings(struct DefinitionParse* parse,
     while (scaling) {
         const char* name = scaling->Attribute("name");
         if (name == NULL) {
-            parse->console->AddLog("[error] Invalid scaling: missing name");
+            parseLog(parse, "[error] Invalid scaling: missing name");
         }
         loadScaling(&definition->scalings[index], scaling);
 
@@ -123,7 +138,7 @@ void loadTable(struct DefinitionParse* parse,
         }
     }
     if (table->Scaling == NULL) {
-        parse->console->AddLog("Could not locate scaling for table %s", table->name);
+        parseLog(parse, "Could not locate scaling for table %s", table->name);
     }
 }
 
@@ -140,7 +155,7 @@ void loadTables(struct DefinitionParse* parse,
         definition->numTables += 1;
         table = table->NextSiblingElement("table");
     }
-    parse->console->AddLog("Processing %d tables", definition->numTables);
+    parseLog(parse, "Processing %d tables", definition->numTables);
     definition_new_tables(&definition->tables, definition->numTables);
 
     /*
@@ -207,14 +222,13 @@ bool loadMetadataFile(struct DefinitionParse* parse,
     assert(parse->metadataFile == NULL);
     parse->metadataFile = new tinyxml2::XMLDocument();
     
-    parse->console->AddLog("loading definition file %s\n", parse->metadataFilePath);
+    parseLog(parse, "loading definition file %s", parse->metadataFilePath);
     if (parse->metadataFile->LoadFile(parse->metadataFilePath) != tinyxml2::XML_SUCCESS) {
-        parse->console->AddLog("Failed to open metadata file %s\n", parse->metadataFile->ErrorStr());
+        parseLog(parse, "Failed to open metadata file %s", parse->metadataFile->ErrorStr());
         closeMetadataFile(parse, definition);
         return false;
     }
-    printf("opened definition file %s\n", parse->metadataFilePath);
-    parse->console->AddLog("Opened %s\n", parse->metadataFilePath);
+    parseLog(parse, "Opened %s", parse->metadataFilePath);
     tinyxml2::XMLElement* def;
     def = parse->metadataFile->RootElement();
     tinyxml2::XMLNode* node;
@@ -236,7 +250,7 @@ bool loadMetadataFile(struct DefinitionParse* parse,
 
             node = node->NextSiblingElement();
         }
-        parse->console->AddLog("metadata xmlid = %s", definition->xmlid);
+        parseLog(parse, "metadata xmlid = %s", definition->xmlid);
         loadScalings(parse, definition, rom);
         loadTables(parse, definition, rom);
         delete parse->metadataFile;
@@ -0,0 +1,180 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "conescan_db.h"
+#include "download_cache.h"
+#include "rom_file.h"
+#include "sqlite3.h"
+
+uint32_t download_cache_blocks(unsigned long transferSize)
+{
+  return (uint32_t)((transferSize + DOWNLOAD_CACHE_BLOCK_SIZE - 1) / DOWNLOAD_CACHE_BLOCK_SIZE);
+}
+
+static unsigned long blockLength(unsigned long transferSize, uint32_t block)
+{
+  unsigned long offset = (unsigned long)block * DOWNLOAD_CACHE_BLOCK_SIZE;
+  return transferSize - offset < DOWNLOAD_CACHE_BLOCK_SIZE ? transferSize - offset : DOWNLOAD_CACHE_BLOCK_SIZE;
+}
+
+int64_t conescan_db_open_download(struct ConeScanDB* db, const char* vin, const char* calID,
+                                  unsigned long startAddress, unsigned long transferSize,
+                                  uint8_t* bitmap, unsigned char* data)
+{
+  uint32_t numBlocks = download_cache_blocks(transferSize);
+  size_t bitmapBytes = (numBlocks + 7) / 8;
+  memset(bitmap, 0, bitmapBytes);
+
+  sqlite3_stmt* statement;
+  int rc;
+  rc = sqlite3_prepare_v2(db->db,
+    "INSERT INTO rom_download(vin, cal_id, start_address, transfer_size, block_size, bitmap, inserted_at, updated_at) "
+    "VALUES(?, ?, ?, ?, ?, ?, strftime('%Y-%m-%dT%H:%M:%S', 'now'), strftime('%Y-%m-%dT%H:%M:%S', 'now')) "
+    "ON CONFLICT(vin, cal_id, start_address, transfer_size) DO UPDATE SET updated_at=excluded.updated_at "
+    "RETURNING id, block_size, bitmap", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 1, vin, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 2, calID, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 3, startAddress);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 4, transferSize);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int(statement, 5, DOWNLOAD_CACHE_BLOCK_SIZE);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_zeroblob(statement, 6, (int)bitmapBytes);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_ROW);
+  int64_t id = sqlite3_column_int64(statement, 0);
+  // blocks saved with a different size can't be reused, they are dropped below
+  bool sameBlocks = sqlite3_column_int(statement, 1) == DOWNLOAD_CACHE_BLOCK_SIZE &&
+                    (size_t)sqlite3_column_bytes(statement, 2) == bitmapBytes;
+  if(sameBlocks) memcpy(bitmap, sqlite3_column_blob(statement, 2), bitmapBytes);
+  sqlite3_finalize(statement);
+
+  if(!sameBlocks) {
+    conescan_db_delete_download(db, id);
+    return conescan_db_open_download(db, vin, calID, startAddress, transferSize, bitmap, data);
+  }
+
+  rc = sqlite3_prepare_v2(db->db, "SELECT block, data, hash FROM rom_download_block WHERE download_id = ?", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 1, id);
+  assert(rc == SQLITE_OK);
+  while((rc = sqlite3_step(statement)) == SQLITE_ROW) {
+    int64_t block = sqlite3_column_int64(statement, 0);
+    if(block < 0 || block >= numBlocks) continue;
+    if(!(bitmap[block / 8] & (1 << (block % 8)))) continue;
+    // a short, missing or damaged block is read again
+    const unsigned char* stored = (const unsigned char*)sqlite3_column_blob(statement, 1);
+    unsigned long length = (unsigned long)sqlite3_column_bytes(statement, 1);
+    if(length != blockLength(transferSize, (uint32_t)block) || sqlite3_column_type(statement, 2) == SQLITE_NULL ||
+       (uint64_t)sqlite3_column_int64(statement, 2) != rom_file_hash_bytes(stored, length, 0)) {
+      bitmap[block / 8] &= ~(1 << (block % 8));
+      continue;
+    }
+    memcpy(data + block * DOWNLOAD_CACHE_BLOCK_SIZE, stored, length);
+  }
+  if(rc != SQLITE_DONE) printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+  sqlite3_finalize(statement);
+  return id;
+}
+
+void conescan_db_save_download_blocks(struct ConeScanDB* db, int64_t id, unsigned long transferSize,
+                                      const uint32_t* blocks, int count, const unsigned char* data,
+                                      const uint8_t* bitmap)
+{
+  if(count == 0) return;
+  int rc;
+  rc = sqlite3_exec(db->db, "BEGIN", NULL, NULL, NULL);
+  assert(rc == SQLITE_OK);
+
+  sqlite3_stmt* statement;
+  rc = sqlite3_prepare_v2(db->db,
+    "INSERT INTO rom_download_block(download_id, block, data, hash) VALUES(?, ?, ?, ?) "
+    "ON CONFLICT(download_id, block) DO UPDATE SET data=excluded.data, hash=excluded.hash", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  for(int i = 0; i < count; i++) {
+    const unsigned char* block = data + (unsigned long)blocks[i] * DOWNLOAD_CACHE_BLOCK_SIZE;
+    unsigned long length = blockLength(transferSize, blocks[i]);
+    rc = sqlite3_bind_int64(statement, 1, id);
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_bind_int(statement, 2, (int)blocks[i]);
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_bind_blob(statement, 3, block, (int)length, SQLITE_STATIC);
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_bind_int64(statement, 4, (sqlite3_int64)rom_file_hash_bytes(block, length, 0));
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_step(statement);
+    assert(rc == SQLITE_DONE);
+    sqlite3_reset(statement);
+  }
+  sqlite3_finalize(statement);
+
+  rc = sqlite3_prepare_v2(db->db,
+    "UPDATE rom_download SET bitmap = ?, updated_at = strftime('%Y-%m-%dT%H:%M:%S', 'now') WHERE id = ?", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_blob(statement, 1, bitmap, (int)((download_cache_blocks(transferSize) + 7) / 8), SQLITE_STATIC);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 2, id);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_DONE);
+  sqlite3_finalize(statement);
+
+  rc = sqlite3_exec(db->db, "COMMIT", NULL, NULL, NULL);
+  assert(rc == SQLITE_OK);
+}
+
+void conescan_db_clear_download(struct ConeScanDB* db, int64_t id, unsigned long transferSize)
+{
+  sqlite3_stmt* statement;
+  int rc;
+  rc = sqlite3_exec(db->db, "BEGIN", NULL, NULL, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_prepare_v2(db->db, "DELETE FROM rom_download_block WHERE download_id = ?", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 1, id);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_DONE);
+  sqlite3_finalize(statement);
+
+  rc = sqlite3_prepare_v2(db->db,
+    "UPDATE rom_download SET bitmap = ?, updated_at = strftime('%Y-%m-%dT%H:%M:%S', 'now') WHERE id = ?", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_zeroblob(statement, 1, (int)((download_cache_blocks(transferSize) + 7) / 8));
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 2, id);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_DONE);
+  sqlite3_finalize(statement);
+  rc = sqlite3_exec(db->db, "COMMIT", NULL, NULL, NULL);
+  assert(rc == SQLITE_OK);
+}
+
+void conescan_db_delete_download(struct ConeScanDB* db, int64_t id)
+{
+  sqlite3_stmt* statement;
+  int rc;
+  // foreign keys aren't enabled on the connection, so blocks go explicitly
+  const char* queries[] = {
+    "DELETE FROM rom_download_block WHERE download_id = ?",
+    "DELETE FROM rom_download WHERE id = ?",
+  };
+  for(size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+    rc = sqlite3_prepare_v2(db->db, queries[i], -1, &statement, 0);
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_bind_int64(statement, 1, id);
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_step(statement);
+    assert(rc == SQLITE_DONE);
+    sqlite3_finalize(statement);
+  }
+}
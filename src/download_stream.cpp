@@ -0,0 +1,176 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "download_stream.h"
+#include "rom_file.h"
+#include "rom_save.h"
+
+static unsigned long pageLength(unsigned long length, long page)
+{
+  unsigned long start = (unsigned long)page << ROM_FILE_PAGE_SHIFT;
+  return length - start < ROM_FILE_PAGE_SIZE ? length - start : ROM_FILE_PAGE_SIZE;
+}
+
+static void consume(struct DownloadStream* stream, const struct DownloadChunk* chunk)
+{
+  if(stream->spool && !stream->spoolFailed) {
+    if(fseek(stream->spool, (long)chunk->offset, SEEK_SET) ||
+       fwrite(stream->data + chunk->offset, 1, chunk->length, stream->spool) != chunk->length)
+      stream->spoolFailed = true;
+  }
+
+  unsigned long end = (unsigned long)chunk->offset + chunk->length;
+  for(long page = chunk->offset >> ROM_FILE_PAGE_SHIFT; page < stream->numPages; page++) {
+    unsigned long pageStart = (unsigned long)page << ROM_FILE_PAGE_SHIFT;
+    if(pageStart >= end) break;
+    unsigned long from = chunk->offset > pageStart ? chunk->offset : pageStart;
+    unsigned long to = end < pageStart + ROM_FILE_PAGE_SIZE ? end : pageStart + ROM_FILE_PAGE_SIZE;
+    stream->pageFilled[page] += (uint32_t)(to - from);
+    if(stream->pageFilled[page] != pageLength(stream->length, page)) continue;
+    stream->pageHash[page] = rom_file_hash_bytes(stream->data + pageStart, pageLength(stream->length, page), page);
+    stream->pagesHashed.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// takes everything queued, returns false when the ring was empty
+static bool drain(struct DownloadStream* stream)
+{
+  uint32_t tail = stream->tail.load(std::memory_order_relaxed);
+  uint32_t head = stream->head.load(std::memory_order_acquire);
+  if(tail == head) return false;
+  for(; tail != head; tail++)
+    consume(stream, &stream->chunks[tail % DOWNLOAD_STREAM_SLOTS]);
+  stream->tail.store(tail, std::memory_order_release);
+  // a producer waiting on a full ring can go on, the lock keeps it from missing this
+  { std::lock_guard<std::mutex> guard(stream->lock); }
+  stream->wake.notify_all();
+  return true;
+}
+
+static void consumer(struct DownloadStream* stream)
+{
+  while(true) {
+    if(drain(stream)) continue;
+    std::unique_lock<std::mutex> guard(stream->lock);
+    if(stream->closing.load(std::memory_order_acquire)) {
+      guard.unlock();
+      drain(stream);
+      return;
+    }
+    stream->wake.wait(guard, [stream] {
+      return stream->closing.load(std::memory_order_acquire) ||
+             stream->head.load(std::memory_order_acquire) != stream->tail.load(std::memory_order_relaxed);
+    });
+  }
+}
+
+void download_stream_open(struct DownloadStream* stream, const unsigned char* data, unsigned long length, const char* path)
+{
+  stream->data = data;
+  stream->length = length;
+  stream->head.store(0, std::memory_order_relaxed);
+  stream->tail.store(0, std::memory_order_relaxed);
+  stream->closing.store(false, std::memory_order_relaxed);
+  stream->numPages = (long)((length + ROM_FILE_PAGE_SIZE - 1) >> ROM_FILE_PAGE_SHIFT);
+  stream->pageFilled = (uint32_t*)calloc(stream->numPages ? stream->numPages : 1, sizeof(uint32_t));
+  stream->pageHash = (uint64_t*)calloc(stream->numPages ? stream->numPages : 1, sizeof(uint64_t));
+  assert(stream->pageFilled && stream->pageHash);
+  stream->pagesHashed.store(0, std::memory_order_relaxed);
+  stream->spoolFailed = false;
+  stream->spool = NULL;
+  stream->spoolPath = NULL;
+  stream->path = NULL;
+  if(path) {
+    size_t size = strlen(path) + sizeof(".part");
+    stream->path = (char*)malloc(strlen(path) + 1);
+    stream->spoolPath = (char*)malloc(size);
+    assert(stream->path && stream->spoolPath);
+    strcpy(stream->path, path);
+    snprintf(stream->spoolPath, size, "%s.part", path);
+    stream->spool = fopen(stream->spoolPath, "wb");
+    if(!stream->spool) stream->spoolFailed = true;
+  }
+
+#ifndef __EMSCRIPTEN__
+  stream->consumer = std::thread(consumer, stream);
+#endif
+}
+
+void download_stream_push(struct DownloadStream* stream, unsigned long offset, unsigned long length)
+{
+  uint32_t head = stream->head.load(std::memory_order_relaxed);
+#ifdef __EMSCRIPTEN__
+  // no consumer thread, the chunk is taken right away
+  if(head - stream->tail.load(std::memory_order_relaxed) >= DOWNLOAD_STREAM_SLOTS) drain(stream);
+#else
+  if(head - stream->tail.load(std::memory_order_acquire) >= DOWNLOAD_STREAM_SLOTS) {
+    std::unique_lock<std::mutex> guard(stream->lock);
+    stream->wake.wait(guard, [stream, head] {
+      return head - stream->tail.load(std::memory_order_acquire) < DOWNLOAD_STREAM_SLOTS;
+    });
+  }
+#endif
+  struct DownloadChunk* chunk = &stream->chunks[head % DOWNLOAD_STREAM_SLOTS];
+  chunk->offset = (uint32_t)offset;
+  chunk->length = (uint32_t)length;
+  stream->head.store(head + 1, std::memory_order_release);
+#ifndef __EMSCRIPTEN__
+  // taking the lock orders this with a consumer about to sleep
+  { std::lock_guard<std::mutex> guard(stream->lock); }
+  stream->wake.notify_all();
+#endif
+}
+
+bool download_stream_close(struct DownloadStream* stream, bool complete, uint64_t* hash, bool* spooled)
+{
+  if(spooled) *spooled = false;
+  if(!download_stream_active(stream)) return false;
+#ifdef __EMSCRIPTEN__
+  drain(stream);
+#else
+  {
+    std::lock_guard<std::mutex> guard(stream->lock);
+    stream->closing.store(true, std::memory_order_release);
+  }
+  stream->wake.notify_all();
+  if(stream->consumer.joinable()) stream->consumer.join();
+#endif
+
+  bool whole = complete && stream->pagesHashed.load(std::memory_order_relaxed) == stream->numPages;
+  if(whole && hash)
+    *hash = rom_file_hash_bytes((const unsigned char*)stream->pageHash, sizeof(uint64_t) * stream->numPages,
+                                (uint64_t)stream->length);
+  if(stream->spool) {
+    if(fclose(stream->spool)) stream->spoolFailed = true;
+    stream->spool = NULL;
+  }
+  if(stream->spoolPath) {
+    bool renamed = whole && !stream->spoolFailed && rom_save_replace(stream->spoolPath, stream->path);
+    if(!renamed) {
+      int error = errno;
+      remove(stream->spoolPath);
+      errno = error;
+    }
+    if(spooled) *spooled = renamed;
+  }
+
+  free(stream->pageFilled);
+  free(stream->pageHash);
+  if(stream->spoolPath) free(stream->spoolPath);
+  if(stream->path) free(stream->path);
+  stream->pageFilled = NULL;
+  stream->pageHash = NULL;
+  stream->spoolPath = NULL;
+  stream->path = NULL;
+  stream->numPages = 0;
+  return whole;
+}
+
+bool download_stream_active(const struct DownloadStream* stream)
+{
+  return stream->pageFilled != NULL;
+}
@@ -36,3 +36,26 @@ char* getFileOpenPath(char* defaultPath, bool save)
     return NULL;
 }
 #endif
+
+char* getFileSavePath(char* defaultPath)
+#ifdef __EMSCRIPTEN__
+{
+    return NULL;
+}
+#else
+{
+    nfdchar_t* outPath = NULL;
+    nfdresult_t result = NFD_SaveDialog(NULL, defaultPath, &outPath);
+
+    if (result == NFD_OKAY) {
+        return outPath;
+    }
+    else if (result == NFD_CANCEL) {
+        fprintf(stderr, "User pressed cancel.");
+        return NULL;
+    }
+
+    printf("Error: %s\n", NFD_GetError());
+    return NULL;
+}
+#endif
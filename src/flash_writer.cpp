@@ -0,0 +1,172 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "flash_writer.h"
+
+static bool fail(struct FlashWriteResult* result, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vsnprintf(result->error, sizeof(result->error), format, args);
+  va_end(args);
+  return false;
+}
+
+static bool unlock(struct UDSEcu* ecu, struct FlashWriteResult* result)
+{
+  uint8_t* seed = NULL;
+  uint8_t* key = NULL;
+  bool ok = false;
+  if(!ecu->initDiagSession(ecu->context, 0x85)) fail(result, "could not get diag session");
+  else if(ecu->getSeed(ecu->context, &seed)) fail(result, "could not get seed");
+  else if(ecu->calculateKey(ecu->context, seed, &key)) fail(result, "could not calculate key");
+  else if(!ecu->unlock(ecu->context, key)) fail(result, "could not exchange key");
+  else ok = true;
+  if(seed) free(seed);
+  if(key) free(key);
+  return ok;
+}
+
+static bool readChunk(struct UDSEcu* ecu, unsigned long address, uint16_t size, char* out,
+                      struct FlashWriteResult* result)
+{
+  for(int attempt = 0; attempt < FLASH_WRITE_RETRIES; attempt++) {
+    if(attempt) result->retries++;
+    if(ecu->readMem(ecu->context, address, size, out) == 0) {
+      result->bytesRead += size;
+      return true;
+    }
+  }
+  return fail(result, "could not read 0x%04X bytes at 0x%06lX", size, address);
+}
+
+static bool writeChunk(struct UDSEcu* ecu, unsigned long address, uint16_t size, const char* data,
+                       struct FlashWriteResult* result)
+{
+  for(int attempt = 0; attempt < FLASH_WRITE_RETRIES; attempt++) {
+    if(attempt) result->retries++;
+    if(ecu->writeMem(ecu->context, address, size, data) == 0) {
+      result->bytesWritten += size;
+      return true;
+    }
+  }
+  return fail(result, "could not write 0x%04X bytes at 0x%06lX", size, address);
+}
+
+static uint16_t chunkAt(unsigned long address, unsigned long end)
+{
+  return (uint16_t)(end - address < FLASH_WRITE_CHUNK ? end - address : FLASH_WRITE_CHUNK);
+}
+
+// stops reading at the first chunk that differs, the rest is rewritten anyway
+static bool sectorMatches(struct UDSEcu* ecu, const struct RomFile* image, unsigned long start, unsigned long end,
+                          char* buffer, bool* same, struct FlashWriteResult* result)
+{
+  *same = true;
+  for(unsigned long address = start; address < end; address += FLASH_WRITE_CHUNK) {
+    uint16_t size = chunkAt(address, end);
+    if(!readChunk(ecu, address, size, buffer, result)) return false;
+    if(memcmp(buffer, image->data + address, size) != 0) {
+      *same = false;
+      return true;
+    }
+  }
+  return true;
+}
+
+static bool erased(const unsigned char* data, uint16_t size)
+{
+  for(uint16_t i = 0; i < size; i++)
+    if(data[i] != 0xFF) return false;
+  return true;
+}
+
+static bool programSector(struct UDSEcu* ecu, const struct RomFile* image, unsigned long start, unsigned long end,
+                          char* buffer, struct FlashWriteResult* result)
+{
+  if(ecu->eraseBlock(ecu->context, start, end - start) != 0)
+    return fail(result, "could not erase 0x%06lX-0x%06lX", start, end);
+
+  // erased flash already reads 0xFF, those chunks need no request
+  for(unsigned long address = start; address < end; address += FLASH_WRITE_CHUNK) {
+    uint16_t size = chunkAt(address, end);
+    if(erased(image->data + address, size)) continue;
+    if(!writeChunk(ecu, address, size, (const char*)image->data + address, result)) return false;
+  }
+
+  for(unsigned long address = start; address < end; address += FLASH_WRITE_CHUNK)
+    if(!readChunk(ecu, address, chunkAt(address, end), buffer + (address - start), result)) return false;
+  if(memcmp(buffer, image->data + start, end - start) != 0)
+    return fail(result, "0x%06lX-0x%06lX doesn't read back as written", start, end);
+  return true;
+}
+
+// sectors holding a page written since the last flash, every sector for
+// an image never flashed. Not the dirty map, saving clears that
+static int pickSectors(const struct RomFile* image, const struct MemModel* model, bool* picked)
+{
+  memset(picked, 0, sizeof(bool) * model->numSectors);
+  unsigned long start, end, offset = 0;
+  while(rom_file_next_unflashed(image, offset, &start, &end)) {
+    int last = memmodel_sector(model, end - 1);
+    for(int s = memmodel_sector(model, start); s >= 0 && s <= last; s++) picked[s] = true;
+    offset = end;
+  }
+  int count = 0;
+  for(int s = 0; s < model->numSectors; s++)
+    if(picked[s]) count++;
+  return count;
+}
+
+bool flash_write(struct UDSEcu* ecu, struct RomFile* image, const struct MemModel* model,
+                 struct Checksum* checksum, bool allowBoot, struct FlashWriteResult* result)
+{
+  memset(result, 0, sizeof(*result));
+  auto begin = std::chrono::steady_clock::now();
+
+  if(!ecu->eraseBlock || !ecu->writeMem) return fail(result, "this ECU connection can't program flash");
+  if(!image->data || (unsigned long)image->length != model->romSize)
+    return fail(result, "image is 0x%lX bytes, %s flash is 0x%lX", (unsigned long)image->length, model->name, model->romSize);
+  if(checksum) {
+    checksum_wait(checksum);
+    int invalid = checksum_invalid(checksum, image);
+    if(invalid != 0) return fail(result, "%d checksum ranges don't match, fix them before flashing", invalid);
+  }
+
+  bool* picked = (bool*)malloc(sizeof(bool) * model->numSectors);
+  unsigned long largest = 0;
+  for(int s = 0; s < model->numSectors; s++)
+    if(model->sectors[s + 1] - model->sectors[s] > largest) largest = model->sectors[s + 1] - model->sectors[s];
+  char* buffer = (char*)malloc(largest);
+  assert(picked && buffer);
+
+  bool ok = pickSectors(image, model, picked) == 0 || unlock(ecu, result);
+  for(int s = 0; ok && s < model->numSectors; s++) {
+    if(!picked[s]) continue;
+    unsigned long start = model->sectors[s], end = model->sectors[s + 1];
+    bool same;
+    ok = sectorMatches(ecu, image, start, end, buffer, &same, result);
+    if(!ok) break;
+    result->sectorsChecked++;
+    if(same) continue;
+    // the boot blocks come first, nothing has been erased yet when this refuses
+    if(start < model->bootEnd && !allowBoot) {
+      ok = fail(result, "0x%06lX-0x%06lX holds boot code, rewriting it wasn't allowed", start, end);
+      break;
+    }
+    ok = programSector(ecu, image, start, end, buffer, result);
+    if(ok) result->sectorsWritten++;
+  }
+
+  free(buffer);
+  free(picked);
+  if(ok) rom_file_clear_unflashed(image);
+  result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  return ok;
+}
@@ -0,0 +1,77 @@
+#include <stddef.h>
+
+#include <atomic>
+
+#include "idle.h"
+
+struct IdleConfig idle_config = {
+  true,  // enabled
+  10,    // backgroundRate
+  0.5f,  // idleTimeout
+  3,     // settleFrames
+};
+
+// set by background threads, cleared by the main loop
+static std::atomic<bool> pending(false);
+
+// posts an empty event to the window system, NULL without a window
+static void (*wakeLoop)(void) = NULL;
+
+// frames left to render after the last input
+static int settle = 0;
+
+// time the last frame was rendered at
+static double lastFrame = 0.0;
+
+void idle_post_event(void)
+{
+  // only the first event since the last frame has to wake the loop
+  if(!pending.exchange(true, std::memory_order_acq_rel) && wakeLoop) wakeLoop();
+}
+
+void idle_set_wake(void (*wake)(void))
+{
+  wakeLoop = wake;
+}
+
+static double backgroundPeriod(void)
+{
+  int rate = idle_config.backgroundRate > 0 ? idle_config.backgroundRate : 1;
+  return 1.0 / rate;
+}
+
+double idle_wait_timeout(double now, bool busy)
+{
+  if(!idle_config.enabled) return 0.0;
+  if(settle > 0) return 0.0;
+
+  if(busy || pending.load(std::memory_order_acquire)) {
+    double next = lastFrame + backgroundPeriod();
+    return next > now ? next - now : 0.0;
+  }
+  return idle_config.idleTimeout;
+}
+
+bool idle_frame_begin(double now, bool had_input, bool busy)
+{
+  bool input = had_input || settle > 0;
+  bool background = false;
+
+  // background work only gets a frame every [backgroundRate]
+  // (with a millisecond of slack for timer granularity)
+  if(busy || pending.load(std::memory_order_acquire))
+    background = (now - lastFrame) >= (backgroundPeriod() - 0.001);
+
+  if(had_input) {
+    settle = idle_config.settleFrames;
+  } else if(settle > 0) {
+    settle--;
+  }
+
+  if(!idle_config.enabled || input || background) {
+    pending.store(false, std::memory_order_release);
+    lastFrame = now;
+    return true;
+  }
+  return false;
+}
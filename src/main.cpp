@@ -40,6 +40,8 @@
 #endif
 
 #include "conescan.h"
+#include "idle.h"
+#include "profiler.h"
 
 #ifdef __EMSCRIPTEN__
 
@@ -65,6 +67,11 @@ EM_ASYNC_JS(int, mount_fs, (), {
     return 0;
 });
 
+// the tab is in the background, nothing we draw will be seen
+EM_JS(int, document_hidden, (), {
+    return document.hidden ? 1 : 0;
+});
+
 EM_ASYNC_JS(int, sync_fs, (), {
     console.log("syncing FS before exit");
     FS.syncfs(function (err) {
@@ -88,6 +95,89 @@ static void glfw_error_callback(int error, const char* description)
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
+// Input seen by the callbacks below since the main loop last looked, so
+// waking for idle_post_event()'s empty event is never mistaken for input.
+// On the main window they are installed before the ImGui backend, which
+// chains to them. ImGui's own viewport windows get them afterwards and
+// they pass each event on to the backend's callback they replaced.
+static int glfw_input_events = 0;
+static GLFWwindow* glfw_main_window = NULL;
+
+static GLFWcursorposfun glfw_prev_cursor = NULL;
+static GLFWmousebuttonfun glfw_prev_button = NULL;
+static GLFWscrollfun glfw_prev_scroll = NULL;
+static GLFWkeyfun glfw_prev_key = NULL;
+static GLFWcharfun glfw_prev_char = NULL;
+static GLFWcursorenterfun glfw_prev_enter = NULL;
+static GLFWwindowfocusfun glfw_prev_focus = NULL;
+static void (*imgui_create_window)(ImGuiViewport* viewport) = NULL;
+
+static void glfw_count_cursor(GLFWwindow* window, double x, double y)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_cursor) glfw_prev_cursor(window, x, y);
+}
+static void glfw_count_button(GLFWwindow* window, int button, int action, int mods)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_button) glfw_prev_button(window, button, action, mods);
+}
+static void glfw_count_scroll(GLFWwindow* window, double x, double y)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_scroll) glfw_prev_scroll(window, x, y);
+}
+static void glfw_count_key(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_key) glfw_prev_key(window, key, scancode, action, mods);
+}
+static void glfw_count_char(GLFWwindow* window, unsigned int c)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_char) glfw_prev_char(window, c);
+}
+static void glfw_count_enter(GLFWwindow* window, int entered)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_enter) glfw_prev_enter(window, entered);
+}
+static void glfw_count_focus(GLFWwindow* window, int focused)
+{
+    glfw_input_events++;
+    if (window != glfw_main_window && glfw_prev_focus) glfw_prev_focus(window, focused);
+}
+static void glfw_count_resize(GLFWwindow*, int, int) { glfw_input_events++; }
+static void glfw_count_refresh(GLFWwindow*) { glfw_input_events++; }
+
+static void glfw_count_input(GLFWwindow* window)
+{
+    // the backend sets the same callbacks on every viewport window
+    GLFWcursorposfun cursor = glfwSetCursorPosCallback(window, glfw_count_cursor);
+    GLFWmousebuttonfun button = glfwSetMouseButtonCallback(window, glfw_count_button);
+    GLFWscrollfun scroll = glfwSetScrollCallback(window, glfw_count_scroll);
+    GLFWkeyfun key = glfwSetKeyCallback(window, glfw_count_key);
+    GLFWcharfun c = glfwSetCharCallback(window, glfw_count_char);
+    GLFWcursorenterfun enter = glfwSetCursorEnterCallback(window, glfw_count_enter);
+    GLFWwindowfocusfun focus = glfwSetWindowFocusCallback(window, glfw_count_focus);
+    glfwSetFramebufferSizeCallback(window, glfw_count_resize);
+    glfwSetWindowRefreshCallback(window, glfw_count_refresh);
+    if (window == glfw_main_window) return;
+    glfw_prev_cursor = cursor;
+    glfw_prev_button = button;
+    glfw_prev_scroll = scroll;
+    glfw_prev_key = key;
+    glfw_prev_char = c;
+    glfw_prev_enter = enter;
+    glfw_prev_focus = focus;
+}
+
+static void glfw_create_viewport(ImGuiViewport* viewport)
+{
+    imgui_create_window(viewport);
+    glfw_count_input((GLFWwindow*)viewport->PlatformHandle);
+}
+
 #endif // __EMSCRIPTEN__
 
 int copy_file(const char* path_to_read_file, const char* path_to_write_file)
@@ -171,6 +261,7 @@ int main(int, char**)
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         return 1;
+    idle_set_wake(glfwPostEmptyEvent);
 
     // Decide GL+GLSL versions
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -209,6 +300,7 @@ int main(int, char**)
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
+    PROFILE_INSTALL_ALLOCATOR();
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
@@ -238,7 +330,15 @@ int main(int, char**)
     ImGui_ImplSDL2_InitForOpenGL(g_Window, g_GLContext);
     ImGui_ImplOpenGL3_Init(glsl_version);
 #else
+    glfw_main_window = window;
+    glfw_count_input(window);
     ImGui_ImplGlfw_InitForOpenGL(window, true);
+    if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
+    {
+        ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+        imgui_create_window = platform_io.Platform_CreateWindow;
+        platform_io.Platform_CreateWindow = glfw_create_viewport;
+    }
     ImGui_ImplOpenGL3_Init(glsl_version);
 #endif
 
@@ -291,24 +391,48 @@ int main(int, char**)
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application, or clear/overwrite your copy of the mouse data.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-        glfwPollEvents();
+
+        // Minimized or hidden: nothing to draw, just service events until restored.
+        if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) || !glfwGetWindowAttrib(window, GLFW_VISIBLE))
+        {
+            glfwWaitEventsTimeout(idle_config.idleTimeout);
+            continue;
+        }
+
+        // In idle mode block until input arrives, or until background work is due a frame.
+        double timeout = idle_wait_timeout(glfwGetTime(), ConeScan::IsBusy());
+        glfw_input_events = 0;
+        if (timeout > 0.0)
+            glfwWaitEventsTimeout(timeout);
+        else
+            glfwPollEvents();
+        bool had_input = glfw_input_events > 0;
+        if (!idle_frame_begin(glfwGetTime(), had_input, ConeScan::IsBusy()))
+            continue;
+        PROFILE_FRAME_BEGIN();
 
         // Start the Dear ImGui frame
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-        ImGui::DockSpaceOverViewport(ImGui::GetMainViewport());
+        {
+            PROFILE_SCOPE("NewFrame");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            ImGui::DockSpaceOverViewport(ImGui::GetMainViewport());
+        }
 
         // Rendering
         ConeScan::RenderUI(&exit_requested);
-        ImGui::Render();
-        int display_w, display_h;
-        glfwGetFramebufferSize(window, &display_w, &display_h);
-        glViewport(0, 0, display_w, display_h);
-        glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            PROFILE_SCOPE("Render");
+            ImGui::Render();
+            int display_w, display_h;
+            glfwGetFramebufferSize(window, &display_w, &display_h);
+            glViewport(0, 0, display_w, display_h);
+            glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
         // Update and Render additional Platform Windows
         // (Platform functions may change the current OpenGL context, so we save/restore it to make it easier to paste this code elsewhere.
@@ -322,11 +446,16 @@ int main(int, char**)
             glfwMakeContextCurrent(backup_current_context);
         }
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("Swap");
+            glfwSwapBuffers(window);
+        }
+        PROFILE_FRAME_END();
     }
 
     // Cleanup
     ConeScan::Cleanup();
+    idle_set_wake(NULL);
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -351,28 +480,63 @@ static void main_loop(void)
     // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application, or clear/overwrite your copy of the mouse data.
     // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
     // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
+    // Hidden tab: drop from requestAnimationFrame to a slow timer until visible again.
+    static bool throttled = false;
+    if (document_hidden())
+    {
+        if (!throttled)
+        {
+            emscripten_set_main_loop_timing(EM_TIMING_SETTIMEOUT, (int)(idle_config.idleTimeout * 1000));
+            throttled = true;
+        }
+        return;
+    }
+    else if (throttled)
+    {
+        emscripten_set_main_loop_timing(EM_TIMING_RAF, 1);
+        throttled = false;
+    }
+
+    bool had_input = false;
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
         ImGui_ImplSDL2_ProcessEvent(&event);
         // Capture events here, based on io.WantCaptureMouse and io.WantCaptureKeyboard
+        had_input = true;
     }
 
+    // Skip the frame entirely when nothing changed
+    if (!should_exit && !idle_frame_begin(emscripten_get_now() / 1000.0, had_input, ConeScan::IsBusy()))
+        return;
+
+    PROFILE_FRAME_BEGIN();
+
     // Start the Dear ImGui frame
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplSDL2_NewFrame();
-    ImGui::NewFrame();
+    {
+        PROFILE_SCOPE("NewFrame");
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplSDL2_NewFrame();
+        ImGui::NewFrame();
+    }
 
     ConeScan::RenderUI(&should_exit);
 
     // Rendering
-    ImGui::Render();
-    SDL_GL_MakeCurrent(g_Window, g_GLContext);
-    glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
-    glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
-    glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    SDL_GL_SwapWindow(g_Window);
+    {
+        PROFILE_SCOPE("Render");
+        ImGui::Render();
+        SDL_GL_MakeCurrent(g_Window, g_GLContext);
+        glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+        glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
+        glClear(GL_COLOR_BUFFER_BIT);
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+    {
+        PROFILE_SCOPE("Swap");
+        SDL_GL_SwapWindow(g_Window);
+    }
+    PROFILE_FRAME_END();
     if(should_exit) {
         printf("syncing FS");
         sync_fs();
@@ -0,0 +1,50 @@
+#include <stddef.h>
+#include <ctype.h>
+
+#include "memmodel.h"
+
+// erase blocks EB0..EB15 from the hardware manuals, eight small ones
+// hold the boot code so it can be rewritten without touching the rest
+static const unsigned long sh7055Sectors[] = {
+  0x00000, 0x01000, 0x02000, 0x03000, 0x04000, 0x05000, 0x06000, 0x07000,
+  0x08000, 0x10000, 0x20000, 0x30000, 0x40000, 0x50000, 0x60000, 0x70000,
+  0x80000,
+};
+
+static const unsigned long sh7058Sectors[] = {
+  0x00000, 0x01000, 0x02000, 0x03000, 0x04000, 0x05000, 0x06000, 0x07000,
+  0x08000, 0x20000, 0x40000, 0x60000, 0x80000, 0xA0000, 0xC0000, 0xE0000,
+  0x100000,
+};
+
+static const struct MemModel memModels[] = {
+  { "SH7055", 0x80000,  16, sh7055Sectors, 0x8000 },
+  { "SH7058", 0x100000, 16, sh7058Sectors, 0x8000 },
+};
+
+static bool sameName(const char* a, const char* b)
+{
+  for(; *a && *b; a++, b++)
+    if(toupper((unsigned char)*a) != toupper((unsigned char)*b)) return false;
+  return *a == *b;
+}
+
+const struct MemModel* memmodel_find(const char* name)
+{
+  if(!name) return NULL;
+  for(size_t i = 0; i < sizeof(memModels) / sizeof(memModels[0]); i++)
+    if(sameName(memModels[i].name, name)) return &memModels[i];
+  return NULL;
+}
+
+int memmodel_sector(const struct MemModel* model, unsigned long address)
+{
+  if(address >= model->romSize) return -1;
+  int lo = 0, hi = model->numSectors;
+  while(hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    if(model->sectors[mid] <= address) lo = mid;
+    else hi = mid;
+  }
+  return lo;
+}
@@ -0,0 +1,103 @@
+#include <stdint.h>
+
+#include "mock_bus.h"
+#include "uds_stats.h"
+
+// queues the answer to [message], false when the queue is full
+static bool answer(struct MockBus* bus, const struct UDSMessage* message)
+{
+  struct MockBusModule* module = NULL;
+  for(int i = 0; i < bus->numModules; i++)
+    if(bus->modules[i].requestId == message->canId) module = &bus->modules[i];
+  if(!module) return true;
+  if(bus->queued + 2 > MOCK_BUS_QUEUE) return false;
+
+  struct MockBusResponse* response = &bus->queue[bus->queued];
+  double seconds;
+  response->message.canId = module->requestId + 8;
+  response->message.length = mock_ecu_respond(module->ecu, message->data, message->length,
+                                              response->message.data, &seconds);
+  // the module starts on this request once it has answered the last one
+  auto now = std::chrono::steady_clock::now();
+  auto start = module->busyUntil > now ? module->busyUntil : now;
+  response->due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+  module->busyUntil = response->due;
+  bus->queued++;
+
+  // a multi-frame response is announced by its first frame, as an adapter does
+  uint32_t frames = uds_isotp_frames(response->message.length);
+  double bandwidth = module->ecu->config.bandwidth;
+  if(frames > 1) {
+    struct MockBusResponse* first = &bus->queue[bus->queued++];
+    double rest = bandwidth > 0.0 ? 8.0 * (frames - 1) / bandwidth : 0.0;
+    first->due = response->due - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(rest));
+    first->message.canId = response->message.canId;
+    first->message.length = 0;
+  }
+  return true;
+}
+
+static enum UDSChannelStatus busSend(void* context, const struct UDSMessage* messages, int count, int* sent)
+{
+  struct MockBus* bus = (struct MockBus*)context;
+  std::lock_guard<std::mutex> guard(bus->lock);
+  *sent = 0;
+  while(*sent < count && *sent < UDS_CHANNEL_BATCH && answer(bus, &messages[*sent])) (*sent)++;
+  bus->arrived.notify_all();
+  return *sent ? UDS_CHANNEL_OK : UDS_CHANNEL_TIMEOUT;
+}
+
+static int nextDue(struct MockBus* bus)
+{
+  int next = -1;
+  for(int i = 0; i < bus->queued; i++)
+    if(next < 0 || bus->queue[i].due < bus->queue[next].due) next = i;
+  return next;
+}
+
+static enum UDSChannelStatus busReceive(void* context, struct UDSMessage* messages, int capacity, int* count,
+                                        unsigned long timeoutMs)
+{
+  struct MockBus* bus = (struct MockBus*)context;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  std::unique_lock<std::mutex> guard(bus->lock);
+  *count = 0;
+  for(;;) {
+    // everything that is due goes out in this call, in the order it arrived
+    auto now = std::chrono::steady_clock::now();
+    int next;
+    while(*count < capacity && (next = nextDue(bus)) >= 0 && bus->queue[next].due <= now) {
+      messages[(*count)++] = bus->queue[next].message;
+      bus->queued--;
+      if(next != bus->queued) bus->queue[next] = bus->queue[bus->queued];
+    }
+    if(*count) return UDS_CHANNEL_OK;
+    if(now >= deadline) return UDS_CHANNEL_TIMEOUT;
+    next = nextDue(bus);
+    auto until = next >= 0 && bus->queue[next].due < deadline ? bus->queue[next].due : deadline;
+    bus->arrived.wait_until(guard, until);
+  }
+}
+
+void mock_bus_init(struct MockBus* bus)
+{
+  bus->numModules = 0;
+  bus->queued = 0;
+}
+
+bool mock_bus_add(struct MockBus* bus, struct MockEcu* ecu, uint32_t requestId)
+{
+  if(bus->numModules == MOCK_BUS_MAX_MODULES) return false;
+  struct MockBusModule* module = &bus->modules[bus->numModules++];
+  module->ecu = ecu;
+  module->requestId = requestId;
+  module->busyUntil = std::chrono::steady_clock::now();
+  return true;
+}
+
+void mock_bus_bind(struct MockBus* bus, struct UDSChannel* channel)
+{
+  channel->context = bus;
+  channel->send = busSend;
+  channel->receive = busReceive;
+}
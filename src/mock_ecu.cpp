@@ -0,0 +1,394 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "mock_ecu.h"
+#include "uds_stats.h"
+
+#define MOCK_ECU_MAX_READ 0xFFE
+
+// xorshift32, the mock only needs repeatable noise
+static uint32_t nextRandom(struct MockEcu* mock)
+{
+  uint32_t x = mock->random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  mock->random = x;
+  return x;
+}
+
+static double randomUnit(struct MockEcu* mock)
+{
+  return (nextRandom(mock) >> 8) / (double)(1 << 24);
+}
+
+// how long a request of [sent] bytes and its [received] byte answer take
+static double exchangeTime(struct MockEcu* mock, unsigned long sent, unsigned long received)
+{
+  mock->requests.fetch_add(1, std::memory_order_relaxed);
+  double seconds = mock->config.latency;
+  if(mock->config.jitter > 0.0) seconds += mock->config.jitter * randomUnit(mock);
+  if(mock->config.bandwidth > 0.0) seconds += 8.0 * (uds_isotp_frames(sent) + uds_isotp_frames(received)) / mock->config.bandwidth;
+  return seconds;
+}
+
+static void exchange(struct MockEcu* mock, unsigned long sent, unsigned long received)
+{
+  double seconds = exchangeTime(mock, sent, received);
+  if(seconds > 0.0) std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+static void refuse(struct MockEcu* mock)
+{
+  exchange(mock, 8, 3); // negative response: 0x7F, service, NRC
+  mock->refused.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void expectedKey(const uint8_t* seed, uint8_t* key)
+{
+  for(int i = 0; i < 3; i++) key[i] = (uint8_t)((seed[i] ^ 0x5A) + i);
+}
+
+static void newSeed(struct MockEcu* mock)
+{
+  for(int i = 0; i < 3; i++) mock->seed[i] = (uint8_t)nextRandom(mock);
+}
+
+static bool keyMatches(struct MockEcu* mock, const uint8_t* key)
+{
+  uint8_t expected[3];
+  expectedKey(mock->seed, expected);
+  return mock->session == 0x85 && memcmp(key, expected, 3) == 0;
+}
+
+// a refused read and an injected error look the same to the tester
+static bool readAllowed(struct MockEcu* mock, unsigned long address, unsigned long size)
+{
+  uint16_t maxRead = mock->config.maxRead ? mock->config.maxRead : MOCK_ECU_MAX_READ;
+  bool inImage = address <= (unsigned long)mock->rom.length && size <= (unsigned long)mock->rom.length - address;
+  if(!mock->unlocked || size == 0 || size > maxRead || !inImage) return false;
+  return !(mock->config.errorRate > 0.0 && randomUnit(mock) < mock->config.errorRate);
+}
+
+static bool mockInitDiagSession(void* context, uint8_t session)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  exchange(mock, 2, 2);
+  mock->session = session;
+  mock->unlocked = false;
+  return true;
+}
+
+static int mockGetSeed(void* context, uint8_t** seed)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  if(mock->session != 0x85) {
+    refuse(mock);
+    return 1;
+  }
+  exchange(mock, 2, 5);
+  newSeed(mock);
+  *seed = (uint8_t*)malloc(3);
+  assert(*seed);
+  memcpy(*seed, mock->seed, 3);
+  return 0;
+}
+
+// runs on the tester side, nothing goes over the bus
+static int mockCalculateKey(void* context, uint8_t* seed, uint8_t** key)
+{
+  *key = (uint8_t*)malloc(3);
+  assert(*key);
+  expectedKey(seed, *key);
+  return 0;
+}
+
+static bool mockUnlock(void* context, uint8_t* key)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  if(!keyMatches(mock, key)) {
+    refuse(mock);
+    return false;
+  }
+  exchange(mock, 5, 2);
+  mock->unlocked = true;
+  return true;
+}
+
+static int mockReadMem(void* context, unsigned long address, uint16_t size, char* out)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  if(!readAllowed(mock, address, size)) {
+    refuse(mock);
+    return 1;
+  }
+  exchange(mock, 8, 1 + (unsigned long)size);
+  memcpy(out, mock->rom.data + address, size);
+  return 0;
+}
+
+static int mockEraseBlock(void* context, unsigned long address, unsigned long size)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  bool inImage = address <= (unsigned long)mock->rom.length && size <= (unsigned long)mock->rom.length - address;
+  bool aligned = address % ROM_FILE_PAGE_SIZE == 0 && size % ROM_FILE_PAGE_SIZE == 0;
+  if(!mock->unlocked || size == 0 || !inImage || !aligned) {
+    refuse(mock);
+    return 1;
+  }
+  exchange(mock, 13, 5);
+  if(mock->config.eraseTime > 0.0)
+    std::this_thread::sleep_for(std::chrono::duration<double>(mock->config.eraseTime * size / 1024.0));
+  memset(mock->rom.data + address, 0xFF, size);
+  rom_file_mark_dirty(&mock->rom, address, size);
+  mock->erased.fetch_add((uint32_t)size, std::memory_order_relaxed);
+  return 0;
+}
+
+static int mockWriteMem(void* context, unsigned long address, uint16_t size, const char* data)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  uint16_t maxRead = mock->config.maxRead ? mock->config.maxRead : MOCK_ECU_MAX_READ;
+  bool inImage = address <= (unsigned long)mock->rom.length && size <= (unsigned long)mock->rom.length - address;
+  if(!mock->unlocked || size == 0 || size > maxRead || !inImage) {
+    refuse(mock);
+    return 1;
+  }
+  // programming can only pull bits low
+  const unsigned char* flash = mock->rom.data + address;
+  for(uint16_t i = 0; i < size; i++) {
+    if(((unsigned char)data[i] & flash[i]) != (unsigned char)data[i]) {
+      refuse(mock);
+      return 1;
+    }
+  }
+  exchange(mock, 8 + (unsigned long)size, 8);
+  rom_file_write(&mock->rom, address, data, size);
+  mock->written.fetch_add(size, std::memory_order_relaxed);
+  return 0;
+}
+
+static char* copyString(const char* s)
+{
+  size_t length = strlen(s) + 1;
+  char* copy = (char*)malloc(length);
+  if(copy) memcpy(copy, s, length);
+  return copy;
+}
+
+static int mockGetVIN(void* context, char** vin)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  exchange(mock, 2, 3 + strlen(mock->vin));
+  *vin = copyString(mock->vin);
+  return *vin ? 0 : 1;
+}
+
+static int mockGetCalibrationID(void* context, char** calID)
+{
+  struct MockEcu* mock = (struct MockEcu*)context;
+  exchange(mock, 2, 3 + strlen(mock->calID));
+  *calID = copyString(mock->calID);
+  return *calID ? 0 : 1;
+}
+
+// copies up to [length] bytes of [from] into [to] as a string
+static void copyField(char* to, size_t size, const char* from, size_t length)
+{
+  size_t n = length;
+  if(n >= size) n = size - 1;
+  memcpy(to, from, n);
+  to[n] = 0;
+}
+
+static void identify(struct MockEcu* mock, const char* romPath)
+{
+  const char* name = romPath;
+  for(const char* c = romPath; *c; c++)
+    if(*c == '/' || *c == '\\') name = c + 1;
+  const char* extension = strrchr(name, '.');
+  size_t length = extension ? (size_t)(extension - name) : strlen(name);
+  const char* dash = (const char*)memchr(name, '-', length);
+
+  strcpy(mock->vin, MOCK_ECU_DEFAULT_VIN);
+  if(dash && dash - name == 17) {
+    copyField(mock->vin, sizeof(mock->vin), name, 17);
+    copyField(mock->calID, sizeof(mock->calID), dash + 1, length - 18);
+  } else if(dash && dash - name == 2 && strncmp(name, "SW", 2) == 0) {
+    copyField(mock->calID, sizeof(mock->calID), dash + 1, length - 3);
+  } else {
+    copyField(mock->calID, sizeof(mock->calID), name, length);
+  }
+}
+
+bool mock_ecu_open(struct MockEcu* mock, const char* romPath, const struct MockEcuConfig* config)
+{
+  memset(&mock->rom, 0, sizeof(mock->rom));
+  if(romPath && !rom_file_open(&mock->rom, romPath)) return false;
+  if(config) mock->config = *config;
+  else memset(&mock->config, 0, sizeof(mock->config));
+  if(romPath) {
+    identify(mock, romPath);
+  } else {
+    strcpy(mock->vin, MOCK_ECU_DEFAULT_VIN);
+    mock->calID[0] = 0;
+  }
+  mock->numDtcs = 0;
+  mock->session = 0;
+  mock->unlocked = false;
+  memset(mock->seed, 0, sizeof(mock->seed));
+  mock->random = mock->config.seed ? mock->config.seed : 0x2545F491;
+  mock->requests.store(0, std::memory_order_relaxed);
+  mock->refused.store(0, std::memory_order_relaxed);
+  mock->erased.store(0, std::memory_order_relaxed);
+  mock->written.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+void mock_ecu_close(struct MockEcu* mock)
+{
+  rom_file_close(&mock->rom);
+}
+
+void mock_ecu_bind(struct MockEcu* mock, struct UDSEcu* ecu)
+{
+  ecu->context = mock;
+  ecu->initDiagSession = mockInitDiagSession;
+  ecu->getSeed = mockGetSeed;
+  ecu->calculateKey = mockCalculateKey;
+  ecu->unlock = mockUnlock;
+  ecu->readMem = mockReadMem;
+  ecu->getVIN = mockGetVIN;
+  ecu->getCalibrationID = mockGetCalibrationID;
+  ecu->eraseBlock = mockEraseBlock;
+  ecu->writeMem = mockWriteMem;
+}
+
+void mock_ecu_add_dtc(struct MockEcu* mock, uint32_t dtc, uint8_t status)
+{
+  if(mock->numDtcs >= MOCK_ECU_MAX_DTCS) return;
+  mock->dtcs[mock->numDtcs] = dtc & 0xFFFFFF;
+  mock->dtcStatus[mock->numDtcs] = status;
+  mock->numDtcs++;
+}
+
+static uint32_t negative(uint8_t* response, uint8_t service, uint8_t code)
+{
+  response[0] = 0x7F;
+  response[1] = service;
+  response[2] = code;
+  return 3;
+}
+
+static unsigned long bigEndian(const uint8_t* bytes, int count)
+{
+  unsigned long value = 0;
+  for(int i = 0; i < count; i++) value = (value << 8) | bytes[i];
+  return value;
+}
+
+// ReadMemoryByAddress: the format byte gives the size (high nibble) and address (low nibble) lengths
+static uint32_t readMemory(struct MockEcu* mock, const uint8_t* request, uint32_t length, uint8_t* response)
+{
+  if(length < 2) return negative(response, 0x23, 0x13);
+  int sizeBytes = request[1] >> 4, addressBytes = request[1] & 0x0F;
+  if(sizeBytes < 1 || sizeBytes > 2 || addressBytes < 1 || addressBytes > 4 || length != 2u + sizeBytes + addressBytes)
+    return negative(response, 0x23, 0x13);
+  unsigned long address = bigEndian(request + 2, addressBytes);
+  unsigned long size = bigEndian(request + 2 + addressBytes, sizeBytes);
+  if(!mock->unlocked) return negative(response, 0x23, 0x33);
+  if(!readAllowed(mock, address, size) || size + 1 > UDS_MAX_MESSAGE) return negative(response, 0x23, 0x31);
+  response[0] = 0x63;
+  memcpy(response + 1, mock->rom.data + address, size);
+  return 1 + (uint32_t)size;
+}
+
+static uint32_t readIdentifier(struct MockEcu* mock, const uint8_t* request, uint32_t length, uint8_t* response)
+{
+  if(length != 3) return negative(response, 0x22, 0x13);
+  const char* value = NULL;
+  if(request[1] == 0xF1 && request[2] == 0x90) value = mock->vin;
+  else if(request[1] == 0xF1 && request[2] == 0x88 && mock->calID[0]) value = mock->calID;
+  if(!value) return negative(response, 0x22, 0x31);
+  memcpy(response, request, 3);
+  response[0] = 0x62;
+  size_t size = strlen(value);
+  memcpy(response + 3, value, size);
+  return 3 + (uint32_t)size;
+}
+
+// only reportDTCByStatusMask
+static uint32_t readDTCs(struct MockEcu* mock, const uint8_t* request, uint32_t length, uint8_t* response)
+{
+  if(length != 3) return negative(response, 0x19, 0x13);
+  if(request[1] != 0x02) return negative(response, 0x19, 0x12);
+  uint32_t used = 0;
+  response[used++] = 0x59;
+  response[used++] = 0x02;
+  response[used++] = 0xFF;  // every status bit is supported
+  for(int i = 0; i < mock->numDtcs; i++) {
+    if(!(mock->dtcStatus[i] & request[2])) continue;
+    response[used++] = (uint8_t)(mock->dtcs[i] >> 16);
+    response[used++] = (uint8_t)(mock->dtcs[i] >> 8);
+    response[used++] = (uint8_t)mock->dtcs[i];
+    response[used++] = mock->dtcStatus[i];
+  }
+  return used;
+}
+
+static uint32_t securityAccess(struct MockEcu* mock, const uint8_t* request, uint32_t length, uint8_t* response)
+{
+  if(length == 2 && request[1] == 0x01) {
+    if(mock->session != 0x85) return negative(response, 0x27, 0x22);
+    newSeed(mock);
+    response[0] = 0x67;
+    response[1] = 0x01;
+    memcpy(response + 2, mock->seed, 3);
+    return 5;
+  }
+  if(length == 5 && request[1] == 0x02) {
+    if(!keyMatches(mock, request + 2)) return negative(response, 0x27, 0x35);
+    mock->unlocked = true;
+    response[0] = 0x67;
+    response[1] = 0x02;
+    return 2;
+  }
+  return negative(response, 0x27, 0x12);
+}
+
+uint32_t mock_ecu_respond(struct MockEcu* mock, const uint8_t* request, uint32_t length,
+                          uint8_t* response, double* seconds)
+{
+  uint32_t used;
+  if(length == 0) {
+    used = negative(response, 0x00, 0x13);
+  } else if(request[0] == 0x10 && length == 2) {
+    mock->session = request[1];
+    mock->unlocked = false;
+    response[0] = 0x50;
+    response[1] = request[1];
+    used = 2;
+  } else if(request[0] == 0x3E && length == 2) {
+    response[0] = 0x7E;
+    response[1] = request[1];
+    used = 2;
+  } else if(request[0] == 0x27) {
+    used = securityAccess(mock, request, length, response);
+  } else if(request[0] == 0x22) {
+    used = readIdentifier(mock, request, length, response);
+  } else if(request[0] == 0x23) {
+    used = readMemory(mock, request, length, response);
+  } else if(request[0] == 0x19) {
+    used = readDTCs(mock, request, length, response);
+  } else {
+    used = negative(response, request[0], 0x11);
+  }
+  if(response[0] == 0x7F) mock->refused.fetch_add(1, std::memory_order_relaxed);
+  *seconds = exchangeTime(mock, length, used);
+  return used;
+}
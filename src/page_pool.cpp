@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_pool.h"
+#include "rom_file.h"
+
+// bucket whose page was released, probing continues past it
+#define PAGE_POOL_TOMBSTONE 0xFFFFFFFEu
+
+void page_pool_init(struct PagePool* pool)
+{
+  memset(pool, 0, sizeof(struct PagePool));
+}
+
+void page_pool_free(struct PagePool* pool)
+{
+  for(uint32_t i = 0; i < pool->numPages; i++) {
+    if(pool->pages[i].data) free(pool->pages[i].data);
+  }
+  if(pool->pages) free(pool->pages);
+  if(pool->freeSlots) free(pool->freeSlots);
+  if(pool->buckets) free(pool->buckets);
+  memset(pool, 0, sizeof(struct PagePool));
+}
+
+static void rehash(struct PagePool* pool, uint32_t numBuckets)
+{
+  if(pool->buckets) free(pool->buckets);
+  pool->numBuckets = numBuckets;
+  pool->buckets = (uint32_t*)malloc(sizeof(uint32_t) * numBuckets);
+  assert(pool->buckets);
+  memset(pool->buckets, 0xff, sizeof(uint32_t) * numBuckets);
+  for(uint32_t id = 0; id < pool->numPages; id++) {
+    if(!pool->pages[id].data) continue;
+    uint32_t b = (uint32_t)pool->pages[id].hash & (numBuckets - 1);
+    while(pool->buckets[b] != PAGE_POOL_NONE) b = (b + 1) & (numBuckets - 1);
+    pool->buckets[b] = id;
+  }
+}
+
+static uint32_t newSlot(struct PagePool* pool)
+{
+  if(pool->numFree) return pool->freeSlots[--pool->numFree];
+  if(pool->numPages == pool->capacity) {
+    pool->capacity = pool->capacity ? pool->capacity * 2 : 256;
+    pool->pages = (struct PoolPage*)realloc(pool->pages, sizeof(struct PoolPage) * pool->capacity);
+    pool->freeSlots = (uint32_t*)realloc(pool->freeSlots, sizeof(uint32_t) * pool->capacity);
+    assert(pool->pages && pool->freeSlots);
+  }
+  return pool->numPages++;
+}
+
+uint32_t page_pool_intern(struct PagePool* pool, const unsigned char* data, uint32_t length)
+{
+  assert(length > 0 && length <= ROM_FILE_PAGE_SIZE);
+  uint64_t hash = rom_file_hash_bytes(data, length, 0);
+
+  // keep the table under 3/4 full, counting released buckets
+  if((pool->numLive + pool->numTombstones + 1) * 4 > pool->numBuckets * 3) {
+    uint32_t size = pool->numBuckets ? pool->numBuckets : 1024;
+    while((pool->numLive + 1) * 2 > size) size *= 2;
+    rehash(pool, size);
+    pool->numTombstones = 0;
+  }
+
+  uint32_t mask = pool->numBuckets - 1;
+  uint32_t b = (uint32_t)hash & mask;
+  uint32_t reuse = PAGE_POOL_NONE;
+  for(; pool->buckets[b] != PAGE_POOL_NONE; b = (b + 1) & mask) {
+    uint32_t id = pool->buckets[b];
+    if(id == PAGE_POOL_TOMBSTONE) {
+      if(reuse == PAGE_POOL_NONE) reuse = b;
+      continue;
+    }
+    struct PoolPage* page = &pool->pages[id];
+    if(page->hash == hash && page->length == length && memcmp(page->data, data, length) == 0) {
+      page->refs++;
+      return id;
+    }
+  }
+  if(reuse != PAGE_POOL_NONE) {
+    b = reuse;
+    pool->numTombstones--;
+  }
+
+  uint32_t id = newSlot(pool);
+  struct PoolPage* page = &pool->pages[id];
+  page->data = (unsigned char*)malloc(length);
+  assert(page->data);
+  memcpy(page->data, data, length);
+  page->hash = hash;
+  page->length = length;
+  page->refs = 1;
+  pool->buckets[b] = id;
+  pool->numLive++;
+  return id;
+}
+
+void page_pool_release(struct PagePool* pool, uint32_t id)
+{
+  assert(id < pool->numPages && pool->pages[id].data);
+  struct PoolPage* page = &pool->pages[id];
+  if(--page->refs) return;
+
+  uint32_t mask = pool->numBuckets - 1;
+  uint32_t b = (uint32_t)page->hash & mask;
+  while(pool->buckets[b] != id) b = (b + 1) & mask;
+  pool->buckets[b] = PAGE_POOL_TOMBSTONE;
+  pool->numTombstones++;
+
+  free(page->data);
+  page->data = NULL;
+  pool->freeSlots[pool->numFree++] = id;
+  pool->numLive--;
+}
+
+const unsigned char* page_pool_data(const struct PagePool* pool, uint32_t id)
+{
+  assert(id < pool->numPages);
+  return pool->pages[id].data;
+}
+
+uint32_t page_pool_length(const struct PagePool* pool, uint32_t id)
+{
+  assert(id < pool->numPages);
+  return pool->pages[id].length;
+}
+
+size_t page_pool_bytes(const struct PagePool* pool)
+{
+  size_t bytes = 0;
+  for(uint32_t i = 0; i < pool->numPages; i++) {
+    if(pool->pages[i].data) bytes += pool->pages[i].length;
+  }
+  return bytes;
+}
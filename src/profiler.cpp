@@ -0,0 +1,246 @@
+#ifdef CONESCAN_PROFILER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+#include <new>
+
+#include "imgui.h"
+
+#include "profiler.h"
+
+#define PROFILER_MAX_DEPTH 32
+
+// every scope ever seen, registered on first use of a call site
+static struct ProfilerScope scopes[PROFILER_MAX_SCOPES];
+static std::atomic<int> numScopes(0);
+static std::mutex registerLock;
+
+// open scopes on this thread, gives new scopes their parent
+static thread_local int scopeStack[PROFILER_MAX_DEPTH];
+static thread_local int scopeDepth = 0;
+
+// ring buffers of whole frames
+static float    frameHistory[PROFILER_HISTORY];
+static uint32_t allocHistory[PROFILER_HISTORY];
+static int      frameHead = 0;
+static int      framesRecorded = 0;
+static uint64_t frameStart = 0;
+
+// allocations since the last frame ended (operator new + ImGui)
+static std::atomic<uint32_t> allocs(0);
+
+static uint64_t profiler_now(void)
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// returns the scope index, or -2 if the table is full
+static int profiler_register(const char* name, int parent)
+{
+  std::lock_guard<std::mutex> lock(registerLock);
+  int count = numScopes.load(std::memory_order_relaxed);
+  for(int i = 0; i < count; i++) {
+    if(scopes[i].parent == parent && strcmp(scopes[i].name, name) == 0)
+      return i;
+  }
+  if(count == PROFILER_MAX_SCOPES) return -2;
+
+  struct ProfilerScope* scope = &scopes[count];
+  scope->name = name;
+  scope->parent = parent;
+  scope->depth = parent < 0 ? 0 : scopes[parent].depth + 1;
+  scope->accumNs.store(0);
+  scope->calls.store(0);
+  memset(scope->history, 0, sizeof(scope->history));
+  memset(scope->callHistory, 0, sizeof(scope->callHistory));
+  numScopes.store(count + 1, std::memory_order_release);
+  return count;
+}
+
+ProfilerTimer::ProfilerTimer(const char* name, std::atomic<int>* site)
+{
+  id = site->load(std::memory_order_relaxed);
+  if(id == -1) {
+    int parent = -1;
+    if(scopeDepth > 0 && scopeDepth <= PROFILER_MAX_DEPTH && scopeStack[scopeDepth - 1] >= 0)
+      parent = scopeStack[scopeDepth - 1];
+    id = profiler_register(name, parent);
+    site->store(id, std::memory_order_relaxed);
+  }
+  if(scopeDepth < PROFILER_MAX_DEPTH) scopeStack[scopeDepth] = id;
+  scopeDepth++;
+  start = profiler_now();
+}
+
+ProfilerTimer::~ProfilerTimer()
+{
+  uint64_t elapsed = profiler_now() - start;
+  scopeDepth--;
+  if(id < 0) return;
+  scopes[id].accumNs.fetch_add(elapsed, std::memory_order_relaxed);
+  scopes[id].calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void profiler_frame_begin(void)
+{
+  frameStart = profiler_now();
+}
+
+void profiler_frame_end(void)
+{
+  frameHistory[frameHead] = (float)(profiler_now() - frameStart) / 1000000.0f;
+  allocHistory[frameHead] = allocs.exchange(0, std::memory_order_relaxed);
+
+  int count = numScopes.load(std::memory_order_acquire);
+  for(int i = 0; i < count; i++) {
+    scopes[i].history[frameHead] = (float)scopes[i].accumNs.exchange(0, std::memory_order_relaxed) / 1000000.0f;
+    scopes[i].callHistory[frameHead] = scopes[i].calls.exchange(0, std::memory_order_relaxed);
+  }
+
+  frameHead = (frameHead + 1) % PROFILER_HISTORY;
+  if(framesRecorded < PROFILER_HISTORY) framesRecorded++;
+}
+
+static void* profiler_imgui_alloc(size_t size, void* user_data)
+{
+  IM_UNUSED(user_data);
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size);
+}
+
+static void profiler_imgui_free(void* ptr, void* user_data)
+{
+  IM_UNUSED(user_data);
+  free(ptr);
+}
+
+void profiler_install_allocator(void)
+{
+  ImGui::SetAllocatorFunctions(profiler_imgui_alloc, profiler_imgui_free, NULL);
+}
+
+void* operator new(size_t size)
+{
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size ? size : 1);
+  if(!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+// slot of the [i]th oldest of the last [frames] frames
+static int profiler_slot(int i, int frames)
+{
+  return (frameHead - frames + i + PROFILER_HISTORY) % PROFILER_HISTORY;
+}
+
+static void profiler_draw_scopes(int parent, int count, int frames)
+{
+  for(int i = 0; i < count; i++) {
+    if(scopes[i].parent != parent) continue;
+
+    float total = 0.0f, max = 0.0f;
+    unsigned long calls = 0;
+    for(int f = 0; f < frames; f++) {
+      int slot = profiler_slot(f, frames);
+      total += scopes[i].history[slot];
+      if(scopes[i].history[slot] > max) max = scopes[i].history[slot];
+      calls += scopes[i].callHistory[slot];
+    }
+
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::Text("%*s%s", scopes[i].depth * 2, "", scopes[i].name);
+    ImGui::TableNextColumn();
+    ImGui::Text("%0.3f", total / frames);
+    ImGui::TableNextColumn();
+    ImGui::Text("%0.3f", max);
+    ImGui::TableNextColumn();
+    ImGui::Text("%0.1f", (float)calls / frames);
+
+    profiler_draw_scopes(i, count, frames);
+  }
+}
+
+void profiler_draw(const char* title, bool* p_open)
+{
+  ImGui::SetNextWindowSize(ImVec2(420, 360), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin(title, p_open)) {
+    ImGui::End();
+    return;
+  }
+
+  int frames = framesRecorded;
+  if(frames == 0) {
+    ImGui::TextDisabled("No frames recorded");
+    ImGui::End();
+    return;
+  }
+
+  float total = 0.0f, max = 0.0f;
+  unsigned long allocTotal = 0;
+  for(int f = 0; f < frames; f++) {
+    int slot = profiler_slot(f, frames);
+    total += frameHistory[slot];
+    if(frameHistory[slot] > max) max = frameHistory[slot];
+    allocTotal += allocHistory[slot];
+  }
+  int last = profiler_slot(frames - 1, frames);
+
+  char overlay[64];
+  snprintf(overlay, sizeof(overlay), "%0.2f ms (avg %0.2f, max %0.2f)", frameHistory[last], total / frames, max);
+  ImGui::PlotLines("##frametime", frameHistory, frames,
+                   frames < PROFILER_HISTORY ? 0 : frameHead,
+                   overlay, 0.0f, max, ImVec2(-1.0f, 60.0f));
+  ImGui::Text("Allocations: %u this frame, %0.1f avg", allocHistory[last], (float)allocTotal / frames);
+  ImGui::Separator();
+
+  static ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+  if (ImGui::BeginTable("scopes", 4, flags)) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Scope", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Avg ms", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableSetupColumn("Max ms", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed);
+    ImGui::TableHeadersRow();
+    profiler_draw_scopes(-1, numScopes.load(std::memory_order_acquire), frames);
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+int profiler_dump_csv(const char* path, int frames)
+{
+  if(frames > framesRecorded) frames = framesRecorded;
+  if(frames < 0) frames = 0;
+
+  FILE* fp = fopen(path, "w");
+  if(!fp) return -1;
+
+  int count = numScopes.load(std::memory_order_acquire);
+  fprintf(fp, "frame,frame_ms,allocations");
+  for(int i = 0; i < count; i++)
+    fprintf(fp, ",\"%s\"", scopes[i].name);
+  fprintf(fp, "\n");
+
+  for(int f = 0; f < frames; f++) {
+    int slot = profiler_slot(f, frames);
+    fprintf(fp, "%d,%0.3f,%u", f, frameHistory[slot], allocHistory[slot]);
+    for(int i = 0; i < count; i++)
+      fprintf(fp, ",%0.3f", scopes[i].history[slot]);
+    fprintf(fp, "\n");
+  }
+  fclose(fp);
+  return frames;
+}
+
+#endif
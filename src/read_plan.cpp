@@ -0,0 +1,73 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "definition.h"
+#include "address_index.h"
+#include "memmodel.h"
+#include "read_plan.h"
+
+static void addRange(struct ReadPlan* plan, unsigned long start, unsigned long end)
+{
+  if(end > plan->romSize) end = plan->romSize;
+  if(start >= end) {
+    plan->clipped++;
+    return;
+  }
+  // spans arrive sorted by start, so only the last range can absorb this one
+  if(plan->numRanges) {
+    struct ReadRange* last = &plan->ranges[plan->numRanges - 1];
+    if(start <= last->end + READ_PLAN_MERGE_GAP) {
+      if(end > last->end) last->end = end;
+      return;
+    }
+  }
+  plan->ranges[plan->numRanges].start = start;
+  plan->ranges[plan->numRanges].end = end;
+  plan->numRanges++;
+}
+
+void read_plan_build(struct ReadPlan* plan, struct Definition* definition)
+{
+  read_plan_free(plan);
+
+  struct AddressIndex index;
+  memset(&index, 0, sizeof(index));
+  address_index_build(&index, definition);
+
+  // the ID string is one more span, placed in start order with the rest
+  unsigned long idStart = definition->internalidaddress;
+  unsigned long idEnd = idStart + (definition->internalidstring ? strlen(definition->internalidstring) : 0);
+  bool idPending = idEnd > idStart;
+
+  const struct MemModel* model = memmodel_find(definition->memmodel);
+  if(model) {
+    plan->romSize = model->romSize;
+  } else {
+    plan->romSize = idPending ? idEnd : 0;
+    if(index.numSpans && index.maxEnd[index.numSpans - 1] > plan->romSize)
+      plan->romSize = index.maxEnd[index.numSpans - 1];
+  }
+
+  plan->ranges = (struct ReadRange*)malloc(sizeof(struct ReadRange) * (index.numSpans + 1));
+  assert(plan->ranges);
+  for(int i = 0; i < index.numSpans; i++) {
+    if(idPending && idStart <= index.spans[i].start) {
+      addRange(plan, idStart, idEnd);
+      idPending = false;
+    }
+    addRange(plan, index.spans[i].start, index.spans[i].end);
+  }
+  if(idPending) addRange(plan, idStart, idEnd);
+  address_index_free(&index);
+
+  for(int i = 0; i < plan->numRanges; i++)
+    plan->bytes += plan->ranges[i].end - plan->ranges[i].start;
+}
+
+void read_plan_free(struct ReadPlan* plan)
+{
+  if(plan->ranges) free(plan->ranges);
+  memset(plan, 0, sizeof(struct ReadPlan));
+}
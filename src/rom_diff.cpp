@@ -0,0 +1,198 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ROM_DIFF_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bit_scan.h"
+#include "definition.h"
+#include "address_index.h"
+#include "rom_diff.h"
+
+// appends [start, end), extending the last range when they touch
+static long addRange(struct RomDiffRange** ranges, long count, long* capacity, unsigned long start, unsigned long end)
+{
+  if(count && (*ranges)[count - 1].end == start) {
+    (*ranges)[count - 1].end = end;
+    return count;
+  }
+  if(count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    *ranges = (struct RomDiffRange*)realloc(*ranges, sizeof(struct RomDiffRange) * *capacity);
+    assert(*ranges);
+  }
+  (*ranges)[count].start = start;
+  (*ranges)[count].end = end;
+  return count + 1;
+}
+
+long rom_diff_ranges(const unsigned char* before, long beforeLength,
+                     const unsigned char* after, long afterLength,
+                     struct RomDiffRange** ranges, long* capacity)
+{
+  size_t length = (size_t)(beforeLength < afterLength ? beforeLength : afterLength);
+  size_t offset = 0;
+  long count = 0;
+
+#ifdef ROM_DIFF_SSE2
+#define ROM_DIFF_SAME(at) \
+  (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(before + (at))), \
+                                                 _mm_loadu_si128((const __m128i*)(after + (at)))))
+  // 64 bytes per step, equal blocks (nearly all of them) cost four compares
+  for(; offset + 64 <= length; offset += 64) {
+    uint64_t bits = ~((uint64_t)ROM_DIFF_SAME(offset) |
+                      ((uint64_t)ROM_DIFF_SAME(offset + 16) << 16) |
+                      ((uint64_t)ROM_DIFF_SAME(offset + 32) << 32) |
+                      ((uint64_t)ROM_DIFF_SAME(offset + 48) << 48));
+    while(bits) {
+      int first = bit_scan_lowest(bits);
+      uint64_t rest = ~(bits >> first);
+      int run = rest ? bit_scan_lowest(rest) : 64 - first;
+      count = addRange(ranges, count, capacity, offset + first, offset + first + run);
+      bits = run + first >= 64 ? 0 : bits & ~(((1ull << run) - 1) << first);
+    }
+  }
+#undef ROM_DIFF_SAME
+#endif
+  for(; offset + 8 <= length; offset += 8) {
+    uint64_t a, b;
+    memcpy(&a, before + offset, sizeof(a));
+    memcpy(&b, after + offset, sizeof(b));
+    if(a == b) continue;
+    for(size_t i = offset; i < offset + 8; i++) {
+      if(before[i] != after[i]) count = addRange(ranges, count, capacity, i, i + 1);
+    }
+  }
+  for(; offset < length; offset++) {
+    if(before[offset] != after[offset]) count = addRange(ranges, count, capacity, offset, offset + 1);
+  }
+
+  long longest = beforeLength > afterLength ? beforeLength : afterLength;
+  if((long)length < longest) count = addRange(ranges, count, capacity, length, (unsigned long)longest);
+  return count;
+}
+
+static int compareCells(const void* a, const void* b)
+{
+  const struct RomDiffCell* ca = (const struct RomDiffCell*)a;
+  const struct RomDiffCell* cb = (const struct RomDiffCell*)b;
+  if(ca->table != cb->table) return ca->table - cb->table;
+  if(ca->axis != cb->axis) return ca->axis - cb->axis;
+  if(ca->element != cb->element) return ca->element < cb->element ? -1 : 1;
+  return 0;
+}
+
+static void readCell(struct Table* table, const unsigned char* data, long length, struct RomDiffCell* cell, double* out)
+{
+  if(cell->address + cell->size > (unsigned long)length) {
+    *out = 0.0;
+    cell->scaled = false;
+  } else if(!definition_read_scaled(table->Scaling, data, cell->address, out)) {
+    *out = definition_read_raw(table->Scaling, data, cell->address);
+    cell->scaled = false;
+  }
+}
+
+// every cell a range touches, a cell split over two ranges is added once
+static void resolveCells(struct RomDiff* diff, const unsigned char* before, long beforeLength,
+                         const unsigned char* after, long afterLength,
+                         struct Definition* definition, const struct AddressIndex* index)
+{
+  struct AddressCursor cursor;
+  memset(&cursor, 0, sizeof(cursor));
+  long capacity = 0;
+  for(long r = 0; r < diff->numRanges; r++) {
+    unsigned long address = diff->ranges[r].start;
+    unsigned long end = diff->ranges[r].end;
+    while(address < end) {
+      const struct AddressSpan* span = address_index_find(index, &cursor, address);
+      if(!span) {
+        unsigned long next = address_index_gap_end(index, &cursor, address, end);
+        diff->unmappedBytes += next - address;
+        address = next;
+        continue;
+      }
+
+      unsigned long element = (address - span->start) / span->cellSize;
+      unsigned long cellAddress = span->start + element * span->cellSize;
+      address = cellAddress + span->cellSize;
+
+      struct RomDiffCell* last = diff->numCells ? &diff->cells[diff->numCells - 1] : NULL;
+      if(last && last->address == cellAddress && last->table == span->table && last->axis == span->axis) continue;
+
+      if(diff->numCells == capacity) {
+        capacity = capacity ? capacity * 2 : 256;
+        diff->cells = (struct RomDiffCell*)realloc(diff->cells, sizeof(struct RomDiffCell) * capacity);
+        assert(diff->cells);
+      }
+      struct RomDiffCell* cell = &diff->cells[diff->numCells++];
+      struct Table* table = address_span_table(definition, span);
+      cell->table = span->table;
+      cell->axis = span->axis;
+      cell->element = element;
+      cell->address = cellAddress;
+      cell->size = span->cellSize;
+      cell->scaled = true;
+      readCell(table, before, beforeLength, cell, &cell->before);
+      readCell(table, after, afterLength, cell, &cell->after);
+    }
+  }
+}
+
+static void groupTables(struct RomDiff* diff)
+{
+  if(diff->numCells == 0) return;
+  qsort(diff->cells, diff->numCells, sizeof(struct RomDiffCell), compareCells);
+
+  int count = 1;
+  for(long i = 1; i < diff->numCells; i++) {
+    if(diff->cells[i].table != diff->cells[i - 1].table) count++;
+  }
+  diff->tables = (struct RomDiffTable*)malloc(sizeof(struct RomDiffTable) * count);
+  assert(diff->tables);
+  for(long i = 0; i < diff->numCells; i++) {
+    if(i == 0 || diff->cells[i].table != diff->cells[i - 1].table) {
+      struct RomDiffTable* table = &diff->tables[diff->numTables++];
+      table->table = diff->cells[i].table;
+      table->firstCell = i;
+      table->numCells = 0;
+    }
+    diff->tables[diff->numTables - 1].numCells++;
+  }
+}
+
+void rom_diff(struct RomDiff* diff, const unsigned char* before, long beforeLength,
+              const unsigned char* after, long afterLength,
+              struct Definition* definition, const struct AddressIndex* index)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  rom_diff_free(diff);
+
+  long capacity = 0;
+  diff->numRanges = rom_diff_ranges(before, beforeLength, after, afterLength, &diff->ranges, &capacity);
+  for(long i = 0; i < diff->numRanges; i++)
+    diff->bytes += diff->ranges[i].end - diff->ranges[i].start;
+
+  if(definition && index) {
+    resolveCells(diff, before, beforeLength, after, afterLength, definition, index);
+    groupTables(diff);
+  } else {
+    diff->unmappedBytes = diff->bytes;
+  }
+
+  diff->microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void rom_diff_free(struct RomDiff* diff)
+{
+  if(diff->ranges) free(diff->ranges);
+  if(diff->cells) free(diff->cells);
+  if(diff->tables) free(diff->tables);
+  memset(diff, 0, sizeof(struct RomDiff));
+}
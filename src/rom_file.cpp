@@ -0,0 +1,346 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#define ROM_FILE_WINDOWS
+#elif !defined(__EMSCRIPTEN__)
+#define ROM_FILE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "rom_file.h"
+
+static bool allocDirty(struct RomFile* rom)
+{
+  rom->numPages = (rom->length + ROM_FILE_PAGE_SIZE - 1) >> ROM_FILE_PAGE_SHIFT;
+  rom->numDirty = 0;
+  rom->numUnflashed = rom->numPages;
+  rom->dirty = (uint8_t*)calloc((rom->numPages + 7) / 8, 1);
+  rom->unflashed = (uint8_t*)malloc((rom->numPages + 7) / 8);
+  rom->pageHash = (uint64_t*)calloc(rom->numPages, sizeof(uint64_t));
+  rom->hashStale = (uint8_t*)malloc((rom->numPages + 7) / 8);
+  if(!rom->dirty || !rom->unflashed || !rom->pageHash || !rom->hashStale) {
+    errno = ENOMEM;
+    return false;
+  }
+  // nothing is hashed until someone asks, or known to be on any ECU
+  memset(rom->hashStale, 0xff, (rom->numPages + 7) / 8);
+  memset(rom->unflashed, 0xff, (rom->numPages + 7) / 8);
+  return true;
+}
+
+#if defined(ROM_FILE_POSIX)
+static bool mapFile(struct RomFile* rom, const char* path)
+{
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) return false;
+
+  struct stat st;
+  if(fstat(fd, &st) || st.st_size <= 0) {
+    if(errno == 0) errno = EINVAL;
+    close(fd);
+    return false;
+  }
+
+  // PROT_WRITE on a private mapping never reaches the file, written pages are copied
+  void* data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  int mapError = errno;
+  close(fd);
+  if(data == MAP_FAILED) {
+    errno = mapError;
+    return false;
+  }
+  rom->data = (unsigned char*)data;
+  rom->length = (long)st.st_size;
+  rom->backing = ROM_FILE_MAPPED;
+  return true;
+}
+#elif defined(ROM_FILE_WINDOWS)
+static bool mapFile(struct RomFile* rom, const char* path)
+{
+  // others may still write the file, an in place save reopens it for writing
+  rom->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(rom->file == INVALID_HANDLE_VALUE) {
+    rom->file = NULL;
+    errno = GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EACCES;
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(rom->file, &size) || size.QuadPart <= 0) {
+    CloseHandle(rom->file);
+    rom->file = NULL;
+    errno = EINVAL;
+    return false;
+  }
+
+  rom->mapping = CreateFileMappingA(rom->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if(rom->mapping) rom->data = (unsigned char*)MapViewOfFile(rom->mapping, FILE_MAP_COPY, 0, 0, 0);
+  if(!rom->data) {
+    if(rom->mapping) CloseHandle(rom->mapping);
+    CloseHandle(rom->file);
+    rom->mapping = NULL;
+    rom->file = NULL;
+    errno = EIO;
+    return false;
+  }
+  rom->length = (long)size.QuadPart;
+  rom->backing = ROM_FILE_MAPPED;
+  return true;
+}
+#endif
+
+// reads the whole image into the heap, short reads are errors
+static bool readFile(struct RomFile* rom, const char* path)
+{
+  FILE* fp = fopen(path, "rb");
+  if(!fp) return false;
+
+  long length = 0;
+  if(fseek(fp, 0, SEEK_END) == 0) length = ftell(fp);
+  if(length <= 0 || fseek(fp, 0, SEEK_SET)) {
+    fclose(fp);
+    errno = EINVAL;
+    return false;
+  }
+
+  rom->data = (unsigned char*)malloc(length);
+  if(!rom->data) {
+    fclose(fp);
+    errno = ENOMEM;
+    return false;
+  }
+  size_t total = 0;
+  while(total < (size_t)length) {
+    size_t n = fread(rom->data + total, 1, length - total, fp);
+    if(n == 0) break;
+    total += n;
+  }
+  fclose(fp);
+  if(total != (size_t)length) {
+    free(rom->data);
+    rom->data = NULL;
+    errno = EIO;
+    return false;
+  }
+  rom->length = length;
+  rom->backing = ROM_FILE_HEAP;
+  return true;
+}
+
+bool rom_file_open(struct RomFile* rom, const char* path)
+{
+  assert(path);
+  rom_file_close(rom);
+  errno = 0;
+
+  bool ok;
+#if defined(ROM_FILE_POSIX) || defined(ROM_FILE_WINDOWS)
+  // some filesystems can't be mapped, read those instead
+  ok = mapFile(rom, path);
+  if(!ok && errno != ENOENT && errno != EACCES) ok = readFile(rom, path);
+#else
+  ok = readFile(rom, path);
+#endif
+  if(ok && !allocDirty(rom)) {
+    int error = errno;
+    rom_file_close(rom);
+    errno = error;
+    return false;
+  }
+  return ok;
+}
+
+bool rom_file_alloc(struct RomFile* rom, long length)
+{
+  rom_file_close(rom);
+  rom->data = (unsigned char*)calloc(length > 0 ? length : 1, 1);
+  if(!rom->data) {
+    errno = ENOMEM;
+    return false;
+  }
+  rom->length = length;
+  rom->backing = ROM_FILE_HEAP;
+  if(!allocDirty(rom)) {
+    rom_file_close(rom);
+    errno = ENOMEM;
+    return false;
+  }
+  return true;
+}
+
+void rom_file_close(struct RomFile* rom)
+{
+  if(rom->backing == ROM_FILE_MAPPED) {
+#if defined(ROM_FILE_POSIX)
+    munmap(rom->data, (size_t)rom->length);
+#elif defined(ROM_FILE_WINDOWS)
+    UnmapViewOfFile(rom->data);
+    CloseHandle(rom->mapping);
+    CloseHandle(rom->file);
+#endif
+  } else if(rom->backing == ROM_FILE_HEAP) {
+    free(rom->data);
+  }
+  if(rom->dirty) free(rom->dirty);
+  if(rom->unflashed) free(rom->unflashed);
+  if(rom->pageHash) free(rom->pageHash);
+  if(rom->hashStale) free(rom->hashStale);
+  memset(rom, 0, sizeof(struct RomFile));
+}
+
+void rom_file_mark_dirty(struct RomFile* rom, unsigned long offset, size_t length)
+{
+  if(length == 0 || offset >= (unsigned long)rom->length) return;
+  long first = offset >> ROM_FILE_PAGE_SHIFT;
+  long last = (offset + length - 1) >> ROM_FILE_PAGE_SHIFT;
+  if(last >= rom->numPages) last = rom->numPages - 1;
+  for(long page = first; page <= last; page++) {
+    uint8_t bit = (uint8_t)(1 << (page & 7));
+    rom->hashStale[page >> 3] |= bit;
+    if(!(rom->dirty[page >> 3] & bit)) {
+      rom->dirty[page >> 3] |= bit;
+      rom->numDirty++;
+    }
+    if(!(rom->unflashed[page >> 3] & bit)) {
+      rom->unflashed[page >> 3] |= bit;
+      rom->numUnflashed++;
+    }
+  }
+}
+
+void rom_file_write(struct RomFile* rom, unsigned long offset, const void* data, size_t length)
+{
+  assert(offset + length <= (unsigned long)rom->length);
+  memcpy(rom->data + offset, data, length);
+  rom_file_mark_dirty(rom, offset, length);
+}
+
+bool rom_file_page_dirty(const struct RomFile* rom, long page)
+{
+  if(page < 0 || page >= rom->numPages) return false;
+  return (rom->dirty[page >> 3] >> (page & 7)) & 1;
+}
+
+void rom_file_clear_dirty(struct RomFile* rom)
+{
+  if(rom->dirty) memset(rom->dirty, 0, (rom->numPages + 7) / 8);
+  rom->numDirty = 0;
+}
+
+static bool pageSet(const uint8_t* bits, long page)
+{
+  return (bits[page >> 3] >> (page & 7)) & 1;
+}
+
+// the next run of set pages in [bits] at or after [offset], clamped to the image
+static bool nextRun(const struct RomFile* rom, const uint8_t* bits, unsigned long offset, unsigned long* start,
+                    unsigned long* end)
+{
+  if(offset >= (unsigned long)rom->length) return false;
+  long page = offset >> ROM_FILE_PAGE_SHIFT;
+
+  // skip clear pages a byte (eight pages) at a time where possible
+  while(page < rom->numPages) {
+    if((page & 7) == 0 && bits[page >> 3] == 0) {
+      page += 8;
+      continue;
+    }
+    if(pageSet(bits, page)) break;
+    page++;
+  }
+  if(page >= rom->numPages) return false;
+
+  long last = page;
+  while(last + 1 < rom->numPages && pageSet(bits, last + 1)) last++;
+
+  *start = (unsigned long)page << ROM_FILE_PAGE_SHIFT;
+  if(*start < offset) *start = offset;
+  *end = (unsigned long)(last + 1) << ROM_FILE_PAGE_SHIFT;
+  if(*end > (unsigned long)rom->length) *end = (unsigned long)rom->length;
+  return true;
+}
+
+bool rom_file_next_dirty(const struct RomFile* rom, unsigned long offset, unsigned long* start, unsigned long* end)
+{
+  return rom->numDirty != 0 && nextRun(rom, rom->dirty, offset, start, end);
+}
+
+void rom_file_clear_unflashed(struct RomFile* rom)
+{
+  if(rom->unflashed) memset(rom->unflashed, 0, (rom->numPages + 7) / 8);
+  rom->numUnflashed = 0;
+}
+
+bool rom_file_next_unflashed(const struct RomFile* rom, unsigned long offset, unsigned long* start, unsigned long* end)
+{
+  return rom->numUnflashed != 0 && nextRun(rom, rom->unflashed, offset, start, end);
+}
+
+// multiply-xorshift over 8 byte words, plenty for spotting changed content
+static uint64_t hashMix(uint64_t h)
+{
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 29;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t rom_file_hash_bytes(const unsigned char* data, size_t length, uint64_t seed)
+{
+  uint64_t h = seed ^ (length * 0x9e3779b97f4a7c15ull);
+  size_t i = 0;
+  for(; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    h = hashMix(h ^ word) + 0x9e3779b97f4a7c15ull;
+  }
+  uint64_t tail = 0;
+  for(size_t n = 0; i < length; i++, n++)
+    tail |= (uint64_t)data[i] << (n * 8);
+  return hashMix(h ^ tail);
+}
+
+static size_t pageLength(long length, long page)
+{
+  long end = (page + 1) << ROM_FILE_PAGE_SHIFT;
+  return (size_t)((end > length ? length : end) - (page << ROM_FILE_PAGE_SHIFT));
+}
+
+uint64_t rom_file_hash(struct RomFile* rom)
+{
+  if(rom->backing == ROM_FILE_CLOSED) return 0;
+  for(long page = 0; page < rom->numPages; page++) {
+    if((page & 7) == 0 && rom->hashStale[page >> 3] == 0) {
+      page += 7;
+      continue;
+    }
+    uint8_t bit = (uint8_t)(1 << (page & 7));
+    if(!(rom->hashStale[page >> 3] & bit)) continue;
+    rom->pageHash[page] = rom_file_hash_bytes(rom->data + (page << ROM_FILE_PAGE_SHIFT), pageLength(rom->length, page), page);
+    rom->hashStale[page >> 3] &= (uint8_t)~bit;
+  }
+  return rom_file_hash_bytes((const unsigned char*)rom->pageHash, sizeof(uint64_t) * rom->numPages, (uint64_t)rom->length);
+}
+
+uint64_t rom_file_hash_buffer(const unsigned char* data, long length)
+{
+  long numPages = (length + ROM_FILE_PAGE_SIZE - 1) >> ROM_FILE_PAGE_SHIFT;
+  uint64_t* pageHash = (uint64_t*)malloc(sizeof(uint64_t) * (numPages ? numPages : 1));
+  assert(pageHash);
+  for(long page = 0; page < numPages; page++)
+    pageHash[page] = rom_file_hash_bytes(data + (page << ROM_FILE_PAGE_SHIFT), pageLength(length, page), page);
+  uint64_t h = rom_file_hash_bytes((const unsigned char*)pageHash, sizeof(uint64_t) * numPages, (uint64_t)length);
+  free(pageHash);
+  return h;
+}
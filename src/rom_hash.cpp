@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "conescan_db.h"
+#include "rom_hash.h"
+#include "sqlite3.h"
+
+bool conescan_db_load_rom_hash(struct ConeScanDB* db, const char* path, uint64_t* hash, long* length)
+{
+  sqlite3_stmt* query;
+  int rc;
+  bool found = false;
+  rc = sqlite3_prepare_v2(db->db, "SELECT hash, length FROM rom_hash WHERE path = ? LIMIT 1", -1, &query, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(query, 1, path, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(query);
+  if(rc == SQLITE_ROW) {
+    const char* tmp = (const char*)sqlite3_column_text(query, 0);
+    *hash = strtoull(tmp, NULL, 16);
+    *length = (long)sqlite3_column_int64(query, 1);
+    found = true;
+  } else if(rc != SQLITE_DONE) {
+    printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+  }
+  sqlite3_finalize(query);
+  return found;
+}
+
+void conescan_db_save_rom_hash(struct ConeScanDB* db, const char* path, uint64_t hash, long length)
+{
+  // stored as hex text, sqlite integers are signed
+  char text[17];
+  snprintf(text, sizeof(text), "%016" PRIx64, hash);
+
+  sqlite3_stmt* statement;
+  int rc;
+  rc = sqlite3_prepare_v2(db->db,
+    "INSERT INTO rom_hash(path, hash, length) VALUES(?, ?, ?) "
+    "ON CONFLICT(path) DO UPDATE SET hash=excluded.hash, length=excluded.length", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 1, path, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 2, text, -1, SQLITE_TRANSIENT);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 3, length);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_DONE);
+  sqlite3_finalize(statement);
+}
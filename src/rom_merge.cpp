@@ -0,0 +1,200 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ROM_MERGE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "definition.h"
+#include "address_index.h"
+#include "rom_diff.h"
+#include "rom_merge.h"
+
+// a changed cell, or a changed run of bytes outside every table
+struct MergeUnit {
+  unsigned long start;
+  unsigned long end;
+  int           table;
+  int           axis;
+  unsigned long element;
+};
+
+struct MergeUnits {
+  struct MergeUnit* units;
+  long              count;
+  long              capacity;
+};
+
+static void addUnit(struct MergeUnits* list, unsigned long start, unsigned long end, int table, int axis, unsigned long element)
+{
+  if(list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 256;
+    list->units = (struct MergeUnit*)realloc(list->units, sizeof(struct MergeUnit) * list->capacity);
+    assert(list->units);
+  }
+  struct MergeUnit* unit = &list->units[list->count++];
+  unit->start = start;
+  unit->end = end;
+  unit->table = table;
+  unit->axis = axis;
+  unit->element = element;
+}
+
+// ours where it differs from base, theirs everywhere else
+static void blend(unsigned char* out, const unsigned char* base, const unsigned char* ours,
+                  const unsigned char* theirs, long length)
+{
+  long offset = 0;
+#ifdef ROM_MERGE_SSE2
+  for(; offset + 16 <= length; offset += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i*)(base + offset));
+    __m128i o = _mm_loadu_si128((const __m128i*)(ours + offset));
+    __m128i t = _mm_loadu_si128((const __m128i*)(theirs + offset));
+    __m128i keep = _mm_cmpeq_epi8(o, b);
+    _mm_storeu_si128((__m128i*)(out + offset), _mm_or_si128(_mm_and_si128(keep, t), _mm_andnot_si128(keep, o)));
+  }
+#endif
+  for(; offset < length; offset++)
+    out[offset] = ours[offset] == base[offset] ? theirs[offset] : ours[offset];
+}
+
+// changed ranges in address order as cells and unmapped runs
+static void collectUnits(struct MergeUnits* list, const struct RomDiffRange* ranges, long numRanges,
+                         const struct AddressIndex* index)
+{
+  struct AddressCursor cursor;
+  memset(&cursor, 0, sizeof(cursor));
+  for(long r = 0; r < numRanges; r++) {
+    unsigned long address = ranges[r].start;
+    unsigned long end = ranges[r].end;
+    while(address < end) {
+      const struct AddressSpan* span = index ? address_index_find(index, &cursor, address) : NULL;
+      if(!span) {
+        unsigned long next = index ? address_index_gap_end(index, &cursor, address, end) : end;
+        addUnit(list, address, next, -1, -1, 0);
+        address = next;
+        continue;
+      }
+      unsigned long element = (address - span->start) / span->cellSize;
+      unsigned long start = span->start + element * span->cellSize;
+      struct MergeUnit* last = list->count ? &list->units[list->count - 1] : NULL;
+      if(!last || last->start != start || last->table != span->table || last->axis != span->axis)
+        addUnit(list, start, start + span->cellSize, span->table, span->axis, element);
+      address = start + span->cellSize;
+    }
+  }
+}
+
+static double cellValue(struct Table* table, const unsigned char* data, long length, unsigned long address, int size)
+{
+  if(address + size > (unsigned long)length) return 0.0;
+  double value;
+  if(definition_read_scaled(table->Scaling, data, address, &value)) return value;
+  return definition_read_raw(table->Scaling, data, address);
+}
+
+static void addConflict(struct RomMerge* merge, long* capacity, const struct MergeUnit* unit,
+                        unsigned long start, unsigned long end, const unsigned char* base,
+                        const unsigned char* ours, const unsigned char* theirs, struct Definition* definition)
+{
+  if(merge->numConflicts == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    merge->conflicts = (struct RomMergeConflict*)realloc(merge->conflicts, sizeof(struct RomMergeConflict) * *capacity);
+    assert(merge->conflicts);
+  }
+  struct RomMergeConflict* conflict = &merge->conflicts[merge->numConflicts++];
+  conflict->table = unit->table;
+  conflict->axis = unit->axis;
+  conflict->element = unit->element;
+  conflict->address = start;
+  conflict->size = (int)(end - start);
+  conflict->choice = ROM_MERGE_OURS;
+  conflict->base = conflict->ours = conflict->theirs = 0.0;
+  if(unit->table >= 0) {
+    struct Table* table = &definition->tables[unit->table];
+    if(unit->axis >= 0) table = &table->tables[unit->axis];
+    conflict->base = cellValue(table, base, merge->length, start, conflict->size);
+    conflict->ours = cellValue(table, ours, merge->length, start, conflict->size);
+    conflict->theirs = cellValue(table, theirs, merge->length, start, conflict->size);
+  }
+  // the blend may have mixed bytes of both sides into this cell
+  memcpy(merge->result + start, ours + start, conflict->size);
+}
+
+void rom_merge(struct RomMerge* merge, const unsigned char* base, const unsigned char* ours,
+               const unsigned char* theirs, long length,
+               struct Definition* definition, const struct AddressIndex* index)
+{
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  rom_merge_free(merge);
+  merge->length = length;
+  merge->result = (unsigned char*)malloc(length > 0 ? length : 1);
+  assert(merge->result);
+  blend(merge->result, base, ours, theirs, length);
+  if(!definition) index = NULL;
+
+  struct RomDiffRange* ranges = NULL;
+  long capacity = 0;
+  struct MergeUnits oursUnits, theirsUnits;
+  memset(&oursUnits, 0, sizeof(oursUnits));
+  memset(&theirsUnits, 0, sizeof(theirsUnits));
+  long count = rom_diff_ranges(base, length, ours, length, &ranges, &capacity);
+  collectUnits(&oursUnits, ranges, count, index);
+  count = rom_diff_ranges(base, length, theirs, length, &ranges, &capacity);
+  collectUnits(&theirsUnits, ranges, count, index);
+  free(ranges);
+
+  // both lists are in address order, walk them together looking for overlaps
+  long conflicts = 0;
+  long o = 0, t = 0;
+  long oursShared = 0, theirsShared = 0;
+  while(o < oursUnits.count && t < theirsUnits.count) {
+    struct MergeUnit* a = &oursUnits.units[o];
+    struct MergeUnit* b = &theirsUnits.units[t];
+    unsigned long start = a->start > b->start ? a->start : b->start;
+    unsigned long end = a->end < b->end ? a->end : b->end;
+    if(start < end) {
+      if(memcmp(ours + start, theirs + start, end - start) != 0)
+        addConflict(merge, &conflicts, a, start, end, base, ours, theirs, definition);
+      else if(a->table >= 0)
+        merge->sameCells++;
+      if(a->table >= 0) {
+        oursShared++;
+        theirsShared++;
+      }
+    }
+    if(a->end <= b->end) o++;
+    else t++;
+  }
+
+  for(long i = 0; i < oursUnits.count; i++) merge->oursCells += oursUnits.units[i].table >= 0;
+  for(long i = 0; i < theirsUnits.count; i++) merge->theirsCells += theirsUnits.units[i].table >= 0;
+  merge->oursCells -= oursShared;
+  merge->theirsCells -= theirsShared;
+
+  free(oursUnits.units);
+  free(theirsUnits.units);
+  merge->microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void rom_merge_resolve(struct RomMerge* merge, long conflict, enum RomMergeChoice choice,
+                       const unsigned char* base, const unsigned char* ours, const unsigned char* theirs)
+{
+  assert(conflict >= 0 && conflict < merge->numConflicts);
+  struct RomMergeConflict* c = &merge->conflicts[conflict];
+  const unsigned char* from = choice == ROM_MERGE_THEIRS ? theirs : (choice == ROM_MERGE_BASE ? base : ours);
+  memcpy(merge->result + c->address, from + c->address, c->size);
+  c->choice = choice;
+}
+
+void rom_merge_free(struct RomMerge* merge)
+{
+  if(merge->result) free(merge->result);
+  if(merge->conflicts) free(merge->conflicts);
+  memset(merge, 0, sizeof(struct RomMerge));
+}
@@ -0,0 +1,311 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+#include <io.h>
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "rom_file.h"
+#include "rom_save.h"
+
+#define ROM_SAVE_JOURNAL_MAGIC "CSJ1"
+#define ROM_SAVE_JOURNAL_HEADER 16
+#define ROM_SAVE_JOURNAL_FOOTER 8
+
+// changes closer together than this are written as one range
+#define ROM_SAVE_MERGE_GAP 16
+
+struct SaveRange {
+  uint32_t offset;
+  uint32_t length;
+};
+
+static char* sidePath(const char* path, const char* suffix)
+{
+  size_t length = strlen(path) + strlen(suffix) + 1;
+  char* out = (char*)malloc(length);
+  assert(out);
+  snprintf(out, length, "%s%s", path, suffix);
+  return out;
+}
+
+// flushes stdio and the OS cache for [fp]
+static bool syncFile(FILE* fp)
+{
+  if(fflush(fp)) return false;
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  return _commit(_fileno(fp)) == 0;
+#else
+  return fsync(fileno(fp)) == 0;
+#endif
+}
+
+static bool replaceFile(const char* from, const char* to)
+{
+#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
+  if(MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) return true;
+  errno = EACCES;
+  return false;
+#else
+  return rename(from, to) == 0;
+#endif
+}
+
+static bool writeAll(FILE* fp, const void* data, size_t length)
+{
+  return length == 0 || fwrite(data, 1, length, fp) == length;
+}
+
+static bool readAll(FILE* fp, void* data, size_t length)
+{
+  return length == 0 || fread(data, 1, length, fp) == length;
+}
+
+static void put32(unsigned char* out, uint32_t value)
+{
+  for(int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static uint32_t get32(const unsigned char* in)
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; i++) value |= (uint32_t)in[i] << (i * 8);
+  return value;
+}
+
+static void put64(unsigned char* out, uint64_t value)
+{
+  for(int i = 0; i < 8; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static uint64_t get64(const unsigned char* in)
+{
+  uint64_t value = 0;
+  for(int i = 0; i < 8; i++) value |= (uint64_t)in[i] << (i * 8);
+  return value;
+}
+
+static long fileLength(FILE* fp)
+{
+  if(fseek(fp, 0, SEEK_END)) return -1;
+  return ftell(fp);
+}
+
+bool rom_save_replace(const char* from, const char* to)
+{
+  return replaceFile(from, to);
+}
+
+bool rom_save_buffer(const char* path, const unsigned char* data, long length)
+{
+  char* tmpPath = sidePath(path, ".tmp");
+  FILE* fp = fopen(tmpPath, "wb");
+  if(!fp) {
+    free(tmpPath);
+    return false;
+  }
+  bool ok = writeAll(fp, data, (size_t)length) && syncFile(fp);
+  if(fclose(fp)) ok = false;
+  if(ok) ok = replaceFile(tmpPath, path);
+  if(!ok) {
+    int error = errno;
+    remove(tmpPath);
+    errno = error;
+  }
+  free(tmpPath);
+  return ok;
+}
+
+bool rom_save_as(struct RomFile* rom, const char* path, struct RomSaveResult* result)
+{
+  if(!rom_save_buffer(path, rom->data, rom->length)) return false;
+  rom_file_clear_dirty(rom);
+  result->hash = rom_file_hash(rom);
+  result->ranges = 1;
+  result->bytes = rom->length;
+  return true;
+}
+
+// byte ranges inside dirty pages that differ from [disk]
+// returns the number of ranges or -1 on a read error
+static long collectRanges(struct RomFile* rom, FILE* disk, struct SaveRange** ranges)
+{
+  unsigned char page[ROM_FILE_PAGE_SIZE];
+  long count = 0, capacity = 0;
+  unsigned long offset = 0, start, end;
+  *ranges = NULL;
+
+  while(rom_file_next_dirty(rom, offset, &start, &end)) {
+    for(unsigned long base = start; base < end; base += ROM_FILE_PAGE_SIZE) {
+      size_t n = end - base < ROM_FILE_PAGE_SIZE ? end - base : ROM_FILE_PAGE_SIZE;
+      if(fseek(disk, (long)base, SEEK_SET) || !readAll(disk, page, n)) {
+        free(*ranges);
+        *ranges = NULL;
+        return -1;
+      }
+      const unsigned char* mem = rom->data + base;
+      for(size_t i = 0; i < n; i++) {
+        if(mem[i] == page[i]) continue;
+        size_t j = i + 1;
+        while(j < n && mem[j] != page[j]) j++;
+
+        uint32_t at = (uint32_t)(base + i);
+        struct SaveRange* last = count ? &(*ranges)[count - 1] : NULL;
+        if(last && at - (last->offset + last->length) < ROM_SAVE_MERGE_GAP) {
+          last->length = (uint32_t)(base + j) - last->offset;
+        } else {
+          if(count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            *ranges = (struct SaveRange*)realloc(*ranges, sizeof(struct SaveRange) * capacity);
+            assert(*ranges);
+          }
+          (*ranges)[count].offset = at;
+          (*ranges)[count].length = (uint32_t)(j - i);
+          count++;
+        }
+        i = j;
+      }
+    }
+    offset = end;
+  }
+  return count;
+}
+
+// header: magic, range count, image length
+// body:   offset, length, bytes for every range
+// footer: hash of everything before it, a torn journal never validates
+static bool writeJournal(const char* journalPath, struct RomFile* rom, const struct SaveRange* ranges, long count)
+{
+  size_t size = ROM_SAVE_JOURNAL_HEADER + ROM_SAVE_JOURNAL_FOOTER;
+  for(long i = 0; i < count; i++) size += 8 + ranges[i].length;
+
+  unsigned char* journal = (unsigned char*)malloc(size);
+  assert(journal);
+  unsigned char* p = journal;
+  memcpy(p, ROM_SAVE_JOURNAL_MAGIC, 4);
+  put32(p + 4, (uint32_t)count);
+  put64(p + 8, (uint64_t)rom->length);
+  p += ROM_SAVE_JOURNAL_HEADER;
+  for(long i = 0; i < count; i++) {
+    put32(p, ranges[i].offset);
+    put32(p + 4, ranges[i].length);
+    memcpy(p + 8, rom->data + ranges[i].offset, ranges[i].length);
+    p += 8 + ranges[i].length;
+  }
+  put64(p, rom_file_hash_buffer(journal, (long)(p - journal)));
+
+  FILE* fp = fopen(journalPath, "wb");
+  bool ok = fp && writeAll(fp, journal, size) && syncFile(fp);
+  if(fp && fclose(fp)) ok = false;
+  free(journal);
+  return ok;
+}
+
+bool rom_save(struct RomFile* rom, const char* path, struct RomSaveResult* result)
+{
+  memset(result, 0, sizeof(struct RomSaveResult));
+  FILE* disk = fopen(path, "r+b");
+  if(!disk) return false;
+  if(fileLength(disk) != rom->length) {
+    fclose(disk);
+    errno = EINVAL;
+    return false;
+  }
+
+  struct SaveRange* ranges = NULL;
+  long count = collectRanges(rom, disk, &ranges);
+  if(count < 0) {
+    fclose(disk);
+    errno = EIO;
+    return false;
+  }
+
+  bool ok = true;
+  char* journalPath = sidePath(path, ".journal");
+  if(count > 0) {
+    ok = writeJournal(journalPath, rom, ranges, count);
+    for(long i = 0; ok && i < count; i++) {
+      ok = fseek(disk, (long)ranges[i].offset, SEEK_SET) == 0 &&
+           writeAll(disk, rom->data + ranges[i].offset, ranges[i].length);
+      if(ok) result->bytes += ranges[i].length;
+    }
+    if(ok) ok = syncFile(disk);
+  }
+  int error = errno;
+  if(fclose(disk)) ok = false;
+
+  // a failed write leaves the journal behind for rom_save_recover()
+  if(ok) {
+    remove(journalPath);
+    rom_file_clear_dirty(rom);
+    result->ranges = count;
+    result->hash = rom_file_hash(rom);
+  } else {
+    errno = error ? error : EIO;
+  }
+  free(journalPath);
+  free(ranges);
+  return ok;
+}
+
+bool rom_save_recover(const char* path)
+{
+  char* journalPath = sidePath(path, ".journal");
+  FILE* fp = fopen(journalPath, "rb");
+  if(!fp) {
+    free(journalPath);
+    return true;
+  }
+
+  long size = fileLength(fp);
+  unsigned char* journal = NULL;
+  bool valid = size >= ROM_SAVE_JOURNAL_HEADER + ROM_SAVE_JOURNAL_FOOTER && fseek(fp, 0, SEEK_SET) == 0;
+  if(valid) {
+    journal = (unsigned char*)malloc(size);
+    assert(journal);
+    valid = readAll(fp, journal, (size_t)size);
+  }
+  fclose(fp);
+
+  if(valid) {
+    long body = size - ROM_SAVE_JOURNAL_FOOTER;
+    valid = memcmp(journal, ROM_SAVE_JOURNAL_MAGIC, 4) == 0 &&
+            get64(journal + body) == rom_file_hash_buffer(journal, body);
+  }
+
+  bool ok = true;
+  if(valid) {
+    // the journal is complete, so the save may have stopped anywhere in the file
+    uint32_t count = get32(journal + 4);
+    long length = (long)get64(journal + 8);
+    FILE* disk = fopen(path, "r+b");
+    ok = disk && fileLength(disk) == length;
+    const unsigned char* p = journal + ROM_SAVE_JOURNAL_HEADER;
+    const unsigned char* end = journal + size - ROM_SAVE_JOURNAL_FOOTER;
+    for(uint32_t i = 0; ok && i < count; i++) {
+      if(end - p < 8) { ok = false; break; }
+      uint32_t offset = get32(p);
+      uint32_t n = get32(p + 4);
+      if((size_t)(end - p - 8) < n || (long)offset + (long)n > length) { ok = false; break; }
+      ok = fseek(disk, (long)offset, SEEK_SET) == 0 && writeAll(disk, p + 8, n);
+      p += 8 + n;
+    }
+    if(disk) {
+      if(ok) ok = syncFile(disk);
+      if(fclose(disk)) ok = false;
+    }
+  }
+
+  // a torn journal means the ROM file was never touched
+  if(ok) remove(journalPath);
+  free(journal);
+  free(journalPath);
+  return ok;
+}
@@ -0,0 +1,373 @@
+#include <assert.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ROM_SEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bit_scan.h"
+#include "rom_search.h"
+
+// smallest slice of the ROM worth handing to another thread
+#define ROM_SEARCH_MIN_CHUNK (128 * 1024)
+#define ROM_SEARCH_MAX_THREADS 8
+
+// matches found by one worker, grown as needed
+struct RomSearchChunk {
+  size_t         begin;
+  size_t         end;
+  unsigned long* offsets;
+  int            count;
+  int            capacity;
+  bool           truncated;
+};
+
+static int hexNibble(char c)
+{
+  if(c >= '0' && c <= '9') return c - '0';
+  c = (char)tolower((unsigned char)c);
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+bool rom_search_parse_hex(struct RomSearchPattern* pattern, const char* text)
+{
+  pattern->type = ROM_SEARCH_BYTES;
+  pattern->length = 0;
+  pattern->align = 1;
+
+  // collect nibbles, '?' is a wildcard nibble
+  int nibbles = 0;
+  for(const char* c = text; *c; c++) {
+    if(isspace((unsigned char)*c)) continue;
+    int value = *c == '?' ? 0 : hexNibble(*c);
+    if(value < 0) return false;
+    if(nibbles / 2 >= ROM_SEARCH_PATTERN_MAX) return false;
+
+    int i = nibbles / 2;
+    uint8_t nibbleMask = *c == '?' ? 0x0 : 0xf;
+    if(nibbles % 2 == 0) {
+      pattern->bytes[i] = (uint8_t)(value << 4);
+      pattern->mask[i] = (uint8_t)(nibbleMask << 4);
+    } else {
+      pattern->bytes[i] |= (uint8_t)value;
+      pattern->mask[i] |= nibbleMask;
+    }
+    nibbles++;
+  }
+  if(nibbles == 0 || nibbles % 2) return false;
+  pattern->length = nibbles / 2;
+  return true;
+}
+
+static int typeSize(enum RomSearchType type)
+{
+  switch(type) {
+    case ROM_SEARCH_UINT8:  return 1;
+    case ROM_SEARCH_UINT16: return 2;
+    case ROM_SEARCH_FLOAT:
+    case ROM_SEARCH_UINT32: return 4;
+    default:                return 0;
+  }
+}
+
+void rom_search_set_value(struct RomSearchPattern* pattern, enum RomSearchType type,
+                          double value, double tolerance, bool bigEndian, bool aligned)
+{
+  assert(type != ROM_SEARCH_BYTES);
+  pattern->type = type;
+  pattern->value = value;
+  pattern->tolerance = tolerance > 0 ? tolerance : 0;
+  pattern->bigEndian = bigEndian;
+  pattern->length = typeSize(type);
+  pattern->align = aligned ? typeSize(type) : 1;
+}
+
+int rom_search_length(const struct RomSearchPattern* pattern)
+{
+  return pattern->type == ROM_SEARCH_BYTES ? pattern->length : typeSize(pattern->type);
+}
+
+// typed searches without a tolerance are plain byte patterns
+static bool isExact(const struct RomSearchPattern* pattern)
+{
+  return pattern->type == ROM_SEARCH_BYTES || pattern->tolerance == 0;
+}
+
+static uint32_t floatBits(float f)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+// byte [n] of [raw] as laid out in memory
+static uint8_t memoryByte(uint32_t raw, int size, bool bigEndian, int n)
+{
+  int shift = bigEndian ? (size - 1 - n) * 8 : n * 8;
+  return (uint8_t)(raw >> shift);
+}
+
+bool rom_search_prepare(struct RomSearchPattern* pattern)
+{
+  if(pattern->align < 1) pattern->align = 1;
+  int size = typeSize(pattern->type);
+
+  if(pattern->type != ROM_SEARCH_BYTES && pattern->tolerance == 0) {
+    uint32_t raw;
+    if(pattern->type == ROM_SEARCH_FLOAT) {
+      if(isnan(pattern->value) || isinf((float)pattern->value)) return false;
+      raw = floatBits((float)pattern->value);
+    } else {
+      // the type can't hold it, searching a clamped or rounded value would find the wrong cells
+      double max = size == 4 ? 4294967295.0 : (double)((1u << (size * 8)) - 1);
+      double v = pattern->value;
+      if(!(v >= 0 && v <= max) || v != floor(v)) return false;
+      raw = (uint32_t)v;
+    }
+    for(int n = 0; n < size; n++) {
+      pattern->bytes[n] = memoryByte(raw, size, pattern->bigEndian, n);
+      pattern->mask[n] = 0xff;
+    }
+    pattern->length = size;
+  }
+
+  if(isExact(pattern)) {
+    // anchor on the first fully specified byte, the last resort is no filter at all
+    pattern->anchor = 0;
+    pattern->anchorMask = 0xff;
+    pattern->anchorLow = 0;
+    pattern->anchorSpan = 0xff;
+    for(int i = 0; i < pattern->length; i++) {
+      if(pattern->mask[i] == 0xff) {
+        pattern->anchor = i;
+        pattern->anchorLow = pattern->bytes[i];
+        pattern->anchorSpan = 0;
+        break;
+      }
+    }
+    return true;
+  }
+
+  // ranges filter on the most significant byte
+  pattern->anchor = pattern->bigEndian ? 0 : size - 1;
+  pattern->anchorMask = 0xff;
+  pattern->anchorLow = 0;
+  pattern->anchorSpan = 0xff;
+  double low = pattern->value - pattern->tolerance;
+  double high = pattern->value + pattern->tolerance;
+  uint32_t lowRaw, highRaw;
+  if(pattern->type == ROM_SEARCH_FLOAT) {
+    // bits order like the values on either side of zero, mirrored below it
+    float lo = nextafterf((float)low, -INFINITY);
+    float hi = nextafterf((float)high, INFINITY);
+    if(low < 0 && high > 0) {
+      // straddles zero, ignore the sign bit and filter on the magnitude
+      pattern->anchorMask = 0x7f;
+      lowRaw = 0;
+      highRaw = floatBits(-lo > hi ? -lo : hi) & 0x7fffffff;
+    } else {
+      lowRaw = floatBits(high <= 0 ? hi : lo);
+      highRaw = floatBits(high <= 0 ? lo : hi);
+    }
+  } else {
+    double max = size == 4 ? 4294967295.0 : (double)((1u << (size * 8)) - 1);
+    if(high < 0 || low > max) {
+      // nothing can match, filter on an empty range
+      pattern->anchorLow = 1;
+      pattern->anchorSpan = 0;
+      pattern->length = size;
+      return true;
+    }
+    lowRaw = low < 0 ? 0 : (uint32_t)ceil(low);
+    highRaw = high > max ? (uint32_t)max : (uint32_t)floor(high);
+  }
+  uint8_t lowByte = (uint8_t)(lowRaw >> ((size - 1) * 8));
+  uint8_t highByte = (uint8_t)(highRaw >> ((size - 1) * 8));
+  if(lowByte <= highByte) {
+    pattern->anchorLow = lowByte;
+    pattern->anchorSpan = highByte - lowByte;
+  }
+  return true;
+}
+
+static inline bool verifyBytes(const uint8_t* p, const struct RomSearchPattern* pattern)
+{
+  for(int i = 0; i < pattern->length; i++)
+    if((p[i] & pattern->mask[i]) != pattern->bytes[i]) return false;
+  return true;
+}
+
+static bool verifyValue(const uint8_t* p, const struct RomSearchPattern* pattern)
+{
+  int size = typeSize(pattern->type);
+  uint32_t raw = 0;
+  for(int n = 0; n < size; n++) {
+    int shift = pattern->bigEndian ? (size - 1 - n) * 8 : n * 8;
+    raw |= (uint32_t)p[n] << shift;
+  }
+  double value;
+  if(pattern->type == ROM_SEARCH_FLOAT) {
+    float f;
+    memcpy(&f, &raw, sizeof(f));
+    value = f;
+  } else {
+    value = raw;
+  }
+  return fabs(value - pattern->value) <= pattern->tolerance;
+}
+
+static void addResult(struct RomSearchChunk* chunk, size_t offset)
+{
+  if(chunk->count == ROM_SEARCH_MAX_RESULTS) {
+    chunk->truncated = true;
+    return;
+  }
+  if(chunk->count == chunk->capacity) {
+    chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 256;
+    chunk->offsets = (unsigned long*)realloc(chunk->offsets, sizeof(unsigned long) * chunk->capacity);
+    assert(chunk->offsets);
+  }
+  chunk->offsets[chunk->count++] = (unsigned long)offset;
+}
+
+// checks every candidate offset the anchor filter lets through
+#define ROM_SEARCH_CHECK(offset) \
+  do { \
+    size_t at = (offset); \
+    if(alignMask && (at & alignMask)) break; \
+    if(exact ? verifyBytes(data + at, pattern) : verifyValue(data + at, pattern)) addResult(chunk, at); \
+  } while(0)
+
+// finds every match starting in [chunk->begin, chunk->end)
+static void searchChunk(const uint8_t* data, const struct RomSearchPattern* pattern, struct RomSearchChunk* chunk)
+{
+  size_t offset = chunk->begin;
+  size_t end = chunk->end;
+  bool exact = isExact(pattern);
+  size_t alignMask = (size_t)pattern->align - 1;
+
+  if(pattern->anchorSpan == 0xff) {
+    for(; offset < end && !chunk->truncated; offset++)
+      ROM_SEARCH_CHECK(offset);
+    return;
+  }
+
+  const uint8_t* anchor = data + pattern->anchor;
+#ifdef ROM_SEARCH_SSE2
+  // ((byte & mask) - low) <= span as unsigned, one compare covers exact bytes and ranges
+  const __m128i mask = _mm_set1_epi8((char)pattern->anchorMask);
+  const __m128i low = _mm_set1_epi8((char)pattern->anchorLow);
+  const __m128i span = _mm_set1_epi8((char)pattern->anchorSpan);
+#define ROM_SEARCH_HITS(at) \
+  (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8( \
+    _mm_sub_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*)(anchor + (at))), mask), low), span), \
+    _mm_sub_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i*)(anchor + (at))), mask), low)))
+  // 64 bytes per step, candidates are rare so only a hit leaves the fast path
+  for(; offset + 64 <= end && !chunk->truncated; offset += 64) {
+    uint64_t bits = (uint64_t)ROM_SEARCH_HITS(offset) |
+                    ((uint64_t)ROM_SEARCH_HITS(offset + 16) << 16) |
+                    ((uint64_t)ROM_SEARCH_HITS(offset + 32) << 32) |
+                    ((uint64_t)ROM_SEARCH_HITS(offset + 48) << 48);
+    while(bits) {
+      size_t candidate = offset + bit_scan_lowest(bits);
+      bits &= bits - 1;
+      ROM_SEARCH_CHECK(candidate);
+    }
+  }
+#undef ROM_SEARCH_HITS
+#endif
+  for(; offset < end && !chunk->truncated; offset++) {
+    if((uint8_t)((anchor[offset] & pattern->anchorMask) - pattern->anchorLow) > pattern->anchorSpan) continue;
+    ROM_SEARCH_CHECK(offset);
+  }
+}
+
+int rom_search(const uint8_t* data, size_t length, struct RomSearchPattern* pattern,
+               struct RomSearchResults* results, int threads)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  results->count = 0;
+  results->truncated = false;
+  results->microseconds = 0;
+
+  if(!rom_search_prepare(pattern)) return -1;
+  results->length = pattern->length;
+  if(pattern->length <= 0 || (size_t)pattern->length > length) return 0;
+  size_t starts = length - pattern->length + 1;
+
+#ifdef __EMSCRIPTEN__
+  threads = 1;
+#else
+  if(threads <= 0) threads = (int)std::thread::hardware_concurrency();
+#endif
+  if(threads > ROM_SEARCH_MAX_THREADS) threads = ROM_SEARCH_MAX_THREADS;
+  if((size_t)threads > starts / ROM_SEARCH_MIN_CHUNK) threads = (int)(starts / ROM_SEARCH_MIN_CHUNK);
+  if(threads < 1) threads = 1;
+
+  struct RomSearchChunk chunks[ROM_SEARCH_MAX_THREADS];
+  memset(chunks, 0, sizeof(chunks));
+  size_t step = starts / threads;
+  for(int i = 0; i < threads; i++) {
+    chunks[i].begin = step * i;
+    chunks[i].end = i == threads - 1 ? starts : step * (i + 1);
+  }
+
+  // this thread takes the first chunk while the others run
+  std::thread workers[ROM_SEARCH_MAX_THREADS];
+  for(int i = 1; i < threads; i++)
+    workers[i] = std::thread(searchChunk, data, pattern, &chunks[i]);
+  searchChunk(data, pattern, &chunks[0]);
+  for(int i = 1; i < threads; i++)
+    workers[i].join();
+
+  for(int i = 0; i < threads; i++) {
+    int take = chunks[i].count;
+    if(take > ROM_SEARCH_MAX_RESULTS - results->count) {
+      take = ROM_SEARCH_MAX_RESULTS - results->count;
+      results->truncated = true;
+    }
+    if(take > 0)
+      memcpy(&results->offsets[results->count], chunks[i].offsets, sizeof(unsigned long) * take);
+    results->count += take;
+    results->truncated |= chunks[i].truncated;
+    free(chunks[i].offsets);
+  }
+
+  results->microseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count() / 1000.0;
+  return results->count;
+}
+
+void rom_search_results_init(struct RomSearchResults* results)
+{
+  memset(results, 0, sizeof(struct RomSearchResults));
+  results->offsets = (unsigned long*)malloc(sizeof(unsigned long) * ROM_SEARCH_MAX_RESULTS);
+  assert(results->offsets);
+}
+
+void rom_search_results_free(struct RomSearchResults* results)
+{
+  if(results->offsets) free(results->offsets);
+  memset(results, 0, sizeof(struct RomSearchResults));
+}
+
+bool rom_search_results_contains(const struct RomSearchResults* results, unsigned long offset)
+{
+  // last match starting at or before [offset]
+  int lo = 0, hi = results->count;
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(results->offsets[mid] <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo > 0 && offset < results->offsets[lo - 1] + results->length;
+}
@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "definition.h"
+#include "address_index.h"
+#include "idle.h"
+#include "table_check.h"
+
+static bool spanInBounds(struct Table* table, long length)
+{
+  if(table->elements < 0) return false;
+  uint64_t size = (uint64_t)table->elements * definition_scaling_size(table->Scaling);
+  return table->address <= (unsigned long)length && size <= (uint64_t)((unsigned long)length - table->address);
+}
+
+static bool shapeMatches(struct Table* table)
+{
+  if(table->numTables > 0 && !table->tables) return false;
+  if(table->type && strcmp(table->type, "3D") == 0)
+    return table->numTables == 2 &&
+           (long)table->tables[0].elements * table->tables[1].elements == (long)table->elements;
+  if(table->type && strcmp(table->type, "2D") == 0)
+    return table->numTables == 1 && table->tables[0].elements == table->elements;
+  return true;
+}
+
+// only rising or only falling, flat runs allowed
+static bool axisMonotonic(struct Table* axis, const unsigned char* data)
+{
+  int size = definition_scaling_size(axis->Scaling);
+  int direction = 0;
+  double previous = 0.0;
+  for(int i = 0; i < axis->elements; i++) {
+    double value = definition_read_raw(axis->Scaling, data, axis->address + (unsigned long)i * size);
+    if(i > 0 && value != previous) {
+      int step = value > previous ? 1 : -1;
+      if(direction && step != direction) return false;
+      direction = step;
+    }
+    previous = value;
+  }
+  return true;
+}
+
+// an axis several tables point at is shared on purpose, anything else sharing bytes is a mistake
+static bool sharedAxis(const struct AddressSpan* a, const struct AddressSpan* b)
+{
+  return a->axis >= 0 && b->axis >= 0 && a->start == b->start && a->end == b->end;
+}
+
+static void markOverlap(struct TableCheck* check, int table, int other)
+{
+  if(check->overlapWith[table] < 0) check->overlapWith[table] = other;
+  check->flags[table] &= ~TABLE_CHECK_NO_OVERLAP;
+}
+
+static void checkTables(struct TableCheck* check, struct Definition* definition, const unsigned char* data, long length)
+{
+  auto begin = std::chrono::steady_clock::now();
+
+  for(int t = 0; t < check->numTables; t++) {
+    struct Table* table = &definition->tables[t];
+    uint8_t flags = TABLE_CHECK_NO_OVERLAP;
+    bool inBounds = spanInBounds(table, length);
+    for(int a = 0; a < table->numTables && table->tables; a++)
+      inBounds = inBounds && spanInBounds(&table->tables[a], length);
+    if(inBounds) flags |= TABLE_CHECK_IN_BOUNDS;
+    if(shapeMatches(table)) flags |= TABLE_CHECK_SHAPE;
+
+    bool monotonic = true;
+    for(int a = 0; inBounds && a < table->numTables && table->tables; a++)
+      monotonic = monotonic && axisMonotonic(&table->tables[a], data);
+    if(inBounds && monotonic) flags |= TABLE_CHECK_MONOTONIC;
+
+    check->flags[t] = flags;
+    check->overlapWith[t] = -1;
+  }
+
+  // spans come back sorted by start, so each only has to be compared
+  // with the ones after it that start before it ends
+  struct AddressIndex index;
+  memset(&index, 0, sizeof(index));
+  address_index_build(&index, definition);
+  for(int i = 0; i < index.numSpans; i++) {
+    const struct AddressSpan* a = &index.spans[i];
+    for(int j = i + 1; j < index.numSpans && index.spans[j].start < a->end; j++) {
+      const struct AddressSpan* b = &index.spans[j];
+      if(a->table == b->table || sharedAxis(a, b)) continue;
+      markOverlap(check, a->table, b->table);
+      markOverlap(check, b->table, a->table);
+    }
+  }
+  address_index_free(&index);
+
+  for(int t = 0; t < check->numTables; t++) {
+    uint8_t flags = check->flags[t];
+    if(!(flags & TABLE_CHECK_IN_BOUNDS)) check->outOfBounds++;
+    if(!(flags & TABLE_CHECK_SHAPE)) check->badShape++;
+    if((flags & TABLE_CHECK_IN_BOUNDS) && !(flags & TABLE_CHECK_MONOTONIC)) check->notMonotonic++;
+    if(!(flags & TABLE_CHECK_NO_OVERLAP)) check->overlapping++;
+  }
+
+  check->microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+  check->state.store(TABLE_CHECK_READY, std::memory_order_release);
+  idle_post_event();
+}
+
+void table_check_open(struct TableCheck* check, struct Definition* definition, const unsigned char* data, long length)
+{
+  table_check_close(check);
+  if(!definition->numTables || !data) return;
+
+  check->numTables = definition->numTables;
+  check->flags = (uint8_t*)calloc(check->numTables, sizeof(uint8_t));
+  check->overlapWith = (int*)malloc(sizeof(int) * check->numTables);
+  assert(check->flags && check->overlapWith);
+  check->state.store(TABLE_CHECK_PENDING, std::memory_order_release);
+
+  // the definition and image can't change while the pass runs, table_check_close() joins first
+#ifdef __EMSCRIPTEN__
+  checkTables(check, definition, data, length);
+#else
+  check->worker = std::thread(checkTables, check, definition, data, length);
+#endif
+}
+
+void table_check_wait(struct TableCheck* check)
+{
+  if(check->worker.joinable()) check->worker.join();
+}
+
+void table_check_close(struct TableCheck* check)
+{
+  table_check_wait(check);
+  if(check->flags) free(check->flags);
+  if(check->overlapWith) free(check->overlapWith);
+  check->flags = NULL;
+  check->overlapWith = NULL;
+  check->numTables = 0;
+  check->outOfBounds = 0;
+  check->badShape = 0;
+  check->notMonotonic = 0;
+  check->overlapping = 0;
+  check->microseconds = 0.0;
+  check->state.store(TABLE_CHECK_NONE, std::memory_order_release);
+}
+
+bool table_check_ready(const struct TableCheck* check)
+{
+  return check->state.load(std::memory_order_acquire) == TABLE_CHECK_READY;
+}
+
+bool table_check_renderable(const struct TableCheck* check, int table)
+{
+  if(!table_check_ready(check) || table < 0 || table >= check->numTables) return false;
+  return (check->flags[table] & TABLE_CHECK_RENDERABLE) == TABLE_CHECK_RENDERABLE;
+}
+
+void table_check_describe(const struct TableCheck* check, struct Definition* definition, int table,
+                          char* buf, size_t size)
+{
+  buf[0] = 0;
+  if(!table_check_ready(check) || table < 0 || table >= check->numTables) return;
+  uint8_t flags = check->flags[table];
+  size_t used = 0;
+  const char* separator = "";
+  if(!(flags & TABLE_CHECK_IN_BOUNDS)) {
+    used += snprintf(buf + used, size - used, "%spast the end of the ROM", separator);
+    separator = ", ";
+  }
+  if(used < size && !(flags & TABLE_CHECK_SHAPE)) {
+    used += snprintf(buf + used, size - used, "%saxis lengths don't match %d elements", separator,
+                     definition->tables[table].elements);
+    separator = ", ";
+  }
+  if(used < size && (flags & TABLE_CHECK_IN_BOUNDS) && !(flags & TABLE_CHECK_MONOTONIC)) {
+    used += snprintf(buf + used, size - used, "%saxis not monotonic", separator);
+    separator = ", ";
+  }
+  if(used < size && !(flags & TABLE_CHECK_NO_OVERLAP))
+    snprintf(buf + used, size - used, "%soverlaps %s", separator, definition->tables[check->overlapWith[table]].name);
+}
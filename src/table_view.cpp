@@ -0,0 +1,168 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "definition.h"
+#include "table_view.h"
+
+static double readCell(struct TableView* view, const unsigned char* data, long length, long element)
+{
+  unsigned long address = view->table->address + (unsigned long)element * view->cellSize;
+  if(address + view->cellSize > (unsigned long)length) return 0.0;
+  double value;
+  if(definition_read_scaled(view->table->Scaling, data, address, &value)) return value;
+  return definition_read_raw(view->table->Scaling, data, address);
+}
+
+static void readAxes(struct TableView* view, const unsigned char* data, long length)
+{
+  for(int a = 0; a < 2; a++) {
+    if(!view->axes[a]) continue;
+    struct Table* axis = &view->table->tables[a];
+    int size = definition_scaling_size(axis->Scaling);
+    for(long i = 0; i < view->axisCells[a]; i++) {
+      unsigned long address = axis->address + (unsigned long)i * size;
+      double value = 0.0;
+      if(address + size <= (unsigned long)length && !definition_read_scaled(axis->Scaling, data, address, &value))
+        value = definition_read_raw(axis->Scaling, data, address);
+      view->axes[a][i] = value;
+    }
+  }
+  view->axesStale = false;
+}
+
+static double cellDelta(const struct TableView* view, long element)
+{
+  double difference = view->values[element] - view->reference[element];
+  if(view->overlay != TABLE_OVERLAY_PERCENT) return difference;
+  double base = fabs(view->reference[element]);
+  // a change away from zero has no sensible percentage, pin it to the scale's end
+  if(base < 1e-9) return difference == 0.0 ? 0.0 : (difference > 0 ? 100.0 : -100.0);
+  return difference / base * 100.0;
+}
+
+static void rescaleDelta(struct TableView* view)
+{
+  view->maxDelta = 0.0;
+  if(!view->reference) return;
+  for(long i = 0; i < view->numCells; i++) {
+    view->delta[i] = cellDelta(view, i);
+    if(fabs(view->delta[i]) > view->maxDelta) view->maxDelta = fabs(view->delta[i]);
+  }
+}
+
+void table_view_open(struct TableView* view, struct Table* table,
+                     const unsigned char* rom, long romLength,
+                     const unsigned char* reference, long referenceLength)
+{
+  table_view_close(view);
+  view->table = table;
+  view->numCells = table->elements > 0 ? table->elements : 0;
+  view->cellSize = definition_scaling_size(table->Scaling);
+  long count = view->numCells ? view->numCells : 1;
+
+  view->values = (double*)malloc(sizeof(double) * count);
+  view->delta = (double*)calloc(count, sizeof(double));
+  view->stale = (uint8_t*)calloc((count + 7) / 8, 1);
+  assert(view->values && view->delta && view->stale);
+  for(long i = 0; i < view->numCells; i++)
+    view->values[i] = readCell(view, rom, romLength, i);
+  for(int a = 0; a < 2 && a < table->numTables; a++) {
+    view->axisCells[a] = table->tables[a].elements > 0 ? table->tables[a].elements : 0;
+    view->axes[a] = (double*)calloc(view->axisCells[a] ? view->axisCells[a] : 1, sizeof(double));
+    assert(view->axes[a]);
+  }
+  readAxes(view, rom, romLength);
+  table_view_set_reference(view, reference, referenceLength);
+}
+
+void table_view_close(struct TableView* view)
+{
+  if(view->values) free(view->values);
+  if(view->reference) free(view->reference);
+  if(view->delta) free(view->delta);
+  if(view->stale) free(view->stale);
+  for(int a = 0; a < 2; a++)
+    if(view->axes[a]) free(view->axes[a]);
+  enum TableOverlay overlay = view->overlay;
+  memset(view, 0, sizeof(struct TableView));
+  // the overlay is a setting of the editor window, it outlives the data
+  view->overlay = overlay;
+}
+
+bool table_view_is_open(const struct TableView* view)
+{
+  return view->values != NULL;
+}
+
+void table_view_set_reference(struct TableView* view, const unsigned char* reference, long referenceLength)
+{
+  if(view->reference) {
+    free(view->reference);
+    view->reference = NULL;
+  }
+  if(reference) {
+    view->reference = (double*)malloc(sizeof(double) * (view->numCells ? view->numCells : 1));
+    assert(view->reference);
+    for(long i = 0; i < view->numCells; i++)
+      view->reference[i] = readCell(view, reference, referenceLength, i);
+  }
+  rescaleDelta(view);
+}
+
+void table_view_set_overlay(struct TableView* view, enum TableOverlay overlay)
+{
+  if(view->overlay == overlay) return;
+  view->overlay = overlay;
+  rescaleDelta(view);
+}
+
+void table_view_mark(struct TableView* view, unsigned long element)
+{
+  if(!view->stale || element >= (unsigned long)view->numCells) return;
+  uint8_t bit = (uint8_t)(1 << (element & 7));
+  if(view->stale[element >> 3] & bit) return;
+  view->stale[element >> 3] |= bit;
+  view->numStale++;
+}
+
+void table_view_mark_axes(struct TableView* view)
+{
+  view->axesStale = true;
+}
+
+long table_view_refresh(struct TableView* view, const unsigned char* rom, long romLength)
+{
+  if(view->axesStale) readAxes(view, rom, romLength);
+  if(view->numStale == 0) return 0;
+  long refreshed = 0;
+  bool shrunk = false;
+  for(long byte = 0; byte < (view->numCells + 7) / 8 && refreshed < view->numStale; byte++) {
+    if(!view->stale[byte]) continue;
+    for(long i = byte * 8; i < byte * 8 + 8 && i < view->numCells; i++) {
+      if(!(view->stale[byte] & (1 << (i & 7)))) continue;
+      view->values[i] = readCell(view, rom, romLength, i);
+      refreshed++;
+      if(!view->reference) continue;
+
+      double before = fabs(view->delta[i]);
+      view->delta[i] = cellDelta(view, i);
+      double after = fabs(view->delta[i]);
+      if(after > view->maxDelta) view->maxDelta = after;
+      else if(before == view->maxDelta && after < before) shrunk = true;
+    }
+    view->stale[byte] = 0;
+  }
+  view->numStale = 0;
+  // the cell that set the scale moved down, only then look at every cell
+  if(shrunk) rescaleDelta(view);
+  return refreshed;
+}
+
+float table_view_heat(const struct TableView* view, unsigned long element)
+{
+  if(!view->reference || view->maxDelta <= 0.0 || element >= (unsigned long)view->numCells) return 0.0f;
+  return (float)(view->delta[element] / view->maxDelta);
+}
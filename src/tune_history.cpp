@@ -0,0 +1,437 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "conescan_db.h"
+#include "rom_diff.h"
+#include "rom_file.h"
+#include "sqlite3.h"
+#include "tune_history.h"
+
+// ranges closer than this are stored as one, a varint pair costs about as much
+#define TUNE_DELTA_MIN_GAP 4
+
+static unsigned char* putVarint(unsigned char* out, unsigned long value)
+{
+  while(value >= 0x80) {
+    *out++ = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = (unsigned char)value;
+  return out;
+}
+
+static bool getVarint(const unsigned char** in, const unsigned char* end, unsigned long* value)
+{
+  unsigned long result = 0;
+  for(int shift = 0; *in < end && shift < 64; shift += 7) {
+    unsigned char byte = *(*in)++;
+    result |= (unsigned long)(byte & 0x7f) << shift;
+    if(!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+long tune_delta_encode(const unsigned char* before, const unsigned char* after, long length, unsigned char** out)
+{
+  struct RomDiffRange* ranges = NULL;
+  long capacity = 0;
+  long numRanges = rom_diff_ranges(before, length, after, length, &ranges, &capacity);
+
+  // merge close ranges in place
+  long merged = 0;
+  for(long i = 0; i < numRanges; i++) {
+    if(merged && ranges[i].start - ranges[merged - 1].end < TUNE_DELTA_MIN_GAP)
+      ranges[merged - 1].end = ranges[i].end;
+    else
+      ranges[merged++] = ranges[i];
+  }
+
+  size_t size = 0;
+  for(long i = 0; i < merged; i++) size += 20 + (ranges[i].end - ranges[i].start);
+  unsigned char* delta = (unsigned char*)malloc(size ? size : 1);
+  assert(delta);
+
+  unsigned char* cursor = delta;
+  unsigned long position = 0;
+  for(long i = 0; i < merged; i++) {
+    unsigned long n = ranges[i].end - ranges[i].start;
+    cursor = putVarint(cursor, ranges[i].start - position);
+    cursor = putVarint(cursor, n);
+    memcpy(cursor, after + ranges[i].start, n);
+    cursor += n;
+    position = ranges[i].end;
+  }
+  if(ranges) free(ranges);
+  *out = delta;
+  return (long)(cursor - delta);
+}
+
+bool tune_delta_apply(unsigned char* image, long length, const unsigned char* delta, long size)
+{
+  const unsigned char* cursor = delta;
+  const unsigned char* end = delta + size;
+  unsigned long position = 0;
+  while(cursor < end) {
+    unsigned long gap, n;
+    if(!getVarint(&cursor, end, &gap) || !getVarint(&cursor, end, &n)) return false;
+    if(gap > (unsigned long)length - position || n > (unsigned long)length - position - gap) return false;
+    if(n > (unsigned long)(end - cursor)) return false;
+    position += gap;
+    memcpy(image + position, cursor, n);
+    cursor += n;
+    position += n;
+  }
+  return true;
+}
+
+static bool loadHead(struct ConeScanDB* db, const char* path, int64_t* id, uint64_t* hash, long* length, int* depth)
+{
+  sqlite3_stmt* query;
+  int rc;
+  bool found = false;
+  rc = sqlite3_prepare_v2(db->db,
+    "SELECT id, hash, length, depth FROM rom_version WHERE path = ? ORDER BY id DESC LIMIT 1", -1, &query, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(query, 1, path, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(query);
+  if(rc == SQLITE_ROW) {
+    *id = sqlite3_column_int64(query, 0);
+    *hash = strtoull((const char*)sqlite3_column_text(query, 1), NULL, 16);
+    *length = (long)sqlite3_column_int64(query, 2);
+    *depth = sqlite3_column_int(query, 3);
+    found = true;
+  } else if(rc != SQLITE_DONE) {
+    printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+  }
+  sqlite3_finalize(query);
+  return found;
+}
+
+int64_t conescan_db_head_version(struct ConeScanDB* db, const char* path)
+{
+  int64_t id = 0;
+  uint64_t hash;
+  long length;
+  int depth;
+  if(!loadHead(db, path, &id, &hash, &length, &depth)) return 0;
+  return id;
+}
+
+// rom_version_base row holding [base], added (as a delta against 0xFF) when it isn't there yet
+static int64_t saveBase(struct ConeScanDB* db, const unsigned char* base, long length)
+{
+  char text[17];
+  snprintf(text, sizeof(text), "%016" PRIx64, rom_file_hash_buffer(base, length));
+
+  sqlite3_stmt* statement;
+  int rc;
+  int64_t id = 0;
+  rc = sqlite3_prepare_v2(db->db, "SELECT id FROM rom_version_base WHERE hash = ? AND length = ?", -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 1, text, -1, SQLITE_TRANSIENT);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 2, length);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  if(rc == SQLITE_ROW) id = sqlite3_column_int64(statement, 0);
+  else if(rc != SQLITE_DONE) printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+  sqlite3_finalize(statement);
+  if(id) return id;
+
+  unsigned char* erased = (unsigned char*)malloc(length ? length : 1);
+  assert(erased);
+  memset(erased, 0xff, length);
+  unsigned char* delta;
+  long size = tune_delta_encode(erased, base, length, &delta);
+  free(erased);
+
+  rc = sqlite3_prepare_v2(db->db,
+    "INSERT INTO rom_version_base(hash, length, data, inserted_at, updated_at) "
+    "VALUES(?, ?, ?, strftime('%Y-%m-%dT%H:%M:%S', 'now'), strftime('%Y-%m-%dT%H:%M:%S', 'now'))",
+    -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 1, text, -1, SQLITE_TRANSIENT);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 2, length);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_blob(statement, 3, delta, (int)size, SQLITE_STATIC);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_DONE);
+  sqlite3_finalize(statement);
+  free(delta);
+  return sqlite3_last_insert_rowid(db->db);
+}
+
+// fills [image] with base [id], false if it is missing or a different length
+static bool loadBase(struct ConeScanDB* db, int64_t id, unsigned char* image, long length)
+{
+  sqlite3_stmt* query;
+  int rc;
+  bool ok = false;
+  rc = sqlite3_prepare_v2(db->db, "SELECT length, data FROM rom_version_base WHERE id = ?", -1, &query, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(query, 1, id);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(query);
+  if(rc == SQLITE_ROW && sqlite3_column_int64(query, 0) == length) {
+    memset(image, 0xff, length);
+    ok = tune_delta_apply(image, length, (const unsigned char*)sqlite3_column_blob(query, 1),
+                          sqlite3_column_bytes(query, 1));
+  } else if(rc != SQLITE_ROW && rc != SQLITE_DONE) {
+    printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+  }
+  sqlite3_finalize(query);
+  return ok;
+}
+
+int64_t conescan_db_commit_version(struct ConeScanDB* db, const char* path, const unsigned char* data, long length,
+                                   const unsigned char* base, long baseLength, const char* message)
+{
+  uint64_t hash = rom_file_hash_buffer(data, length);
+  int64_t parent = 0;
+  uint64_t parentHash = 0;
+  long parentLength = 0;
+  int depth = 0;
+  bool haveParent = loadHead(db, path, &parent, &parentHash, &parentLength, &depth);
+  if(haveParent && parentHash == hash && parentLength == length) return parent;
+
+  unsigned char* before = NULL;
+  long beforeLength = 0;
+  int64_t baseId = 0;
+  bool snapshot = !haveParent || parentLength != length || depth + 1 >= TUNE_HISTORY_SNAPSHOT_EVERY;
+  if(!snapshot && !conescan_db_checkout_version(db, parent, &before, &beforeLength)) snapshot = true;
+  bool onBase = snapshot && base && baseLength == length;
+  if(snapshot) {
+    if(before) free(before);
+    before = (unsigned char*)malloc(length ? length : 1);
+    assert(before);
+    if(onBase) {
+      memcpy(before, base, length);
+    } else {
+      memset(before, 0xff, length);
+    }
+    depth = 0;
+  } else {
+    depth++;
+  }
+
+  unsigned char* delta;
+  long size = tune_delta_encode(before, data, length, &delta);
+  free(before);
+
+  char text[17];
+  snprintf(text, sizeof(text), "%016" PRIx64, hash);
+
+  // the base and the version it belongs to land together or not at all
+  int rc = sqlite3_exec(db->db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+  if(rc != SQLITE_OK) {
+    printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+    free(delta);
+    return 0;
+  }
+  if(onBase) baseId = saveBase(db, base, length);
+
+  sqlite3_stmt* statement;
+  rc = sqlite3_prepare_v2(db->db,
+    "INSERT INTO rom_version(path, parent, hash, length, depth, snapshot, base, data, message, inserted_at, updated_at) "
+    "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, strftime('%Y-%m-%dT%H:%M:%S', 'now'), strftime('%Y-%m-%dT%H:%M:%S', 'now'))",
+    -1, &statement, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 1, path, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = haveParent ? sqlite3_bind_int64(statement, 2, parent) : sqlite3_bind_null(statement, 2);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(statement, 3, text, -1, SQLITE_TRANSIENT);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int64(statement, 4, length);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int(statement, 5, depth);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int(statement, 6, snapshot ? 1 : 0);
+  assert(rc == SQLITE_OK);
+  rc = baseId ? sqlite3_bind_int64(statement, 7, baseId) : sqlite3_bind_null(statement, 7);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_blob(statement, 8, delta, (int)size, SQLITE_STATIC);
+  assert(rc == SQLITE_OK);
+  rc = message && message[0] ? sqlite3_bind_text(statement, 9, message, -1, NULL) : sqlite3_bind_null(statement, 9);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_step(statement);
+  assert(rc == SQLITE_DONE);
+  sqlite3_finalize(statement);
+  free(delta);
+  int64_t id = sqlite3_last_insert_rowid(db->db);
+  rc = sqlite3_exec(db->db, "COMMIT", NULL, NULL, NULL);
+  assert(rc == SQLITE_OK);
+  return id;
+}
+
+int conescan_db_log_versions(struct ConeScanDB* db, const char* path, struct TuneVersion* versions, int max)
+{
+  sqlite3_stmt* query;
+  int rc;
+  int count = 0;
+  rc = sqlite3_prepare_v2(db->db,
+    "SELECT id, parent, hash, length, depth, snapshot, length(data), message, inserted_at "
+    "FROM rom_version WHERE path = ? ORDER BY id DESC LIMIT ?", -1, &query, 0);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_text(query, 1, path, -1, NULL);
+  assert(rc == SQLITE_OK);
+  rc = sqlite3_bind_int(query, 2, max);
+  assert(rc == SQLITE_OK);
+  while((rc = sqlite3_step(query)) == SQLITE_ROW) {
+    struct TuneVersion* version = &versions[count++];
+    memset(version, 0, sizeof(struct TuneVersion));
+    version->id = sqlite3_column_int64(query, 0);
+    version->parent = sqlite3_column_int64(query, 1);
+    version->hash = strtoull((const char*)sqlite3_column_text(query, 2), NULL, 16);
+    version->length = (long)sqlite3_column_int64(query, 3);
+    version->depth = sqlite3_column_int(query, 4);
+    version->snapshot = sqlite3_column_int(query, 5) != 0;
+    version->size = (long)sqlite3_column_int64(query, 6);
+    const char* tmp = (const char*)sqlite3_column_text(query, 7);
+    if(tmp) snprintf(version->message, sizeof(version->message), "%s", tmp);
+    tmp = (const char*)sqlite3_column_text(query, 8);
+    if(tmp) snprintf(version->insertedAt, sizeof(version->insertedAt), "%s", tmp);
+  }
+  if(rc != SQLITE_DONE) printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+  sqlite3_finalize(query);
+  return count;
+}
+
+bool conescan_db_checkout_version(struct ConeScanDB* db, int64_t id, unsigned char** data, long* length)
+{
+  sqlite3_stmt* query;
+  int rc;
+  rc = sqlite3_prepare_v2(db->db, "SELECT parent, length, snapshot, data, base FROM rom_version WHERE id = ?", -1, &query, 0);
+  assert(rc == SQLITE_OK);
+
+  // walk back to the snapshot, keeping each delta, then apply them oldest first
+  unsigned char* deltas[TUNE_HISTORY_SNAPSHOT_EVERY];
+  long sizes[TUNE_HISTORY_SNAPSHOT_EVERY];
+  int numDeltas = 0;
+  long imageLength = -1;
+  int64_t baseId = 0;
+  bool complete = false;
+  while(numDeltas < TUNE_HISTORY_SNAPSHOT_EVERY) {
+    sqlite3_reset(query);
+    rc = sqlite3_bind_int64(query, 1, id);
+    assert(rc == SQLITE_OK);
+    rc = sqlite3_step(query);
+    if(rc != SQLITE_ROW) {
+      if(rc != SQLITE_DONE) printf("unexpected SQLITE status(%d): %s\n", rc, sqlite3_errmsg(db->db));
+      break;
+    }
+    long rowLength = (long)sqlite3_column_int64(query, 1);
+    if(imageLength < 0) imageLength = rowLength;
+    if(rowLength != imageLength) break;
+    long size = sqlite3_column_bytes(query, 3);
+    deltas[numDeltas] = (unsigned char*)malloc(size ? size : 1);
+    assert(deltas[numDeltas]);
+    if(size) memcpy(deltas[numDeltas], sqlite3_column_blob(query, 3), size);
+    sizes[numDeltas++] = size;
+    if(sqlite3_column_int(query, 2)) {
+      baseId = sqlite3_column_int64(query, 4);
+      complete = true;
+      break;
+    }
+    id = sqlite3_column_int64(query, 0);
+  }
+  sqlite3_finalize(query);
+
+  unsigned char* image = NULL;
+  if(complete) {
+    image = (unsigned char*)malloc(imageLength ? imageLength : 1);
+    assert(image);
+    if(!baseId) {
+      memset(image, 0xff, imageLength);
+    } else if(!loadBase(db, baseId, image, imageLength)) {
+      free(image);
+      image = NULL;
+    }
+    for(int i = numDeltas - 1; i >= 0 && image; i--) {
+      if(!tune_delta_apply(image, imageLength, deltas[i], sizes[i])) {
+        free(image);
+        image = NULL;
+      }
+    }
+  }
+  for(int i = 0; i < numDeltas; i++) free(deltas[i]);
+  if(!image) return false;
+  *data = image;
+  *length = imageLength;
+  return true;
+}
+
+static void commitVersion(struct TuneCommit* commit)
+{
+  // a connection of its own, the UI keeps inserting on the shared one and
+  // the ids read back here have to be this commit's
+  struct ConeScanDB db;
+  commit->id = 0;
+  if(sqlite3_open_v2(commit->dbPath, &db.db, SQLITE_OPEN_READWRITE, NULL) == SQLITE_OK) {
+    sqlite3_busy_timeout(db.db, CONESCAN_DB_BUSY_MS);
+    commit->id = conescan_db_commit_version(&db, commit->path, commit->data, commit->length,
+                                            commit->base, commit->baseLength, commit->message);
+  } else {
+    printf("could not open %s for the tune history: %s\n", commit->dbPath, sqlite3_errmsg(db.db));
+  }
+  sqlite3_close(db.db);
+  free(commit->dbPath);
+  free(commit->path);
+  free(commit->data);
+  if(commit->base) free(commit->base);
+  commit->dbPath = NULL;
+  commit->path = NULL;
+  commit->data = NULL;
+  commit->base = NULL;
+  commit->busy.store(false, std::memory_order_release);
+}
+
+void tune_commit_start(struct TuneCommit* commit, struct ConeScanDB* db, const char* path,
+                       const unsigned char* data, long length, const unsigned char* base, long baseLength,
+                       const char* message)
+{
+  tune_commit_wait(commit);
+  commit->dbPath = strdup(sqlite3_db_filename(db->db, "main"));
+  commit->path = strdup(path);
+  commit->data = (unsigned char*)malloc(length ? length : 1);
+  assert(commit->dbPath && commit->path && commit->data);
+  memcpy(commit->data, data, length);
+  commit->length = length;
+  // only a base the snapshot could use is worth copying
+  commit->base = NULL;
+  commit->baseLength = 0;
+  if(base && baseLength == length) {
+    commit->base = (unsigned char*)malloc(length ? length : 1);
+    assert(commit->base);
+    memcpy(commit->base, base, length);
+    commit->baseLength = length;
+  }
+  snprintf(commit->message, sizeof(commit->message), "%s", message ? message : "");
+  commit->busy.store(true, std::memory_order_release);
+
+#ifdef __EMSCRIPTEN__
+  commitVersion(commit);
+#else
+  commit->worker = std::thread(commitVersion, commit);
+#endif
+}
+
+void tune_commit_wait(struct TuneCommit* commit)
+{
+  if(commit->worker.joinable()) commit->worker.join();
+}
+
+bool tune_commit_busy(const struct TuneCommit* commit)
+{
+  return commit->busy.load(std::memory_order_acquire);
+}
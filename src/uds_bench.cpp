@@ -0,0 +1,338 @@
+// uds-bench: ROM download throughput against the mock ECU
+//
+// Runs uds_request_start_download() end to end against a simulated ECU
+// serving a ROM file, with the latency, bus speed and error rate given on
+// the command line, and reports the throughput of every run plus the
+// latency distribution of each UDS service from uds_stats.
+//
+// With -U the download goes through UDSSessionManager and a simulated
+// CAN bus instead of calling the mock directly. With -F it flashes an
+// edited copy of the ROM to the mock instead and reports how many erase
+// blocks were rewritten, and with -M it scans a simulated vehicle of
+// several modules through UDSSessionManager, once with every module at
+// the same time and once a module at a time.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "checksum.h"
+#include "console.h"
+#include "flash_writer.h"
+#include "memmodel.h"
+#include "mock_bus.h"
+#include "mock_ecu.h"
+#include "rom_file.h"
+#include "uds_ecu.h"
+#include "uds_ecu_session.h"
+#include "uds_stats.h"
+#include "uds_request_download.h"
+#include "vehicle_scan.h"
+
+static void usage(const char* program)
+{
+  fprintf(stderr, "usage: %s [options] rom.bin\n\n", program);
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -l <ms>        latency per request, default 1\n");
+  fprintf(stderr, "  -J <ms>        extra random latency up to this, default 0\n");
+  fprintf(stderr, "  -b <bytes/s>   CAN data rate, default 36000 (500 kbit/s), 0 for no limit\n");
+  fprintf(stderr, "  -e <rate>      chance a read fails, default 0\n");
+  fprintf(stderr, "  -m <bytes>     largest read the ECU answers, default 0xFFE\n");
+  fprintf(stderr, "  -c <bytes>     initial chunk size, default 0x100\n");
+  fprintf(stderr, "  -s <bytes>     bytes to download, default the whole ROM\n");
+  fprintf(stderr, "  -n <runs>      downloads to run, default 3\n");
+  fprintf(stderr, "  -S <seed>      seed for errors and jitter\n");
+  fprintf(stderr, "  -w <path>      spool each download to this file while it runs\n");
+  fprintf(stderr, "  -o <path>      write the latency histograms and counters as CSV\n");
+  fprintf(stderr, "  -F <edited>    flash this edited ROM to the mock instead of downloading\n");
+  fprintf(stderr, "  -C <module>    with -F, refuse an image whose checksums don't hold\n");
+  fprintf(stderr, "  -E <ms>        with -F, erase time per KiB, default 0\n");
+  fprintf(stderr, "  -B             with -F, allow rewriting the boot blocks\n");
+  fprintf(stderr, "  -M <modules>   scan this many mock modules (1-%d) instead of downloading\n", UDS_SESSION_MODULES);
+  fprintf(stderr, "  -U             download through UDSSessionManager on a mock bus\n");
+  fprintf(stderr, "  -v             print the download log\n");
+}
+
+static const struct MemModel* modelFor(long length)
+{
+  const char* names[] = { "SH7055", "SH7058" };
+  for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    const struct MemModel* model = memmodel_find(names[i]);
+    if(model && model->romSize == (unsigned long)length) return model;
+  }
+  return NULL;
+}
+
+static void printStats(struct UDSStats* stats)
+{
+  for(int service = 0; service < UDS_SERVICE_COUNT; service++) {
+    const struct UDSHistogram* histogram = &stats->services[service];
+    if(histogram->count.load() == 0) continue;
+    printf("%-18s %6u requests: p50 %.2fms p90 %.2fms p99 %.2fms max %.2fms\n",
+           uds_stats_service_name((enum UDSService)service), histogram->count.load(),
+           uds_stats_percentile(histogram, 0.50) / 1000.0, uds_stats_percentile(histogram, 0.90) / 1000.0,
+           uds_stats_percentile(histogram, 0.99) / 1000.0, histogram->maxMicros.load() / 1000.0);
+  }
+  printf("%u negative responses, %u timeouts, %u retries, %llu frames\n", stats->negative.load(),
+         stats->timeouts.load(), stats->retries.load(), (unsigned long long)stats->frames.load());
+}
+
+// applies [editedPath] to a copy of the mock's ROM the way the editor
+// would, so only the pages that changed are dirty, saves and flashes it
+// twice: the second pass has to find nothing left to write
+static int flashBench(struct MockEcu* mock, struct UDSEcu* ecu, const char* romPath, const char* editedPath,
+                      const char* checksumModule, bool allowBoot)
+{
+  const struct MemModel* model = modelFor(mock->rom.length);
+  if(!model) {
+    fprintf(stderr, "no memory model is 0x%lX bytes\n", (unsigned long)mock->rom.length);
+    return 2;
+  }
+  struct RomFile image, edited;
+  memset(&image, 0, sizeof(image));
+  memset(&edited, 0, sizeof(edited));
+  if(!rom_file_open(&image, romPath) || !rom_file_open(&edited, editedPath) || edited.length != image.length) {
+    fprintf(stderr, "could not open %s as an edit of %s\n", editedPath, romPath);
+    rom_file_close(&image);
+    rom_file_close(&edited);
+    return 2;
+  }
+  // the mock already holds romPath
+  rom_file_clear_unflashed(&image);
+  for(long page = 0; page < image.numPages; page++) {
+    unsigned long offset = (unsigned long)page * ROM_FILE_PAGE_SIZE;
+    size_t length = (unsigned long)image.length - offset < ROM_FILE_PAGE_SIZE ? (unsigned long)image.length - offset : ROM_FILE_PAGE_SIZE;
+    if(memcmp(image.data + offset, edited.data + offset, length) != 0)
+      rom_file_write(&image, offset, edited.data + offset, length);
+  }
+  printf("%s: %ld of %ld pages differ, %s with %d erase blocks\n", editedPath, image.numDirty, image.numPages,
+         model->name, model->numSectors);
+  // saved before flashing, the flash still has to pick those pages up
+  rom_file_clear_dirty(&image);
+
+  static struct Checksum checksum;
+  if(checksumModule && !checksum_open(&checksum, checksumModule, &image)) {
+    fprintf(stderr, "checksum module %s doesn't fit this ROM\n", checksumModule);
+    rom_file_close(&image);
+    rom_file_close(&edited);
+    return 2;
+  }
+
+  int failed = 0;
+  for(int pass = 1; pass <= 2; pass++) {
+    struct FlashWriteResult result;
+    bool ok = flash_write(ecu, &image, model, checksumModule ? &checksum : NULL, allowBoot, &result);
+    printf("pass %d: %s %.3fs, %d blocks compared, %d written, %lu bytes read, %lu written, %d retries%s%s\n", pass,
+           ok ? "ok" : "FAILED", result.seconds, result.sectorsChecked, result.sectorsWritten, result.bytesRead,
+           result.bytesWritten, result.retries, ok ? "" : ": ", result.error);
+    if(!ok || (pass == 2 && result.sectorsWritten != 0)) failed++;
+    if(!ok) break;
+  }
+  bool same = memcmp(mock->rom.data, image.data, (size_t)image.length) == 0;
+  printf("mock flash %s the edited image, %u bytes erased, %u programmed\n", same ? "matches" : "DOESN'T MATCH",
+         mock->erased.load(), mock->written.load());
+  if(!same) failed++;
+
+  if(checksumModule) checksum_close(&checksum);
+  rom_file_close(&image);
+  rom_file_close(&edited);
+  return failed ? 1 : 0;
+}
+
+static void printScan(const char* label, struct VehicleScan* scan)
+{
+  const struct UDSSessionManager* manager = &scan->manager;
+  printf("%s: %.3fs, %d of %d modules answered, %u requests in %u writes, %u responses in %u reads\n", label,
+         scan->seconds, vehicle_scan_present(scan), scan->numModules, manager->sent, manager->sendCalls,
+         manager->received, manager->receiveCalls);
+}
+
+// module 0 serves the ROM, the others only identify themselves and carry
+// a few DTCs, the IDs past [count] have nothing fitted and time out
+static int scanBench(const char* romPath, const struct MockEcuConfig* config, int count, bool verbose)
+{
+  static struct MockEcu modules[UDS_SESSION_MODULES];
+  static struct MockBus bus;
+  mock_bus_init(&bus);
+  for(int i = 0; i < count; i++) {
+    if(!mock_ecu_open(&modules[i], i == 0 ? romPath : NULL, config)) {
+      fprintf(stderr, "could not open %s\n", romPath);
+      return 2;
+    }
+    if(i > 0) snprintf(modules[i].calID, sizeof(modules[i].calID), "MOCK%03X", UDS_SESSION_FIRST_ID + i);
+    for(int d = 0; d < i; d++) mock_ecu_add_dtc(&modules[i], 0x030100 + (uint32_t)(d << 8) + (uint32_t)i, 0x09);
+    mock_bus_add(&bus, &modules[i], UDS_SESSION_FIRST_ID + i);
+  }
+  struct UDSChannel channel;
+  mock_bus_bind(&bus, &channel);
+
+  static struct VehicleScan scan;
+  vehicle_scan_start(&scan, &channel, UDS_SESSION_FIRST_ID, UDS_SESSION_MODULES);
+  vehicle_scan_wait(&scan);
+  printScan("all modules at once", &scan);
+  int failed = vehicle_scan_present(&scan) == count ? 0 : 1;
+  for(int i = 0; i < scan.numModules; i++) {
+    const struct ModuleScan* module = &scan.modules[i];
+    if(!module->present) continue;
+    printf("  0x%03X VIN %s calibration %s, %d DTCs", module->requestId, module->vin, module->calID, module->numDtcs);
+    if(verbose) {
+      for(int d = 0; d < module->numDtcs && d < VEHICLE_SCAN_MAX_DTCS; d++) {
+        char name[16];
+        vehicle_scan_dtc_name(module->dtcs[d], name, sizeof(name));
+        printf(" %s", name);
+      }
+    }
+    printf("\n");
+    if(module->numDtcs != i || strcmp(module->vin, modules[i].vin) != 0) failed++;
+  }
+
+  double serial = 0.0;
+  for(int i = 0; i < UDS_SESSION_MODULES; i++) {
+    vehicle_scan_start(&scan, &channel, UDS_SESSION_FIRST_ID + i, 1);
+    vehicle_scan_wait(&scan);
+    serial += scan.seconds;
+  }
+  printf("one module at a time: %.3fs\n", serial);
+  vehicle_scan_close(&scan);
+
+  for(int i = 0; i < count; i++) mock_ecu_close(&modules[i]);
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+  struct MockEcuConfig config;
+  memset(&config, 0, sizeof(config));
+  config.latency = 0.001;
+  config.bandwidth = 36000;
+  unsigned long chunk = 0x100, size = 0;
+  int runs = 3;
+  bool verbose = false;
+  const char* csvPath = NULL;
+  const char* spoolPath = NULL;
+  const char* flashPath = NULL;
+  const char* checksumModule = NULL;
+  bool allowBoot = false;
+  bool sessions = false;
+  int scanModules = 0;
+  int arg = 1;
+
+  for(; arg < argc - 1; arg++) {
+    if(strcmp(argv[arg], "-l") == 0) config.latency = atof(argv[++arg]) / 1000.0;
+    else if(strcmp(argv[arg], "-J") == 0) config.jitter = atof(argv[++arg]) / 1000.0;
+    else if(strcmp(argv[arg], "-b") == 0) config.bandwidth = atof(argv[++arg]);
+    else if(strcmp(argv[arg], "-e") == 0) config.errorRate = atof(argv[++arg]);
+    else if(strcmp(argv[arg], "-m") == 0) config.maxRead = (uint16_t)strtoul(argv[++arg], NULL, 0);
+    else if(strcmp(argv[arg], "-c") == 0) chunk = strtoul(argv[++arg], NULL, 0);
+    else if(strcmp(argv[arg], "-s") == 0) size = strtoul(argv[++arg], NULL, 0);
+    else if(strcmp(argv[arg], "-n") == 0) runs = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-S") == 0) config.seed = (unsigned int)strtoul(argv[++arg], NULL, 0);
+    else if(strcmp(argv[arg], "-o") == 0) csvPath = argv[++arg];
+    else if(strcmp(argv[arg], "-w") == 0) spoolPath = argv[++arg];
+    else if(strcmp(argv[arg], "-F") == 0) flashPath = argv[++arg];
+    else if(strcmp(argv[arg], "-C") == 0) checksumModule = argv[++arg];
+    else if(strcmp(argv[arg], "-B") == 0) allowBoot = true;
+    else if(strcmp(argv[arg], "-E") == 0) config.eraseTime = atof(argv[++arg]) / 1000.0;
+    else if(strcmp(argv[arg], "-M") == 0) scanModules = atoi(argv[++arg]);
+    else if(strcmp(argv[arg], "-U") == 0) sessions = true;
+    else if(strcmp(argv[arg], "-v") == 0) verbose = true;
+    else break;
+  }
+  if(arg != argc - 1 || argv[arg][0] == '-' || runs < 1 || chunk == 0 || chunk > 0xFFFF ||
+     scanModules < 0 || scanModules > UDS_SESSION_MODULES) {
+    usage(argv[0]);
+    return 2;
+  }
+  if(scanModules) return scanBench(argv[arg], &config, scanModules, verbose);
+
+  struct MockEcu mock;
+  if(!mock_ecu_open(&mock, argv[arg], &config)) {
+    fprintf(stderr, "could not open %s\n", argv[arg]);
+    return 2;
+  }
+  if(size == 0 || size > (unsigned long)mock.rom.length) size = (unsigned long)mock.rom.length;
+  printf("%s: %lu bytes, VIN %s, calibration %s\n", argv[arg], size, mock.vin, mock.calID);
+
+  struct UDSEcu ecu;
+  mock_ecu_bind(&mock, &ecu);
+
+  // the same ECU as the only module on a bus, the way a car is driven now
+  static struct MockBus bus;
+  static struct UDSSessionManager manager;
+  struct UDSChannel channel;
+  struct UDSSessionEcu module;
+  struct UDSEcu sessionEcu;
+  if(sessions) {
+    mock_bus_init(&bus);
+    mock_bus_add(&bus, &mock, UDS_SESSION_FIRST_ID);
+    mock_bus_bind(&bus, &channel);
+    uds_session_open(&manager, &channel, UDS_SESSION_FIRST_ID, 1);
+    module.manager = &manager;
+    module.session = &manager.sessions[0];
+    module.keys = &ecu;
+    uds_ecu_session(&sessionEcu, &module);
+  }
+
+  static struct UDSStats stats;
+  struct UDSStatsEcu timed;
+  uds_stats_wrap(&timed, sessions ? &sessionEcu : &ecu, &stats);
+
+  if(flashPath) {
+    int status = flashBench(&mock, &timed.ecu, argv[arg], flashPath, checksumModule, allowBoot);
+    printStats(&stats);
+    if(csvPath && uds_stats_dump_csv(&stats, csvPath) != 0) fprintf(stderr, "could not write %s\n", csvPath);
+    mock_ecu_close(&mock);
+    return status;
+  }
+
+  ConeScan::Console console;
+  static struct UDSRequestDownload request;
+  int failed = 0;
+  double totalSeconds = 0.0;
+  for(int run = 0; run < runs; run++) {
+    request.startAddress = 0;
+    request.transferSize = size;
+    request.transferChunkSize = (uint16_t)chunk;
+    request.stats = &stats;
+    request.spoolPath = spoolPath;
+    uint32_t requests = mock.requests.load();
+
+    auto begin = std::chrono::steady_clock::now();
+    // no database, every run reads the whole range
+    uds_request_start_download(&timed.ecu, &request, &console, NULL, mock.vin, mock.calID);
+    while(uds_request_busy(&request)) {
+      uds_request_poll(&request, &console);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uds_request_poll(&request, &console);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // the streamed hash has to agree with hashing the finished image
+    bool ok = uds_request_state(&request) == UDS_REQUEST_DONE &&
+              memcmp(request.payload, mock.rom.data, size) == 0 &&
+              request.hashed && request.hash == rom_file_hash_buffer(mock.rom.data, (long)size) &&
+              (!spoolPath || request.spooled);
+    if(!ok) failed++;
+    totalSeconds += seconds;
+    printf("run %d: %s %.3fs %.1f KB/s, %u requests, %u retries, final chunk 0x%X\n", run + 1,
+           ok ? "ok" : "FAILED", seconds, size / seconds / 1024.0, mock.requests.load() - requests,
+           request.retries.load(), request.chunkSize.load());
+    if(verbose) {
+      for(int i = 0; i < console.Items.Size; i++) printf("  %s\n", console.Items[i]);
+    }
+    console.ClearLog();
+    uds_request_complete(&request);
+  }
+
+  printf("average %.1f KB/s over %d runs\n", size * runs / totalSeconds / 1024.0, runs);
+  printStats(&stats);
+  if(csvPath && uds_stats_dump_csv(&stats, csvPath) != 0) fprintf(stderr, "could not write %s\n", csvPath);
+
+  mock_ecu_close(&mock);
+  return failed ? 1 : 0;
+}
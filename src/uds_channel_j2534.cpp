@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "J2534.h"
+#include "uds_channel.h"
+
+#define UDS_J2534_WRITE_TIMEOUT 100   // ms for the adapter to take the batch
+
+static enum UDSChannelStatus j2534Send(void* context, const struct UDSMessage* messages, int count, int* sent)
+{
+  struct UDSJ2534* link = (struct UDSJ2534*)context;
+  PASSTHRU_MSG* pool = (PASSTHRU_MSG*)link->txPool;
+  if(count > UDS_CHANNEL_BATCH) count = UDS_CHANNEL_BATCH;
+  for(int i = 0; i < count; i++) {
+    const struct UDSMessage* message = &messages[i];
+    PASSTHRU_MSG* msg = &pool[i];
+    msg->ProtocolID = ISO15765;
+    msg->RxStatus = 0;
+    msg->TxFlags = ISO15765_FRAME_PAD;
+    msg->Timestamp = 0;
+    msg->ExtraDataIndex = 0;
+    // the first four data bytes are the CAN ID
+    msg->Data[0] = (unsigned char)(message->canId >> 24);
+    msg->Data[1] = (unsigned char)(message->canId >> 16);
+    msg->Data[2] = (unsigned char)(message->canId >> 8);
+    msg->Data[3] = (unsigned char)message->canId;
+    memcpy(msg->Data + 4, message->data, message->length);
+    msg->DataSize = 4 + message->length;
+  }
+
+  unsigned long taken = (unsigned long)count;
+  long rc = link->j2534->PassThruWriteMsgs(link->channel, pool, &taken, UDS_J2534_WRITE_TIMEOUT);
+  *sent = (int)taken;
+  // a full transmit queue takes part of the batch, the rest goes next time
+  if(rc && rc != ERR_TIMEOUT && rc != ERR_BUFFER_FULL) return UDS_CHANNEL_ERROR;
+  return taken > 0 ? UDS_CHANNEL_OK : UDS_CHANNEL_TIMEOUT;
+}
+
+// PassThruReadMsgs waits until it has all the messages asked for or the
+// timeout passes, so only a single message is ever waited for: what is
+// already queued is drained with a zero timeout around it
+static long drain(struct UDSJ2534* link, PASSTHRU_MSG* pool, int capacity, unsigned long timeoutMs, unsigned long* read)
+{
+  *read = (unsigned long)capacity;
+  long rc = link->j2534->PassThruReadMsgs(link->channel, pool, read, 0);
+  if((rc && rc != ERR_BUFFER_EMPTY && rc != ERR_TIMEOUT) || *read > 0 || timeoutMs == 0) return rc;
+
+  *read = 1;
+  rc = link->j2534->PassThruReadMsgs(link->channel, pool, read, timeoutMs);
+  if(*read == 0 || capacity == 1) return rc;
+  unsigned long more = (unsigned long)capacity - 1;
+  rc = link->j2534->PassThruReadMsgs(link->channel, pool + 1, &more, 0);
+  *read += more;
+  return rc;
+}
+
+static enum UDSChannelStatus j2534Receive(void* context, struct UDSMessage* messages, int capacity, int* count,
+                                          unsigned long timeoutMs)
+{
+  struct UDSJ2534* link = (struct UDSJ2534*)context;
+  PASSTHRU_MSG* pool = (PASSTHRU_MSG*)link->rxPool;
+  if(capacity > UDS_CHANNEL_BATCH) capacity = UDS_CHANNEL_BATCH;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  *count = 0;
+  for(;;) {
+    long left = (long)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    if(left < 0) return UDS_CHANNEL_TIMEOUT;
+    unsigned long read;
+    long rc = drain(link, pool, capacity, (unsigned long)left, &read);
+    if(rc && rc != ERR_BUFFER_EMPTY && rc != ERR_TIMEOUT) return UDS_CHANNEL_ERROR;
+
+    for(unsigned long i = 0; i < read; i++) {
+      const PASSTHRU_MSG* msg = &pool[i];
+      // echoes of what we sent carry no response, a first frame
+      // indication is passed on with no data so the session waits longer
+      bool first = (msg->RxStatus & START_OF_MESSAGE) != 0;
+      if((msg->RxStatus & TX_MSG_TYPE) || msg->DataSize < 4 || (!first && msg->DataSize == 4)) continue;
+      struct UDSMessage* message = &messages[(*count)++];
+      message->canId = ((uint32_t)msg->Data[0] << 24) | ((uint32_t)msg->Data[1] << 16) |
+                       ((uint32_t)msg->Data[2] << 8) | msg->Data[3];
+      message->length = first ? 0 : msg->DataSize - 4 < UDS_MAX_MESSAGE ? msg->DataSize - 4 : UDS_MAX_MESSAGE;
+      memcpy(message->data, msg->Data + 4, message->length);
+    }
+    if(*count) return UDS_CHANNEL_OK;
+    if(read == 0 && left == 0) return UDS_CHANNEL_TIMEOUT;
+  }
+}
+
+void uds_channel_j2534(struct UDSChannel* channel, struct UDSJ2534* j2534)
+{
+  // a sender and a reader run at the same time, each needs its own messages
+  if(!j2534->txPool) j2534->txPool = calloc(UDS_CHANNEL_BATCH, sizeof(PASSTHRU_MSG));
+  if(!j2534->rxPool) j2534->rxPool = calloc(UDS_CHANNEL_BATCH, sizeof(PASSTHRU_MSG));
+  assert(j2534->txPool && j2534->rxPool);
+  channel->context = j2534;
+  channel->send = j2534Send;
+  channel->receive = j2534Receive;
+}
+
+void uds_channel_j2534_close(struct UDSJ2534* j2534)
+{
+  if(j2534->txPool) free(j2534->txPool);
+  if(j2534->rxPool) free(j2534->rxPool);
+  j2534->txPool = NULL;
+  j2534->rxPool = NULL;
+}
@@ -0,0 +1,55 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "librx8.h"
+#include "uds_ecu.h"
+
+static bool rx8InitDiagSession(void* context, uint8_t session)
+{
+  return ((RX8*)context)->initDiagSession(session);
+}
+
+static int rx8GetSeed(void* context, uint8_t** seed)
+{
+  return ((RX8*)context)->getSeed(seed);
+}
+
+static int rx8CalculateKey(void* context, uint8_t* seed, uint8_t** key)
+{
+  return ((RX8*)context)->calculateKey(seed, key);
+}
+
+static bool rx8Unlock(void* context, uint8_t* key)
+{
+  return ((RX8*)context)->unlock(key);
+}
+
+static int rx8ReadMem(void* context, unsigned long address, uint16_t size, char* out)
+{
+  return ((RX8*)context)->readMem(address, size, out);
+}
+
+static int rx8GetVIN(void* context, char** vin)
+{
+  return ((RX8*)context)->getVIN(vin);
+}
+
+static int rx8GetCalibrationID(void* context, char** calID)
+{
+  return ((RX8*)context)->getCalibrationID(calID);
+}
+
+void uds_ecu_rx8(struct UDSEcu* ecu, RX8* rx8)
+{
+  ecu->context = rx8;
+  ecu->initDiagSession = rx8InitDiagSession;
+  ecu->getSeed = rx8GetSeed;
+  ecu->calculateKey = rx8CalculateKey;
+  ecu->unlock = rx8Unlock;
+  ecu->readMem = rx8ReadMem;
+  ecu->getVIN = rx8GetVIN;
+  ecu->getCalibrationID = rx8GetCalibrationID;
+  // RX8 only knows the read services
+  ecu->eraseBlock = NULL;
+  ecu->writeMem = NULL;
+}
@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uds_ecu_session.h"
+
+// sends [request] and waits, a positive answer is left in session->response
+static bool exchange(struct UDSSessionEcu* module, const uint8_t* request, uint32_t length)
+{
+  return uds_session_request(module->manager, module->session, request, length) == UDS_SESSION_POSITIVE;
+}
+
+static bool sessionInitDiagSession(void* context, uint8_t session)
+{
+  const uint8_t request[] = { 0x10, session };
+  return exchange((struct UDSSessionEcu*)context, request, sizeof(request));
+}
+
+static int sessionGetSeed(void* context, uint8_t** seed)
+{
+  struct UDSSessionEcu* module = (struct UDSSessionEcu*)context;
+  const uint8_t request[] = { 0x27, 0x01 };
+  if(!exchange(module, request, sizeof(request))) return 1;
+  const struct UDSMessage* response = &module->session->response;
+  if(response->length != 2 + UDS_ECU_SESSION_KEY) return 1;
+  *seed = (uint8_t*)malloc(UDS_ECU_SESSION_KEY);
+  assert(*seed);
+  memcpy(*seed, response->data + 2, UDS_ECU_SESSION_KEY);
+  return 0;
+}
+
+static int sessionCalculateKey(void* context, uint8_t* seed, uint8_t** key)
+{
+  struct UDSEcu* keys = ((struct UDSSessionEcu*)context)->keys;
+  return keys->calculateKey(keys->context, seed, key);
+}
+
+static bool sessionUnlock(void* context, uint8_t* key)
+{
+  uint8_t request[2 + UDS_ECU_SESSION_KEY] = { 0x27, 0x02 };
+  memcpy(request + 2, key, UDS_ECU_SESSION_KEY);
+  return exchange((struct UDSSessionEcu*)context, request, sizeof(request));
+}
+
+static int sessionReadMem(void* context, unsigned long address, uint16_t size, char* out)
+{
+  struct UDSSessionEcu* module = (struct UDSSessionEcu*)context;
+  const uint8_t request[] = {
+    0x23, 0x24,
+    (uint8_t)(address >> 24), (uint8_t)(address >> 16), (uint8_t)(address >> 8), (uint8_t)address,
+    (uint8_t)(size >> 8), (uint8_t)size,
+  };
+  if(!exchange(module, request, sizeof(request))) return 1;
+  const struct UDSMessage* response = &module->session->response;
+  if(response->length != 1u + size) return 1;
+  memcpy(out, response->data + 1, size);
+  return 0;
+}
+
+// ReadDataByIdentifier [id] as a string, malloc'd
+static int readString(struct UDSSessionEcu* module, uint16_t id, char** value)
+{
+  const uint8_t request[] = { 0x22, (uint8_t)(id >> 8), (uint8_t)id };
+  if(!exchange(module, request, sizeof(request))) return 1;
+  const struct UDSMessage* response = &module->session->response;
+  if(response->length < 3) return 1;
+  uint32_t length = response->length - 3;
+  *value = (char*)malloc(length + 1);
+  assert(*value);
+  memcpy(*value, response->data + 3, length);
+  (*value)[length] = 0;
+  return 0;
+}
+
+static int sessionGetVIN(void* context, char** vin)
+{
+  return readString((struct UDSSessionEcu*)context, 0xF190, vin);
+}
+
+static int sessionGetCalibrationID(void* context, char** calID)
+{
+  return readString((struct UDSSessionEcu*)context, 0xF188, calID);
+}
+
+void uds_ecu_session(struct UDSEcu* ecu, struct UDSSessionEcu* module)
+{
+  ecu->context = module;
+  ecu->initDiagSession = sessionInitDiagSession;
+  ecu->getSeed = sessionGetSeed;
+  ecu->calculateKey = sessionCalculateKey;
+  ecu->unlock = sessionUnlock;
+  ecu->readMem = sessionReadMem;
+  ecu->getVIN = sessionGetVIN;
+  ecu->getCalibrationID = sessionGetCalibrationID;
+  ecu->eraseBlock = NULL;
+  ecu->writeMem = NULL;
+}
@@ -1,146 +1,516 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <chrono>
+
 #include "uds_request_download.h"
+#include "download_cache.h"
 #include "console.h"
-#include "util.h"
+#include "idle.h"
+#include "profiler.h"
 
-#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-DWORD WINAPI MyThreadFunction(LPVOID lpParam);
-#else
-#endif
+// queues a line for the console, never blocks the worker
+static void requestLog(struct UDSRequestDownload* request, const char* fmt, ...)
+{
+    struct UDSRequestLog* log = &request->log;
+    uint32_t head = log->head.load(std::memory_order_relaxed);
+    if (head - log->tail.load(std::memory_order_acquire) >= UDS_REQUEST_LOG_SLOTS) {
+        log->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(log->lines[head % UDS_REQUEST_LOG_SLOTS], UDS_REQUEST_LOG_SIZE, fmt, args);
+    va_end(args);
+    log->head.store(head + 1, std::memory_order_release);
+    idle_post_event();
+}
 
-struct ThreadData {
-    RX8* ecu;
-    UDSRequestDownload* request;
-    uint8_t* seed;
-    uint8_t* key;
-    ConeScan::Console* console;
-} _thread_data;
+static void finish(struct UDSRequestDownload* request, enum UDSRequestState state)
+{
+    request->state.store(state, std::memory_order_release);
+    idle_post_event();
+}
 
-void uds_request_start_download(RX8* ecu, struct UDSRequestDownload* request, ConeScan::Console* console)
+// doubles the chunk size against [address] until the ECU refuses it,
+// read into scratch so resumed blocks in [payload] stay as they are
+static unsigned long probeChunkSize(struct UDSRequestDownload* request, unsigned long address)
 {
-    if (_thread_data.ecu && _thread_data.request) return;
-    if (request->transferChunkSize == 0) {
-        console->AddLog("[UDS] Invalid Transfer params: chunkSize must be > 0");
-        return;
+    char scratch[UDS_REQUEST_MAX_CHUNK];
+    unsigned long limit = request->endAddress - address;
+    unsigned long size = request->transferChunkSize;
+    if (size > UDS_REQUEST_MAX_CHUNK) size = UDS_REQUEST_MAX_CHUNK;
+    if (size > limit) size = limit;
+    // the start must work before anything bigger is tried
+    while (size > UDS_REQUEST_MIN_CHUNK && request->ecu->readMem(request->ecu->context, address, (uint16_t)size, scratch))
+        size /= 2;
+    while (size < UDS_REQUEST_MAX_CHUNK && size < limit) {
+        unsigned long next = size * 2 > UDS_REQUEST_MAX_CHUNK ? UDS_REQUEST_MAX_CHUNK : size * 2;
+        if (next > limit) next = limit;
+        if (request->ecu->readMem(request->ecu->context, address, (uint16_t)next, scratch)) break;
+        size = next;
     }
-    if (request->transferSize == 0) {
-        console->AddLog("[UDS] Invalid Transfer params: transferSize must be > 0");
-        return;
+    return size;
+}
+
+static bool isBlockDone(const struct UDSRequestDownload* request, uint32_t block)
+{
+    return request->blockDone[block].load(std::memory_order_acquire) != 0;
+}
+
+// end address of [block], the last one may be short
+static unsigned long blockEnd(const struct UDSRequestDownload* request, uint32_t block)
+{
+    unsigned long end = request->startAddress + (unsigned long)(block + 1) * DOWNLOAD_CACHE_BLOCK_SIZE;
+    return end > request->endAddress ? request->endAddress : end;
+}
+
+// the ECU may have been reflashed since the blocks were stored: the first
+// and last stored block are read again and compared before any are used.
+// False when the ECU couldn't be read, [matched] says whether they agree
+static bool verifyStored(struct UDSRequestDownload* request, unsigned long chunkSize, bool* matched)
+{
+    char check[DOWNLOAD_CACHE_BLOCK_SIZE];
+    uint32_t first = request->numBlocks, last = 0;
+    for (uint32_t block = 0; block < request->numBlocks; block++) {
+        if (!isBlockDone(request, block)) continue;
+        if (first == request->numBlocks) first = block;
+        last = block;
     }
-    memset(&_thread_data, 0, sizeof(struct ThreadData));
-    _thread_data.ecu = ecu;
-    _thread_data.request = request;
-    _thread_data.console = console;
-    _thread_data.request->downloadinProgress = 1;
-#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-	request->threadHandle = CreateThread(
-        NULL,                   // default security attributes
-        0,                      // use default stack size  
-        MyThreadFunction,       // thread function name
-        &_thread_data,           // argument to thread function 
-        0,                      // use default creation flags 
-        &request->threadID      // thread param
-    );
-#else
-#endif
+    *matched = true;
+    uint32_t verify[2] = { first, last };
+    for (int i = 0; i < 2 && first < request->numBlocks; i++) {
+        if (i == 1 && last == first) break;
+        unsigned long start = request->startAddress + (unsigned long)verify[i] * DOWNLOAD_CACHE_BLOCK_SIZE;
+        unsigned long end = blockEnd(request, verify[i]);
+        for (unsigned long address = start; address < end; ) {
+            unsigned long chunk = end - address < chunkSize ? end - address : chunkSize;
+            if (request->ecu->readMem(request->ecu->context, address, (uint16_t)chunk, check + (address - start)))
+                return false;
+            address += chunk;
+        }
+        if (memcmp(check, request->payload + (start - request->startAddress), end - start) != 0) {
+            *matched = false;
+            return true;
+        }
+    }
+    return true;
 }
-#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-DWORD WINAPI MyThreadFunction(LPVOID lpParam) {
-    struct ThreadData* thread_data = (struct ThreadData*)lpParam;
-#else
-int MyThreadFunction(void* param) {
-    struct ThreadData* thread_data = (struct ThreadData*) param;
-#endif
-    char* transferBuffer = NULL; // pointer to the real transfer buffer for pointer math, do not free
 
-    thread_data->console->AddLog("[UDS] Starting download");
-    if (!thread_data->ecu->initDiagSession(0x85)) {
-        thread_data->console->AddLog("[UDS] Download failed: could not get diag session");
+static void downloadWorker(struct UDSRequestDownload* request)
+{
+    uint8_t* seed = NULL;
+    uint8_t* key = NULL;
+    char* transferBuffer = request->payload; // pointer to the real transfer buffer for pointer math, do not free
+    enum UDSRequestState result = UDS_REQUEST_FAILED;
+    unsigned long maxChunk, chunkSize;
+    int fastChunks = 0, failures = 0;
+    uint32_t transferBytes, readBytes = 0;
+    uint32_t block = 0, runEnd = 0;     // stays 0 for a sparse read, no blocks are marked
+    std::chrono::steady_clock::time_point begin;
+
+    requestLog(request, "[UDS] Starting download");
+    if (!request->ecu->initDiagSession(request->ecu->context, 0x85)) {
+        requestLog(request, "[UDS] Download failed: could not get diag session");
         goto cleanup;
     }
-    thread_data->console->AddLog("[UDS] Diag Session 85 initialized");
+    requestLog(request, "[UDS] Diag Session 85 initialized");
 
-    if (thread_data->ecu->getSeed(&thread_data->seed)) {
-        thread_data->console->AddLog("[UDS] Download failed: could not get seed");
+    if (request->ecu->getSeed(request->ecu->context, &seed)) {
+        requestLog(request, "[UDS] Download failed: could not get seed");
         goto cleanup;
     }
-    thread_data->console->AddLog("[UDS] Got Key Seed: 0x%02X, 0x%02X, 0x%02X", thread_data->seed[0], thread_data->seed[1], thread_data->seed[2]);
+    requestLog(request, "[UDS] Got Key Seed: 0x%02X, 0x%02X, 0x%02X", seed[0], seed[1], seed[2]);
 
-    if (thread_data->ecu->calculateKey(thread_data->seed, &thread_data->key)) {
-        thread_data->console->AddLog("[UDS] Download failed: could not calculate key");
+    if (request->ecu->calculateKey(request->ecu->context, seed, &key)) {
+        requestLog(request, "[UDS] Download failed: could not calculate key");
         goto cleanup;
     }
-    thread_data->console->AddLog("[UDS] Calculated Key 0x%02X, 0x%02X, 0x%02X", thread_data->key[0], thread_data->key[1], thread_data->key[2]);
+    requestLog(request, "[UDS] Calculated Key 0x%02X, 0x%02X, 0x%02X", key[0], key[1], key[2]);
 
-    if (!thread_data->ecu->unlock(thread_data->key)) {
-        thread_data->console->AddLog("[UDS] Download failed: could not exchange key");
+    if (!request->ecu->unlock(request->ecu->context, key)) {
+        requestLog(request, "[UDS] Download failed: could not exchange key");
+        goto cleanup;
     }
-    // malloc this *after* exchange so it doesn't need to be freed
-    thread_data->request->payload = (char*)malloc(sizeof(char) * thread_data->request->transferSize);
-    assert(thread_data->request->payload);
-    memset(thread_data->request->payload, 0, (sizeof(char) * thread_data->request->transferSize));
 
-    thread_data->request->endAddress = thread_data->request->startAddress + thread_data->request->transferSize;
-    thread_data->request->address = thread_data->request->startAddress;
+    request->endAddress = request->startAddress + request->transferSize;
+    request->address = request->startAddress;
 
-    thread_data->console->AddLog("[UDS] Starting transfer\n TransferSize=0x%04X bytes\n ChunkSize=0x%04X bytes\n StartAddress=0x%04X\n EndAddress=0x%04X\n ", 
-        thread_data->request->transferSize,
-        thread_data->request->transferChunkSize,
-        thread_data->request->startAddress,
-        thread_data->request->endAddress);
+    requestLog(request, "[UDS] Starting transfer TransferSize=0x%04lX ChunkSize=0x%04X StartAddress=0x%04lX EndAddress=0x%04lX",
+        request->transferSize,
+        request->transferChunkSize,
+        request->startAddress,
+        request->endAddress);
 
-    transferBuffer = thread_data->request->payload;
+    maxChunk = probeChunkSize(request, request->numRanges ? request->ranges[0].start : request->startAddress);
+    chunkSize = maxChunk;
+    request->chunkSize.store((uint32_t)chunkSize, std::memory_order_relaxed);
+    requestLog(request, "[UDS] ECU accepts reads of 0x%04lX bytes", maxChunk);
 
-    for (thread_data->request->transferBytes = 0; 
-         thread_data->request->address < thread_data->request->endAddress; 
-         thread_data->request->address += thread_data->request->transferChunkSize, thread_data->request->transferBytes += thread_data->request->transferChunkSize, transferBuffer += thread_data->request->transferChunkSize) 
-    {
-        if (thread_data->request->downloadinProgress == false) break;
-        assert(thread_data->request->endAddress > thread_data->request->address);
-        if (thread_data->ecu->readMem(thread_data->request->address, thread_data->request->transferChunkSize, transferBuffer)) {
-            thread_data->console->AddLog("[UDS] Transfer failed!");
-            break;
+    if (request->resumedBlocks) {
+        bool matched;
+        if (!verifyStored(request, maxChunk, &matched)) {
+            requestLog(request, "[UDS] Download failed: could not read back a stored block");
+            goto cleanup;
+        }
+        if (!matched) {
+            // the UI drops the stored copy once it sees [cacheStale]
+            requestLog(request, "[UDS] Stored blocks don't match the ECU, downloading everything again");
+            for (uint32_t block = 0; block < request->numBlocks; block++)
+                request->blockDone[block].store(0, std::memory_order_relaxed);
+            request->transferBytes.store(0, std::memory_order_release);
+            request->cacheStale.store(true, std::memory_order_release);
         }
-        thread_data->request->transferProgress = (float)((float)thread_data->request->transferBytes / (float)thread_data->request->transferSize);
     }
-    hexdump(thread_data->request->payload, thread_data->request->transferChunkSize);
-    thread_data->request->downloadinProgress = false;
-    
-cleanup:
-    thread_data->console->AddLog("[UDS] Download complete");
-    if (thread_data->key) {
-        free(thread_data->key);
-        thread_data->key = NULL;
+    // resumed blocks go through the stream like any others once they are known to be good
+    if (download_stream_active(&request->stream)) {
+        for (uint32_t b = 0; b < request->numBlocks; b++) {
+            if (!isBlockDone(request, b)) continue;
+            unsigned long offset = (unsigned long)b * DOWNLOAD_CACHE_BLOCK_SIZE;
+            download_stream_push(&request->stream, offset, blockEnd(request, b) - request->startAddress - offset);
+        }
+    }
+
+    result = UDS_REQUEST_DONE;
+    begin = std::chrono::steady_clock::now();
+    transferBytes = request->transferBytes.load(std::memory_order_relaxed);
+    // a sparse read goes through its ranges, a full one through the runs
+    // of missing blocks, stored ones are skipped
+    for (int range = 0; result == UDS_REQUEST_DONE; )
+    {
+        unsigned long endAddress;
+        if (request->numRanges) {
+            if (range == request->numRanges) break;
+            request->address = request->ranges[range].start;
+            endAddress = request->ranges[range].end;
+            range++;
+        } else {
+            while (block < request->numBlocks && isBlockDone(request, block)) block++;
+            if (block == request->numBlocks) break;
+            runEnd = block;
+            while (runEnd < request->numBlocks && !isBlockDone(request, runEnd)) runEnd++;
+            request->address = request->startAddress + (unsigned long)block * DOWNLOAD_CACHE_BLOCK_SIZE;
+            endAddress = blockEnd(request, runEnd - 1);
+        }
+        transferBuffer = request->payload + (request->address - request->startAddress);
+
+        while (request->address < endAddress)
+        {
+            PROFILE_SCOPE("UDS readMem");
+            if (request->cancel.load(std::memory_order_relaxed)) {
+                requestLog(request, "[UDS] Transfer cancelled at 0x%04lX", request->address);
+                result = UDS_REQUEST_CANCELLED;
+                break;
+            }
+            // the last chunk of a run is cut short instead of reading bytes that aren't needed
+            unsigned long chunk = endAddress - request->address;
+            if (chunk > chunkSize) chunk = chunkSize;
+            auto sent = std::chrono::steady_clock::now();
+            bool failed = request->ecu->readMem(request->ecu->context, request->address, (uint16_t)chunk, transferBuffer) != 0;
+            auto received = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(received - sent).count();
+
+            if (failed) {
+                // the same address again at half the size
+                if (chunkSize <= UDS_REQUEST_MIN_CHUNK && ++failures >= UDS_REQUEST_MAX_RETRIES) {
+                    requestLog(request, "[UDS] Transfer failed at 0x%04lX", request->address);
+                    result = UDS_REQUEST_FAILED;
+                    break;
+                }
+                chunkSize = chunkSize / 2 < UDS_REQUEST_MIN_CHUNK ? UDS_REQUEST_MIN_CHUNK : chunkSize / 2;
+                fastChunks = 0;
+                request->retries.fetch_add(1, std::memory_order_relaxed);
+                if (request->stats) uds_stats_retry(request->stats);
+            } else {
+                failures = 0;
+                request->address += chunk;
+                transferBuffer += chunk;
+                transferBytes += (uint32_t)chunk;
+                readBytes += (uint32_t)chunk;
+                // publishes the chunk's bytes along with the count and any block it completed
+                for (; block < runEnd && blockEnd(request, block) <= request->address; block++)
+                    request->blockDone[block].store(1, std::memory_order_release);
+                if (download_stream_active(&request->stream))
+                    download_stream_push(&request->stream, request->address - chunk - request->startAddress, chunk);
+                request->transferBytes.store(transferBytes, std::memory_order_release);
+
+                if (seconds > UDS_REQUEST_LATENCY_BUDGET && chunkSize > UDS_REQUEST_MIN_CHUNK) {
+                    chunkSize /= 2;
+                    fastChunks = 0;
+                } else if (++fastChunks >= UDS_REQUEST_GROW_AFTER && chunkSize < maxChunk) {
+                    chunkSize = chunkSize * 2 > maxChunk ? maxChunk : chunkSize * 2;
+                    fastChunks = 0;
+                }
+                double elapsed = std::chrono::duration<double>(received - begin).count();
+                if (elapsed > 0.0) request->bytesPerSecond.store((uint32_t)(readBytes / elapsed), std::memory_order_relaxed);
+            }
+            request->chunkSize.store((uint32_t)chunkSize, std::memory_order_relaxed);
+            idle_post_event();
+        }
     }
-    if (thread_data->seed) {
-        free(thread_data->seed);
-        thread_data->seed = NULL;
+    if (result == UDS_REQUEST_DONE) {
+        requestLog(request, "[UDS] Download complete, %u bytes read at %u bytes/s, %u retries",
+                   readBytes, request->bytesPerSecond.load(std::memory_order_relaxed), request->retries.load(std::memory_order_relaxed));
     }
 
-    return 0;
+cleanup:
+    if (key) free(key);
+    if (seed) free(seed);
+    finish(request, result);
 }
 
-void uds_request_complete(struct UDSRequestDownload* request)
+// everything after validation that both kinds of download share
+static void beginDownload(struct UDSEcu* ecu, struct UDSRequestDownload* request, ConeScan::Console* console,
+                          struct ConeScanDB* db, const char* vin, const char* calID)
 {
-    request->downloadinProgress = false;
-#if defined(_WIN32) || defined(WIN32) || defined (_WIN64) || defined (WIN64)
-    if (request->threadHandle) {
-        WaitForMultipleObjects(1, &request->threadHandle, TRUE, INFINITE);
-        CloseHandle(request->threadHandle);
-        request->threadHandle = NULL;
-        request->threadID = NULL;
+    request->ecu = ecu;
+    request->payload = (char*)malloc(sizeof(char) * request->transferSize);
+    assert(request->payload);
+    // bytes a sparse read skips look like erased flash
+    memset(request->payload, request->numRanges ? 0xFF : 0, sizeof(char) * request->transferSize);
+    request->numBlocks = download_cache_blocks(request->transferSize);
+    request->blockDone = new std::atomic<uint8_t>[request->numBlocks];
+    request->blockSaved = (uint8_t*)calloc((request->numBlocks + 7) / 8, sizeof(uint8_t));
+    assert(request->blockSaved);
+    for (uint32_t block = 0; block < request->numBlocks; block++)
+        request->blockDone[block].store(0, std::memory_order_relaxed);
+
+    uint32_t resumedBlocks = 0, resumedBytes = 0;
+    request->db = db;
+    request->downloadId = 0;
+    if (db) {
+        request->downloadId = conescan_db_open_download(db, vin ? vin : "", calID ? calID : "",
+                                                        request->startAddress, request->transferSize,
+                                                        request->blockSaved, (unsigned char*)request->payload);
+        for (uint32_t block = 0; block < request->numBlocks; block++) {
+            if (!(request->blockSaved[block / 8] & (1 << (block % 8)))) continue;
+            request->blockDone[block].store(1, std::memory_order_relaxed);
+            unsigned long offset = (unsigned long)block * DOWNLOAD_CACHE_BLOCK_SIZE;
+            resumedBytes += (uint32_t)(request->transferSize - offset < DOWNLOAD_CACHE_BLOCK_SIZE ?
+                                       request->transferSize - offset : DOWNLOAD_CACHE_BLOCK_SIZE);
+            resumedBlocks++;
+        }
+        if (resumedBlocks)
+            console->AddLog("[UDS] Resuming download, %u of %u blocks already stored", resumedBlocks, request->numBlocks);
     }
+
+    // a sparse image is never whole, the worker streams resumed blocks once it has checked them
+    request->resumedBlocks = resumedBlocks;
+    request->cacheStale.store(false, std::memory_order_relaxed);
+    request->endAddress = request->startAddress + request->transferSize;
+    request->reported = false;
+    request->hashed = false;
+    request->spooled = false;
+    if (!request->numRanges)
+        download_stream_open(&request->stream, (const unsigned char*)request->payload, request->transferSize, request->spoolPath);
+
+    request->transferBytes.store(resumedBytes, std::memory_order_relaxed);
+    request->chunkSize.store(request->transferChunkSize, std::memory_order_relaxed);
+    request->bytesPerSecond.store(0, std::memory_order_relaxed);
+    request->retries.store(0, std::memory_order_relaxed);
+    request->cancel.store(false, std::memory_order_relaxed);
+    request->state.store(UDS_REQUEST_RUNNING, std::memory_order_release);
+
+#ifdef __EMSCRIPTEN__
+    downloadWorker(request);
 #else
+    request->worker = std::thread(downloadWorker, request);
 #endif
+}
+
+static bool validParams(struct UDSRequestDownload* request, ConeScan::Console* console)
+{
+    if (request->transferChunkSize == 0) {
+        console->AddLog("[UDS] Invalid Transfer params: chunkSize must be > 0");
+        return false;
+    }
+    if (request->transferSize == 0) {
+        console->AddLog("[UDS] Invalid Transfer params: transferSize must be > 0");
+        return false;
+    }
+    return true;
+}
+
+void uds_request_start_download(struct UDSEcu* ecu, struct UDSRequestDownload* request, ConeScan::Console* console,
+                                struct ConeScanDB* db, const char* vin, const char* calID)
+{
+    if (uds_request_busy(request)) return;
+    if (!validParams(request, console)) return;
+    // the last download's worker and payload go before a new one starts
+    uds_request_complete(request);
+    request->plannedBytes = request->transferSize;
+    beginDownload(ecu, request, console, db, vin, calID);
+}
+
+void uds_request_start_sparse_download(struct UDSEcu* ecu, struct UDSRequestDownload* request, ConeScan::Console* console,
+                                       const struct ReadPlan* plan)
+{
+    if (uds_request_busy(request)) return;
+    if (plan->numRanges == 0) {
+        console->AddLog("[UDS] Nothing to read: the definition has no tables inside the ROM");
+        return;
+    }
+    request->startAddress = 0;
+    request->transferSize = plan->romSize;
+    if (!validParams(request, console)) return;
+    uds_request_complete(request);
+
+    request->ranges = (struct ReadRange*)malloc(sizeof(struct ReadRange) * plan->numRanges);
+    assert(request->ranges);
+    memcpy(request->ranges, plan->ranges, sizeof(struct ReadRange) * plan->numRanges);
+    request->numRanges = plan->numRanges;
+    request->plannedBytes = plan->bytes;
+    console->AddLog("[UDS] Sparse read of %d ranges, %lu of %lu bytes", plan->numRanges, plan->bytes, plan->romSize);
+    // a few KB are read again rather than cached
+    beginDownload(ecu, request, console, NULL, NULL, NULL);
+}
+
+void uds_request_cancel(struct UDSRequestDownload* request)
+{
+    request->cancel.store(true, std::memory_order_relaxed);
+}
+
+// stores the blocks the worker finished since the last call, returns how many are stored in total
+static uint32_t saveBlocks(struct UDSRequestDownload* request)
+{
+    if (!request->db || !request->blockDone) return 0;
+    if (request->cacheStale.exchange(false, std::memory_order_acquire)) {
+        conescan_db_clear_download(request->db, request->downloadId, request->transferSize);
+        memset(request->blockSaved, 0, (request->numBlocks + 7) / 8);
+    }
+    uint32_t stored = 0;
+    uint32_t* blocks = NULL;
+    int count = 0;
+    for (uint32_t block = 0; block < request->numBlocks; block++) {
+        uint8_t bit = 1 << (block % 8);
+        if (request->blockSaved[block / 8] & bit) {
+            stored++;
+            continue;
+        }
+        if (!isBlockDone(request, block)) continue;
+        if (!blocks) {
+            blocks = (uint32_t*)malloc(sizeof(uint32_t) * request->numBlocks);
+            assert(blocks);
+        }
+        blocks[count++] = block;
+        request->blockSaved[block / 8] |= bit;
+        stored++;
+    }
+    if (count)
+        conescan_db_save_download_blocks(request->db, request->downloadId, request->transferSize, blocks, count,
+                                         (const unsigned char*)request->payload, request->blockSaved);
+    if (blocks) free(blocks);
+    return stored;
+}
+
+// a complete ROM is in [payload], the stored copy is no longer needed
+static void finishStored(struct UDSRequestDownload* request)
+{
+    if (request->db && uds_request_state(request) == UDS_REQUEST_DONE)
+        conescan_db_delete_download(request->db, request->downloadId);
+    request->db = NULL;
+}
+
+void uds_request_complete(struct UDSRequestDownload* request)
+{
+    uds_request_cancel(request);
+    if (request->worker.joinable()) request->worker.join();
+    // whatever arrived before a cancel is kept for the next attempt
+    if (request->db && uds_request_state(request) != UDS_REQUEST_DONE) saveBlocks(request);
+    finishStored(request);
+    if (download_stream_active(&request->stream))
+        download_stream_close(&request->stream, uds_request_state(request) == UDS_REQUEST_DONE, NULL, NULL);
     if (request->payload) {
         free(request->payload);
         request->payload = NULL;
     }
+    if (request->blockDone) {
+        delete[] request->blockDone;
+        request->blockDone = NULL;
+    }
+    if (request->blockSaved) {
+        free(request->blockSaved);
+        request->blockSaved = NULL;
+    }
+    if (request->ranges) {
+        free(request->ranges);
+        request->ranges = NULL;
+    }
+    request->numRanges = 0;
+    request->downloadId = 0;
+    request->numBlocks = 0;
+    request->ecu = NULL;
+    request->transferBytes.store(0, std::memory_order_relaxed);
+    request->state.store(UDS_REQUEST_IDLE, std::memory_order_release);
+}
+
+bool uds_request_poll(struct UDSRequestDownload* request, ConeScan::Console* console)
+{
+    struct UDSRequestLog* log = &request->log;
+    uint32_t tail = log->tail.load(std::memory_order_relaxed);
+    uint32_t head = log->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++)
+        console->AddLog("%s", log->lines[tail % UDS_REQUEST_LOG_SLOTS]);
+    log->tail.store(tail, std::memory_order_release);
+
+    uint32_t dropped = log->dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) console->AddLog("[UDS] %u log lines dropped", dropped);
+
+    if (uds_request_busy(request)) {
+        saveBlocks(request);
+        return false;
+    }
+    // a finished worker is joined here so the next start doesn't block on it
+    if (request->worker.joinable()) request->worker.join();
+    if (request->reported || uds_request_state(request) == UDS_REQUEST_IDLE) return false;
+    request->reported = true;
+
+    bool done = uds_request_state(request) == UDS_REQUEST_DONE;
+    if (request->db && !done) {
+        uint32_t stored = saveBlocks(request);
+        console->AddLog("[UDS] %u of %u blocks kept, Download ROM again to resume", stored, request->numBlocks);
+    }
+    finishStored(request);
 
-    _thread_data.ecu = NULL;
-    _thread_data.request = NULL;
-    _thread_data.console = NULL;   
-}
\ No newline at end of file
+    if (download_stream_active(&request->stream)) {
+        request->hashed = download_stream_close(&request->stream, done, &request->hash, &request->spooled);
+        if (request->spooled)
+            console->AddLog("[UDS] ROM written to %s while downloading", request->spoolPath);
+        else if (done && request->spoolPath)
+            console->AddLog("[UDS] IO error writing %s %s", request->spoolPath, strerror(errno));
+    }
+    return true;
+}
+
+bool uds_request_busy(const struct UDSRequestDownload* request)
+{
+    return request->state.load(std::memory_order_acquire) == UDS_REQUEST_RUNNING;
+}
+
+enum UDSRequestState uds_request_state(const struct UDSRequestDownload* request)
+{
+    return (enum UDSRequestState)request->state.load(std::memory_order_acquire);
+}
+
+float uds_request_progress(const struct UDSRequestDownload* request)
+{
+    if (request->plannedBytes == 0) return 0.0f;
+    return (float)request->transferBytes.load(std::memory_order_acquire) / (float)request->plannedBytes;
+}
+
+uint32_t uds_request_contiguous_bytes(const struct UDSRequestDownload* request)
+{
+    if (!request->blockDone) return 0;
+    // ranges finish in any order, a sparse image is shown once it is complete
+    if (request->numRanges)
+        return uds_request_state(request) == UDS_REQUEST_DONE ? (uint32_t)request->transferSize : 0;
+    uint32_t block = 0;
+    while (block < request->numBlocks && isBlockDone(request, block)) block++;
+    if (block == request->numBlocks) return (uint32_t)request->transferSize;
+    return block * DOWNLOAD_CACHE_BLOCK_SIZE;
+}
@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "uds_session.h"
+
+void uds_session_open(struct UDSSessionManager* manager, struct UDSChannel* channel, uint32_t firstId, int count)
+{
+  if(count > UDS_SESSION_MAX_MODULES) count = UDS_SESSION_MAX_MODULES;
+  manager->channel = channel;
+  manager->numSessions = count;
+  for(int i = 0; i < count; i++) {
+    struct UDSSession* session = &manager->sessions[i];
+    session->requestId = firstId + i;
+    session->responseId = firstId + i + UDS_SESSION_RESPONSE_OFFSET;
+    session->outstanding = false;
+    session->sent = false;
+    session->answered = false;
+    session->service = 0;
+    session->response.length = 0;
+    session->requests = 0;
+    session->negative = 0;
+    session->timeouts = 0;
+  }
+  manager->reading = false;
+  manager->failed = false;
+  manager->unexpected = 0;
+  manager->receiveCalls = 0;
+  manager->received = 0;
+  manager->queued = 0;
+  manager->sendCalls = 0;
+  manager->sent = 0;
+}
+
+struct UDSSession* uds_session_find(struct UDSSessionManager* manager, uint32_t requestId)
+{
+  for(int i = 0; i < manager->numSessions; i++)
+    if(manager->sessions[i].requestId == requestId) return &manager->sessions[i];
+  return NULL;
+}
+
+// files [message] under its session, called with the lock held
+static void dispatch(struct UDSSessionManager* manager, const struct UDSMessage* message)
+{
+  struct UDSSession* session = NULL;
+  for(int i = 0; i < manager->numSessions; i++)
+    if(manager->sessions[i].responseId == message->canId) session = &manager->sessions[i];
+
+  // the response has started, the rest of its frames take a while
+  if(message->length == 0) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(UDS_SESSION_MESSAGE_MS);
+    if(session && session->outstanding && session->sent && !session->answered && session->deadline < until)
+      session->deadline = until;
+    return;
+  }
+
+  // a late answer to a request that already timed out belongs to nobody,
+  // neither does one that arrives before the next request went out
+  const uint8_t* data = message->data;
+  bool positive = message->length >= 1 && data[0] == (uint8_t)(session ? session->service + 0x40 : 0);
+  bool negative = message->length >= 3 && data[0] == 0x7F && session && data[1] == session->service;
+  if(!session || !session->outstanding || !session->sent || session->answered || !(positive || negative)) {
+    manager->unexpected++;
+    return;
+  }
+  if(negative && data[2] == 0x78) {
+    session->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(UDS_SESSION_PENDING_MS);
+    return;
+  }
+  session->response.canId = message->canId;
+  session->response.length = message->length;
+  memcpy(session->response.data, message->data, message->length);
+  session->answered = true;
+}
+
+// called with [sendLock] held and the lock not, what the adapter didn't take stays queued
+static enum UDSChannelStatus flushQueued(struct UDSSessionManager* manager)
+{
+  if(manager->queued == 0) return UDS_CHANNEL_OK;
+  int sent = 0;
+  enum UDSChannelStatus status = manager->channel->send(manager->channel->context, manager->outbox, manager->queued, &sent);
+  manager->sendCalls++;
+  manager->sent += sent;
+  if(sent > 0) {
+    std::lock_guard<std::mutex> guard(manager->lock);
+    for(int i = 0; i < sent; i++) {
+      struct UDSSession* session = uds_session_find(manager, manager->outbox[i].canId);
+      if(session && session->outstanding) session->sent = true;
+    }
+  }
+  if(sent > 0 && sent < manager->queued)
+    memmove(manager->outbox, manager->outbox + sent, sizeof(manager->outbox[0]) * (manager->queued - sent));
+  manager->queued -= sent;
+  return status;
+}
+
+static void channelFailed(struct UDSSessionManager* manager)
+{
+  std::lock_guard<std::mutex> guard(manager->lock);
+  manager->failed = true;
+  manager->arrived.notify_all();
+}
+
+bool uds_session_flush(struct UDSSessionManager* manager)
+{
+  enum UDSChannelStatus status;
+  {
+    std::lock_guard<std::mutex> guard(manager->sendLock);
+    status = flushQueued(manager);
+  }
+  if(status == UDS_CHANNEL_ERROR) channelFailed(manager);
+  return status != UDS_CHANNEL_ERROR;
+}
+
+enum UDSSessionResult uds_session_send(struct UDSSessionManager* manager, struct UDSSession* session,
+                                       const uint8_t* request, uint32_t length)
+{
+  if(length == 0 || length > UDS_MAX_MESSAGE) return UDS_SESSION_ERROR;
+  {
+    std::lock_guard<std::mutex> guard(manager->lock);
+    if(manager->failed) return UDS_SESSION_ERROR;
+    if(session->outstanding) return UDS_SESSION_BUSY;
+    session->outstanding = true;
+    session->sent = false;
+    session->answered = false;
+    session->service = request[0];
+    session->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(UDS_SESSION_TIMEOUT_MS);
+    session->requests++;
+  }
+
+  enum UDSChannelStatus status = UDS_CHANNEL_OK;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> guard(manager->sendLock);
+    if(manager->queued == UDS_CHANNEL_BATCH) status = flushQueued(manager);
+    if(manager->queued < UDS_CHANNEL_BATCH) {
+      struct UDSMessage* message = &manager->outbox[manager->queued++];
+      message->canId = session->requestId;
+      message->length = length;
+      memcpy(message->data, request, length);
+      queued = true;
+    }
+  }
+  if(status == UDS_CHANNEL_ERROR) channelFailed(manager);
+  if(queued) return UDS_SESSION_POSITIVE;
+
+  std::lock_guard<std::mutex> guard(manager->lock);
+  session->outstanding = false;
+  return manager->failed ? UDS_SESSION_ERROR : UDS_SESSION_TIMEOUT;
+}
+
+enum UDSSessionResult uds_session_wait(struct UDSSessionManager* manager, struct UDSSession* session)
+{
+  uds_session_flush(manager);
+  std::unique_lock<std::mutex> guard(manager->lock);
+  if(!session->outstanding) return UDS_SESSION_ERROR;
+  while(!session->answered) {
+    auto now = std::chrono::steady_clock::now();
+    if(manager->failed || now >= session->deadline) {
+      session->outstanding = false;
+      if(manager->failed) return UDS_SESSION_ERROR;
+      session->timeouts++;
+      return UDS_SESSION_TIMEOUT;
+    }
+    auto poll = now + std::chrono::milliseconds(UDS_SESSION_POLL_MS);
+    auto until = session->deadline < poll ? session->deadline : poll;
+    if(manager->reading) {
+      manager->arrived.wait_until(guard, until);
+      continue;
+    }
+
+    // read for everyone until this session's deadline or the next poll,
+    // sending whatever was queued since first
+    manager->reading = true;
+    guard.unlock();
+    enum UDSChannelStatus sendStatus;
+    {
+      std::lock_guard<std::mutex> sendGuard(manager->sendLock);
+      sendStatus = flushQueued(manager);
+    }
+    // rounded up, a read for less than a millisecond would come straight back
+    long long micros = std::chrono::duration_cast<std::chrono::microseconds>(until - now).count();
+    unsigned long timeoutMs = (unsigned long)((micros + 999) / 1000);
+    int count = 0;
+    enum UDSChannelStatus status = manager->channel->receive(manager->channel->context, manager->incoming,
+                                                             UDS_CHANNEL_BATCH, &count, timeoutMs);
+    guard.lock();
+    manager->reading = false;
+    manager->receiveCalls++;
+    manager->received += count;
+    for(int i = 0; status == UDS_CHANNEL_OK && i < count; i++) dispatch(manager, &manager->incoming[i]);
+    if(status == UDS_CHANNEL_ERROR || sendStatus == UDS_CHANNEL_ERROR) manager->failed = true;
+    manager->arrived.notify_all();
+  }
+  session->outstanding = false;
+  if(session->response.data[0] != 0x7F) return UDS_SESSION_POSITIVE;
+  session->negative++;
+  return UDS_SESSION_NEGATIVE;
+}
+
+enum UDSSessionResult uds_session_request(struct UDSSessionManager* manager, struct UDSSession* session,
+                                          const uint8_t* request, uint32_t length)
+{
+  enum UDSSessionResult result = uds_session_send(manager, session, request, length);
+  if(result != UDS_SESSION_POSITIVE) return result;
+  return uds_session_wait(manager, session);
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "uds_stats.h"
+
+static const char* serviceNames[UDS_SERVICE_COUNT] = {
+  "DiagnosticSession",
+  "SecuritySeed",
+  "SecurityKey",
+  "ReadMemory",
+  "VIN",
+  "CalibrationID",
+  "EraseMemory",
+  "WriteMemory",
+};
+
+// bytes on the wire for each request and its positive response, past the data itself
+#define UDS_READ_REQUEST_BYTES 7   // SID, address and length format, 4 address bytes, 2 size bytes
+#define UDS_SHORT_MESSAGE      3
+#define UDS_ERASE_REQUEST_BYTES 13 // routine control, routine id, address and size format, 4 + 4 bytes
+
+static int bucketFor(uint64_t micros)
+{
+  if(micros < UDS_STATS_SUB_BUCKETS) return (int)micros;
+  int octave = 0;
+  for(uint64_t v = micros; v >= 2 * UDS_STATS_SUB_BUCKETS; v >>= 1) octave++;
+  int sub = (int)(micros >> octave) - UDS_STATS_SUB_BUCKETS;
+  int bucket = (octave + 1) * UDS_STATS_SUB_BUCKETS + sub;
+  return bucket < UDS_STATS_BUCKETS ? bucket : UDS_STATS_BUCKETS - 1;
+}
+
+// middle of the values that fall in [bucket]
+static uint32_t bucketMiddle(int bucket)
+{
+  if(bucket < UDS_STATS_SUB_BUCKETS) return (uint32_t)bucket;
+  int octave = bucket / UDS_STATS_SUB_BUCKETS - 1;
+  uint64_t sub = bucket % UDS_STATS_SUB_BUCKETS + UDS_STATS_SUB_BUCKETS;
+  uint64_t first = sub << octave;
+  uint64_t last = ((sub + 1) << octave) - 1;
+  uint64_t middle = (first + last) / 2;
+  return middle > UINT32_MAX ? UINT32_MAX : (uint32_t)middle;
+}
+
+void uds_stats_record(struct UDSStats* stats, enum UDSService service, uint64_t micros)
+{
+  struct UDSHistogram* histogram = &stats->services[service];
+  histogram->buckets[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+  histogram->count.fetch_add(1, std::memory_order_relaxed);
+  histogram->totalMicros.fetch_add(micros, std::memory_order_relaxed);
+  uint32_t value = micros > UINT32_MAX ? UINT32_MAX : (uint32_t)micros;
+  uint32_t max = histogram->maxMicros.load(std::memory_order_relaxed);
+  while(value > max && !histogram->maxMicros.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+  stats->requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+void uds_stats_retry(struct UDSStats* stats)
+{
+  stats->retries.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t uds_stats_percentile(const struct UDSHistogram* histogram, double fraction)
+{
+  uint32_t count = histogram->count.load(std::memory_order_relaxed);
+  if(count == 0) return 0;
+  uint64_t rank = (uint64_t)(fraction * count + 0.5);
+  if(rank < 1) rank = 1;
+  uint64_t seen = 0;
+  for(int i = 0; i < UDS_STATS_BUCKETS; i++) {
+    seen += histogram->buckets[i].load(std::memory_order_relaxed);
+    if(seen >= rank) {
+      // never past the slowest request actually seen
+      uint32_t middle = bucketMiddle(i);
+      uint32_t max = histogram->maxMicros.load(std::memory_order_relaxed);
+      return middle < max ? middle : max;
+    }
+  }
+  return histogram->maxMicros.load(std::memory_order_relaxed);
+}
+
+const char* uds_stats_service_name(enum UDSService service)
+{
+  return serviceNames[service];
+}
+
+uint32_t uds_isotp_frames(unsigned long bytes)
+{
+  // a single frame holds 7 bytes, otherwise a first frame of 6 and consecutive frames of 7
+  if(bytes <= 7) return 1;
+  return (uint32_t)(1 + (bytes - 6 + 6) / 7);
+}
+
+void uds_stats_reset(struct UDSStats* stats)
+{
+  for(int s = 0; s < UDS_SERVICE_COUNT; s++) {
+    struct UDSHistogram* histogram = &stats->services[s];
+    for(int i = 0; i < UDS_STATS_BUCKETS; i++) histogram->buckets[i].store(0, std::memory_order_relaxed);
+    histogram->count.store(0, std::memory_order_relaxed);
+    histogram->maxMicros.store(0, std::memory_order_relaxed);
+    histogram->totalMicros.store(0, std::memory_order_relaxed);
+  }
+  stats->requests.store(0, std::memory_order_relaxed);
+  stats->negative.store(0, std::memory_order_relaxed);
+  stats->timeouts.store(0, std::memory_order_relaxed);
+  stats->retries.store(0, std::memory_order_relaxed);
+  stats->bytesSent.store(0, std::memory_order_relaxed);
+  stats->bytesReceived.store(0, std::memory_order_relaxed);
+  stats->frames.store(0, std::memory_order_relaxed);
+}
+
+// accounts one exchange, [responseBytes] only count when it succeeded
+static void account(struct UDSStats* stats, enum UDSService service, std::chrono::steady_clock::time_point sent,
+                    bool ok, unsigned long requestBytes, unsigned long responseBytes)
+{
+  uint64_t micros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - sent).count();
+  uds_stats_record(stats, service, micros);
+  stats->bytesSent.fetch_add(requestBytes, std::memory_order_relaxed);
+  uint32_t frames = uds_isotp_frames(requestBytes);
+  if(ok) {
+    stats->bytesReceived.fetch_add(responseBytes, std::memory_order_relaxed);
+    frames += uds_isotp_frames(responseBytes);
+  } else if(micros >= (uint64_t)UDS_STATS_TIMEOUT_MS * 1000) {
+    stats->timeouts.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    stats->negative.fetch_add(1, std::memory_order_relaxed);
+    frames += 1;
+  }
+  stats->frames.fetch_add(frames, std::memory_order_relaxed);
+}
+
+static bool timedInitDiagSession(void* context, uint8_t session)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  bool ok = wrapper->inner->initDiagSession(wrapper->inner->context, session);
+  account(wrapper->stats, UDS_SERVICE_DIAG_SESSION, sent, ok, 2, 2);
+  return ok;
+}
+
+static int timedGetSeed(void* context, uint8_t** seed)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  int rc = wrapper->inner->getSeed(wrapper->inner->context, seed);
+  account(wrapper->stats, UDS_SERVICE_SEED, sent, rc == 0, 2, 5);
+  return rc;
+}
+
+// computed by the tester, nothing to time
+static int forwardCalculateKey(void* context, uint8_t* seed, uint8_t** key)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  return wrapper->inner->calculateKey(wrapper->inner->context, seed, key);
+}
+
+static bool timedUnlock(void* context, uint8_t* key)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  bool ok = wrapper->inner->unlock(wrapper->inner->context, key);
+  account(wrapper->stats, UDS_SERVICE_KEY, sent, ok, 5, 2);
+  return ok;
+}
+
+static int timedReadMem(void* context, unsigned long address, uint16_t size, char* out)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  int rc = wrapper->inner->readMem(wrapper->inner->context, address, size, out);
+  account(wrapper->stats, UDS_SERVICE_READ_MEM, sent, rc == 0, UDS_READ_REQUEST_BYTES, 1 + (unsigned long)size);
+  return rc;
+}
+
+static int timedGetVIN(void* context, char** vin)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  int rc = wrapper->inner->getVIN(wrapper->inner->context, vin);
+  account(wrapper->stats, UDS_SERVICE_VIN, sent, rc == 0, UDS_SHORT_MESSAGE, rc == 0 ? UDS_SHORT_MESSAGE + strlen(*vin) : 0);
+  return rc;
+}
+
+static int timedGetCalibrationID(void* context, char** calID)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  int rc = wrapper->inner->getCalibrationID(wrapper->inner->context, calID);
+  account(wrapper->stats, UDS_SERVICE_CAL_ID, sent, rc == 0, UDS_SHORT_MESSAGE, rc == 0 ? UDS_SHORT_MESSAGE + strlen(*calID) : 0);
+  return rc;
+}
+
+static int timedEraseBlock(void* context, unsigned long address, unsigned long size)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  int rc = wrapper->inner->eraseBlock(wrapper->inner->context, address, size);
+  account(wrapper->stats, UDS_SERVICE_ERASE, sent, rc == 0, UDS_ERASE_REQUEST_BYTES, 5);
+  return rc;
+}
+
+static int timedWriteMem(void* context, unsigned long address, uint16_t size, const char* data)
+{
+  struct UDSStatsEcu* wrapper = (struct UDSStatsEcu*)context;
+  auto sent = std::chrono::steady_clock::now();
+  int rc = wrapper->inner->writeMem(wrapper->inner->context, address, size, data);
+  account(wrapper->stats, UDS_SERVICE_WRITE_MEM, sent, rc == 0, UDS_READ_REQUEST_BYTES + (unsigned long)size, UDS_READ_REQUEST_BYTES);
+  return rc;
+}
+
+void uds_stats_wrap(struct UDSStatsEcu* wrapper, struct UDSEcu* inner, struct UDSStats* stats)
+{
+  wrapper->inner = inner;
+  wrapper->stats = stats;
+  wrapper->ecu.context = wrapper;
+  wrapper->ecu.initDiagSession = timedInitDiagSession;
+  wrapper->ecu.getSeed = timedGetSeed;
+  wrapper->ecu.calculateKey = forwardCalculateKey;
+  wrapper->ecu.unlock = timedUnlock;
+  wrapper->ecu.readMem = timedReadMem;
+  wrapper->ecu.getVIN = timedGetVIN;
+  wrapper->ecu.getCalibrationID = timedGetCalibrationID;
+  // an ECU that can't be programmed stays that way behind the wrapper
+  wrapper->ecu.eraseBlock = inner->eraseBlock ? timedEraseBlock : NULL;
+  wrapper->ecu.writeMem = inner->writeMem ? timedWriteMem : NULL;
+}
+
+int uds_stats_dump_csv(const struct UDSStats* stats, const char* path)
+{
+  FILE* fp = fopen(path, "w");
+  if(!fp) return -1;
+  fprintf(fp, "service,count,mean_us,p50_us,p90_us,p99_us,max_us\n");
+  for(int s = 0; s < UDS_SERVICE_COUNT; s++) {
+    const struct UDSHistogram* histogram = &stats->services[s];
+    uint32_t count = histogram->count.load(std::memory_order_relaxed);
+    uint64_t total = histogram->totalMicros.load(std::memory_order_relaxed);
+    fprintf(fp, "%s,%u,%llu,%u,%u,%u,%u\n", serviceNames[s], count,
+            (unsigned long long)(count ? total / count : 0),
+            uds_stats_percentile(histogram, 0.50), uds_stats_percentile(histogram, 0.90),
+            uds_stats_percentile(histogram, 0.99), histogram->maxMicros.load(std::memory_order_relaxed));
+  }
+  fprintf(fp, "\ncounter,value\n");
+  fprintf(fp, "requests,%u\n", stats->requests.load(std::memory_order_relaxed));
+  fprintf(fp, "negative_responses,%u\n", stats->negative.load(std::memory_order_relaxed));
+  fprintf(fp, "timeouts,%u\n", stats->timeouts.load(std::memory_order_relaxed));
+  fprintf(fp, "retries,%u\n", stats->retries.load(std::memory_order_relaxed));
+  fprintf(fp, "bytes_sent,%llu\n", (unsigned long long)stats->bytesSent.load(std::memory_order_relaxed));
+  fprintf(fp, "bytes_received,%llu\n", (unsigned long long)stats->bytesReceived.load(std::memory_order_relaxed));
+  fprintf(fp, "frames,%llu\n", (unsigned long long)stats->frames.load(std::memory_order_relaxed));
+  fclose(fp);
+  return 0;
+}
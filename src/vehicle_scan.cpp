@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "idle.h"
+#include "vehicle_scan.h"
+
+typedef void (*ScanParse)(struct ModuleScan* module, const struct UDSMessage* response);
+
+// printable bytes of a ReadDataByIdentifier response past its 3 byte header
+static void copyIdentifier(char* to, size_t size, const struct UDSMessage* response)
+{
+  size_t used = 0;
+  for(uint32_t i = 3; i < response->length && used + 1 < size; i++)
+    if(response->data[i] >= 0x20 && response->data[i] < 0x7F) to[used++] = (char)response->data[i];
+  to[used] = 0;
+}
+
+static void parseVIN(struct ModuleScan* module, const struct UDSMessage* response)
+{
+  copyIdentifier(module->vin, sizeof(module->vin), response);
+}
+
+static void parseCalID(struct ModuleScan* module, const struct UDSMessage* response)
+{
+  copyIdentifier(module->calID, sizeof(module->calID), response);
+}
+
+// 0x59 0x02 availability mask, then 3 DTC bytes and a status byte per DTC
+static void parseDTCs(struct ModuleScan* module, const struct UDSMessage* response)
+{
+  module->dtcsRead = true;
+  for(uint32_t i = 3; i + 4 <= response->length; i += 4) {
+    if(module->numDtcs < VEHICLE_SCAN_MAX_DTCS) {
+      const uint8_t* record = response->data + i;
+      module->dtcs[module->numDtcs] = ((uint32_t)record[0] << 16) | ((uint32_t)record[1] << 8) | record[2];
+      module->dtcStatus[module->numDtcs] = record[3];
+    }
+    module->numDtcs++;
+  }
+}
+
+// sends [request] to every present module, then collects the answers
+static void broadcast(struct VehicleScan* scan, const uint8_t* request, uint32_t length, ScanParse parse, bool probe)
+{
+  struct UDSSessionManager* manager = &scan->manager;
+  bool sent[UDS_SESSION_MAX_MODULES];
+  for(int i = 0; i < scan->numModules; i++) {
+    sent[i] = scan->modules[i].present &&
+              uds_session_send(manager, &manager->sessions[i], request, length) == UDS_SESSION_POSITIVE;
+  }
+  for(int i = 0; i < scan->numModules; i++) {
+    if(!sent[i]) continue;
+    enum UDSSessionResult result = uds_session_wait(manager, &manager->sessions[i]);
+    if(result == UDS_SESSION_POSITIVE) parse(&scan->modules[i], &manager->sessions[i].response);
+    else if(probe && result != UDS_SESSION_NEGATIVE) scan->modules[i].present = false;
+  }
+}
+
+static void scanModules(struct VehicleScan* scan)
+{
+  auto begin = std::chrono::steady_clock::now();
+  const uint8_t readVIN[] = { 0x22, 0xF1, 0x90 };
+  const uint8_t readCalID[] = { 0x22, 0xF1, 0x88 };
+  const uint8_t readDTCs[] = { 0x19, 0x02, VEHICLE_SCAN_DTC_MASK };
+  broadcast(scan, readVIN, sizeof(readVIN), parseVIN, true);
+  broadcast(scan, readCalID, sizeof(readCalID), parseCalID, false);
+  broadcast(scan, readDTCs, sizeof(readDTCs), parseDTCs, false);
+  scan->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  scan->state.store(VEHICLE_SCAN_READY, std::memory_order_release);
+  idle_post_event();
+}
+
+void vehicle_scan_start(struct VehicleScan* scan, struct UDSChannel* channel, uint32_t firstId, int count)
+{
+  vehicle_scan_close(scan);
+  uds_session_open(&scan->manager, channel, firstId, count);
+  scan->numModules = scan->manager.numSessions;
+  for(int i = 0; i < scan->numModules; i++) {
+    struct ModuleScan* module = &scan->modules[i];
+    memset(module, 0, sizeof(*module));
+    module->requestId = scan->manager.sessions[i].requestId;
+    module->present = true;
+  }
+  scan->state.store(VEHICLE_SCAN_RUNNING, std::memory_order_release);
+#ifdef __EMSCRIPTEN__
+  scanModules(scan);
+#else
+  scan->worker = std::thread(scanModules, scan);
+#endif
+}
+
+void vehicle_scan_wait(struct VehicleScan* scan)
+{
+  if(scan->worker.joinable()) scan->worker.join();
+}
+
+void vehicle_scan_close(struct VehicleScan* scan)
+{
+  vehicle_scan_wait(scan);
+  scan->numModules = 0;
+  scan->seconds = 0.0;
+  scan->state.store(VEHICLE_SCAN_NONE, std::memory_order_release);
+}
+
+bool vehicle_scan_busy(const struct VehicleScan* scan)
+{
+  return scan->state.load(std::memory_order_acquire) == VEHICLE_SCAN_RUNNING;
+}
+
+bool vehicle_scan_ready(const struct VehicleScan* scan)
+{
+  return scan->state.load(std::memory_order_acquire) == VEHICLE_SCAN_READY;
+}
+
+int vehicle_scan_present(const struct VehicleScan* scan)
+{
+  if(!vehicle_scan_ready(scan)) return 0;
+  int count = 0;
+  for(int i = 0; i < scan->numModules; i++)
+    if(scan->modules[i].present) count++;
+  return count;
+}
+
+void vehicle_scan_dtc_name(uint32_t dtc, char* buf, size_t size)
+{
+  // the top two bits pick the system, the rest is the SAE code and the failure type byte
+  const char systems[] = { 'P', 'C', 'B', 'U' };
+  snprintf(buf, size, "%c%04X-%02X", systems[(dtc >> 22) & 3], (unsigned)((dtc >> 8) & 0x3FFF), (unsigned)(dtc & 0xFF));
+}
@@ -0,0 +1,99 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page_pool.h"
+#include "rom_file.h"
+#include "workspace.h"
+
+void workspace_init(struct Workspace* workspace)
+{
+  memset(workspace, 0, sizeof(struct Workspace));
+  page_pool_init(&workspace->pool);
+}
+
+void workspace_free(struct Workspace* workspace)
+{
+  while(workspace->numRoms) workspace_remove(workspace, workspace->numRoms - 1);
+  if(workspace->roms) free(workspace->roms);
+  page_pool_free(&workspace->pool);
+  memset(workspace, 0, sizeof(struct Workspace));
+}
+
+int workspace_add(struct Workspace* workspace, const char* path, const unsigned char* data, long length)
+{
+  workspace->roms = (struct WorkspaceRom*)realloc(workspace->roms, sizeof(struct WorkspaceRom) * (workspace->numRoms + 1));
+  assert(workspace->roms);
+  struct WorkspaceRom* image = &workspace->roms[workspace->numRoms];
+
+  size_t pathLength = strlen(path);
+  image->path = (char*)malloc(pathLength + 1);
+  assert(image->path);
+  memcpy(image->path, path, pathLength + 1);
+  image->length = length;
+  image->numPages = (uint32_t)((length + ROM_FILE_PAGE_SIZE - 1) >> ROM_FILE_PAGE_SHIFT);
+  image->pages = (uint32_t*)malloc(sizeof(uint32_t) * (image->numPages ? image->numPages : 1));
+  assert(image->pages);
+  for(uint32_t page = 0; page < image->numPages; page++) {
+    unsigned long offset = (unsigned long)page << ROM_FILE_PAGE_SHIFT;
+    unsigned long size = (unsigned long)length - offset < ROM_FILE_PAGE_SIZE ? (unsigned long)length - offset : ROM_FILE_PAGE_SIZE;
+    image->pages[page] = page_pool_intern(&workspace->pool, data + offset, (uint32_t)size);
+  }
+  image->hash = rom_file_hash_buffer(data, length);
+  return workspace->numRoms++;
+}
+
+int workspace_add_file(struct Workspace* workspace, const char* path)
+{
+  struct RomFile file;
+  memset(&file, 0, sizeof(file));
+  if(!rom_file_open(&file, path)) return -1;
+  // pages are copied into the pool, the mapping is only needed while interning
+  int index = workspace_add(workspace, path, file.data, file.length);
+  rom_file_close(&file);
+  return index;
+}
+
+void workspace_remove(struct Workspace* workspace, int index)
+{
+  assert(index >= 0 && index < workspace->numRoms);
+  struct WorkspaceRom* image = &workspace->roms[index];
+  for(uint32_t page = 0; page < image->numPages; page++)
+    page_pool_release(&workspace->pool, image->pages[page]);
+  free(image->pages);
+  free(image->path);
+  memmove(image, image + 1, sizeof(struct WorkspaceRom) * (workspace->numRoms - index - 1));
+  workspace->numRoms--;
+}
+
+bool workspace_read(const struct Workspace* workspace, int index, unsigned long offset, void* out, size_t length)
+{
+  assert(index >= 0 && index < workspace->numRoms);
+  const struct WorkspaceRom* image = &workspace->roms[index];
+  if(offset + length > (unsigned long)image->length) return false;
+
+  unsigned char* dest = (unsigned char*)out;
+  while(length) {
+    uint32_t page = (uint32_t)(offset >> ROM_FILE_PAGE_SHIFT);
+    unsigned long within = offset & (ROM_FILE_PAGE_SIZE - 1);
+    size_t n = ROM_FILE_PAGE_SIZE - within < length ? ROM_FILE_PAGE_SIZE - within : length;
+    memcpy(dest, page_pool_data(&workspace->pool, image->pages[page]) + within, n);
+    dest += n;
+    offset += n;
+    length -= n;
+  }
+  return true;
+}
+
+size_t workspace_logical_bytes(const struct Workspace* workspace)
+{
+  size_t bytes = 0;
+  for(int i = 0; i < workspace->numRoms; i++) bytes += (size_t)workspace->roms[i].length;
+  return bytes;
+}
+
+size_t workspace_stored_bytes(const struct Workspace* workspace)
+{
+  return page_pool_bytes(&workspace->pool);
+}
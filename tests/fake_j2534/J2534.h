@@ -0,0 +1,81 @@
+#pragma once
+// Stands in for the J2534 wrapper in tests: a loopback adapter that
+// answers every message written to CAN ID x on x + 8 with the same data.
+//
+// Both calls hold on to the caller's messages for a while before and
+// after touching them and check nothing else changed them in between,
+// so a message array shared between a writer and a reader shows up as
+// corrupted messages.
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define ISO15765           0x06
+#define ISO15765_FRAME_PAD 0x40
+#define TX_MSG_TYPE        0x01
+#define START_OF_MESSAGE   0x02
+#define ERR_TIMEOUT        0x09
+#define ERR_BUFFER_EMPTY   0x10
+#define ERR_BUFFER_FULL    0x11
+
+typedef struct {
+  unsigned long ProtocolID;
+  unsigned long RxStatus;
+  unsigned long TxFlags;
+  unsigned long Timestamp;
+  unsigned long DataSize;
+  unsigned long ExtraDataIndex;
+  unsigned char Data[4128];
+} PASSTHRU_MSG;
+
+class J2534 {
+public:
+  std::atomic<unsigned> corruptedWrites{0};
+  std::atomic<unsigned> corruptedReads{0};
+
+  long PassThruWriteMsgs(unsigned long, PASSTHRU_MSG* pMsg, unsigned long* pNumMsgs, unsigned long)
+  {
+    std::vector<PASSTHRU_MSG> copy(pMsg, pMsg + *pNumMsgs);
+    dwell();
+    if(memcmp(copy.data(), pMsg, sizeof(PASSTHRU_MSG) * *pNumMsgs) != 0) corruptedWrites++;
+    std::lock_guard<std::mutex> guard(lock);
+    for(unsigned long i = 0; i < *pNumMsgs; i++) {
+      PASSTHRU_MSG answer = copy[i];
+      answer.Data[3] += 8;
+      queue.push_back(answer);
+    }
+    arrived.notify_all();
+    return 0;
+  }
+
+  long PassThruReadMsgs(unsigned long, PASSTHRU_MSG* pMsg, unsigned long* pNumMsgs, unsigned long Timeout)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    arrived.wait_for(guard, std::chrono::milliseconds(Timeout), [this] { return !queue.empty(); });
+    unsigned long count = 0;
+    while(count < *pNumMsgs && !queue.empty()) {
+      pMsg[count++] = queue.front();
+      queue.pop_front();
+    }
+    guard.unlock();
+    std::vector<PASSTHRU_MSG> copy(pMsg, pMsg + count);
+    dwell();
+    if(memcmp(copy.data(), pMsg, sizeof(PASSTHRU_MSG) * count) != 0) corruptedReads++;
+    *pNumMsgs = count;
+    return count ? 0 : ERR_BUFFER_EMPTY;
+  }
+
+private:
+  std::mutex                lock;
+  std::condition_variable   arrived;
+  std::deque<PASSTHRU_MSG>  queue;
+
+  static void dwell() { std::this_thread::sleep_for(std::chrono::microseconds(50)); }
+};